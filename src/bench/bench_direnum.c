@@ -0,0 +1,165 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include "../direnum.h"
+#include "../fm_entry.h"
+
+/**
+ * Benchmark of directory listing backends
+ *
+ * Compares the readdir() path that get_files_in_directory() used to take (one
+ * formatted path, GFile and store append per entry) with the getdents64 listing
+ * plus lazily resolved FmEntry items appended with a single splice.
+ *
+ * Usage: bench_direnum [--create COUNT] [--runs N] DIRECTORY
+ * --create fills DIRECTORY with COUNT empty files first if it has fewer entries.
+ */
+
+#define BENCH_DEFAULT_RUNS 5
+
+/**
+ * The listing code as it was before the getdents64 backend, kept for comparison
+ */
+static GListStore* list_with_readdir(const char *directory, size_t *file_count) {
+    DIR *dir = opendir(directory);
+    if (!dir) {
+        return NULL;
+    }
+
+    GListStore *files = g_list_store_new(G_TYPE_FILE);
+    size_t count = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+
+        char path[1024];
+        if (directory[strlen(directory) - 1] == '/') {
+            snprintf(path, sizeof(path), "%s%s", directory, entry->d_name);
+        } else {
+            snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name);
+        }
+
+        GFile *file = g_file_new_for_path(path);
+        g_list_store_append(files, file);
+        g_object_unref(file);
+        count++;
+    }
+    closedir(dir);
+
+    *file_count = count;
+    return files;
+}
+
+/**
+ * The current listing code
+ */
+static GListStore* list_with_getdents(const char *directory, size_t *file_count) {
+    dir_listing_t *listing = dir_listing_read(directory, FALSE, NULL);
+    if (!listing) {
+        return NULL;
+    }
+
+    GListStore *files = g_list_store_new(FM_TYPE_ENTRY);
+    fm_entry_append_listing(files, listing);
+    *file_count = dir_listing_get_count(listing);
+    dir_listing_unref(listing);
+    return files;
+}
+
+/**
+ * Creates empty files until the directory holds at least count entries
+ */
+static gboolean create_entries(const char *directory, guint count) {
+    if (g_mkdir_with_parents(directory, 0755) != 0) {
+        g_printerr("Could not create %s: %s\n", directory, g_strerror(errno));
+        return FALSE;
+    }
+
+    dir_listing_t *listing = dir_listing_read(directory, TRUE, NULL);
+    guint existing = listing ? dir_listing_get_count(listing) : 0;
+    g_clear_pointer(&listing, dir_listing_unref);
+
+    for (guint i = existing; i < count; i++) {
+        char *path = g_strdup_printf("%s/file-%08u", directory, i);
+        int fd = open(path, O_CREAT | O_WRONLY | O_CLOEXEC, 0644);
+        g_free(path);
+        if (fd < 0) {
+            g_printerr("Could not create entry %u: %s\n", i, g_strerror(errno));
+            return FALSE;
+        }
+        close(fd);
+    }
+    return TRUE;
+}
+
+/**
+ * Runs a backend several times and prints the best and median time
+ */
+static void run_backend(const char *name, GListStore* (*list)(const char*, size_t*), const char *directory, guint runs) {
+    gint64 *times = g_new(gint64, runs);
+    size_t count = 0;
+
+    for (guint i = 0; i < runs; i++) {
+        gint64 start = g_get_monotonic_time();
+        GListStore *files = list(directory, &count);
+        times[i] = g_get_monotonic_time() - start;
+        if (!files) {
+            g_printerr("%s: could not list %s\n", name, directory);
+            g_free(times);
+            return;
+        }
+        g_object_unref(files);
+    }
+
+    // Sort the few samples for the median
+    for (guint i = 1; i < runs; i++) {
+        for (guint j = i; j > 0 && times[j - 1] > times[j]; j--) {
+            gint64 swap = times[j];
+            times[j] = times[j - 1];
+            times[j - 1] = swap;
+        }
+    }
+
+    g_print("%-10s %10zu entries  best %9.2f ms  median %9.2f ms\n",
+            name, count, times[0] / 1000.0, times[runs / 2] / 1000.0);
+    g_free(times);
+}
+
+int main(int argc, char **argv) {
+    guint create = 0;
+    guint runs = BENCH_DEFAULT_RUNS;
+    const char *directory = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (g_strcmp0(argv[i], "--create") == 0 && i + 1 < argc) {
+            create = (guint)g_ascii_strtoull(argv[++i], NULL, 10);
+        } else if (g_strcmp0(argv[i], "--runs") == 0 && i + 1 < argc) {
+            runs = MAX(1, (guint)g_ascii_strtoull(argv[++i], NULL, 10));
+        } else {
+            directory = argv[i];
+        }
+    }
+
+    if (!directory) {
+        g_printerr("Usage: %s [--create COUNT] [--runs N] DIRECTORY\n", argv[0]);
+        return 1;
+    }
+    if (create > 0 && !create_entries(directory, create)) {
+        return 1;
+    }
+
+    run_backend("readdir", list_with_readdir, directory, runs);
+    run_backend("getdents", list_with_getdents, directory, runs);
+    return 0;
+}
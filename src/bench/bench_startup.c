@@ -0,0 +1,211 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include "fixture.h"
+
+/**
+ * Time to first paint benchmark
+ *
+ * Generates the flat fixture (fixture.h), then starts the file manager on it
+ * several times with --exit-after-first-paint and --profile-output. Every run
+ * gets fresh state, cache, data and config directories, so no previous session,
+ * size cache or history is read. The phase times written by each run are
+ * collected and the best and median of every phase are printed, along with the
+ * wall time from spawning the process to its exit.
+ *
+ * Usage: bench_startup [--entries COUNT] [--runs N] FILE_MANAGER
+ * The file manager needs a display, the run_bench_startup target provides a
+ * virtual one with xvfb-run when it is installed.
+ */
+
+#define BENCH_DEFAULT_ENTRIES 10000
+#define BENCH_DEFAULT_RUNS 5
+
+/**
+ * Times of one phase over every run
+ */
+typedef struct {
+    char *phase;
+    GArray *times; // double, milliseconds
+} phase_times_t;
+
+/**
+ * Finds the times of a phase, adding it if it was not seen yet
+ */
+static phase_times_t* get_phase(GPtrArray *phases, const char *phase) {
+    for (guint i = 0; i < phases->len; i++) {
+        phase_times_t *times = g_ptr_array_index(phases, i);
+        if (strcmp(times->phase, phase) == 0) {
+            return times;
+        }
+    }
+
+    phase_times_t *times = g_new0(phase_times_t, 1);
+    times->phase = g_strdup(phase);
+    times->times = g_array_new(FALSE, FALSE, sizeof(double));
+    g_ptr_array_add(phases, times);
+    return times;
+}
+
+static void phase_times_free(phase_times_t *times) {
+    g_free(times->phase);
+    g_array_unref(times->times);
+    g_free(times);
+}
+
+/**
+ * Reads the profile written by a run, one {"phase": ..., "time": ...} per line
+ */
+static gboolean read_profile(const char *path, GPtrArray *phases) {
+    char *contents = NULL;
+    GError *error = NULL;
+    if (!g_file_get_contents(path, &contents, NULL, &error)) {
+        g_printerr("Could not read the profile: %s\n", error->message);
+        g_error_free(error);
+        return FALSE;
+    }
+
+    char **lines = g_strsplit(contents, "\n", -1);
+    for (char **line = lines; *line; line++) {
+        char phase[128];
+        double time;
+        if (sscanf(*line, " {\"phase\": \"%127[^\"]\", \"time\": %lf}", phase, &time) == 2) {
+            g_array_append_val(get_phase(phases, phase)->times, time);
+        }
+    }
+    g_strfreev(lines);
+    g_free(contents);
+    return TRUE;
+}
+
+/**
+ * Starts the file manager once and waits for it to quit
+ * @return Wall time from spawn to exit in milliseconds, negative on failure
+ */
+static double run_once(const char *file_manager, const char *work, const char *directory, const char *profile) {
+    GSubprocessLauncher *launcher = g_subprocess_launcher_new(G_SUBPROCESS_FLAGS_NONE);
+    const char *homes[][2] = {
+        { "XDG_STATE_HOME", "state" },
+        { "XDG_CACHE_HOME", "cache" },
+        { "XDG_DATA_HOME", "data" },
+        { "XDG_CONFIG_HOME", "config" },
+    };
+    for (guint i = 0; i < G_N_ELEMENTS(homes); i++) {
+        char *path = g_build_filename(work, homes[i][1], NULL);
+        fixture_remove(path);
+        g_subprocess_launcher_setenv(launcher, homes[i][0], path, TRUE);
+        g_free(path);
+    }
+
+    char *directory_option = g_strconcat("--directory=", directory, NULL);
+    char *profile_option = g_strconcat("--profile-output=", profile, NULL);
+    GError *error = NULL;
+
+    gint64 start = g_get_monotonic_time();
+    GSubprocess *process = g_subprocess_launcher_spawn(launcher, &error, file_manager,
+                                                       directory_option, profile_option,
+                                                       "--exit-after-first-paint", NULL);
+    double elapsed = -1;
+    if (!process) {
+        g_printerr("Could not start %s: %s\n", file_manager, error->message);
+        g_error_free(error);
+    } else if (!g_subprocess_wait_check(process, NULL, &error)) {
+        g_printerr("%s failed: %s\n", file_manager, error->message);
+        g_error_free(error);
+    } else {
+        elapsed = (g_get_monotonic_time() - start) / 1000.0;
+    }
+
+    g_clear_object(&process);
+    g_free(directory_option);
+    g_free(profile_option);
+    g_object_unref(launcher);
+    return elapsed;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Prints the best and median of some samples
+ */
+static void print_times(const char *name, GArray *times) {
+    if (times->len == 0) {
+        return;
+    }
+    qsort(times->data, times->len, sizeof(double), compare_doubles);
+    g_print("%-24s best %9.2f ms  median %9.2f ms\n",
+            name, g_array_index(times, double, 0), g_array_index(times, double, times->len / 2));
+}
+
+int main(int argc, char **argv) {
+    guint entries = BENCH_DEFAULT_ENTRIES;
+    guint runs = BENCH_DEFAULT_RUNS;
+    const char *file_manager = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (g_strcmp0(argv[i], "--entries") == 0 && i + 1 < argc) {
+            entries = (guint)g_ascii_strtoull(argv[++i], NULL, 10);
+        } else if (g_strcmp0(argv[i], "--runs") == 0 && i + 1 < argc) {
+            runs = MAX(1, (guint)g_ascii_strtoull(argv[++i], NULL, 10));
+        } else {
+            file_manager = argv[i];
+        }
+    }
+    if (!file_manager) {
+        g_printerr("Usage: %s [--entries COUNT] [--runs N] FILE_MANAGER\n", argv[0]);
+        return 1;
+    }
+
+    GError *error = NULL;
+    char *work = fixture_make_work_dir(NULL, "fm-bench-startup", &error);
+    if (!work) {
+        g_printerr("Could not create a work directory: %s\n", error->message);
+        g_error_free(error);
+        return 1;
+    }
+
+    char *directory = g_build_filename(work, "listing", NULL);
+    char *profile = g_build_filename(work, "profile.json", NULL);
+    GPtrArray *phases = g_ptr_array_new_with_free_func((GDestroyNotify)phase_times_free);
+    GArray *wall_times = g_array_new(FALSE, FALSE, sizeof(double));
+    int status = 0;
+
+    fixture_stats_t fixture;
+    if (!fixture_create("flat", directory, entries, FIXTURE_DEFAULT_SEED, &fixture, &error)) {
+        g_printerr("Could not generate the fixture: %s\n", error->message);
+        g_error_free(error);
+        status = 1;
+    }
+    for (guint i = 0; status == 0 && i < runs; i++) {
+        g_unlink(profile);
+        double elapsed = run_once(file_manager, work, directory, profile);
+        if (elapsed < 0 || !read_profile(profile, phases)) {
+            status = 1;
+            break;
+        }
+        g_array_append_val(wall_times, elapsed);
+    }
+
+    if (status == 0) {
+        g_print("%u entries generated in %.2f ms, %u runs, times since main()\n", entries, fixture.time_ms, runs);
+        for (guint i = 0; i < phases->len; i++) {
+            phase_times_t *times = g_ptr_array_index(phases, i);
+            print_times(times->phase, times->times);
+        }
+        print_times("process (spawn to exit)", wall_times);
+    }
+
+    fixture_remove(work);
+    g_array_unref(wall_times);
+    g_ptr_array_unref(phases);
+    g_free(profile);
+    g_free(directory);
+    g_free(work);
+    return status;
+}
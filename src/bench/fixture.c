@@ -0,0 +1,445 @@
+#define _GNU_SOURCE
+#include "fixture.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/statfs.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
+
+#define TMPFS_MAGIC_NUMBER 0x01021994 // statfs() type of a tmpfs
+#define FIXTURE_MTIME_BASE G_GINT64_CONSTANT(1500000000) // Generated modification times start here (2017)
+#define FIXTURE_MTIME_SPAN (10 * 365 * 24 * 3600) // and spread over ten years
+
+/**
+ * State of one generation
+ */
+typedef struct {
+    int dir_fd; // The fixture's directory
+    guint count;
+    GRand *rand;
+    fixture_stats_t *stats;
+    char contents[FIXTURE_MAX_FILE_SIZE]; // Seeded bytes written to files
+} fixture_ctx_t;
+
+typedef gboolean (*fixture_func)(fixture_ctx_t *ctx, GError **error);
+
+static gboolean create_flat(fixture_ctx_t *ctx, GError **error);
+static gboolean create_deep(fixture_ctx_t *ctx, GError **error);
+static gboolean create_longnames(fixture_ctx_t *ctx, GError **error);
+static gboolean create_unicode(fixture_ctx_t *ctx, GError **error);
+static gboolean create_hardlinks(fixture_ctx_t *ctx, GError **error);
+static gboolean create_symlinks(fixture_ctx_t *ctx, GError **error);
+static gboolean create_sparse(fixture_ctx_t *ctx, GError **error);
+
+static const fixture_info_t fixtures[] = {
+    { "flat", "Files in one directory", 1000000 },
+    { "deep", "Nested directories", 50 },
+    { "longnames", "Files with names close to NAME_MAX", 1000 },
+    { "unicode", "Files with mixed Unicode names", 1000 },
+    { "hardlinks", "Hard links to a few files", 1000 },
+    { "symlinks", "Groups of symlink loops and dangling links", 100 },
+    { "sparse", "Large sparse files", 8 },
+};
+
+// Same order as fixtures
+static const fixture_func fixture_funcs[] = {
+    create_flat,
+    create_deep,
+    create_longnames,
+    create_unicode,
+    create_hardlinks,
+    create_symlinks,
+    create_sparse,
+};
+
+// Pieces the unicode fixture builds names from
+static const char *unicode_fragments[] = {
+    "caf\xc3\xa9", // café, precomposed (NFC)
+    "cafe\xcc\x81", // café, combining acute accent (NFD)
+    "\xc3\x85ngstr\xc3\xb6m", // Ångström
+    "stra\xc3\x9f" "e", // straße
+    "\xc4\xb0stanbul", // İstanbul, dotted capital I
+    "\xce\xa9\xce\xbc\xce\xad\xce\xb3\xce\xb1", // Ωμέγα
+    "\xd0\xb6\xd1\x83\xd1\x80\xd0\xbd\xd0\xb0\xd0\xbb", // журнал
+    "\xe4\xb8\xad\xe6\x96\x87", // 中文
+    "\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e", // 日本語
+    "\xed\x95\x9c\xea\xb5\xad\xec\x96\xb4", // 한국어
+    "\xd7\xa2\xd7\x91\xd7\xa8\xd7\x99\xd7\xaa", // עברית, right-to-left
+    "\xd8\xa7\xd9\x84\xd8\xb9\xd8\xb1\xd8\xa8\xd9\x8a\xd8\xa9", // العربية, right-to-left
+    "\xe0\xa4\xb9\xe0\xa4\xbf\xe0\xa4\xa8\xe0\xa5\x8d\xe0\xa4\xa6\xe0\xa5\x80", // हिन्दी
+    "\xf0\x9f\xa6\x80", // Crab emoji, outside the BMP
+    "\xf0\x9f\x91\xa9\xe2\x80\x8d\xf0\x9f\x91\xa9\xe2\x80\x8d\xf0\x9f\x91\xa7", // Family emoji joined with ZWJ
+    "a\xe2\x80\x8b" "b", // Zero width space
+    "\xef\xbc\xa6\xef\xbd\x95\xef\xbd\x8c\xef\xbd\x8c", // Fullwidth letters
+    " ", // Plain space
+};
+
+static void set_errno_error(GError **error, int saved_errno, const char *action, const char *name) {
+    g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(saved_errno), "Could not %s %s: %s",
+                action, name, g_strerror(saved_errno));
+}
+
+/**
+ * Creates a file with seeded content and modification time
+ * @param size Bytes of content, at most FIXTURE_MAX_FILE_SIZE
+ */
+static gboolean write_file(fixture_ctx_t *ctx, int dir_fd, const char *name, guint size, GError **error) {
+    int fd = openat(dir_fd, name, O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        set_errno_error(error, errno, "create", name);
+        return FALSE;
+    }
+
+    if (size > 0) {
+        guint offset = g_rand_int_range(ctx->rand, 0, FIXTURE_MAX_FILE_SIZE - size + 1);
+        if (write(fd, ctx->contents + offset, size) != (ssize_t)size) {
+            int saved_errno = errno;
+            close(fd);
+            set_errno_error(error, saved_errno, "write", name);
+            return FALSE;
+        }
+        ctx->stats->bytes += size;
+    }
+
+    struct timespec times[2] = { { 0, UTIME_OMIT } };
+    times[1].tv_sec = FIXTURE_MTIME_BASE + g_rand_int_range(ctx->rand, 0, FIXTURE_MTIME_SPAN);
+    futimens(fd, times);
+    close(fd);
+
+    ctx->stats->entries++;
+    return TRUE;
+}
+
+static gboolean make_dir(fixture_ctx_t *ctx, int dir_fd, const char *name, GError **error) {
+    if (mkdirat(dir_fd, name, 0755) != 0) {
+        set_errno_error(error, errno, "create", name);
+        return FALSE;
+    }
+    ctx->stats->entries++;
+    return TRUE;
+}
+
+static gboolean make_symlink(fixture_ctx_t *ctx, const char *target, const char *name, GError **error) {
+    if (symlinkat(target, ctx->dir_fd, name) != 0) {
+        set_errno_error(error, errno, "create", name);
+        return FALSE;
+    }
+    ctx->stats->entries++;
+    return TRUE;
+}
+
+static int open_dir(int dir_fd, const char *name, GError **error) {
+    int fd = openat(dir_fd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        set_errno_error(error, errno, "open", name);
+    }
+    return fd;
+}
+
+/**
+ * Fills a buffer with count seeded characters from a set
+ */
+static void fill_random(GRand *rand, char *buffer, guint count, const char *set) {
+    guint set_length = strlen(set);
+    for (guint i = 0; i < count; i++) {
+        buffer[i] = set[g_rand_int_range(rand, 0, set_length)];
+    }
+    buffer[count] = '\0';
+}
+
+static gboolean create_flat(fixture_ctx_t *ctx, GError **error) {
+    char name[32];
+    for (guint i = 0; i < ctx->count; i++) {
+        // Most files of a large directory are small, empty ones keep a big fixture cheap on tmpfs
+        guint size = 0;
+        if (g_rand_int_range(ctx->rand, 0, FIXTURE_FILLED_RATIO) == 0) {
+            size = g_rand_int_range(ctx->rand, 1, FIXTURE_MAX_FILE_SIZE + 1);
+        }
+
+        g_snprintf(name, sizeof(name), "file-%08u", i);
+        if (!write_file(ctx, ctx->dir_fd, name, size, error)) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static gboolean create_deep(fixture_ctx_t *ctx, GError **error) {
+    int dir_fd = dup(ctx->dir_fd);
+    char name[32];
+    gboolean success = TRUE;
+
+    for (guint level = 0; success && level < ctx->count; level++) {
+        for (guint i = 0; success && i < FIXTURE_DEEP_FILES; i++) {
+            g_snprintf(name, sizeof(name), "file-%u", i);
+            success = write_file(ctx, dir_fd, name, g_rand_int_range(ctx->rand, 0, FIXTURE_MAX_FILE_SIZE + 1), error);
+        }
+
+        g_snprintf(name, sizeof(name), "level-%02u", level);
+        if (success && make_dir(ctx, dir_fd, name, error)) {
+            int child_fd = open_dir(dir_fd, name, error);
+            close(dir_fd);
+            dir_fd = child_fd;
+            success = dir_fd >= 0;
+        } else {
+            success = FALSE;
+        }
+    }
+
+    if (dir_fd >= 0) {
+        close(dir_fd);
+    }
+    return success;
+}
+
+static gboolean create_longnames(fixture_ctx_t *ctx, GError **error) {
+    static const char set[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789-_. ";
+    char name[NAME_MAX + 1];
+
+    for (guint i = 0; i < ctx->count; i++) {
+        guint length = g_rand_int_range(ctx->rand, 200, NAME_MAX + 1);
+        int prefix = g_snprintf(name, sizeof(name), "%08u-", i);
+        fill_random(ctx->rand, name + prefix, length - prefix, set);
+        if (!write_file(ctx, ctx->dir_fd, name, 0, error)) {
+            return FALSE;
+        }
+    }
+
+    // Paths close to PATH_MAX, created relative to each directory since the full path gets too long to pass
+    int dir_fd = dup(ctx->dir_fd);
+    gboolean success = TRUE;
+    for (guint level = 0; success && level < FIXTURE_LONG_PATH_DEPTH; level++) {
+        int prefix = g_snprintf(name, sizeof(name), "deep-%02u-", level);
+        fill_random(ctx->rand, name + prefix, 250 - prefix, set);
+        success = make_dir(ctx, dir_fd, name, error);
+        if (success) {
+            int child_fd = open_dir(dir_fd, name, error);
+            close(dir_fd);
+            dir_fd = child_fd;
+            success = dir_fd >= 0;
+        }
+    }
+    if (success) {
+        success = write_file(ctx, dir_fd, "leaf", 0, error);
+    }
+    if (dir_fd >= 0) {
+        close(dir_fd);
+    }
+    return success;
+}
+
+static gboolean create_unicode(fixture_ctx_t *ctx, GError **error) {
+    GString *name = g_string_new(NULL);
+    gboolean success = TRUE;
+
+    for (guint i = 0; success && i < ctx->count; i++) {
+        g_string_truncate(name, 0);
+        guint fragments = g_rand_int_range(ctx->rand, 1, 5);
+        for (guint j = 0; j < fragments; j++) {
+            g_string_append(name, unicode_fragments[g_rand_int_range(ctx->rand, 0, G_N_ELEMENTS(unicode_fragments))]);
+        }
+        // Keeps names unique while every name still starts with the mixed text
+        g_string_append_printf(name, "-%u", i);
+        success = write_file(ctx, ctx->dir_fd, name->str, g_rand_int_range(ctx->rand, 0, 2) * 64, error);
+    }
+
+    g_string_free(name, TRUE);
+    return success;
+}
+
+static gboolean create_hardlinks(fixture_ctx_t *ctx, GError **error) {
+    char name[32];
+    char target[32];
+
+    for (guint i = 0; i < FIXTURE_HARDLINK_TARGETS; i++) {
+        g_snprintf(name, sizeof(name), "target-%02u", i);
+        if (!write_file(ctx, ctx->dir_fd, name, g_rand_int_range(ctx->rand, 1, FIXTURE_MAX_FILE_SIZE + 1), error)) {
+            return FALSE;
+        }
+    }
+
+    for (guint i = 0; i < ctx->count; i++) {
+        g_snprintf(target, sizeof(target), "target-%02u", g_rand_int_range(ctx->rand, 0, FIXTURE_HARDLINK_TARGETS));
+        g_snprintf(name, sizeof(name), "link-%06u", i);
+        if (linkat(ctx->dir_fd, target, ctx->dir_fd, name, 0) != 0) {
+            set_errno_error(error, errno, "link", name);
+            return FALSE;
+        }
+        ctx->stats->entries++;
+    }
+    return TRUE;
+}
+
+static gboolean create_symlinks(fixture_ctx_t *ctx, GError **error) {
+    char name[48];
+    char target[48];
+
+    for (guint i = 0; i < ctx->count; i++) {
+        // a -> b -> a
+        g_snprintf(name, sizeof(name), "loop-%04u-a", i);
+        g_snprintf(target, sizeof(target), "loop-%04u-b", i);
+        if (!make_symlink(ctx, target, name, error) || !make_symlink(ctx, name, target, error)) {
+            return FALSE;
+        }
+
+        g_snprintf(name, sizeof(name), "self-%04u", i);
+        if (!make_symlink(ctx, name, name, error)) {
+            return FALSE;
+        }
+
+        // A directory containing a link to its parent, recursive walks that follow links never end
+        g_snprintf(name, sizeof(name), "dir-%04u", i);
+        g_snprintf(target, sizeof(target), "dir-%04u/up", i);
+        if (!make_dir(ctx, ctx->dir_fd, name, error) || !make_symlink(ctx, "..", target, error)) {
+            return FALSE;
+        }
+
+        g_snprintf(name, sizeof(name), "dangling-%04u", i);
+        g_snprintf(target, sizeof(target), "missing-%04u", i);
+        if (!make_symlink(ctx, target, name, error)) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static gboolean create_sparse(fixture_ctx_t *ctx, GError **error) {
+    char name[32];
+    static char extent[FIXTURE_SPARSE_EXTENT_SIZE];
+
+    for (guint i = 0; i < ctx->count; i++) {
+        g_snprintf(name, sizeof(name), "sparse-%02u", i);
+        int fd = openat(ctx->dir_fd, name, O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            set_errno_error(error, errno, "create", name);
+            return FALSE;
+        }
+
+        gboolean success = ftruncate(fd, FIXTURE_SPARSE_SIZE) == 0;
+        guint64 extents = FIXTURE_SPARSE_SIZE / FIXTURE_SPARSE_EXTENT_SIZE;
+        for (guint j = 0; success && j < FIXTURE_SPARSE_EXTENTS; j++) {
+            memset(extent, g_rand_int_range(ctx->rand, 1, 256), sizeof(extent));
+            off_t offset = (off_t)(g_rand_double(ctx->rand) * extents) * FIXTURE_SPARSE_EXTENT_SIZE;
+            success = pwrite(fd, extent, sizeof(extent), offset) == sizeof(extent);
+            ctx->stats->bytes += success ? sizeof(extent) : 0;
+        }
+
+        int saved_errno = errno;
+        close(fd);
+        if (!success) {
+            set_errno_error(error, saved_errno, "write", name);
+            return FALSE;
+        }
+        ctx->stats->entries++;
+    }
+    return TRUE;
+}
+
+const fixture_info_t* fixture_get_all(guint *count) {
+    *count = G_N_ELEMENTS(fixtures);
+    return fixtures;
+}
+
+const fixture_info_t* fixture_lookup(const char *name) {
+    for (guint i = 0; i < G_N_ELEMENTS(fixtures); i++) {
+        if (g_strcmp0(fixtures[i].name, name) == 0) {
+            return &fixtures[i];
+        }
+    }
+    return NULL;
+}
+
+gboolean fixture_create(const char *name, const char *directory, guint count, guint32 seed,
+                        fixture_stats_t *stats, GError **error) {
+    const fixture_info_t *info = fixture_lookup(name);
+    if (!info) {
+        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "Unknown fixture %s", name);
+        return FALSE;
+    }
+
+    fixture_stats_t local_stats;
+    if (!stats) {
+        stats = &local_stats;
+    }
+    memset(stats, 0, sizeof(*stats));
+    gint64 start = g_get_monotonic_time();
+
+    if (g_mkdir_with_parents(directory, 0755) != 0) {
+        set_errno_error(error, errno, "create", directory);
+        return FALSE;
+    }
+
+    fixture_ctx_t *ctx = g_new(fixture_ctx_t, 1);
+    ctx->dir_fd = open_dir(AT_FDCWD, directory, error);
+    if (ctx->dir_fd < 0) {
+        g_free(ctx);
+        return FALSE;
+    }
+    ctx->count = count > 0 ? count : info->default_count;
+    // Each kind gets its own sequence, so a fixture does not depend on which others are generated
+    ctx->rand = g_rand_new_with_seed(seed ^ g_str_hash(name));
+    ctx->stats = stats;
+    for (guint i = 0; i < sizeof(ctx->contents); i++) {
+        ctx->contents[i] = (char)g_rand_int_range(ctx->rand, 0, 256);
+    }
+
+    gboolean success = fixture_funcs[info - fixtures](ctx, error);
+
+    close(ctx->dir_fd);
+    g_rand_free(ctx->rand);
+    g_free(ctx);
+
+    stats->time_ms = (g_get_monotonic_time() - start) / 1000.0;
+    return success;
+}
+
+const char* fixture_get_default_root(void) {
+    struct statfs fs;
+    if (statfs("/dev/shm", &fs) == 0 && fs.f_type == TMPFS_MAGIC_NUMBER && access("/dev/shm", W_OK) == 0) {
+        return "/dev/shm";
+    }
+    return g_get_tmp_dir();
+}
+
+char* fixture_make_work_dir(const char *root, const char *prefix, GError **error) {
+    char *template = g_strdup_printf("%s/%s-XXXXXX", root ? root : fixture_get_default_root(), prefix);
+    if (!g_mkdtemp(template)) {
+        set_errno_error(error, errno, "create", template);
+        g_free(template);
+        return NULL;
+    }
+    return template;
+}
+
+/**
+ * Removes an entry relative to a directory, recursing into directories
+ * Works on paths longer than PATH_MAX since every step is relative
+ */
+static void remove_at(int parent_fd, const char *name) {
+    if (unlinkat(parent_fd, name, 0) == 0 || (errno != EISDIR && errno != EPERM)) {
+        return;
+    }
+
+    int fd = openat(parent_fd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    DIR *dir = fd >= 0 ? fdopendir(fd) : NULL;
+    if (dir) {
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL) {
+            if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+                remove_at(dirfd(dir), entry->d_name);
+            }
+        }
+        closedir(dir);
+    } else if (fd >= 0) {
+        close(fd);
+    }
+    unlinkat(parent_fd, name, AT_REMOVEDIR);
+}
+
+void fixture_remove(const char *path) {
+    remove_at(AT_FDCWD, path);
+}
@@ -0,0 +1,105 @@
+#ifndef FIXTURE_H
+#define FIXTURE_H
+
+#include <glib.h>
+
+/**
+ * Synthetic file system fixtures for benchmarks and scaling tests
+ *
+ * Every fixture is generated from a seed: the same name, count and seed create
+ * the same names, links, sizes, contents and file modification times on every
+ * run and machine. Generation is timed separately so fixture cost can be told apart
+ * from the cost of what is measured on the fixture.
+ *
+ *     flat       count files in one directory (file-00000000, ...), mostly empty
+ *     deep       count nested directories (level-00/level-01/...), a few files each
+ *     longnames  count files with names of 200 to NAME_MAX bytes, and a chain of
+ *                directories with long names close to PATH_MAX
+ *     unicode    count files named from mixed scripts, combining characters,
+ *                NFC and NFD forms of the same text, right-to-left text and emoji
+ *     hardlinks  count hard links to a few files
+ *     symlinks   count groups of symlink loops, self links, links to a parent
+ *                directory and dangling links
+ *     sparse     count files of FIXTURE_SPARSE_SIZE with a few written extents
+ *
+ * Fixtures are best generated on a tmpfs (see fixture_get_default_root()) so
+ * their cost does not depend on a disk.
+ */
+
+#define FIXTURE_MAX_FILE_SIZE 4096 // Largest content written to a generated file
+#define FIXTURE_FILLED_RATIO 16 // 1 in this many flat files has content, the others are empty
+#define FIXTURE_DEEP_FILES 8 // Files in every directory of the deep fixture
+#define FIXTURE_LONG_PATH_DEPTH 15 // Directories of NAME_MAX-ish names chained by the longnames fixture
+#define FIXTURE_HARDLINK_TARGETS 10 // Files the hard links of the hardlinks fixture point to
+#define FIXTURE_SPARSE_SIZE (G_GUINT64_CONSTANT(4) << 30) // Apparent size of a sparse file
+#define FIXTURE_SPARSE_EXTENTS 4 // Written extents in every sparse file
+#define FIXTURE_SPARSE_EXTENT_SIZE (64 * 1024)
+#define FIXTURE_DEFAULT_SEED 1
+
+/**
+ * A kind of fixture
+ */
+typedef struct {
+    const char *name;
+    const char *description;
+    guint default_count; // Meaning depends on the fixture, see above
+} fixture_info_t;
+
+/**
+ * What generating a fixture did
+ */
+typedef struct {
+    guint64 entries; // Files, directories and links created
+    guint64 bytes; // Bytes written, not the apparent size of sparse files
+    double time_ms; // Wall time of the generation
+} fixture_stats_t;
+
+/**
+ * Gets every kind of fixture
+ * @param count Filled with the number of kinds
+ * @return Static array of the kinds
+ */
+const fixture_info_t* fixture_get_all(guint *count);
+
+/**
+ * Finds a kind of fixture by name
+ * @param name The name
+ * @return The kind, NULL if unknown
+ */
+const fixture_info_t* fixture_lookup(const char *name);
+
+/**
+ * Generates a fixture
+ * @param name Kind of fixture
+ * @param directory Created if needed, must not contain entries with the generated names
+ * @param count Size of the fixture, 0 for the default of the kind
+ * @param seed Seed of the generation
+ * @param stats Filled with what was generated, may be NULL
+ * @param error Set on failure
+ * @return FALSE on failure
+ */
+gboolean fixture_create(const char *name, const char *directory, guint count, guint32 seed,
+                        fixture_stats_t *stats, GError **error);
+
+/**
+ * Gets where fixtures are generated when no path is given
+ * @return /dev/shm when it is a writable tmpfs, the temporary directory otherwise
+ */
+const char* fixture_get_default_root(void);
+
+/**
+ * Creates a new directory for fixtures under a root
+ * @param root Parent directory, NULL for fixture_get_default_root()
+ * @param prefix Start of the name of the directory
+ * @param error Set on failure
+ * @return Path of the new directory, free with g_free()
+ */
+char* fixture_make_work_dir(const char *root, const char *prefix, GError **error);
+
+/**
+ * Removes a directory tree, without following symlinks
+ * @param path The directory
+ */
+void fixture_remove(const char *path);
+
+#endif //FIXTURE_H
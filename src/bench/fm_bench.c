@@ -0,0 +1,369 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include "../direnum.h"
+#include "../fm_entry.h"
+#include "../fmsort.h"
+#include "../history.h"
+#include "../statbatch.h"
+#include "../trace.h"
+#include "fixture.h"
+
+/**
+ * Benchmarks of the headless core (fmcore)
+ *
+ * Generates the flat fixture (fixture.h), then times the operations behind the
+ * views and the file actions on it, the same calls the application makes:
+ *
+ *     enumerate   dir_listing_read() and FmEntry items for every entry
+ *     stat        statbatch over the whole listing
+ *     sort_*      g_list_store_sort() with fm_sort_compare() by name, date, size,
+ *                 and by BENCH_MULTI_SORT (sort_multi)
+ *     psort_*     fm_sort_entries() (parallel merge sort) by the same orders
+ *     filter      fm_entry_filter_store()
+ *     copy        paste_uris() of --file-ops entries into another directory
+ *     undo        undo_last_operation() of that paste, until its job finished
+ *     delete      delete_file() of --file-ops entries to the trash, in one batch
+ *
+ * The work directory is created on a tmpfs when available, or under --path.
+ * State, data and cache directories point into it, so the journal and the trash
+ * of the user are never touched. Results are written as JSON, with the best and
+ * median of every benchmark in milliseconds and the fixture generation time.
+ *
+ * Usage: fm_bench [--entries COUNT] [--file-ops COUNT] [--runs N] [--seed N] [--path DIR] [--output FILE]
+ * FM_TRACE can be set as for the application to trace the runs.
+ */
+
+#define BENCH_DEFAULT_ENTRIES 10000
+#define BENCH_DEFAULT_FILE_OPS 1000
+#define BENCH_DEFAULT_RUNS 5
+#define BENCH_FILTER "7" // Matches about a third of the generated names
+#define BENCH_MULTI_SORT "folders,date-desc,name" // Order of the multi-key sort benchmarks
+
+/**
+ * Times of one benchmark over every run
+ */
+typedef struct {
+    const char *name;
+    GArray *times; // double, milliseconds
+} bench_result_t;
+
+static GMainLoop *loop = NULL;
+
+static double elapsed_ms(gint64 start) {
+    return (g_get_monotonic_time() - start) / 1000.0;
+}
+
+static void add_time(GPtrArray *results, const char *name, double time) {
+    for (guint i = 0; i < results->len; i++) {
+        bench_result_t *result = g_ptr_array_index(results, i);
+        if (strcmp(result->name, name) == 0) {
+            g_array_append_val(result->times, time);
+            return;
+        }
+    }
+
+    bench_result_t *result = g_new0(bench_result_t, 1);
+    result->name = name;
+    result->times = g_array_new(FALSE, FALSE, sizeof(double));
+    g_array_append_val(result->times, time);
+    g_ptr_array_add(results, result);
+}
+
+static void bench_result_free(bench_result_t *result) {
+    g_array_unref(result->times);
+    g_free(result);
+}
+
+static void on_stat_progress(dir_listing_t *listing, gboolean finished, gpointer user_data) {
+    if (finished) {
+        g_main_loop_quit(loop);
+    }
+}
+
+static void on_history_changed(void) {
+    g_main_loop_quit(loop);
+}
+
+/**
+ * Ignores the progress the file operations print
+ */
+static void discard_print(const gchar *string) {
+}
+
+/**
+ * Builds the URIs of the first count entries of a directory, as a paste would get them
+ */
+static char** get_entry_uris(const char *directory, guint count) {
+    char **uris = g_new0(char*, count + 1);
+    for (guint i = 0; i < count; i++) {
+        char *path = g_strdup_printf("%s/file-%08u", directory, i);
+        uris[i] = g_filename_to_uri(path, NULL, NULL);
+        g_free(path);
+    }
+    return uris;
+}
+
+/**
+ * Times sorting a copy of a store, the store itself keeps its order
+ */
+static double time_sort(GListStore *store, const char *spec) {
+    guint n_items = g_list_model_get_n_items(G_LIST_MODEL(store));
+    gpointer *items = g_new(gpointer, n_items);
+    for (guint i = 0; i < n_items; i++) {
+        items[i] = g_list_model_get_item(G_LIST_MODEL(store), i);
+    }
+    GListStore *copy = g_list_store_new(FM_TYPE_ENTRY);
+    g_list_store_splice(copy, 0, 0, items, n_items);
+    for (guint i = 0; i < n_items; i++) {
+        g_object_unref(items[i]);
+    }
+    g_free(items);
+
+    fm_sort_t sort;
+    fm_sort_parse(spec, TRUE, &sort);
+    gint64 start = g_get_monotonic_time();
+    g_list_store_sort(copy, fm_sort_compare, &sort);
+    double time = elapsed_ms(start);
+
+    g_object_unref(copy);
+    return time;
+}
+
+/**
+ * Times the parallel merge sort of the entries of a store
+ */
+static double time_parallel_sort(GListStore *store, const char *spec) {
+    guint n_items = g_list_model_get_n_items(G_LIST_MODEL(store));
+    GPtrArray *entries = g_ptr_array_new_full(n_items, g_object_unref);
+    for (guint i = 0; i < n_items; i++) {
+        g_ptr_array_add(entries, g_list_model_get_item(G_LIST_MODEL(store), i));
+    }
+
+    fm_sort_t sort;
+    fm_sort_parse(spec, TRUE, &sort);
+    gint64 start = g_get_monotonic_time();
+    fm_sort_entries(entries, &sort, NULL);
+    double time = elapsed_ms(start);
+
+    g_ptr_array_unref(entries);
+    return time;
+}
+
+/**
+ * Times copying files, undoing the copy and deleting copies
+ */
+static gboolean run_file_ops(GPtrArray *results, char **uris, const char *destination, guint file_ops) {
+    g_mkdir_with_parents(destination, 0755);
+
+    gint64 start = g_get_monotonic_time();
+    guint copied = paste_uris(uris, destination);
+    add_time(results, "copy", elapsed_ms(start));
+    if (copied != file_ops) {
+        g_printerr("Copied %u of %u files\n", copied, file_ops);
+        return FALSE;
+    }
+
+    start = g_get_monotonic_time();
+    if (!undo_last_operation()) {
+        g_printerr("Could not undo the copy\n");
+        return FALSE;
+    }
+    g_main_loop_run(loop);
+    add_time(results, "undo", elapsed_ms(start));
+
+    // Copies to delete, not timed
+    if (paste_uris(uris, destination) != file_ops) {
+        g_printerr("Could not copy the files to delete\n");
+        return FALSE;
+    }
+
+    start = g_get_monotonic_time();
+    gboolean success = TRUE;
+    begin_operation_batch();
+    for (guint i = 0; success && i < file_ops; i++) {
+        char *path = g_strdup_printf("%s/file-%08u", destination, i);
+        success = delete_file(path);
+        g_free(path);
+    }
+    end_operation_batch();
+    if (!success) {
+        g_printerr("Could not delete the copies\n");
+        return FALSE;
+    }
+    add_time(results, "delete", elapsed_ms(start));
+    return TRUE;
+}
+
+/**
+ * Runs every benchmark once
+ */
+static gboolean run_once(GPtrArray *results, const char *work, const char *source, guint file_ops) {
+    GError *error = NULL;
+
+    gint64 start = g_get_monotonic_time();
+    dir_listing_t *listing = dir_listing_read(source, FALSE, &error);
+    if (!listing) {
+        g_printerr("Could not list %s: %s\n", source, error->message);
+        g_error_free(error);
+        return FALSE;
+    }
+    GListStore *store = g_list_store_new(FM_TYPE_ENTRY);
+    fm_entry_append_listing(store, listing);
+    add_time(results, "enumerate", elapsed_ms(start));
+
+    start = g_get_monotonic_time();
+    statbatch_t *batch = statbatch_start(listing, on_stat_progress, NULL);
+    g_main_loop_run(loop);
+    add_time(results, "stat", elapsed_ms(start));
+    statbatch_unref(batch);
+
+    add_time(results, "sort_name", time_sort(store, "name"));
+    add_time(results, "sort_date", time_sort(store, "date"));
+    add_time(results, "sort_size", time_sort(store, "size"));
+    add_time(results, "sort_multi", time_sort(store, BENCH_MULTI_SORT));
+    add_time(results, "psort_name", time_parallel_sort(store, "name"));
+    add_time(results, "psort_date", time_parallel_sort(store, "date"));
+    add_time(results, "psort_size", time_parallel_sort(store, "size"));
+    add_time(results, "psort_multi", time_parallel_sort(store, BENCH_MULTI_SORT));
+
+    start = g_get_monotonic_time();
+    GListStore *filtered = fm_entry_filter_store(G_LIST_MODEL(store), BENCH_FILTER);
+    add_time(results, "filter", elapsed_ms(start));
+    g_object_unref(filtered);
+    g_object_unref(store);
+    dir_listing_unref(listing);
+
+    char *destination = g_build_filename(work, "copies", NULL);
+    char **uris = get_entry_uris(source, file_ops);
+    gboolean success = run_file_ops(results, uris, destination, file_ops);
+
+    fixture_remove(destination);
+    char *trash = g_build_filename(g_get_user_data_dir(), "Trash", NULL);
+    fixture_remove(trash);
+    g_free(trash);
+    g_strfreev(uris);
+    g_free(destination);
+    return success;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Writes the best and median of every benchmark as JSON
+ */
+static void write_results(FILE *out, GPtrArray *results, guint entries, guint file_ops, guint runs,
+                          guint32 seed, const fixture_stats_t *fixture) {
+    fprintf(out, "{\"fm_bench\": 1, \"entries\": %u, \"file_ops\": %u, \"runs\": %u, \"seed\": %u, "
+            "\"fixture_ms\": %.3f, \"results\": [\n", entries, file_ops, runs, seed, fixture->time_ms);
+    for (guint i = 0; i < results->len; i++) {
+        bench_result_t *result = g_ptr_array_index(results, i);
+        GArray *times = result->times;
+        qsort(times->data, times->len, sizeof(double), compare_doubles);
+        fprintf(out, "  {\"name\": \"%s\", \"best_ms\": %.3f, \"median_ms\": %.3f}%s\n",
+                result->name, g_array_index(times, double, 0), g_array_index(times, double, times->len / 2),
+                i + 1 < results->len ? "," : "");
+    }
+    fprintf(out, "]}\n");
+}
+
+int main(int argc, char **argv) {
+    guint entries = BENCH_DEFAULT_ENTRIES;
+    guint file_ops = BENCH_DEFAULT_FILE_OPS;
+    guint runs = BENCH_DEFAULT_RUNS;
+    guint32 seed = FIXTURE_DEFAULT_SEED;
+    const char *root = NULL;
+    const char *output = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (g_strcmp0(argv[i], "--entries") == 0 && i + 1 < argc) {
+            entries = MAX(1, (guint)g_ascii_strtoull(argv[++i], NULL, 10));
+        } else if (g_strcmp0(argv[i], "--file-ops") == 0 && i + 1 < argc) {
+            file_ops = MAX(1, (guint)g_ascii_strtoull(argv[++i], NULL, 10));
+        } else if (g_strcmp0(argv[i], "--runs") == 0 && i + 1 < argc) {
+            runs = MAX(1, (guint)g_ascii_strtoull(argv[++i], NULL, 10));
+        } else if (g_strcmp0(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = (guint32)g_ascii_strtoull(argv[++i], NULL, 10);
+        } else if (g_strcmp0(argv[i], "--path") == 0 && i + 1 < argc) {
+            root = argv[++i];
+        } else if (g_strcmp0(argv[i], "--output") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else {
+            g_printerr("Usage: %s [--entries COUNT] [--file-ops COUNT] [--runs N] [--seed N] [--path DIR] [--output FILE]\n",
+                       argv[0]);
+            return 1;
+        }
+    }
+    file_ops = MIN(file_ops, entries);
+
+    GError *error = NULL;
+    char *work = fixture_make_work_dir(root, "fm-bench", &error);
+    if (!work) {
+        g_printerr("Could not create a work directory: %s\n", error->message);
+        g_error_free(error);
+        return 1;
+    }
+
+    // Before anything reads them, GLib caches the user directories
+    const char *homes[][2] = {
+        { "XDG_STATE_HOME", "state" },
+        { "XDG_CACHE_HOME", "cache" },
+        { "XDG_DATA_HOME", "data" },
+    };
+    for (guint i = 0; i < G_N_ELEMENTS(homes); i++) {
+        char *path = g_build_filename(work, homes[i][1], NULL);
+        g_mkdir_with_parents(path, 0700);
+        g_setenv(homes[i][0], path, TRUE);
+        g_free(path);
+    }
+
+    trace_init();
+    g_set_print_handler(discard_print);
+    loop = g_main_loop_new(NULL, FALSE);
+    init_operation_history();
+    set_history_changed_func(on_history_changed);
+
+    char *source = g_build_filename(work, "listing", NULL);
+    GPtrArray *results = g_ptr_array_new_with_free_func((GDestroyNotify)bench_result_free);
+    fixture_stats_t fixture;
+    int status = 0;
+    if (!fixture_create("flat", source, entries, seed, &fixture, &error)) {
+        g_printerr("Could not generate the fixture: %s\n", error->message);
+        g_error_free(error);
+        status = 1;
+    }
+
+    for (guint i = 0; status == 0 && i < runs; i++) {
+        if (!run_once(results, work, source, file_ops)) {
+            status = 1;
+        }
+    }
+
+    if (status == 0) {
+        FILE *out = output ? fopen(output, "w") : stdout;
+        if (!out) {
+            g_printerr("Could not write %s: %s\n", output, g_strerror(errno));
+            status = 1;
+        } else {
+            write_results(out, results, entries, file_ops, runs, seed, &fixture);
+            if (out != stdout) {
+                fclose(out);
+            }
+        }
+    }
+
+    cleanup_operation_history();
+    trace_shutdown();
+    fixture_remove(work);
+    g_ptr_array_unref(results);
+    g_main_loop_unref(loop);
+    g_free(source);
+    g_free(work);
+    return status;
+}
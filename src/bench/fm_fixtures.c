@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fixture.h"
+
+/**
+ * Generates synthetic file system fixtures (see fixture.h)
+ *
+ * Usage: fm_fixtures [--seed N] [--count N] [--path DIR] [--keep] [FIXTURE...]
+ *        fm_fixtures --list
+ *
+ * Every fixture is created in its own directory named after it. Without --path
+ * they go to a new directory on a tmpfs when one is available, which is removed
+ * again unless --keep is given, so the tool can also just time the generation.
+ * With --path the fixtures are created under DIR and kept. Without any FIXTURE
+ * every kind is generated. --count overrides the default size of every kind.
+ */
+
+static void print_usage(const char *program) {
+    g_printerr("Usage: %s [--seed N] [--count N] [--path DIR] [--keep] [FIXTURE...]\n"
+               "       %s --list\n", program, program);
+}
+
+static void print_fixtures(void) {
+    guint count;
+    const fixture_info_t *fixtures = fixture_get_all(&count);
+    for (guint i = 0; i < count; i++) {
+        g_print("%-10s %-44s default count %u\n", fixtures[i].name, fixtures[i].description, fixtures[i].default_count);
+    }
+}
+
+int main(int argc, char **argv) {
+    guint32 seed = FIXTURE_DEFAULT_SEED;
+    guint count = 0;
+    const char *path = NULL;
+    gboolean keep = FALSE;
+    GPtrArray *names = g_ptr_array_new();
+
+    for (int i = 1; i < argc; i++) {
+        if (g_strcmp0(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = (guint32)g_ascii_strtoull(argv[++i], NULL, 10);
+        } else if (g_strcmp0(argv[i], "--count") == 0 && i + 1 < argc) {
+            count = (guint)g_ascii_strtoull(argv[++i], NULL, 10);
+        } else if (g_strcmp0(argv[i], "--path") == 0 && i + 1 < argc) {
+            path = argv[++i];
+        } else if (g_strcmp0(argv[i], "--keep") == 0) {
+            keep = TRUE;
+        } else if (g_strcmp0(argv[i], "--list") == 0) {
+            print_fixtures();
+            g_ptr_array_unref(names);
+            return 0;
+        } else if (fixture_lookup(argv[i])) {
+            g_ptr_array_add(names, argv[i]);
+        } else {
+            print_usage(argv[0]);
+            g_ptr_array_unref(names);
+            return 1;
+        }
+    }
+
+    if (names->len == 0) {
+        guint n_fixtures;
+        const fixture_info_t *fixtures = fixture_get_all(&n_fixtures);
+        for (guint i = 0; i < n_fixtures; i++) {
+            g_ptr_array_add(names, (gpointer)fixtures[i].name);
+        }
+    }
+
+    GError *error = NULL;
+    char *root = path ? g_strdup(path) : fixture_make_work_dir(NULL, "fm-fixtures", &error);
+    if (!root) {
+        g_printerr("%s\n", error->message);
+        g_error_free(error);
+        g_ptr_array_unref(names);
+        return 1;
+    }
+
+    int status = 0;
+    g_print("Seed %u, generating in %s\n", seed, root);
+    for (guint i = 0; i < names->len; i++) {
+        const char *name = g_ptr_array_index(names, i);
+        char *directory = g_build_filename(root, name, NULL);
+        fixture_stats_t stats;
+
+        if (fixture_create(name, directory, count, seed, &stats, &error)) {
+            g_print("%-10s %10" G_GUINT64_FORMAT " entries %12" G_GUINT64_FORMAT " bytes written %10.2f ms\n",
+                    name, stats.entries, stats.bytes, stats.time_ms);
+        } else {
+            g_printerr("%s: %s\n", name, error->message);
+            g_clear_error(&error);
+            status = 1;
+        }
+        g_free(directory);
+    }
+
+    if (!path && !keep) {
+        fixture_remove(root);
+    }
+    g_free(root);
+    g_ptr_array_unref(names);
+    return status;
+}
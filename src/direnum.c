@@ -0,0 +1,367 @@
+#include "direnum.h"
+#include "trace.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <dirent.h>
+
+/**
+ * Layout of the records returned by getdents64, glibc does not export it
+ */
+struct linux_dirent64 {
+    guint64 d_ino;
+    gint64 d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+static gint live_listings = 0; // Atomic, listings read and not freed yet
+
+/**
+ * Called for every entry read from a directory except "." and ".."
+ * @param fd The open directory
+ * @param entry The raw entry
+ * @param user_data Data passed to read_directory()
+ */
+typedef void (*direnum_entry_func)(int fd, const struct linux_dirent64 *entry, gpointer user_data);
+
+static void names_init(direnum_names_t *names, gsize arena_capacity, guint capacity) {
+    names->arena_length = 0;
+    names->arena_capacity = arena_capacity;
+    names->arena = g_malloc(names->arena_capacity);
+    names->count = 0;
+    names->capacity = capacity;
+    names->offsets = g_new(guint32, names->capacity);
+}
+
+static void names_clear(direnum_names_t *names) {
+    g_free(names->arena);
+    g_free(names->offsets);
+}
+
+/**
+ * Copies a name into the arena
+ */
+static void names_append(direnum_names_t *names, const char *name) {
+    gsize length = strlen(name) + 1;
+
+    if (names->arena_length + length > names->arena_capacity) {
+        while (names->arena_length + length > names->arena_capacity) {
+            names->arena_capacity *= 2;
+        }
+        names->arena = g_realloc(names->arena, names->arena_capacity);
+    }
+    if (names->count == names->capacity) {
+        names->capacity *= 2;
+        names->offsets = g_renew(guint32, names->offsets, names->capacity);
+    }
+
+    memcpy(names->arena + names->arena_length, name, length);
+    names->offsets[names->count++] = (guint32)names->arena_length;
+    names->arena_length += length;
+}
+
+/**
+ * Checks whether an entry is a directory, only calling stat() when d_type does not tell
+ */
+static gboolean entry_is_directory(int fd, const struct linux_dirent64 *entry) {
+    switch (entry->d_type) {
+        case DT_DIR:
+            return TRUE;
+        case DT_UNKNOWN:
+        case DT_LNK: {
+            // Follow links like GIO does, so a link to a directory shows up as one
+            struct stat st;
+            return fstatat(fd, entry->d_name, &st, 0) == 0 && S_ISDIR(st.st_mode);
+        }
+        default:
+            return FALSE;
+    }
+}
+
+/**
+ * Reads every entry of a directory with getdents64
+ * @param path Directory to read
+ * @param func Called for every entry
+ * @param user_data Data passed to func
+ * @param error Set if the directory could not be read
+ * @return FALSE on error
+ */
+static gboolean read_directory(const char *path, direnum_entry_func func, gpointer user_data, GError **error) {
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        int saved_errno = errno;
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(saved_errno), "Could not open %s: %s", path, g_strerror(saved_errno));
+        return FALSE;
+    }
+
+    gboolean success = TRUE;
+    char *buffer = g_malloc(DIRENUM_BUFFER_SIZE);
+
+    for (;;) {
+        long read = syscall(SYS_getdents64, fd, buffer, DIRENUM_BUFFER_SIZE);
+        if (read < 0) {
+            if (errno == EINTR) continue;
+            int saved_errno = errno;
+            g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(saved_errno), "Could not read %s: %s", path, g_strerror(saved_errno));
+            success = FALSE;
+            break;
+        }
+        if (read == 0) {
+            break;
+        }
+
+        for (long offset = 0; offset < read;) {
+            const struct linux_dirent64 *entry = (const struct linux_dirent64*)(buffer + offset);
+            offset += entry->d_reclen;
+
+            const char *name = entry->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                continue;
+            }
+            func(fd, entry, user_data);
+        }
+    }
+
+    g_free(buffer);
+    close(fd);
+    return success;
+}
+
+/**
+ * Keeps the entries that are directories
+ */
+static void collect_directory(int fd, const struct linux_dirent64 *entry, gpointer user_data) {
+    if (entry_is_directory(fd, entry)) {
+        names_append(user_data, entry->d_name);
+    }
+}
+
+direnum_names_t* direnum_list_directories(const char *path, GError **error) {
+    trace_span_t span = trace_begin("io", "direnum_list_directories");
+    direnum_names_t *names = g_new0(direnum_names_t, 1);
+    names_init(names, 4096, 64);
+
+    gboolean success = read_directory(path, collect_directory, names, error);
+    trace_end_detail(span, path);
+    if (!success) {
+        direnum_names_free(names);
+        return NULL;
+    }
+    return names;
+}
+
+/**
+ * State of dir_listing_read() while the directory is being read
+ */
+typedef struct {
+    dir_listing_t *listing;
+    guint capacity; // Allocated length of the per-entry arrays
+    gboolean show_hidden;
+} listing_reader_t;
+
+/**
+ * Appends an entry to the listing
+ */
+static void collect_entry(int fd, const struct linux_dirent64 *entry, gpointer user_data) {
+    listing_reader_t *reader = user_data;
+    dir_listing_t *listing = reader->listing;
+
+    if (!reader->show_hidden && entry->d_name[0] == '.') {
+        return;
+    }
+
+    names_append(&listing->names, entry->d_name);
+
+    guint index = listing->names.count - 1;
+    if (index >= reader->capacity) {
+        reader->capacity = listing->names.capacity;
+        listing->types = g_renew(guint8, listing->types, reader->capacity);
+        listing->inodes = g_renew(guint64, listing->inodes, reader->capacity);
+    }
+    listing->types[index] = entry->d_type;
+    listing->inodes[index] = entry->d_ino;
+}
+
+dir_listing_t* dir_listing_read(const char *directory, gboolean show_hidden, GError **error) {
+    dir_listing_t *listing = g_new0(dir_listing_t, 1);
+    listing->ref_count = 1;
+    g_atomic_int_inc(&live_listings);
+    listing->directory = g_strdup(directory);
+    names_init(&listing->names, 4096, 64);
+
+    trace_span_t span = trace_begin("io", "dir_listing_read");
+    listing_reader_t reader = { listing, 0, show_hidden };
+    gboolean success = read_directory(directory, collect_entry, &reader, error);
+    trace_end_detail(span, directory);
+    if (!success) {
+        dir_listing_unref(listing);
+        return NULL;
+    }
+    return listing;
+}
+
+dir_listing_t* dir_listing_read_entry(const char *directory, const char *name, GError **error) {
+    char *path = g_build_filename(directory, name, NULL);
+    struct stat st;
+    if (lstat(path, &st) != 0) {
+        int saved_errno = errno;
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(saved_errno), "Could not stat %s: %s", path, g_strerror(saved_errno));
+        g_free(path);
+        return NULL;
+    }
+
+    dir_listing_t *listing = g_new0(dir_listing_t, 1);
+    listing->ref_count = 1;
+    g_atomic_int_inc(&live_listings);
+    listing->directory = g_strdup(directory);
+    // Sized to the one entry, a burst of created files must not cost a full arena each
+    names_init(&listing->names, strlen(name) + 1, 1);
+    names_append(&listing->names, name);
+    listing->types = g_new(guint8, 1);
+    listing->types[0] = IFTODT(st.st_mode);
+    listing->inodes = g_new(guint64, 1);
+    listing->inodes[0] = st.st_ino;
+
+    // Same metadata as statbatch_start(), which follows links
+    dir_listing_alloc_stats(listing);
+    if (S_ISLNK(st.st_mode) && stat(path, &st) != 0) {
+        dir_listing_set_stat_failed(listing, 0);
+    } else {
+        gint64 mtime = (gint64)st.st_mtim.tv_sec * G_GINT64_CONSTANT(1000000000) + st.st_mtim.tv_nsec;
+        dir_listing_set_stat(listing, 0, st.st_size, mtime, st.st_mode);
+    }
+    g_free(path);
+    return listing;
+}
+
+dir_listing_t* dir_listing_ref(dir_listing_t *listing) {
+    g_atomic_int_inc(&listing->ref_count);
+    return listing;
+}
+
+void dir_listing_unref(dir_listing_t *listing) {
+    if (!g_atomic_int_dec_and_test(&listing->ref_count)) {
+        return;
+    }
+
+    names_clear(&listing->names);
+    g_free(listing->types);
+    g_free(listing->inodes);
+    g_free(listing->stat_states);
+    g_free(listing->sizes);
+    g_free(listing->mtimes);
+    g_free(listing->modes);
+    g_free(listing->directory);
+    g_atomic_int_add(&live_listings, -1);
+    g_free(listing);
+}
+
+char* dir_listing_get_path(const dir_listing_t *listing, guint index) {
+    return g_build_filename(listing->directory, dir_listing_get_name(listing, index), NULL);
+}
+
+void dir_listing_alloc_stats(dir_listing_t *listing) {
+    if (listing->stat_states) {
+        return;
+    }
+
+    guint count = dir_listing_get_count(listing);
+    listing->sizes = g_new0(guint64, count);
+    listing->mtimes = g_new0(gint64, count);
+    listing->modes = g_new0(guint32, count);
+    listing->stat_states = g_new0(gint, count);
+    listing->stats_remaining = (gint)count;
+}
+
+gboolean dir_listing_claim_stats(dir_listing_t *listing) {
+    return g_atomic_int_compare_and_exchange(&listing->stats_claimed, FALSE, TRUE);
+}
+
+void dir_listing_release_stats(dir_listing_t *listing) {
+    g_atomic_int_set(&listing->stats_claimed, FALSE);
+}
+
+guint dir_listing_get_pending_stats(const dir_listing_t *listing) {
+    if (!listing->stat_states) {
+        return dir_listing_get_count(listing);
+    }
+    return (guint)g_atomic_int_get(&listing->stats_remaining);
+}
+
+gboolean dir_listing_stat_is_pending(const dir_listing_t *listing, guint index) {
+    return g_atomic_int_get(&listing->stat_states[index]) == DIR_LISTING_STAT_PENDING;
+}
+
+guint dir_listing_get_live_count(void) {
+    return (guint)g_atomic_int_get(&live_listings);
+}
+
+gsize dir_listing_get_memory_size(const dir_listing_t *listing) {
+    gsize size = sizeof(*listing) + listing->names.arena_capacity;
+    // Offsets, types and inodes are sized to the name capacity
+    size += (gsize)listing->names.capacity * (sizeof(guint32) + sizeof(guint8) + sizeof(guint64));
+    if (listing->stat_states) {
+        size += (gsize)dir_listing_get_count(listing) * (sizeof(gint) + sizeof(guint64) + sizeof(gint64) + sizeof(guint32));
+    }
+    return size;
+}
+
+void dir_listing_set_stat(dir_listing_t *listing, guint index, guint64 size, gint64 mtime, guint32 mode) {
+    listing->sizes[index] = size;
+    listing->mtimes[index] = mtime;
+    listing->modes[index] = mode;
+    // Published last with a barrier, so readers never see a half written entry
+    g_atomic_int_set(&listing->stat_states[index], DIR_LISTING_STAT_VALID);
+    g_atomic_int_add(&listing->stats_remaining, -1);
+}
+
+void dir_listing_set_stat_failed(dir_listing_t *listing, guint index) {
+    g_atomic_int_set(&listing->stat_states[index], DIR_LISTING_STAT_FAILED);
+    g_atomic_int_add(&listing->stats_remaining, -1);
+}
+
+gboolean dir_listing_get_stat(const dir_listing_t *listing, guint index, guint64 *size, gint64 *mtime, guint32 *mode) {
+    if (!listing->stat_states || g_atomic_int_get(&listing->stat_states[index]) != DIR_LISTING_STAT_VALID) {
+        return FALSE;
+    }
+
+    if (size) *size = listing->sizes[index];
+    if (mtime) *mtime = listing->mtimes[index];
+    if (mode) *mode = listing->modes[index];
+    return TRUE;
+}
+
+static int compare_names(const void *a, const void *b) {
+    return g_ascii_strcasecmp(*(const char* const*)a, *(const char* const*)b);
+}
+
+void direnum_names_sort(direnum_names_t *names) {
+    if (names->count < 2) {
+        return;
+    }
+
+    // Sort pointers into the arena, then turn them back into offsets
+    const char **sorted = g_new(const char*, names->count);
+    for (guint i = 0; i < names->count; i++) {
+        sorted[i] = direnum_names_get(names, i);
+    }
+    qsort(sorted, names->count, sizeof(*sorted), compare_names);
+    for (guint i = 0; i < names->count; i++) {
+        names->offsets[i] = (guint32)(sorted[i] - names->arena);
+    }
+    g_free(sorted);
+}
+
+void direnum_names_free(direnum_names_t *names) {
+    if (!names) {
+        return;
+    }
+    names_clear(names);
+    g_free(names);
+}
@@ -0,0 +1,232 @@
+#ifndef DIRENUM_H
+#define DIRENUM_H
+
+#include <glib.h>
+
+/**
+ * Fast directory enumeration on top of the raw getdents64 system call
+ *
+ * Entries are read in large batches straight from the kernel and names are
+ * copied back to back into a single arena, so no per-entry allocation is made.
+ *
+ * direnum_list_directories() filters on d_type and only calls stat() for file
+ * systems that report DT_UNKNOWN (and for symbolic links, which are followed the
+ * way GIO does). dir_listing_read() keeps every entry with its d_type and d_ino;
+ * sizes, dates and modes are added later by statbatch_start().
+ */
+
+#define DIRENUM_BUFFER_SIZE (64 * 1024) // Bytes requested from getdents64 per call
+
+/**
+ * Names of the entries of a directory, stored in one arena
+ */
+typedef struct {
+    char *arena; // NUL terminated names back to back
+    gsize arena_length;
+    gsize arena_capacity;
+    guint32 *offsets; // Offset of every name in the arena
+    guint count;
+    guint capacity;
+} direnum_names_t;
+
+/**
+ * Gets a name
+ * @param names The names
+ * @param index Index of the name, below names->count
+ * @return The name, owned by names
+ */
+static inline const char* direnum_names_get(const direnum_names_t *names, guint index) {
+    return names->arena + names->offsets[index];
+}
+
+/**
+ * All entries of a directory, as read by dir_listing_read()
+ *
+ * Names live in one arena and the per-entry data is kept in parallel arrays
+ * (struct of arrays), so a listing of a million entries is a handful of
+ * allocations. The names and types are immutable once read and listings are
+ * reference counted, so they can be shared between threads and views. The
+ * metadata arrays are written once per entry and published through stat_states.
+ */
+typedef struct {
+    gint ref_count;
+    char *directory; // Path of the listed directory
+    direnum_names_t names; // Entry names, in directory order
+    guint8 *types; // d_type of every entry (DT_DIR, DT_REG, ..., DT_UNKNOWN)
+    guint64 *inodes; // d_ino of every entry
+
+    // Metadata filled in the background by statbatch_start(), NULL until allocated
+    gint *stat_states; // dir_listing_stat_state_t of every entry, written last
+    guint64 *sizes; // st_size
+    gint64 *mtimes; // Modification time in nanoseconds since the epoch
+    guint32 *modes; // st_mode
+    gint stats_remaining; // Entries whose metadata is still pending
+    gint stats_claimed; // A statbatch is fetching the metadata
+} dir_listing_t;
+
+/**
+ * Whether the metadata of an entry was fetched
+ */
+typedef enum {
+    DIR_LISTING_STAT_PENDING,
+    DIR_LISTING_STAT_VALID,
+    DIR_LISTING_STAT_FAILED
+} dir_listing_stat_state_t;
+
+/**
+ * Lists a directory
+ * @param directory Directory to read
+ * @param show_hidden Whether to keep entries starting with a dot
+ * @param error Set if the directory could not be read
+ * @return New listing, free with dir_listing_unref(), NULL on error
+ */
+dir_listing_t* dir_listing_read(const char *directory, gboolean show_hidden, GError **error);
+
+/**
+ * Reads a single entry of a directory with its metadata, e.g. a file that was
+ * just created, without listing the whole directory
+ * @param directory Directory of the entry
+ * @param name Name of the entry
+ * @param error Set if the entry could not be read
+ * @return New listing holding only that entry, free with dir_listing_unref(), NULL on error
+ */
+dir_listing_t* dir_listing_read_entry(const char *directory, const char *name, GError **error);
+
+/**
+ * Takes a reference to a listing
+ * @param listing The listing
+ * @return The listing
+ */
+dir_listing_t* dir_listing_ref(dir_listing_t *listing);
+
+/**
+ * Drops a reference to a listing, freeing it with the last one
+ * @param listing The listing
+ */
+void dir_listing_unref(dir_listing_t *listing);
+
+/**
+ * Gets the number of entries of a listing
+ * @param listing The listing
+ * @return Number of entries
+ */
+static inline guint dir_listing_get_count(const dir_listing_t *listing) {
+    return listing->names.count;
+}
+
+/**
+ * Gets the name of an entry
+ * @param listing The listing
+ * @param index Index of the entry
+ * @return The name, owned by the listing
+ */
+static inline const char* dir_listing_get_name(const dir_listing_t *listing, guint index) {
+    return direnum_names_get(&listing->names, index);
+}
+
+/**
+ * Builds the full path of an entry
+ * @param listing The listing
+ * @param index Index of the entry
+ * @return Newly allocated path
+ */
+char* dir_listing_get_path(const dir_listing_t *listing, guint index);
+
+/**
+ * Allocates the metadata arrays of a listing, does nothing if they exist
+ * Must be called from the main thread before any metadata is written
+ * @param listing The listing
+ */
+void dir_listing_alloc_stats(dir_listing_t *listing);
+
+/**
+ * Claims the metadata fetch of a listing, so several views of it only fetch once
+ * @param listing The listing, with its metadata arrays allocated
+ * @return TRUE if the caller should fetch, FALSE if someone else already does
+ */
+gboolean dir_listing_claim_stats(dir_listing_t *listing);
+
+/**
+ * Gives up a claim taken with dir_listing_claim_stats() before every entry was fetched
+ * @param listing The listing
+ */
+void dir_listing_release_stats(dir_listing_t *listing);
+
+/**
+ * Gets the number of entries whose metadata was not fetched yet
+ * @param listing The listing
+ * @return Number of pending entries, 0 once the metadata is complete
+ */
+guint dir_listing_get_pending_stats(const dir_listing_t *listing);
+
+/**
+ * Checks whether the metadata of an entry still has to be fetched
+ * @param listing The listing, with its metadata arrays allocated
+ * @param index Index of the entry
+ * @return TRUE while the entry is pending
+ */
+gboolean dir_listing_stat_is_pending(const dir_listing_t *listing, guint index);
+
+/**
+ * Gets the number of listings alive in the process, leaked listings show up here
+ * @return Listings read and not freed yet
+ */
+guint dir_listing_get_live_count(void);
+
+/**
+ * Estimates the memory used by a listing
+ * @param listing The listing
+ * @return Size in bytes
+ */
+gsize dir_listing_get_memory_size(const dir_listing_t *listing);
+
+/**
+ * Stores the metadata of an entry, may be called from any thread
+ * Every entry must be stored (or marked failed) at most once
+ * @param listing The listing, with its metadata arrays allocated
+ * @param index Index of the entry
+ * @param size Size in bytes
+ * @param mtime Modification time in nanoseconds since the epoch
+ * @param mode st_mode of the entry
+ */
+void dir_listing_set_stat(dir_listing_t *listing, guint index, guint64 size, gint64 mtime, guint32 mode);
+
+/**
+ * Marks the metadata of an entry as unavailable, may be called from any thread
+ * @param listing The listing, with its metadata arrays allocated
+ * @param index Index of the entry
+ */
+void dir_listing_set_stat_failed(dir_listing_t *listing, guint index);
+
+/**
+ * Gets the metadata of an entry if it was fetched
+ * @param listing The listing
+ * @param index Index of the entry
+ * @param size Filled with the size, may be NULL
+ * @param mtime Filled with the modification time in nanoseconds, may be NULL
+ * @param mode Filled with st_mode, may be NULL
+ * @return TRUE if the metadata is known
+ */
+gboolean dir_listing_get_stat(const dir_listing_t *listing, guint index, guint64 *size, gint64 *mtime, guint32 *mode);
+
+/**
+ * Lists the subdirectories of a directory
+ * @param path Directory to read
+ * @param error Set if the directory could not be read
+ * @return Names of the subdirectories in directory order, free with direnum_names_free(), NULL on error
+ */
+direnum_names_t* direnum_list_directories(const char *path, GError **error);
+
+/**
+ * Sorts names case-insensitively, the way the sidebar shows them
+ * @param names The names
+ */
+void direnum_names_sort(direnum_names_t *names);
+
+/**
+ * Frees names returned by direnum_list_directories()
+ * @param names The names
+ */
+void direnum_names_free(direnum_names_t *names);
+
+#endif //DIRENUM_H
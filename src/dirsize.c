@@ -0,0 +1,581 @@
+#include "dirsize.h"
+#include "sizecache.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define DIRSIZE_MIN_THREADS 4 // Directory scans mostly wait on I/O, so use at least this many threads
+#define DIRSIZE_FLAG_NOTIFY (1 << 16) // Private flag, calls request_finished() on the main thread when the walk stops
+
+struct dirsize_walk {
+    gint ref_count;
+    gint cancelled;
+    gint finished;
+    dirsize_flags_t flags;
+    char *path;
+    dev_t dev; // File system of the walk, for DIRSIZE_FLAG_ONE_FILE_SYSTEM
+
+    _Atomic guint64 apparent_size;
+    _Atomic guint64 disk_size;
+    _Atomic guint64 file_count;
+    _Atomic guint64 dir_count;
+    _Atomic guint64 error_count;
+
+    GMutex links_mutex;
+    GHashTable *links; // (device, inode) of every multiply linked file seen so far
+};
+
+/**
+ * A directory waiting to be scanned or whose subdirectories are still being scanned
+ */
+typedef struct dirsize_node dirsize_node_t;
+struct dirsize_node {
+    dirsize_walk_t *walk;
+    dirsize_node_t *parent;
+    char *path;
+    struct stat st; // Stat of the directory, taken by whoever found it
+    gint pending; // 1 for the directory itself plus 1 for every unfinished subdirectory
+    gint incomplete; // Set if anything in the subtree was skipped, the result is then not cached
+
+    // Filled by the task that scans the directory
+    sizecache_counts_t own;
+    GPtrArray *children; // Names of the subdirectories, NULL if the directory could not be read
+
+    // Whole subtree, children add theirs when they finish
+    _Atomic guint64 total_apparent_size;
+    _Atomic guint64 total_disk_size;
+    _Atomic guint64 total_file_count;
+    _Atomic guint64 total_dir_count;
+};
+
+// Key of the hard link table
+typedef struct {
+    dev_t dev;
+    ino_t ino;
+} dirsize_inode_t;
+
+/**
+ * A directory requested with dirsize_request() and the callbacks waiting for it
+ */
+typedef struct {
+    char *path;
+    GPtrArray *waiters; // dirsize_waiter_t
+    dirsize_walk_t *walk; // NULL while the request is queued
+} dirsize_request_t;
+
+/**
+ * A callback waiting for a request
+ */
+typedef struct {
+    dirsize_request_t *request;
+    dirsize_ready_func func;
+    gpointer user_data;
+    GDestroyNotify destroy;
+    GCancellable *cancellable;
+    gulong cancelled_id;
+} dirsize_waiter_t;
+
+static GThreadPool *dirsize_pool = NULL;
+// Requests of dirsize_request(), main thread only
+static GHashTable *requests = NULL; // path -> dirsize_request_t
+static GQueue queued_requests = G_QUEUE_INIT; // dirsize_request_t waiting for a free slot, newest first
+static guint running_requests = 0; // Walks of requests that did not report back yet
+
+static guint inode_hash(gconstpointer key) {
+    const dirsize_inode_t *inode = key;
+    return (guint)(inode->ino ^ (inode->ino >> 32) ^ (inode->dev * 31));
+}
+
+static gboolean inode_equal(gconstpointer a, gconstpointer b) {
+    const dirsize_inode_t *first = a;
+    const dirsize_inode_t *second = b;
+    return first->dev == second->dev && first->ino == second->ino;
+}
+
+/**
+ * Marks an inode as counted
+ * @return TRUE if the inode was not counted before
+ */
+static gboolean claim_inode(dirsize_walk_t *walk, dev_t dev, ino_t ino) {
+    dirsize_inode_t key = { dev, ino };
+
+    g_mutex_lock(&walk->links_mutex);
+    gboolean is_new = !g_hash_table_contains(walk->links, &key);
+    if (is_new) {
+        g_hash_table_add(walk->links, g_memdup2(&key, sizeof(key)));
+    }
+    g_mutex_unlock(&walk->links_mutex);
+
+    return is_new;
+}
+
+static dirsize_node_t* new_node(dirsize_walk_t *walk, dirsize_node_t *parent, char *path, const struct stat *st) {
+    dirsize_node_t *node = g_new0(dirsize_node_t, 1);
+    node->walk = walk;
+    node->parent = parent;
+    node->path = path;
+    node->st = *st;
+    node->pending = 1;
+    return node;
+}
+
+static void free_node(dirsize_node_t *node) {
+    if (node->children) {
+        g_ptr_array_unref(node->children);
+    }
+    g_free(node->path);
+    g_free(node);
+}
+
+/**
+ * Adds counters to the walk, which is what progress reports show
+ */
+static void add_to_walk(dirsize_walk_t *walk, const sizecache_counts_t *counts) {
+    atomic_fetch_add_explicit(&walk->apparent_size, counts->apparent_size, memory_order_relaxed);
+    atomic_fetch_add_explicit(&walk->disk_size, counts->disk_size, memory_order_relaxed);
+    atomic_fetch_add_explicit(&walk->file_count, counts->file_count, memory_order_relaxed);
+    atomic_fetch_add_explicit(&walk->dir_count, counts->dir_count, memory_order_relaxed);
+}
+
+/**
+ * Adds counters to the subtree totals of a node
+ */
+static void add_to_node(dirsize_node_t *node, const sizecache_counts_t *counts) {
+    atomic_fetch_add_explicit(&node->total_apparent_size, counts->apparent_size, memory_order_relaxed);
+    atomic_fetch_add_explicit(&node->total_disk_size, counts->disk_size, memory_order_relaxed);
+    atomic_fetch_add_explicit(&node->total_file_count, counts->file_count, memory_order_relaxed);
+    atomic_fetch_add_explicit(&node->total_dir_count, counts->dir_count, memory_order_relaxed);
+}
+
+/**
+ * Reads the subtree totals of a node
+ */
+static void get_node_total(dirsize_node_t *node, sizecache_counts_t *counts) {
+    counts->apparent_size = atomic_load(&node->total_apparent_size);
+    counts->disk_size = atomic_load(&node->total_disk_size);
+    counts->file_count = atomic_load(&node->total_file_count);
+    counts->dir_count = atomic_load(&node->total_dir_count);
+}
+
+/**
+ * Queues a subdirectory of a node and counts its inode
+ * @param counts Counters of the parent directory's own entries
+ */
+static void queue_child(dirsize_node_t *node, const char *name, const struct stat *st, sizecache_counts_t *counts) {
+    // The name is kept so the cached entry lists every subdirectory, whatever the flags of the walk reusing it
+    g_ptr_array_add(node->children, g_strdup(name));
+    if ((node->walk->flags & DIRSIZE_FLAG_ONE_FILE_SYSTEM) && st->st_dev != node->walk->dev) {
+        return;
+    }
+
+    // The directory inode itself is counted by its parent, its contents by its own task
+    counts->apparent_size += st->st_size;
+    counts->disk_size += (guint64)st->st_blocks * 512;
+    counts->dir_count++;
+
+    g_atomic_int_inc(&node->pending);
+    dirsize_node_t *child = new_node(node->walk, node, g_build_filename(node->path, name, NULL), st);
+    g_thread_pool_push(dirsize_pool, child, NULL);
+}
+
+/**
+ * Schedules an unchanged directory from the cache without reading it
+ * Only its subdirectories are stat'ed, so they can be validated in turn
+ */
+static void reuse_directory(dirsize_node_t *node, const sizecache_entry_t *entry) {
+    sizecache_counts_t counts = entry->own;
+    node->own = entry->own;
+    node->children = g_ptr_array_new_with_free_func(g_free);
+
+    for (char **child = entry->children; child && *child; child++) {
+        if (g_atomic_int_get(&node->walk->cancelled)) {
+            g_atomic_int_set(&node->incomplete, TRUE);
+            break;
+        }
+
+        char *path = g_build_filename(node->path, *child, NULL);
+        struct stat st;
+        gboolean is_dir = lstat(path, &st) == 0 && S_ISDIR(st.st_mode);
+        g_free(path);
+
+        // Cannot happen unless the directory changed within the same timestamp
+        if (!is_dir) {
+            g_atomic_int_set(&node->incomplete, TRUE);
+            continue;
+        }
+        queue_child(node, *child, &st, &counts);
+    }
+
+    add_to_node(node, &counts);
+    add_to_walk(node->walk, &counts);
+}
+
+/**
+ * Reads one directory, adds its files to the totals and queues its subdirectories
+ */
+static void scan_directory(dirsize_node_t *node) {
+    dirsize_walk_t *walk = node->walk;
+
+    if (walk->flags & DIRSIZE_FLAG_USE_CACHE) {
+        sizecache_entry_t entry;
+        if (sizecache_lookup(&node->st, &entry)) {
+            reuse_directory(node, &entry);
+            sizecache_entry_clear(&entry);
+            return;
+        }
+    }
+
+    int fd = open(node->path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0) {
+        atomic_fetch_add_explicit(&walk->error_count, 1, memory_order_relaxed);
+        return;
+    }
+
+    DIR *dir = fdopendir(fd);
+    if (!dir) {
+        close(fd);
+        atomic_fetch_add_explicit(&walk->error_count, 1, memory_order_relaxed);
+        return;
+    }
+
+    // Sum locally and publish once per directory to keep the shared counters cold
+    sizecache_counts_t files = {0};
+    sizecache_counts_t dirs = {0};
+    node->children = g_ptr_array_new_with_free_func(g_free);
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        const char *name = entry->d_name;
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+            continue;
+        }
+
+        if (g_atomic_int_get(&walk->cancelled)) {
+            g_atomic_int_set(&node->incomplete, TRUE);
+            break;
+        }
+
+        struct stat st;
+        if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+            continue;
+        }
+
+        if (S_ISDIR(st.st_mode)) {
+            queue_child(node, name, &st, &dirs);
+            continue;
+        }
+
+        if (st.st_nlink > 1 && !claim_inode(walk, st.st_dev, st.st_ino)) {
+            continue;
+        }
+
+        files.apparent_size += st.st_size;
+        files.disk_size += (guint64)st.st_blocks * 512;
+        files.file_count++;
+    }
+    closedir(dir);
+
+    node->own = files;
+    add_to_node(node, &files);
+    add_to_node(node, &dirs);
+    add_to_walk(walk, &files);
+    add_to_walk(walk, &dirs);
+}
+
+static void free_request(dirsize_request_t *request) {
+    // Waiters first, freeing them disconnects from their cancellables
+    g_ptr_array_unref(request->waiters);
+    if (request->walk) {
+        dirsize_walk_unref(request->walk);
+    }
+    g_free(request->path);
+    g_free(request);
+}
+
+/**
+ * Starts the walks of queued requests while fewer than DIRSIZE_MAX_REQUESTS are running
+ */
+static void start_queued_requests(void) {
+    while (running_requests < DIRSIZE_MAX_REQUESTS && !g_queue_is_empty(&queued_requests)) {
+        dirsize_request_t *request = g_queue_pop_head(&queued_requests);
+        running_requests++;
+        request->walk = dirsize_walk_start(request->path,
+                                           DIRSIZE_FLAG_USE_CACHE | DIRSIZE_FLAG_ONE_FILE_SYSTEM | DIRSIZE_FLAG_NOTIFY);
+    }
+}
+
+/**
+ * Calls the waiters of a finished request, runs on the main thread
+ * The walk may belong to a request that was cancelled, its path can have a newer request by then
+ */
+static gboolean request_finished(gpointer data) {
+    dirsize_walk_t *walk = data;
+
+    dirsize_request_t *request = requests ? g_hash_table_lookup(requests, walk->path) : NULL;
+    if (request && request->walk == walk) {
+        g_hash_table_steal(requests, walk->path);
+        dirsize_totals_t totals;
+        dirsize_walk_get_totals(walk, &totals);
+
+        // The callbacks may cancel other waiters of the request, which is not in the table any more
+        for (guint i = 0; i < request->waiters->len; i++) {
+            dirsize_waiter_t *waiter = g_ptr_array_index(request->waiters, i);
+            if (waiter->cancellable) {
+                g_signal_handler_disconnect(waiter->cancellable, waiter->cancelled_id);
+                g_clear_object(&waiter->cancellable);
+            }
+        }
+        for (guint i = 0; i < request->waiters->len; i++) {
+            dirsize_waiter_t *waiter = g_ptr_array_index(request->waiters, i);
+            if (totals.finished && waiter->func) {
+                waiter->func(walk->path, &totals, waiter->user_data);
+            }
+        }
+        free_request(request);
+    }
+
+    dirsize_walk_unref(walk);
+    running_requests--;
+    start_queued_requests();
+    return G_SOURCE_REMOVE;
+}
+
+/**
+ * Marks a node as done and walks up the tree, releasing every directory whose subtree is complete
+ * A complete subtree is stored in the size cache and added to its parent's totals
+ * The walk is finished once the root is released
+ */
+static void finish_node(dirsize_node_t *node) {
+    while (node && g_atomic_int_dec_and_test(&node->pending)) {
+        dirsize_node_t *parent = node->parent;
+        dirsize_walk_t *walk = node->walk;
+
+        sizecache_counts_t total;
+        get_node_total(node, &total);
+
+        gboolean incomplete = g_atomic_int_get(&node->incomplete) || !node->children;
+        if (!incomplete) {
+            g_ptr_array_add(node->children, NULL);
+            sizecache_store(&node->st, &node->own, &total, (char**)node->children->pdata);
+        }
+
+        if (parent) {
+            add_to_node(parent, &total);
+            if (g_atomic_int_get(&node->incomplete)) {
+                g_atomic_int_set(&parent->incomplete, TRUE);
+            }
+        } else {
+            if (!g_atomic_int_get(&walk->cancelled)) {
+                g_atomic_int_set(&walk->finished, TRUE);
+            }
+            if (walk->flags & DIRSIZE_FLAG_NOTIFY) {
+                // Hands the background reference over to the main thread
+                g_idle_add(request_finished, walk);
+            } else {
+                // Drop the reference held by the background work
+                dirsize_walk_unref(walk);
+            }
+        }
+
+        free_node(node);
+        node = parent;
+    }
+}
+
+/**
+ * Thread pool entry point, handles one directory
+ */
+static void dirsize_worker(gpointer data, gpointer user_data) {
+    dirsize_node_t *node = data;
+
+    if (!g_atomic_int_get(&node->walk->cancelled)) {
+        scan_directory(node);
+    } else {
+        g_atomic_int_set(&node->incomplete, TRUE);
+    }
+    finish_node(node);
+}
+
+/**
+ * Creates the shared thread pool on first use
+ */
+static void ensure_pool(void) {
+    static gsize initialized = 0;
+
+    if (g_once_init_enter(&initialized)) {
+        GError *error = NULL;
+        gint threads = MAX(DIRSIZE_MIN_THREADS, (gint)g_get_num_processors());
+        dirsize_pool = g_thread_pool_new(dirsize_worker, NULL, threads, FALSE, &error);
+        if (error) {
+            g_warning("Failed to create directory size thread pool: %s", error->message);
+            g_error_free(error);
+        }
+        g_once_init_leave(&initialized, 1);
+    }
+}
+
+dirsize_walk_t* dirsize_walk_start(const char *path, dirsize_flags_t flags) {
+    ensure_pool();
+    sizecache_load();
+
+    dirsize_walk_t *walk = g_new0(dirsize_walk_t, 1);
+    walk->ref_count = 1;
+    walk->flags = flags;
+    walk->path = g_strdup(path);
+    g_mutex_init(&walk->links_mutex);
+    walk->links = g_hash_table_new_full(inode_hash, inode_equal, g_free, NULL);
+
+    struct stat st;
+    gboolean valid = dirsize_pool && stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+    walk->dev = valid ? st.st_dev : 0;
+    if (valid && (flags & DIRSIZE_FLAG_ONE_FILE_SYSTEM)) {
+        // Stay on the file system of the parent, a mount point only counts its own inode
+        char *parent = g_path_get_dirname(path);
+        struct stat parent_st;
+        if (stat(parent, &parent_st) == 0) {
+            walk->dev = parent_st.st_dev;
+        }
+        g_free(parent);
+    }
+
+    if (!valid) {
+        walk->error_count = 1;
+        if (flags & DIRSIZE_FLAG_NOTIFY) {
+            // Nothing was queued, report the failure right away
+            g_atomic_int_inc(&walk->ref_count);
+            g_idle_add(request_finished, walk);
+        }
+        return walk;
+    }
+
+    // The root directory counts itself, since it has no parent to do it
+    walk->apparent_size = st.st_size;
+    walk->disk_size = (guint64)st.st_blocks * 512;
+    walk->dir_count = 1;
+
+    if (st.st_dev != walk->dev) {
+        g_atomic_int_set(&walk->finished, TRUE);
+        if (flags & DIRSIZE_FLAG_NOTIFY) {
+            g_atomic_int_inc(&walk->ref_count);
+            g_idle_add(request_finished, walk);
+        }
+        return walk;
+    }
+
+    // The background work keeps the walk alive until the root node is released
+    g_atomic_int_inc(&walk->ref_count);
+    g_thread_pool_push(dirsize_pool, new_node(walk, NULL, g_strdup(path), &st), NULL);
+
+    return walk;
+}
+
+static void free_waiter(gpointer data) {
+    dirsize_waiter_t *waiter = data;
+    if (waiter->cancellable) {
+        g_signal_handler_disconnect(waiter->cancellable, waiter->cancelled_id);
+        g_object_unref(waiter->cancellable);
+    }
+    if (waiter->destroy) {
+        waiter->destroy(waiter->user_data);
+    }
+    g_free(waiter);
+}
+
+/**
+ * Drops a cancelled waiter, and its request once nobody waits for it any more
+ * A queued request is forgotten, the walk of a running one is cancelled and
+ * still holds its slot until it stops.
+ */
+static void on_waiter_cancelled(GCancellable *cancellable, gpointer data) {
+    dirsize_waiter_t *waiter = data;
+    dirsize_request_t *request = waiter->request;
+
+    g_ptr_array_remove_fast(request->waiters, waiter);
+    if (request->waiters->len > 0) {
+        return;
+    }
+
+    g_hash_table_steal(requests, request->path);
+    if (request->walk) {
+        dirsize_walk_cancel(request->walk);
+    } else {
+        g_queue_remove(&queued_requests, request);
+    }
+    free_request(request);
+}
+
+void dirsize_request(const char *path, GCancellable *cancellable,
+                     dirsize_ready_func func, gpointer user_data, GDestroyNotify destroy) {
+    if (g_cancellable_is_cancelled(cancellable)) {
+        if (destroy) {
+            destroy(user_data);
+        }
+        return;
+    }
+    if (!requests) {
+        requests = g_hash_table_new(g_str_hash, g_str_equal);
+    }
+
+    dirsize_request_t *request = g_hash_table_lookup(requests, path);
+    if (!request) {
+        request = g_new0(dirsize_request_t, 1);
+        request->path = g_strdup(path);
+        request->waiters = g_ptr_array_new_with_free_func(free_waiter);
+        g_hash_table_insert(requests, request->path, request);
+        // The rows bound last are the ones on screen, their sizes come first
+        g_queue_push_head(&queued_requests, request);
+    }
+
+    dirsize_waiter_t *waiter = g_new0(dirsize_waiter_t, 1);
+    waiter->request = request;
+    waiter->func = func;
+    waiter->user_data = user_data;
+    waiter->destroy = destroy;
+    if (cancellable) {
+        waiter->cancellable = g_object_ref(cancellable);
+        waiter->cancelled_id = g_signal_connect(cancellable, "cancelled", G_CALLBACK(on_waiter_cancelled), waiter);
+    }
+    g_ptr_array_add(request->waiters, waiter);
+
+    start_queued_requests();
+}
+
+void dirsize_walk_get_totals(dirsize_walk_t *walk, dirsize_totals_t *totals) {
+    // Read finished first, so totals are complete whenever it is set
+    totals->finished = g_atomic_int_get(&walk->finished);
+    totals->apparent_size = atomic_load(&walk->apparent_size);
+    totals->disk_size = atomic_load(&walk->disk_size);
+    totals->file_count = atomic_load(&walk->file_count);
+    totals->dir_count = atomic_load(&walk->dir_count);
+    totals->error_count = atomic_load(&walk->error_count);
+}
+
+void dirsize_walk_cancel(dirsize_walk_t *walk) {
+    g_atomic_int_set(&walk->cancelled, TRUE);
+}
+
+void dirsize_walk_unref(dirsize_walk_t *walk) {
+    if (!g_atomic_int_dec_and_test(&walk->ref_count)) {
+        return;
+    }
+
+    g_hash_table_destroy(walk->links);
+    g_mutex_clear(&walk->links_mutex);
+    g_free(walk->path);
+    g_free(walk);
+}
+
+char* dirsize_format_size(guint64 size) {
+    if (size >= (1ULL << 30)) {
+        return g_strdup_printf("%.2f GB", (double)size / (1ULL << 30));
+    } else if (size >= (1ULL << 20)) {
+        return g_strdup_printf("%.2f MB", (double)size / (1ULL << 20));
+    } else if (size >= (1ULL << 10)) {
+        return g_strdup_printf("%.2f KB", (double)size / (1ULL << 10));
+    }
+    return g_strdup_printf("%llu bytes", (unsigned long long)size);
+}
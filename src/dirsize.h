@@ -0,0 +1,108 @@
+#ifndef DIRSIZE_H
+#define DIRSIZE_H
+
+#include <gio/gio.h>
+
+/**
+ * Parallel recursive directory size computation
+ *
+ * A walk scans every directory of a subtree on a shared thread pool, one task per
+ * directory. Entries are stat'ed with fstatat() relative to the directory's file
+ * descriptor, so only directory paths are ever resolved. Files with more than one
+ * hard link are only counted the first time their (device, inode) pair is seen.
+ *
+ * Progress can be read at any time from any thread while the walk is running.
+ *
+ * Every directory whose subtree was fully scanned is stored in the size cache
+ * (sizecache.h). Walks started with DIRSIZE_FLAG_USE_CACHE reuse cached directories
+ * whose mtime/ctime did not change instead of reading them, and only rescan the
+ * subtrees that changed. Files with several hard links inside a reused directory are
+ * not de-duplicated against the rest of the walk.
+ *
+ * Walks started with DIRSIZE_FLAG_ONE_FILE_SYSTEM skip directories on another
+ * device than the walk, like du -x. The cached size of a directory is the one
+ * of the last walk that scanned it, with or without what is mounted below it.
+ */
+
+#define DIRSIZE_MAX_REQUESTS 4 // Walks of dirsize_request() running at once, the others wait in a queue
+
+typedef enum {
+    DIRSIZE_FLAG_NONE = 0,
+    DIRSIZE_FLAG_USE_CACHE = 1 << 0, // Reuse unchanged directories from the size cache
+    DIRSIZE_FLAG_ONE_FILE_SYSTEM = 1 << 1 // Stay on the file system of the directory containing the root
+} dirsize_flags_t;
+
+typedef struct dirsize_walk dirsize_walk_t;
+
+/**
+ * Totals of a walk, as returned by dirsize_walk_get_totals()
+ */
+typedef struct {
+    guint64 apparent_size; // Sum of st_size
+    guint64 disk_size; // Sum of st_blocks * 512
+    guint64 file_count; // Everything that is not a directory
+    guint64 dir_count; // Directories, including the root
+    guint64 error_count; // Directories that could not be read
+    gboolean finished; // TRUE once every directory was scanned
+} dirsize_totals_t;
+
+/**
+ * Called on the main thread once a requested directory size is known
+ * @param path Directory that was requested
+ * @param totals Totals of the finished walk
+ * @param user_data Data passed to dirsize_request()
+ */
+typedef void (*dirsize_ready_func)(const char *path, const dirsize_totals_t *totals, gpointer user_data);
+
+/**
+ * Starts computing the size of a directory tree in the background
+ * @param path Root directory of the walk
+ * @param flags Combination of dirsize_flags_t
+ * @return New walk, free with dirsize_walk_unref()
+ */
+dirsize_walk_t* dirsize_walk_start(const char *path, dirsize_flags_t flags);
+
+/**
+ * Computes the size of a directory in the background using the size cache
+ * Requests for a directory that is already being computed share the same walk.
+ * At most DIRSIZE_MAX_REQUESTS walks run at once, the newest requests start
+ * first. Walks do not leave the file system of the directory containing path,
+ * so a mount point only reports its own inode.
+ * Must be called from the main thread, and cancellable only cancelled from it
+ * @param path Directory to compute
+ * @param cancellable Drops the request, the walk stops once no request waits for it, may be NULL
+ * @param func Called on the main thread when the walk finishes, not called if it fails or is cancelled
+ * @param user_data Data passed to func
+ * @param destroy Frees user_data once the request is done, may be NULL
+ */
+void dirsize_request(const char *path, GCancellable *cancellable,
+                     dirsize_ready_func func, gpointer user_data, GDestroyNotify destroy);
+
+/**
+ * Reads the current totals of a walk, can be called while the walk is running
+ * @param walk The walk
+ * @param totals Filled with the current totals
+ */
+void dirsize_walk_get_totals(dirsize_walk_t *walk, dirsize_totals_t *totals);
+
+/**
+ * Stops a walk as soon as possible, directories that are not scanned yet are skipped
+ * The totals stay at what was counted so far and finished is never set
+ * @param walk The walk
+ */
+void dirsize_walk_cancel(dirsize_walk_t *walk);
+
+/**
+ * Releases a walk, the background work holds its own reference until it stops
+ * @param walk The walk
+ */
+void dirsize_walk_unref(dirsize_walk_t *walk);
+
+/**
+ * Formats a byte count for display (e.g. "1.50 MB")
+ * @param size Size in bytes
+ * @return Newly allocated string
+ */
+char* dirsize_format_size(guint64 size);
+
+#endif //DIRSIZE_H
@@ -0,0 +1,831 @@
+#define _GNU_SOURCE // O_NOATIME, posix_fadvise()
+#include "dupfind.h"
+#include "direnum.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef HAVE_XXHASH
+#include <xxhash.h>
+#endif
+
+#define DUPFIND_COMPARE_SIZE (64 * 1024) // Read size of the byte by byte comparison of dupfind_link()
+#define DUPFIND_LINK_ATTEMPTS 16 // Temporary names tried by dupfind_link() before giving up
+#define DUPFIND_PRIME_1 G_GUINT64_CONSTANT(0x9E3779B185EBCA87) // Constants of the built-in hash
+#define DUPFIND_PRIME_2 G_GUINT64_CONSTANT(0xC2B2AE3D27D4EB4F)
+#define DUPFIND_STRIPE_SIZE 32 // Bytes consumed per round by the built-in hash, the read sizes are multiples of it
+
+/**
+ * A regular file found by the walk
+ */
+typedef struct {
+    guint64 size; // 0 once the file could not be read
+    guint64 inode;
+    guint64 hash; // Of the last stage that read the file, 0 before
+    guint32 dir; // Index in dirs
+    guint32 name; // Offset of the name in names
+} dupfind_file_t;
+
+/**
+ * A directory holding at least one recorded file
+ */
+typedef struct {
+    char *path;
+    dev_t device;
+} dupfind_dir_t;
+
+struct dupfind {
+    gint ref_count;
+    gint cancelled;
+    gint stage;
+    gboolean show_hidden;
+    char *root;
+
+    _Atomic guint64 file_count;
+    _Atomic guint64 candidate_count;
+    _Atomic guint64 hashed_count;
+    _Atomic guint64 bytes_to_hash;
+    _Atomic guint64 bytes_hashed;
+    _Atomic guint64 error_count;
+
+    GMutex mutex;
+    GCond done_cond; // Signaled when pending drops to 0
+    guint pending; // Tasks of the current stage still queued or running, guarded by mutex
+
+    // Written by the walk under mutex, then only by the search thread
+    GPtrArray *dirs; // dupfind_dir_t
+    GByteArray *names; // Names of the files, NUL terminated
+    GArray *files; // dupfind_file_t
+
+    _Atomic guint next_file; // Next file to hash, shared by the workers of a stage
+    GPtrArray *groups; // dupfind_group_t, set when the search is done
+};
+
+/**
+ * Work queued on the shared thread pool
+ */
+typedef struct {
+    dupfind_t *search;
+    char *path; // Directory to read, NULL for a hash worker
+    dupfind_stage_t stage; // Stage of a hash worker
+} dupfind_task_t;
+
+/**
+ * State of a running hash
+ */
+typedef struct {
+#ifdef HAVE_XXHASH
+    XXH3_state_t *state;
+#else
+    guint64 lanes[4];
+    guint64 length;
+#endif
+} dupfind_hash_t;
+
+static GThreadPool *dupfind_pool = NULL;
+
+#ifdef HAVE_XXHASH
+
+static void hash_init(dupfind_hash_t *hash) {
+    hash->state = XXH3_createState();
+}
+
+static void hash_clear(dupfind_hash_t *hash) {
+    XXH3_freeState(hash->state);
+}
+
+static void hash_reset(dupfind_hash_t *hash) {
+    XXH3_64bits_reset(hash->state);
+}
+
+static void hash_update(dupfind_hash_t *hash, const guint8 *data, gsize length) {
+    XXH3_64bits_update(hash->state, data, length);
+}
+
+static guint64 hash_digest(dupfind_hash_t *hash) {
+    return XXH3_64bits_digest(hash->state);
+}
+
+#else
+
+static inline guint64 rotate_left(guint64 value, guint bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static inline guint64 read_word(const guint8 *data) {
+    guint64 word;
+    memcpy(&word, data, sizeof(word));
+    return GUINT64_FROM_LE(word);
+}
+
+static void hash_init(dupfind_hash_t *hash) {
+}
+
+static void hash_clear(dupfind_hash_t *hash) {
+}
+
+static void hash_reset(dupfind_hash_t *hash) {
+    hash->lanes[0] = DUPFIND_PRIME_1;
+    hash->lanes[1] = DUPFIND_PRIME_2;
+    hash->lanes[2] = ~DUPFIND_PRIME_1;
+    hash->lanes[3] = ~DUPFIND_PRIME_2;
+    hash->length = 0;
+}
+
+/**
+ * Hashes more data, every call but the last must pass a multiple of DUPFIND_STRIPE_SIZE bytes
+ */
+static void hash_update(dupfind_hash_t *hash, const guint8 *data, gsize length) {
+    hash->length += length;
+
+    // Four independent lanes, so the multiplications of a stripe run in parallel
+    gsize offset = 0;
+    for (; offset + DUPFIND_STRIPE_SIZE <= length; offset += DUPFIND_STRIPE_SIZE) {
+        for (guint lane = 0; lane < 4; lane++) {
+            guint64 word = read_word(data + offset + lane * sizeof(guint64));
+            hash->lanes[lane] = rotate_left(hash->lanes[lane] + word * DUPFIND_PRIME_2, 31) * DUPFIND_PRIME_1;
+        }
+    }
+
+    // Tail of the last call, whole words first, then the remaining bytes as one word
+    guint lane = 0;
+    for (; offset + sizeof(guint64) <= length; offset += sizeof(guint64), lane++) {
+        hash->lanes[lane] = rotate_left(hash->lanes[lane] + read_word(data + offset) * DUPFIND_PRIME_2, 31) * DUPFIND_PRIME_1;
+    }
+    if (offset < length) {
+        guint8 last[sizeof(guint64)] = { 0 };
+        memcpy(last, data + offset, length - offset);
+        hash->lanes[lane] = rotate_left(hash->lanes[lane] + read_word(last) * DUPFIND_PRIME_2, 31) * DUPFIND_PRIME_1;
+    }
+}
+
+static guint64 hash_digest(dupfind_hash_t *hash) {
+    guint64 value = rotate_left(hash->lanes[0], 1) + rotate_left(hash->lanes[1], 7) +
+                    rotate_left(hash->lanes[2], 12) + rotate_left(hash->lanes[3], 18);
+    value ^= hash->length * DUPFIND_PRIME_1;
+
+    // Final avalanche, so every input bit affects every output bit
+    value ^= value >> 33;
+    value *= DUPFIND_PRIME_2;
+    value ^= value >> 29;
+    value *= DUPFIND_PRIME_1;
+    value ^= value >> 32;
+    return value;
+}
+
+#endif
+
+/**
+ * Reads until the buffer is full or the end of the file
+ * @return Bytes read, -1 on error
+ */
+static gssize read_full(int fd, guint8 *buffer, gsize length, off_t offset) {
+    gsize done = 0;
+    while (done < length) {
+        gssize got = pread(fd, buffer + done, length - done, offset + done);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got < 0) {
+            return -1;
+        }
+        if (got == 0) {
+            break;
+        }
+        done += got;
+    }
+    return done;
+}
+
+/**
+ * Opens a file to hash, without updating its access time when allowed
+ */
+static int open_for_hash(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC | O_NOFOLLOW | O_NOATIME);
+    if (fd < 0 && errno == EPERM) {
+        // O_NOATIME is only allowed on files of the same user
+        fd = open(path, O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+    }
+    return fd;
+}
+
+/**
+ * Hashes the first and the last DUPFIND_EDGE_SIZE bytes of a file, or all of it if it is small enough
+ * @param buffer At least 2 * DUPFIND_EDGE_SIZE bytes
+ */
+static gboolean hash_edges(dupfind_hash_t *hash, int fd, guint64 size, guint8 *buffer, guint64 *result) {
+    hash_reset(hash);
+    if (size <= 2 * DUPFIND_EDGE_SIZE) {
+        if (read_full(fd, buffer, size, 0) != (gssize)size) {
+            return FALSE;
+        }
+        hash_update(hash, buffer, size);
+    } else {
+        if (read_full(fd, buffer, DUPFIND_EDGE_SIZE, 0) != DUPFIND_EDGE_SIZE ||
+            read_full(fd, buffer + DUPFIND_EDGE_SIZE, DUPFIND_EDGE_SIZE, size - DUPFIND_EDGE_SIZE) != DUPFIND_EDGE_SIZE) {
+            return FALSE;
+        }
+        hash_update(hash, buffer, 2 * DUPFIND_EDGE_SIZE);
+    }
+    *result = hash_digest(hash);
+    return TRUE;
+}
+
+/**
+ * Hashes a whole file with DUPFIND_READ_SIZE reads
+ * @param buffer At least DUPFIND_READ_SIZE bytes
+ */
+static gboolean hash_contents(dupfind_t *search, dupfind_hash_t *hash, int fd, guint64 size, guint8 *buffer, guint64 *result) {
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    hash_reset(hash);
+
+    guint64 offset = 0;
+    while (offset < size) {
+        if (g_atomic_int_get(&search->cancelled)) {
+            return FALSE;
+        }
+        gsize length = MIN(size - offset, DUPFIND_READ_SIZE);
+        if (read_full(fd, buffer, length, offset) != (gssize)length) {
+            // Truncated or unreadable while being hashed
+            return FALSE;
+        }
+        hash_update(hash, buffer, length);
+        offset += length;
+        atomic_fetch_add_explicit(&search->bytes_hashed, length, memory_order_relaxed);
+    }
+    // Whole pages were read, they are not needed again unless the file gets linked
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    *result = hash_digest(hash);
+    return TRUE;
+}
+
+/**
+ * Builds the full path of a recorded file
+ */
+static char* get_file_path(dupfind_t *search, const dupfind_file_t *file) {
+    const dupfind_dir_t *dir = search->dirs->pdata[file->dir];
+    return g_build_filename(dir->path, (const char*)search->names->data + file->name, NULL);
+}
+
+/**
+ * Hashes files of the current stage until none is left, runs on the thread pool
+ */
+static void hash_files(dupfind_t *search, dupfind_stage_t stage) {
+    gboolean edges = stage == DUPFIND_STAGE_EDGES;
+    guint8 *buffer = g_malloc(edges ? 2 * DUPFIND_EDGE_SIZE : DUPFIND_READ_SIZE);
+    dupfind_hash_t hash;
+    hash_init(&hash);
+
+    // Only the fields of their own files are written by the workers, the arrays do not change during a stage
+    dupfind_file_t *files = (dupfind_file_t*)search->files->data;
+    guint count = search->files->len;
+    while (!g_atomic_int_get(&search->cancelled)) {
+        guint index = atomic_fetch_add(&search->next_file, 1);
+        if (index >= count) {
+            break;
+        }
+        dupfind_file_t *file = &files[index];
+        if (!edges && file->size <= 2 * DUPFIND_EDGE_SIZE) {
+            // Fully hashed by the previous stage already
+            continue;
+        }
+
+        char *path = get_file_path(search, file);
+        int fd = open_for_hash(path);
+        gboolean hashed = fd >= 0 && (edges ? hash_edges(&hash, fd, file->size, buffer, &file->hash)
+                                            : hash_contents(search, &hash, fd, file->size, buffer, &file->hash));
+        if (fd >= 0) {
+            close(fd);
+        }
+        if (!hashed) {
+            file->size = 0;
+            atomic_fetch_add_explicit(&search->error_count, 1, memory_order_relaxed);
+        } else if (edges) {
+            atomic_fetch_add_explicit(&search->bytes_hashed, MIN(file->size, 2 * DUPFIND_EDGE_SIZE), memory_order_relaxed);
+        }
+        atomic_fetch_add_explicit(&search->hashed_count, 1, memory_order_relaxed);
+        g_free(path);
+    }
+
+    hash_clear(&hash);
+    g_free(buffer);
+}
+
+static void queue_task(dupfind_t *search, char *path, dupfind_stage_t stage) {
+    dupfind_task_t *task = g_new(dupfind_task_t, 1);
+    task->search = search;
+    task->path = path;
+    task->stage = stage;
+
+    g_mutex_lock(&search->mutex);
+    search->pending++;
+    g_mutex_unlock(&search->mutex);
+    g_thread_pool_push(dupfind_pool, task, NULL);
+}
+
+/**
+ * Records the regular files of one directory and queues its subdirectories, runs on the thread pool
+ */
+static void read_directory(dupfind_t *search, char *path) {
+    dir_listing_t *listing = dir_listing_read(path, search->show_hidden, NULL);
+    int fd = listing ? open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC) : -1;
+    struct stat dir_st;
+    if (fd < 0 || fstat(fd, &dir_st) != 0) {
+        atomic_fetch_add_explicit(&search->error_count, 1, memory_order_relaxed);
+        if (fd >= 0) {
+            close(fd);
+        }
+        if (listing) {
+            dir_listing_unref(listing);
+        }
+        g_free(path);
+        return;
+    }
+
+    // Collected locally, so the shared arrays are only locked once per directory
+    GArray *files = g_array_new(FALSE, FALSE, sizeof(dupfind_file_t));
+    GByteArray *names = g_byte_array_new();
+    guint count = dir_listing_get_count(listing);
+    for (guint i = 0; i < count && !g_atomic_int_get(&search->cancelled); i++) {
+        guint8 type = listing->types[i];
+        if (type != DT_REG && type != DT_DIR && type != DT_UNKNOWN) {
+            // Links, devices, sockets and pipes
+            continue;
+        }
+
+        const char *name = dir_listing_get_name(listing, i);
+        struct stat st;
+        if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+            atomic_fetch_add_explicit(&search->error_count, 1, memory_order_relaxed);
+            continue;
+        }
+        if (S_ISDIR(st.st_mode)) {
+            queue_task(search, dir_listing_get_path(listing, i), DUPFIND_STAGE_WALK);
+        } else if (S_ISREG(st.st_mode) && st.st_size >= DUPFIND_MIN_SIZE) {
+            dupfind_file_t file = { st.st_size, st.st_ino, 0, 0, names->len };
+            g_array_append_val(files, file);
+            g_byte_array_append(names, (const guint8*)name, strlen(name) + 1);
+        }
+    }
+    close(fd);
+    dir_listing_unref(listing);
+
+    if (files->len == 0) {
+        g_free(path);
+    } else {
+        dupfind_dir_t *dir = g_new(dupfind_dir_t, 1);
+        dir->path = path;
+        dir->device = dir_st.st_dev;
+
+        g_mutex_lock(&search->mutex);
+        guint32 dir_index = search->dirs->len;
+        guint32 name_base = search->names->len;
+        g_ptr_array_add(search->dirs, dir);
+        g_byte_array_append(search->names, names->data, names->len);
+        for (guint i = 0; i < files->len; i++) {
+            dupfind_file_t *file = &g_array_index(files, dupfind_file_t, i);
+            file->dir = dir_index;
+            file->name += name_base;
+        }
+        g_array_append_vals(search->files, files->data, files->len);
+        g_mutex_unlock(&search->mutex);
+        atomic_fetch_add_explicit(&search->file_count, files->len, memory_order_relaxed);
+    }
+    g_array_unref(files);
+    g_byte_array_unref(names);
+}
+
+/**
+ * Thread pool entry point, reads a directory or hashes files
+ */
+static void dupfind_worker(gpointer data, gpointer user_data) {
+    dupfind_task_t *task = data;
+    dupfind_t *search = task->search;
+
+    if (task->path) {
+        if (g_atomic_int_get(&search->cancelled)) {
+            g_free(task->path);
+        } else {
+            read_directory(search, task->path);
+        }
+    } else {
+        hash_files(search, task->stage);
+    }
+    g_free(task);
+
+    // Subdirectories were queued before this, so 0 means the stage is complete
+    g_mutex_lock(&search->mutex);
+    if (--search->pending == 0) {
+        g_cond_signal(&search->done_cond);
+    }
+    g_mutex_unlock(&search->mutex);
+}
+
+/**
+ * Waits on the search thread until every task of the current stage is done
+ */
+static void wait_for_tasks(dupfind_t *search) {
+    g_mutex_lock(&search->mutex);
+    while (search->pending > 0) {
+        g_cond_wait(&search->done_cond, &search->mutex);
+    }
+    g_mutex_unlock(&search->mutex);
+}
+
+static gint compare_files(gconstpointer a, gconstpointer b, gpointer user_data) {
+    const dupfind_file_t *file_a = a;
+    const dupfind_file_t *file_b = b;
+    GPtrArray *dirs = user_data;
+
+    if (file_a->size != file_b->size) {
+        return file_a->size < file_b->size ? -1 : 1;
+    }
+    if (file_a->hash != file_b->hash) {
+        return file_a->hash < file_b->hash ? -1 : 1;
+    }
+    dev_t device_a = ((dupfind_dir_t*)dirs->pdata[file_a->dir])->device;
+    dev_t device_b = ((dupfind_dir_t*)dirs->pdata[file_b->dir])->device;
+    if (device_a != device_b) {
+        return device_a < device_b ? -1 : 1;
+    }
+    return file_a->inode < file_b->inode ? -1 : file_a->inode > file_b->inode;
+}
+
+/**
+ * Checks whether two sorted files are hard links to the same inode
+ */
+static gboolean same_inode(dupfind_t *search, const dupfind_file_t *a, const dupfind_file_t *b) {
+    return a->inode == b->inode &&
+           ((dupfind_dir_t*)search->dirs->pdata[a->dir])->device == ((dupfind_dir_t*)search->dirs->pdata[b->dir])->device;
+}
+
+/**
+ * Keeps the files sharing their size and hash with another inode, in runs of equal size and hash
+ * Files that could not be read and repeated hard links are dropped, and the names are compacted
+ */
+static void keep_duplicates(dupfind_t *search) {
+    g_array_sort_with_data(search->files, compare_files, search->dirs);
+
+    dupfind_file_t *files = (dupfind_file_t*)search->files->data;
+    guint count = search->files->len;
+    GByteArray *names = g_byte_array_new();
+    guint kept = 0;
+
+    guint start = 0;
+    while (start < count) {
+        // One file per inode of the run
+        guint end = start + 1;
+        guint inodes = 1;
+        for (; end < count && files[end].size == files[start].size && files[end].hash == files[start].hash; end++) {
+            inodes += !same_inode(search, &files[end - 1], &files[end]);
+        }
+
+        if (files[start].size > 0 && inodes > 1) {
+            for (guint i = start; i < end; i++) {
+                if (i > start && same_inode(search, &files[i - 1], &files[i])) {
+                    continue;
+                }
+                const char *name = (const char*)search->names->data + files[i].name;
+                files[kept] = files[i];
+                files[kept].name = names->len;
+                g_byte_array_append(names, (const guint8*)name, strlen(name) + 1);
+                kept++;
+            }
+        }
+        start = end;
+    }
+
+    g_array_set_size(search->files, kept);
+    g_byte_array_unref(search->names);
+    search->names = names;
+}
+
+/**
+ * Runs a hash stage on one worker per thread of the pool and keeps the files whose hash matches another
+ */
+static void run_hash_stage(dupfind_t *search, dupfind_stage_t stage) {
+    guint64 candidates = 0;
+    guint64 bytes = 0;
+    for (guint i = 0; i < search->files->len; i++) {
+        guint64 size = g_array_index(search->files, dupfind_file_t, i).size;
+        if (stage == DUPFIND_STAGE_EDGES) {
+            candidates++;
+            bytes += MIN(size, 2 * DUPFIND_EDGE_SIZE);
+        } else if (size > 2 * DUPFIND_EDGE_SIZE) {
+            candidates++;
+            bytes += size;
+        }
+    }
+
+    atomic_store(&search->candidate_count, candidates);
+    atomic_store(&search->hashed_count, 0);
+    atomic_store(&search->bytes_to_hash, bytes);
+    atomic_store(&search->bytes_hashed, 0);
+    atomic_store(&search->next_file, 0);
+    g_atomic_int_set(&search->stage, stage);
+
+    if (candidates > 0) {
+        guint workers = MIN(candidates, (guint64)g_thread_pool_get_max_threads(dupfind_pool));
+        for (guint i = 0; i < workers; i++) {
+            queue_task(search, NULL, stage);
+        }
+        wait_for_tasks(search);
+    }
+    keep_duplicates(search);
+}
+
+static int compare_paths(const void *a, const void *b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+static gint compare_groups(gconstpointer a, gconstpointer b) {
+    const dupfind_group_t *group_a = *(dupfind_group_t* const*)a;
+    const dupfind_group_t *group_b = *(dupfind_group_t* const*)b;
+    guint64 wasted_a = group_a->size * (group_a->count - 1);
+    guint64 wasted_b = group_b->size * (group_b->count - 1);
+    return wasted_a < wasted_b ? 1 : wasted_a > wasted_b ? -1 : 0;
+}
+
+static void free_group(gpointer data) {
+    dupfind_group_t *group = data;
+    g_strfreev(group->paths);
+    g_free(group);
+}
+
+static void free_dir(gpointer data) {
+    dupfind_dir_t *dir = data;
+    g_free(dir->path);
+    g_free(dir);
+}
+
+/**
+ * Turns the runs of equal size and hash left by the last stage into groups and frees the records
+ */
+static void build_groups(dupfind_t *search) {
+    dupfind_file_t *files = (dupfind_file_t*)search->files->data;
+    guint count = search->files->len;
+
+    guint start = 0;
+    while (start < count) {
+        guint end = start + 1;
+        while (end < count && files[end].size == files[start].size && files[end].hash == files[start].hash) {
+            end++;
+        }
+
+        dupfind_group_t *group = g_new(dupfind_group_t, 1);
+        group->size = files[start].size;
+        group->count = end - start;
+        group->paths = g_new(char*, group->count + 1);
+        for (guint i = start; i < end; i++) {
+            group->paths[i - start] = get_file_path(search, &files[i]);
+        }
+        group->paths[group->count] = NULL;
+        qsort(group->paths, group->count, sizeof(char*), compare_paths);
+        g_ptr_array_add(search->groups, group);
+        start = end;
+    }
+    g_ptr_array_sort(search->groups, compare_groups);
+
+    g_array_set_size(search->files, 0);
+    g_ptr_array_set_size(search->dirs, 0);
+    g_byte_array_set_size(search->names, 0);
+}
+
+/**
+ * Runs the stages of a search, stops early when it is cancelled
+ */
+static void search_duplicates(dupfind_t *search) {
+    queue_task(search, g_strdup(search->root), DUPFIND_STAGE_WALK);
+    wait_for_tasks(search);
+    if (g_atomic_int_get(&search->cancelled)) {
+        return;
+    }
+    keep_duplicates(search);
+
+    run_hash_stage(search, DUPFIND_STAGE_EDGES);
+    if (g_atomic_int_get(&search->cancelled)) {
+        return;
+    }
+    run_hash_stage(search, DUPFIND_STAGE_CONTENTS);
+    if (g_atomic_int_get(&search->cancelled)) {
+        return;
+    }
+
+    build_groups(search);
+    g_atomic_int_set(&search->stage, DUPFIND_STAGE_DONE);
+}
+
+/**
+ * Entry point of the search thread, which holds its own reference
+ */
+static gpointer run_search(gpointer data) {
+    dupfind_t *search = data;
+    if (dupfind_pool) {
+        search_duplicates(search);
+    } else {
+        atomic_store(&search->error_count, 1);
+        g_atomic_int_set(&search->stage, DUPFIND_STAGE_DONE);
+    }
+    dupfind_unref(search);
+    return NULL;
+}
+
+/**
+ * Creates the shared thread pool on first use
+ */
+static void ensure_pool(void) {
+    static gsize initialized = 0;
+
+    if (g_once_init_enter(&initialized)) {
+        GError *error = NULL;
+        gint threads = MAX(DUPFIND_MIN_THREADS, (gint)g_get_num_processors());
+        dupfind_pool = g_thread_pool_new(dupfind_worker, NULL, threads, FALSE, &error);
+        if (error) {
+            g_warning("Failed to create duplicate search thread pool: %s", error->message);
+            g_error_free(error);
+        }
+        g_once_init_leave(&initialized, 1);
+    }
+}
+
+dupfind_t* dupfind_start(const char *root, gboolean show_hidden) {
+    ensure_pool();
+
+    dupfind_t *search = g_new0(dupfind_t, 1);
+    search->ref_count = 2; // The caller and the search thread
+    search->stage = DUPFIND_STAGE_WALK;
+    search->show_hidden = show_hidden;
+    search->root = g_strdup(root);
+    g_mutex_init(&search->mutex);
+    g_cond_init(&search->done_cond);
+    search->dirs = g_ptr_array_new_with_free_func(free_dir);
+    search->names = g_byte_array_new();
+    search->files = g_array_new(FALSE, FALSE, sizeof(dupfind_file_t));
+    search->groups = g_ptr_array_new_with_free_func(free_group);
+
+    g_thread_unref(g_thread_new("dupfind", run_search, search));
+    return search;
+}
+
+void dupfind_get_progress(dupfind_t *search, dupfind_progress_t *progress) {
+    // Read the stage first, so the counts are at least as recent as it
+    progress->stage = g_atomic_int_get(&search->stage);
+    progress->file_count = atomic_load(&search->file_count);
+    progress->candidate_count = atomic_load(&search->candidate_count);
+    progress->hashed_count = atomic_load(&search->hashed_count);
+    progress->bytes_to_hash = atomic_load(&search->bytes_to_hash);
+    progress->bytes_hashed = atomic_load(&search->bytes_hashed);
+    progress->error_count = atomic_load(&search->error_count);
+}
+
+GPtrArray* dupfind_get_groups(dupfind_t *search) {
+    g_return_val_if_fail(g_atomic_int_get(&search->stage) == DUPFIND_STAGE_DONE, NULL);
+    return search->groups;
+}
+
+void dupfind_cancel(dupfind_t *search) {
+    g_atomic_int_set(&search->cancelled, TRUE);
+}
+
+void dupfind_unref(dupfind_t *search) {
+    if (!g_atomic_int_dec_and_test(&search->ref_count)) {
+        return;
+    }
+
+    g_ptr_array_unref(search->groups);
+    g_array_unref(search->files);
+    g_byte_array_unref(search->names);
+    g_ptr_array_unref(search->dirs);
+    g_cond_clear(&search->done_cond);
+    g_mutex_clear(&search->mutex);
+    g_free(search->root);
+    g_free(search);
+}
+
+void dupfind_cancel_and_unref(dupfind_t *search) {
+    dupfind_cancel(search);
+    dupfind_unref(search);
+}
+
+/**
+ * Sets error from errno for an operation on a path
+ */
+static void set_errno_error(GError **error, const char *action, const char *path) {
+    int saved_errno = errno;
+    g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(saved_errno), "Could not %s %s: %s", action, path, g_strerror(saved_errno));
+}
+
+/**
+ * Compares the contents of two open files of the same size
+ */
+static gboolean same_contents(int fd_a, int fd_b, guint64 size, const char *path_b, GError **error) {
+    guint8 *buffer_a = g_malloc(DUPFIND_COMPARE_SIZE);
+    guint8 *buffer_b = g_malloc(DUPFIND_COMPARE_SIZE);
+    gboolean same = TRUE;
+
+    for (guint64 offset = 0; offset < size && same; offset += DUPFIND_COMPARE_SIZE) {
+        gsize length = MIN(size - offset, DUPFIND_COMPARE_SIZE);
+        if (read_full(fd_a, buffer_a, length, offset) != (gssize)length ||
+            read_full(fd_b, buffer_b, length, offset) != (gssize)length ||
+            memcmp(buffer_a, buffer_b, length) != 0) {
+            g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_FAILED, "%s changed since the search", path_b);
+            same = FALSE;
+        }
+    }
+
+    g_free(buffer_a);
+    g_free(buffer_b);
+    return same;
+}
+
+/**
+ * Creates the link to the original next to the duplicate
+ * @param duplicate_st Stat of the duplicate, a reflink gets its permissions
+ * @return The temporary path of the link, NULL on error
+ */
+static char* create_link(const char *original, int original_fd, const char *duplicate, const struct stat *duplicate_st,
+                         dupfind_link_mode_t mode, GError **error) {
+    if (mode == DUPFIND_LINK_REFLINK) {
+        char *temp = g_strdup_printf("%s.XXXXXX", duplicate);
+        int fd = g_mkstemp_full(temp, O_WRONLY | O_CLOEXEC, duplicate_st->st_mode & 07777);
+        if (fd < 0) {
+            set_errno_error(error, "create a file next to", duplicate);
+            g_free(temp);
+            return NULL;
+        }
+        gboolean cloned = ioctl(fd, FICLONE, original_fd) == 0;
+        if (!cloned) {
+            set_errno_error(error, "reflink", original);
+        } else if (fchown(fd, duplicate_st->st_uid, duplicate_st->st_gid) != 0 && errno != EPERM) {
+            // Other users' files can only be given away by root, the copy stays usable either way
+            g_warning("Could not keep the owner of %s: %s", duplicate, g_strerror(errno));
+        }
+        close(fd);
+        if (!cloned) {
+            unlink(temp);
+            g_free(temp);
+            return NULL;
+        }
+        return temp;
+    }
+
+    for (guint attempt = 0; attempt < DUPFIND_LINK_ATTEMPTS; attempt++) {
+        char *temp = g_strdup_printf("%s.%08x", duplicate, g_random_int());
+        if (link(original, temp) == 0) {
+            return temp;
+        }
+        g_free(temp);
+        if (errno != EEXIST) {
+            set_errno_error(error, "hard link", original);
+            return NULL;
+        }
+    }
+    g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_EXIST, "Could not find a free name next to %s", duplicate);
+    return NULL;
+}
+
+gboolean dupfind_link(const char *original, const char *duplicate, dupfind_link_mode_t mode, GError **error) {
+    int original_fd = open(original, O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+    if (original_fd < 0) {
+        set_errno_error(error, "open", original);
+        return FALSE;
+    }
+    int duplicate_fd = open(duplicate, O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+    if (duplicate_fd < 0) {
+        set_errno_error(error, "open", duplicate);
+        close(original_fd);
+        return FALSE;
+    }
+
+    gboolean linked = FALSE;
+    struct stat original_st, duplicate_st;
+    if (fstat(original_fd, &original_st) != 0 || fstat(duplicate_fd, &duplicate_st) != 0) {
+        set_errno_error(error, "read the metadata of", duplicate);
+    } else if (!S_ISREG(original_st.st_mode) || !S_ISREG(duplicate_st.st_mode)) {
+        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "%s is not a regular file", duplicate);
+    } else if (original_st.st_dev == duplicate_st.st_dev && original_st.st_ino == duplicate_st.st_ino) {
+        // Already the same file
+        linked = TRUE;
+    } else if (original_st.st_size != duplicate_st.st_size) {
+        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_FAILED, "%s changed since the search", duplicate);
+    } else if (same_contents(original_fd, duplicate_fd, original_st.st_size, duplicate, error)) {
+        char *temp = create_link(original, original_fd, duplicate, &duplicate_st, mode, error);
+        if (temp && rename(temp, duplicate) != 0) {
+            set_errno_error(error, "replace", duplicate);
+            unlink(temp);
+        } else if (temp) {
+            linked = TRUE;
+        }
+        g_free(temp);
+    }
+
+    close(duplicate_fd);
+    close(original_fd);
+    return linked;
+}
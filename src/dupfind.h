@@ -0,0 +1,130 @@
+#ifndef DUPFIND_H
+#define DUPFIND_H
+
+#include <glib.h>
+
+/**
+ * Parallel search for files with identical contents under a directory
+ *
+ * The search runs in stages, each one only looking at what the previous one
+ * could not rule out:
+ *
+ *   1. The subtree is walked on a shared thread pool, one task per directory,
+ *      and every regular file of at least DUPFIND_MIN_SIZE bytes is recorded.
+ *      Files whose size is unique are dropped.
+ *   2. The first and last DUPFIND_EDGE_SIZE bytes of the remaining files are
+ *      hashed. Files no larger than twice that are fully hashed here already.
+ *   3. The files still sharing a size and an edge hash are hashed completely,
+ *      with DUPFIND_READ_SIZE reads, by one worker per core.
+ *
+ * Hashes are 64-bit XXH3 when built with libxxhash (HAVE_XXHASH), and a
+ * built-in 64-bit multiply-rotate hash otherwise. Neither is cryptographic,
+ * so dupfind_link() compares the contents byte by byte before it replaces
+ * anything.
+ *
+ * A file costs a fixed-size record plus its name during the walk. The names
+ * are stored once per directory in a shared arena, not as full paths. Only
+ * the candidates are kept after the first stage, so memory follows the number
+ * of files that share a size, not the size of the tree. Paths are only built
+ * for the files of the final groups. Hard links to the same inode are
+ * counted once, since they do not use any extra space.
+ *
+ * Progress can be read from any thread while the search runs. Symbolic links
+ * are neither followed nor reported.
+ */
+
+#define DUPFIND_MIN_SIZE 1 // Smaller files are ignored, all empty files are identical but free
+#define DUPFIND_EDGE_SIZE 4096 // Bytes hashed at the start and at the end of every candidate in stage 2
+#define DUPFIND_READ_SIZE (1024 * 1024) // Read size of the full hash, one buffer per worker
+#define DUPFIND_MIN_THREADS 4 // Walks and small reads mostly wait on I/O, so use at least this many threads
+
+typedef enum {
+    DUPFIND_STAGE_WALK, // Listing the files
+    DUPFIND_STAGE_EDGES, // Hashing the start and the end of the candidates
+    DUPFIND_STAGE_CONTENTS, // Hashing the full contents of the remaining candidates
+    DUPFIND_STAGE_DONE
+} dupfind_stage_t;
+
+/**
+ * Progress of a search, as returned by dupfind_get_progress()
+ */
+typedef struct {
+    dupfind_stage_t stage;
+    guint64 file_count; // Files recorded by the walk
+    guint64 candidate_count; // Files hashed by the current stage
+    guint64 hashed_count; // Files of the current stage hashed so far
+    guint64 bytes_to_hash; // Bytes the current stage reads
+    guint64 bytes_hashed; // Bytes the current stage read so far
+    guint64 error_count; // Directories and files that could not be read
+} dupfind_progress_t;
+
+/**
+ * Files with identical contents
+ */
+typedef struct {
+    guint64 size; // Size of every file of the group
+    char **paths; // NULL terminated, sorted
+    guint count; // Number of paths, at least 2
+} dupfind_group_t;
+
+typedef enum {
+    DUPFIND_LINK_HARD, // Replace the duplicate with a hard link to the original
+    DUPFIND_LINK_REFLINK // Replace the duplicate with a copy sharing the original's blocks (FICLONE)
+} dupfind_link_mode_t;
+
+typedef struct dupfind dupfind_t;
+
+/**
+ * Starts searching a directory for duplicates in the background
+ * @param root The directory
+ * @param show_hidden Whether to include entries starting with a dot, hidden directories are not entered otherwise
+ * @return New search, free with dupfind_cancel_and_unref()
+ */
+dupfind_t* dupfind_start(const char *root, gboolean show_hidden);
+
+/**
+ * Reads the progress of a search, can be called from any thread
+ * @param search The search
+ * @param progress Filled with the progress
+ */
+void dupfind_get_progress(dupfind_t *search, dupfind_progress_t *progress);
+
+/**
+ * Gets the duplicates found by a search
+ * @param search The search, its stage must be DUPFIND_STAGE_DONE
+ * @return dupfind_group_t ordered by wasted space, largest first, owned by the search
+ */
+GPtrArray* dupfind_get_groups(dupfind_t *search);
+
+/**
+ * Stops a search as soon as possible, its stage never reaches DUPFIND_STAGE_DONE
+ * @param search The search
+ */
+void dupfind_cancel(dupfind_t *search);
+
+/**
+ * Releases a search, the background work holds its own reference until it stops
+ * @param search The search
+ */
+void dupfind_unref(dupfind_t *search);
+
+/**
+ * Cancels and releases a search, usable as a GDestroyNotify
+ * @param search The search
+ */
+void dupfind_cancel_and_unref(dupfind_t *search);
+
+/**
+ * Replaces a file with a link to another file with the same contents
+ * The contents are compared first. The link is created next to the duplicate
+ * and renamed over it, so the duplicate is never missing. A reflink keeps the
+ * permissions of the duplicate. Blocks, call from a worker thread.
+ * @param original File to keep
+ * @param duplicate File to replace
+ * @param mode Kind of link
+ * @param error Set on failure, e.g. when the files differ or are on different file systems
+ * @return TRUE if the duplicate was replaced
+ */
+gboolean dupfind_link(const char *original, const char *duplicate, dupfind_link_mode_t mode, GError **error);
+
+#endif //DUPFIND_H
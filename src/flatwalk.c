@@ -0,0 +1,249 @@
+#define _GNU_SOURCE // statx()
+#include "flatwalk.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define FLATWALK_STAT_MASK (STATX_TYPE | STATX_MODE | STATX_SIZE | STATX_MTIME)
+
+struct flatwalk {
+    gint ref_count;
+    gint cancelled;
+    gint pending; // Directories queued or being read, the walk is finished when it drops to 0
+    gint finished;
+    gint notify_pending; // A batch is scheduled
+    gboolean reported_finished; // Main thread only
+    gboolean show_hidden;
+    _Atomic guint64 dir_count;
+
+    GMutex ready_mutex;
+    GPtrArray *ready; // dir_listing_t read since the last batch, guarded by ready_mutex
+
+    flatwalk_batch_func func;
+    gpointer user_data;
+};
+
+/**
+ * A directory waiting to be read
+ */
+typedef struct {
+    flatwalk_t *walk;
+    char *path;
+} flatwalk_task_t;
+
+static GThreadPool *flatwalk_pool = NULL;
+
+/**
+ * Hands the listings read so far to the main thread, scheduled by schedule_batch()
+ */
+static gboolean deliver_batch(gpointer data) {
+    flatwalk_t *walk = data;
+
+    // Cleared before reading finished, so a walk finishing right now schedules another batch
+    g_atomic_int_set(&walk->notify_pending, FALSE);
+    gboolean finished = g_atomic_int_get(&walk->finished);
+
+    if (g_atomic_int_get(&walk->cancelled) || walk->reported_finished) {
+        return G_SOURCE_REMOVE;
+    }
+
+    g_mutex_lock(&walk->ready_mutex);
+    GPtrArray *listings = walk->ready;
+    walk->ready = g_ptr_array_new_with_free_func((GDestroyNotify)dir_listing_unref);
+    g_mutex_unlock(&walk->ready_mutex);
+
+    walk->reported_finished = finished;
+    if (listings->len > 0 || finished) {
+        walk->func(listings, finished, walk->user_data);
+    }
+    g_ptr_array_unref(listings);
+    return G_SOURCE_REMOVE;
+}
+
+/**
+ * Schedules a batch unless one is already pending, can be called from any thread
+ */
+static void schedule_batch(flatwalk_t *walk) {
+    if (g_atomic_int_get(&walk->cancelled) ||
+        !g_atomic_int_compare_and_exchange(&walk->notify_pending, FALSE, TRUE)) {
+        return;
+    }
+
+    // The end of the walk is reported right away, batches at most once per interval
+    guint interval = g_atomic_int_get(&walk->finished) ? 0 : FLATWALK_BATCH_INTERVAL_MS;
+    g_atomic_int_inc(&walk->ref_count);
+    g_timeout_add_full(G_PRIORITY_DEFAULT, interval, deliver_batch, walk, (GDestroyNotify)flatwalk_unref);
+}
+
+/**
+ * Queues a directory of the walk, the task holds a reference to the walk
+ * @param path Path of the directory, ownership is taken
+ */
+static void queue_directory(flatwalk_t *walk, char *path) {
+    flatwalk_task_t *task = g_new(flatwalk_task_t, 1);
+    task->walk = walk;
+    task->path = path;
+
+    g_atomic_int_inc(&walk->ref_count);
+    g_atomic_int_inc(&walk->pending);
+    g_thread_pool_push(flatwalk_pool, task, NULL);
+}
+
+/**
+ * Checks whether an entry is a directory to walk into, without following links
+ */
+static gboolean is_subdirectory(int dir_fd, dir_listing_t *listing, guint index, const struct statx *stx, gboolean stat_valid) {
+    switch (listing->types[index]) {
+        case DT_DIR:
+            return TRUE;
+        case DT_UNKNOWN: {
+            // The followed stat already rules out everything that is not a directory or a link to one
+            if (!stat_valid || !S_ISDIR(stx->stx_mode)) {
+                return FALSE;
+            }
+            struct stat st;
+            return fstatat(dir_fd, dir_listing_get_name(listing, index), &st, AT_SYMLINK_NOFOLLOW) == 0 &&
+                   S_ISDIR(st.st_mode);
+        }
+        default:
+            return FALSE;
+    }
+}
+
+/**
+ * Reads one directory with the metadata of its entries and queues its subdirectories
+ */
+static void read_directory(flatwalk_t *walk, const char *path) {
+    dir_listing_t *listing = dir_listing_read(path, walk->show_hidden, NULL);
+    atomic_fetch_add_explicit(&walk->dir_count, 1, memory_order_relaxed);
+    if (!listing) {
+        return;
+    }
+
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    // Nobody else sees the listing yet, so its metadata can be written from this thread
+    dir_listing_alloc_stats(listing);
+    dir_listing_claim_stats(listing);
+
+    guint count = dir_listing_get_count(listing);
+    for (guint i = 0; i < count; i++) {
+        if (g_atomic_int_get(&walk->cancelled)) {
+            break;
+        }
+
+        // Links are followed like statbatch does, so a link shows the size and date of its target
+        struct statx stx;
+        gboolean stat_valid = fd >= 0 &&
+                              statx(fd, dir_listing_get_name(listing, i), AT_STATX_SYNC_AS_STAT, FLATWALK_STAT_MASK, &stx) == 0;
+        if (stat_valid) {
+            gint64 mtime = (gint64)stx.stx_mtime.tv_sec * G_GINT64_CONSTANT(1000000000) + stx.stx_mtime.tv_nsec;
+            dir_listing_set_stat(listing, i, stx.stx_size, mtime, stx.stx_mode);
+        } else {
+            dir_listing_set_stat_failed(listing, i);
+        }
+
+        if (fd >= 0 && is_subdirectory(fd, listing, i, &stx, stat_valid)) {
+            queue_directory(walk, dir_listing_get_path(listing, i));
+        }
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+
+    if (count == 0 || g_atomic_int_get(&walk->cancelled)) {
+        dir_listing_unref(listing);
+        return;
+    }
+
+    g_mutex_lock(&walk->ready_mutex);
+    g_ptr_array_add(walk->ready, listing);
+    g_mutex_unlock(&walk->ready_mutex);
+    schedule_batch(walk);
+}
+
+/**
+ * Thread pool entry point, handles one directory
+ */
+static void flatwalk_worker(gpointer data, gpointer user_data) {
+    flatwalk_task_t *task = data;
+    flatwalk_t *walk = task->walk;
+
+    if (!g_atomic_int_get(&walk->cancelled)) {
+        read_directory(walk, task->path);
+    }
+
+    // Subdirectories were queued before this, so 0 means the whole subtree was read
+    if (g_atomic_int_dec_and_test(&walk->pending)) {
+        g_atomic_int_set(&walk->finished, TRUE);
+        schedule_batch(walk);
+    }
+
+    flatwalk_unref(walk);
+    g_free(task->path);
+    g_free(task);
+}
+
+/**
+ * Creates the shared thread pool on first use
+ */
+static void ensure_pool(void) {
+    static gsize initialized = 0;
+
+    if (g_once_init_enter(&initialized)) {
+        GError *error = NULL;
+        gint threads = MAX(FLATWALK_MIN_THREADS, (gint)g_get_num_processors());
+        flatwalk_pool = g_thread_pool_new(flatwalk_worker, NULL, threads, FALSE, &error);
+        if (error) {
+            g_warning("Failed to create flatten thread pool: %s", error->message);
+            g_error_free(error);
+        }
+        g_once_init_leave(&initialized, 1);
+    }
+}
+
+flatwalk_t* flatwalk_start(const char *root, gboolean show_hidden, flatwalk_batch_func func, gpointer user_data) {
+    ensure_pool();
+
+    flatwalk_t *walk = g_new0(flatwalk_t, 1);
+    walk->ref_count = 1;
+    walk->show_hidden = show_hidden;
+    walk->func = func;
+    walk->user_data = user_data;
+    g_mutex_init(&walk->ready_mutex);
+    walk->ready = g_ptr_array_new_with_free_func((GDestroyNotify)dir_listing_unref);
+
+    if (!flatwalk_pool) {
+        // Nothing can be read, report an empty walk
+        walk->finished = TRUE;
+        schedule_batch(walk);
+        return walk;
+    }
+
+    queue_directory(walk, g_strdup(root));
+    return walk;
+}
+
+guint64 flatwalk_get_dir_count(flatwalk_t *walk) {
+    return atomic_load(&walk->dir_count);
+}
+
+void flatwalk_cancel(flatwalk_t *walk) {
+    g_atomic_int_set(&walk->cancelled, TRUE);
+}
+
+void flatwalk_unref(flatwalk_t *walk) {
+    if (!g_atomic_int_dec_and_test(&walk->ref_count)) {
+        return;
+    }
+
+    g_ptr_array_unref(walk->ready);
+    g_mutex_clear(&walk->ready_mutex);
+    g_free(walk);
+}
+
+void flatwalk_cancel_and_unref(flatwalk_t *walk) {
+    flatwalk_cancel(walk);
+    flatwalk_unref(walk);
+}
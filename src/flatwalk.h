@@ -0,0 +1,75 @@
+#ifndef FLATWALK_H
+#define FLATWALK_H
+
+#include <glib.h>
+#include "direnum.h"
+
+/**
+ * Parallel walk of a subtree for the flattened view
+ *
+ * Every directory of the subtree is read with dir_listing_read() on a shared
+ * thread pool, one task per directory, and the metadata of its entries is
+ * fetched by the same task with statx() relative to the directory, so the
+ * listings are handed over complete and the view can be sorted by size or date
+ * right away.
+ *
+ * Names stay in the arena of their directory's listing and each listing only
+ * keeps the path of its directory, so a file costs its name plus a few bytes of
+ * per-entry arrays, not a full path string.
+ *
+ * Listings are handed to the main thread in batches, at most one per
+ * FLATWALK_BATCH_INTERVAL_MS, so a large tree streams into the view with few
+ * model updates. Symbolic links to directories are not followed.
+ */
+
+#define FLATWALK_MIN_THREADS 4 // Directory reads mostly wait on I/O, so use at least this many threads
+#define FLATWALK_BATCH_INTERVAL_MS 100 // Minimum time between two batches handed to the main thread
+
+typedef struct flatwalk flatwalk_t;
+
+/**
+ * Called on the main thread with the directories read since the last call
+ * @param listings dir_listing_t of every directory read, owned by the walk
+ * @param finished TRUE for the last call, once every directory was read
+ * @param user_data Data passed to flatwalk_start()
+ */
+typedef void (*flatwalk_batch_func)(GPtrArray *listings, gboolean finished, gpointer user_data);
+
+/**
+ * Starts walking a subtree in the background
+ * Must be called from the main thread
+ * @param root Root directory of the walk, its own listing is part of the first batches
+ * @param show_hidden Whether to keep entries starting with a dot, hidden directories are not entered otherwise
+ * @param func Called on the main thread as directories are read
+ * @param user_data Data passed to func
+ * @return New walk, free with flatwalk_cancel_and_unref()
+ */
+flatwalk_t* flatwalk_start(const char *root, gboolean show_hidden, flatwalk_batch_func func, gpointer user_data);
+
+/**
+ * Gets the number of directories read so far, can be called from any thread
+ * @param walk The walk
+ * @return Directories read, including the ones that could not be
+ */
+guint64 flatwalk_get_dir_count(flatwalk_t *walk);
+
+/**
+ * Stops a walk as soon as possible, func is not called anymore once this returns
+ * Must be called from the main thread
+ * @param walk The walk
+ */
+void flatwalk_cancel(flatwalk_t *walk);
+
+/**
+ * Releases a walk, the background work holds its own reference until it stops
+ * @param walk The walk
+ */
+void flatwalk_unref(flatwalk_t *walk);
+
+/**
+ * Cancels and releases a walk, usable as a GDestroyNotify
+ * @param walk The walk
+ */
+void flatwalk_cancel_and_unref(flatwalk_t *walk);
+
+#endif //FLATWALK_H
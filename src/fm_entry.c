@@ -0,0 +1,164 @@
+#include "fm_entry.h"
+#include <dirent.h>
+#include <string.h>
+#include <sys/stat.h>
+
+struct _FmEntry {
+    GObject parent_instance;
+
+    dir_listing_t *listing;
+    guint index;
+    GFile *file; // Created by fm_entry_get_file()
+    fm_entry_sort_cache_t sort_cache; // Filled by fm_sort_compare()
+};
+
+G_DEFINE_FINAL_TYPE(FmEntry, fm_entry, G_TYPE_OBJECT)
+
+static gint live_entries = 0; // Atomic, entries created and not finalized yet
+
+static void fm_entry_finalize(GObject *object) {
+    FmEntry *entry = FM_ENTRY(object);
+    g_atomic_int_add(&live_entries, -1);
+
+    g_clear_object(&entry->file);
+    g_clear_pointer(&entry->listing, dir_listing_unref);
+
+    G_OBJECT_CLASS(fm_entry_parent_class)->finalize(object);
+}
+
+static void fm_entry_class_init(FmEntryClass *klass) {
+    G_OBJECT_CLASS(klass)->finalize = fm_entry_finalize;
+}
+
+static void fm_entry_init(FmEntry *entry) {
+    g_atomic_int_inc(&live_entries);
+}
+
+FmEntry* fm_entry_new(dir_listing_t *listing, guint index) {
+    FmEntry *entry = g_object_new(FM_TYPE_ENTRY, NULL);
+    entry->listing = dir_listing_ref(listing);
+    entry->index = index;
+    return entry;
+}
+
+void fm_entry_append_listing(GListStore *store, dir_listing_t *listing) {
+    guint count = dir_listing_get_count(listing);
+    gpointer *entries = g_new(gpointer, count);
+
+    for (guint i = 0; i < count; i++) {
+        entries[i] = fm_entry_new(listing, i);
+    }
+
+    // One items-changed signal for the whole directory instead of one per entry
+    guint n_items = g_list_model_get_n_items(G_LIST_MODEL(store));
+    g_list_store_splice(store, n_items, 0, entries, count);
+
+    for (guint i = 0; i < count; i++) {
+        g_object_unref(entries[i]);
+    }
+    g_free(entries);
+}
+
+guint fm_entry_append_files(GListStore *store, GPtrArray *listings) {
+    GPtrArray *entries = g_ptr_array_new_with_free_func(g_object_unref);
+
+    for (guint i = 0; i < listings->len; i++) {
+        dir_listing_t *listing = g_ptr_array_index(listings, i);
+        guint count = dir_listing_get_count(listing);
+        for (guint j = 0; j < count; j++) {
+            FmEntry *entry = fm_entry_new(listing, j);
+            if (fm_entry_is_directory(entry)) {
+                g_object_unref(entry);
+            } else {
+                g_ptr_array_add(entries, entry);
+            }
+        }
+    }
+
+    guint n_items = g_list_model_get_n_items(G_LIST_MODEL(store));
+    g_list_store_splice(store, n_items, 0, entries->pdata, entries->len);
+
+    guint added = entries->len;
+    g_ptr_array_unref(entries);
+    return added;
+}
+
+GListStore* fm_entry_filter_store(GListModel *entries, const char *filter) {
+    GListStore *filtered = g_list_store_new(FM_TYPE_ENTRY);
+    guint n_items = g_list_model_get_n_items(entries);
+
+    for (guint i = 0; i < n_items; i++) {
+        FmEntry *entry = g_list_model_get_item(entries, i);
+        if (!filter || *filter == '\0' || g_strrstr(fm_entry_get_name(entry), filter)) {
+            g_list_store_append(filtered, entry);
+        }
+        g_object_unref(entry);
+    }
+    return filtered;
+}
+
+const char* fm_entry_get_name(FmEntry *entry) {
+    return dir_listing_get_name(entry->listing, entry->index);
+}
+
+const char* fm_entry_get_extension(FmEntry *entry) {
+    const char *name = fm_entry_get_name(entry);
+    const char *dot = strrchr(name + 1, '.');
+    return dot ? dot + 1 : "";
+}
+
+guint fm_entry_get_live_count(void) {
+    return (guint)g_atomic_int_get(&live_entries);
+}
+
+GFile* fm_entry_get_file(FmEntry *entry) {
+    if (!entry->file) {
+        char *path = fm_entry_get_path(entry);
+        entry->file = g_file_new_for_path(path);
+        g_free(path);
+    }
+    return entry->file;
+}
+
+char* fm_entry_get_path(FmEntry *entry) {
+    return dir_listing_get_path(entry->listing, entry->index);
+}
+
+gboolean fm_entry_is_directory(FmEntry *entry) {
+    switch (entry->listing->types[entry->index]) {
+        case DT_DIR:
+            return TRUE;
+        case DT_UNKNOWN:
+        case DT_LNK: {
+            // Prefer what the metadata fetch already found over another stat()
+            guint32 mode;
+            if (fm_entry_get_stat(entry, NULL, NULL, &mode)) {
+                return S_ISDIR(mode);
+            }
+
+            char *path = fm_entry_get_path(entry);
+            struct stat st;
+            gboolean is_directory = stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+            g_free(path);
+            return is_directory;
+        }
+        default:
+            return FALSE;
+    }
+}
+
+gboolean fm_entry_get_stat(FmEntry *entry, guint64 *size, gint64 *mtime, guint32 *mode) {
+    return dir_listing_get_stat(entry->listing, entry->index, size, mtime, mode);
+}
+
+fm_entry_sort_cache_t* fm_entry_get_sort_cache(FmEntry *entry) {
+    return &entry->sort_cache;
+}
+
+dir_listing_t* fm_entry_get_listing(FmEntry *entry) {
+    return entry->listing;
+}
+
+guint fm_entry_get_index(FmEntry *entry) {
+    return entry->index;
+}
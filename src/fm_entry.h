@@ -0,0 +1,137 @@
+#ifndef FM_ENTRY_H
+#define FM_ENTRY_H
+
+#include <gio/gio.h>
+#include "direnum.h"
+
+/**
+ * An item of the file views
+ *
+ * An entry only points at its row in a shared dir_listing_t, so building the
+ * model of a directory costs one small object per entry. The GFile of an entry
+ * is only created when something asks for it, which in practice means the
+ * entries that get bound to a visible widget or activated.
+ */
+
+#define FM_ENTRY_SORT_WORDS 4 // Words of the sort key cached on an entry, at least FM_SORT_MAX_KEYS
+
+#define FM_TYPE_ENTRY (fm_entry_get_type())
+G_DECLARE_FINAL_TYPE(FmEntry, fm_entry, FM, ENTRY, GObject)
+
+/**
+ * The packed sort key cached on an entry by fm_sort_compare()
+ */
+typedef struct {
+    guint32 signature; // Sort the words were packed for, 0 while nothing is cached
+    guint32 generation; // Value of the key generation when they were packed
+    gboolean stat_known; // Whether the metadata of the entry was known then
+    guint64 words[FM_ENTRY_SORT_WORDS];
+} fm_entry_sort_cache_t;
+
+/**
+ * Creates an entry for a row of a listing
+ * @param listing The listing, a reference is taken
+ * @param index Index of the row
+ * @return New entry
+ */
+FmEntry* fm_entry_new(dir_listing_t *listing, guint index);
+
+/**
+ * Creates an entry for every row of a listing and appends them to a store with one splice
+ * @param store Store of FmEntry
+ * @param listing The listing
+ */
+void fm_entry_append_listing(GListStore *store, dir_listing_t *listing);
+
+/**
+ * Creates an entry for every file of some listings and appends them to a store with one splice
+ * Directories are skipped, the listings should have their metadata so links do not need another stat()
+ * @param store Store of FmEntry
+ * @param listings dir_listing_t to add
+ * @return Number of entries added
+ */
+guint fm_entry_append_files(GListStore *store, GPtrArray *listings);
+
+/**
+ * Keeps the entries whose name contains a string (case-sensitive)
+ * @param entries Model of FmEntry
+ * @param filter The string, NULL or empty keeps every entry
+ * @return New store of the matching entries, in the same order
+ */
+GListStore* fm_entry_filter_store(GListModel *entries, const char *filter);
+
+/**
+ * Gets the name of an entry
+ * @param entry The entry
+ * @return The name, owned by the listing
+ */
+const char* fm_entry_get_name(FmEntry *entry);
+
+/**
+ * Gets the extension of an entry's name, the part after its last dot
+ * A dot starting the name does not count, ".bashrc" has no extension
+ * @param entry The entry
+ * @return The extension without the dot, "" if there is none, owned by the listing
+ */
+const char* fm_entry_get_extension(FmEntry *entry);
+
+/**
+ * Gets the GFile of an entry, creating it on first use
+ * @param entry The entry
+ * @return The GFile, owned by the entry
+ */
+GFile* fm_entry_get_file(FmEntry *entry);
+
+/**
+ * Builds the full path of an entry
+ * @param entry The entry
+ * @return Newly allocated path
+ */
+char* fm_entry_get_path(FmEntry *entry);
+
+/**
+ * Checks whether an entry is a directory, following symbolic links
+ * Uses d_type when it is conclusive and stat() otherwise
+ * @param entry The entry
+ * @return TRUE for directories
+ */
+gboolean fm_entry_is_directory(FmEntry *entry);
+
+/**
+ * Gets the metadata fetched for an entry by statbatch_start()
+ * @param entry The entry
+ * @param size Filled with the size, may be NULL
+ * @param mtime Filled with the modification time in nanoseconds, may be NULL
+ * @param mode Filled with st_mode, may be NULL
+ * @return FALSE while the metadata is not known
+ */
+gboolean fm_entry_get_stat(FmEntry *entry, guint64 *size, gint64 *mtime, guint32 *mode);
+
+/**
+ * Gets the sort key cached on an entry, only used from the main thread
+ * @param entry The entry
+ * @return The cache, owned by the entry
+ */
+fm_entry_sort_cache_t* fm_entry_get_sort_cache(FmEntry *entry);
+
+/**
+ * Gets the listing an entry belongs to
+ * @param entry The entry
+ * @return The listing, owned by the entry
+ */
+dir_listing_t* fm_entry_get_listing(FmEntry *entry);
+
+/**
+ * Gets the row of an entry in its listing
+ * @param entry The entry
+ * @return Index of the row
+ */
+guint fm_entry_get_index(FmEntry *entry);
+
+/**
+ * Gets the number of entries alive in the process, leaked stores show up here
+ * @return Entries created and not finalized yet
+ */
+guint fm_entry_get_live_count(void);
+
+#endif //FM_ENTRY_H
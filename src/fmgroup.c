@@ -0,0 +1,479 @@
+#include "fmgroup.h"
+#include <string.h>
+
+struct _FmGroup {
+    GObject parent_instance;
+
+    char *label;
+    guint rank; // Groups are shown by rank, then by label
+    GListStore *entries;
+};
+
+G_DEFINE_FINAL_TYPE(FmGroup, fm_group, G_TYPE_OBJECT)
+
+static void fm_group_finalize(GObject *object) {
+    FmGroup *group = FM_GROUP(object);
+    g_free(group->label);
+    g_clear_object(&group->entries);
+    G_OBJECT_CLASS(fm_group_parent_class)->finalize(object);
+}
+
+static void fm_group_class_init(FmGroupClass *klass) {
+    G_OBJECT_CLASS(klass)->finalize = fm_group_finalize;
+}
+
+static void fm_group_init(FmGroup *group) {
+    group->entries = g_list_store_new(FM_TYPE_ENTRY);
+}
+
+const char* fm_group_get_label(FmGroup *group) {
+    return group->label;
+}
+
+GListModel* fm_group_get_entries(FmGroup *group) {
+    return G_LIST_MODEL(group->entries);
+}
+
+/**
+ * Kinds of the type grouping, in display order
+ */
+typedef enum {
+    KIND_FOLDERS,
+    KIND_DOCUMENTS,
+    KIND_IMAGES,
+    KIND_AUDIO,
+    KIND_VIDEO,
+    KIND_ARCHIVES,
+    KIND_OTHER
+} file_kind_t;
+
+static const char *kind_labels[] = { "Folders", "Documents", "Images", "Audio", "Video", "Archives", "Other" };
+
+/**
+ * Date buckets, in display order
+ */
+typedef enum {
+    BUCKET_TODAY,
+    BUCKET_YESTERDAY,
+    BUCKET_WEEK,
+    BUCKET_MONTH,
+    BUCKET_OLDER,
+    BUCKET_PENDING
+} date_bucket_t;
+
+static const char *bucket_labels[] = { "Today", "Yesterday", "Earlier this week", "Earlier this month", "Older",
+                                       FM_GROUP_PENDING_LABEL };
+
+struct fm_grouping {
+    fm_group_key_t key;
+    fm_sort_t sort;
+    gboolean sorted; // Whether sort is set
+    GListStore *groups; // FmGroup in display order
+    GHashTable *by_label; // Label -> FmGroup in groups
+    GHashTable *kinds; // Lowercase extension -> file_kind_t + 1, guessed once per extension
+    gint64 bucket_starts[BUCKET_OLDER]; // Unix time each bucket before BUCKET_OLDER starts at
+};
+
+gboolean fm_group_parse_key(const char *name, fm_group_key_t *key) {
+    if (g_strcmp0(name, "none") == 0) {
+        *key = FM_GROUP_NONE;
+    } else if (g_strcmp0(name, "type") == 0) {
+        *key = FM_GROUP_TYPE;
+    } else if (g_strcmp0(name, "extension") == 0) {
+        *key = FM_GROUP_EXTENSION;
+    } else if (g_strcmp0(name, "date") == 0) {
+        *key = FM_GROUP_DATE;
+    } else {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/**
+ * Classifies a content type guessed from a name
+ */
+static file_kind_t classify_content_type(const char *content_type) {
+    static const char *archives[] = { "application/zip", "application/x-tar", "application/gzip",
+                                      "application/x-7z-compressed", "application/x-xz", "application/x-bzip",
+                                      "application/x-rar", "application/zstd", "application/vnd.rar" };
+    static const char *documents[] = { "application/pdf", "application/msword", "application/vnd.oasis.opendocument",
+                                       "application/vnd.openxmlformats", "application/rtf", "application/json",
+                                       "application/xml", "application/x-shellscript" };
+
+    if (g_str_has_prefix(content_type, "image/")) return KIND_IMAGES;
+    if (g_str_has_prefix(content_type, "audio/")) return KIND_AUDIO;
+    if (g_str_has_prefix(content_type, "video/")) return KIND_VIDEO;
+    if (g_str_has_prefix(content_type, "text/")) return KIND_DOCUMENTS;
+    for (guint i = 0; i < G_N_ELEMENTS(archives); i++) {
+        if (g_str_has_prefix(content_type, archives[i])) return KIND_ARCHIVES;
+    }
+    for (guint i = 0; i < G_N_ELEMENTS(documents); i++) {
+        if (g_str_has_prefix(content_type, documents[i])) return KIND_DOCUMENTS;
+    }
+    return strstr(content_type, "compressed") ? KIND_ARCHIVES : KIND_OTHER;
+}
+
+/**
+ * Gets the kind of a file, guessing the content type once per extension
+ */
+static file_kind_t get_file_kind(fm_grouping_t *grouping, FmEntry *entry) {
+    char *extension = g_ascii_strdown(fm_entry_get_extension(entry), -1);
+    gpointer cached = g_hash_table_lookup(grouping->kinds, extension);
+    if (cached) {
+        g_free(extension);
+        return GPOINTER_TO_INT(cached) - 1;
+    }
+
+    char *content_type = g_content_type_guess(fm_entry_get_name(entry), NULL, 0, NULL);
+    file_kind_t kind = classify_content_type(content_type);
+    g_free(content_type);
+    g_hash_table_insert(grouping->kinds, extension, GINT_TO_POINTER(kind + 1));
+    return kind;
+}
+
+/**
+ * Gets the group an entry belongs to
+ * @param label Filled with the label of the group
+ * @return The rank of the group
+ */
+static guint get_entry_group(fm_grouping_t *grouping, FmEntry *entry, char label[FM_GROUP_LABEL_MAX]) {
+    switch (grouping->key) {
+        case FM_GROUP_EXTENSION: {
+            const char *extension = fm_entry_get_extension(entry);
+            if (fm_entry_is_directory(entry)) {
+                g_strlcpy(label, kind_labels[KIND_FOLDERS], FM_GROUP_LABEL_MAX);
+                return 0;
+            }
+            if (extension[0] == '\0') {
+                g_strlcpy(label, "No extension", FM_GROUP_LABEL_MAX);
+                return 2;
+            }
+            g_strlcpy(label, extension, FM_GROUP_LABEL_MAX);
+            for (char *c = label; *c; c++) {
+                *c = g_ascii_tolower(*c);
+            }
+            return 1;
+        }
+
+        case FM_GROUP_DATE: {
+            gint64 mtime;
+            date_bucket_t bucket = BUCKET_PENDING;
+            if (fm_entry_get_stat(entry, NULL, &mtime, NULL)) {
+                gint64 seconds = mtime / G_GINT64_CONSTANT(1000000000);
+                bucket = BUCKET_TODAY;
+                while (bucket < BUCKET_OLDER && seconds < grouping->bucket_starts[bucket]) {
+                    bucket++;
+                }
+            }
+            g_strlcpy(label, bucket_labels[bucket], FM_GROUP_LABEL_MAX);
+            return bucket;
+        }
+
+        default: {
+            file_kind_t kind = fm_entry_is_directory(entry) ? KIND_FOLDERS : get_file_kind(grouping, entry);
+            g_strlcpy(label, kind_labels[kind], FM_GROUP_LABEL_MAX);
+            return kind;
+        }
+    }
+}
+
+static gint compare_groups(gconstpointer a, gconstpointer b, gpointer user_data) {
+    const FmGroup *group_a = a;
+    const FmGroup *group_b = b;
+    if (group_a->rank != group_b->rank) {
+        return group_a->rank < group_b->rank ? -1 : 1;
+    }
+    return g_ascii_strcasecmp(group_a->label, group_b->label);
+}
+
+static gint compare_entry_pointers(gconstpointer a, gconstpointer b, gpointer user_data) {
+    return fm_sort_compare(*(gpointer const*)a, *(gpointer const*)b, user_data);
+}
+
+/**
+ * Finds the group of a label, creating it outside of the groups store
+ * @param created Set to TRUE if the group is new
+ */
+static FmGroup* lookup_group(fm_grouping_t *grouping, const char *label, guint rank, gboolean *created) {
+    FmGroup *group = g_hash_table_lookup(grouping->by_label, label);
+    *created = group == NULL;
+    if (!group) {
+        group = g_object_new(FM_TYPE_GROUP, NULL);
+        group->label = g_strdup(label);
+        group->rank = rank;
+        g_hash_table_insert(grouping->by_label, group->label, group);
+    }
+    return group;
+}
+
+/**
+ * Appends entries to a store with one splice
+ */
+static void append_entries(GListStore *store, GPtrArray *entries) {
+    guint n_items = g_list_model_get_n_items(G_LIST_MODEL(store));
+    g_list_store_splice(store, n_items, 0, entries->pdata, entries->len);
+}
+
+/**
+ * Distributes entries over the groups, keeping their order
+ * Every group is filled with one splice, groups left without entries are dropped
+ */
+static void regroup(fm_grouping_t *grouping, GListModel *entries) {
+    GHashTable *members = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)g_ptr_array_unref);
+    GPtrArray *new_groups = g_ptr_array_new_with_free_func(g_object_unref);
+    guint n_items = g_list_model_get_n_items(entries);
+    char label[FM_GROUP_LABEL_MAX];
+
+    for (guint i = 0; i < n_items; i++) {
+        FmEntry *entry = g_list_model_get_item(entries, i);
+        guint rank = get_entry_group(grouping, entry, label);
+        gboolean created;
+        FmGroup *group = lookup_group(grouping, label, rank, &created);
+        if (created) {
+            g_ptr_array_add(new_groups, group);
+        }
+
+        GPtrArray *added = g_hash_table_lookup(members, group);
+        if (!added) {
+            added = g_ptr_array_new_with_free_func(g_object_unref);
+            g_hash_table_insert(members, group, added);
+        }
+        g_ptr_array_add(added, entry);
+    }
+
+    // Backwards, so dropping a group does not move the ones still to visit
+    guint n_groups = g_list_model_get_n_items(G_LIST_MODEL(grouping->groups));
+    for (guint i = n_groups; i-- > 0;) {
+        FmGroup *group = g_list_model_get_item(G_LIST_MODEL(grouping->groups), i);
+        GPtrArray *added = g_hash_table_lookup(members, group);
+        if (added) {
+            guint n_old = g_list_model_get_n_items(G_LIST_MODEL(group->entries));
+            g_list_store_splice(group->entries, 0, n_old, added->pdata, added->len);
+        } else {
+            g_hash_table_remove(grouping->by_label, group->label);
+            g_list_store_remove(grouping->groups, i);
+        }
+        g_object_unref(group);
+    }
+
+    for (guint i = 0; i < new_groups->len; i++) {
+        FmGroup *group = g_ptr_array_index(new_groups, i);
+        append_entries(group->entries, g_hash_table_lookup(members, group));
+        g_list_store_insert_sorted(grouping->groups, group, compare_groups, NULL);
+    }
+
+    g_ptr_array_unref(new_groups);
+    g_hash_table_unref(members);
+}
+
+fm_grouping_t* fm_grouping_new(fm_group_key_t key, GListModel *entries, const fm_sort_t *sort) {
+    fm_grouping_t *grouping = g_new0(fm_grouping_t, 1);
+    grouping->key = key;
+    grouping->groups = g_list_store_new(FM_TYPE_GROUP);
+    // Groups are owned by the groups store, the table only points at them
+    grouping->by_label = g_hash_table_new(g_str_hash, g_str_equal);
+    grouping->kinds = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    if (sort) {
+        grouping->sort = *sort;
+        grouping->sorted = TRUE;
+    }
+
+    GDateTime *now = g_date_time_new_now_local();
+    GDateTime *today = g_date_time_new_local(g_date_time_get_year(now), g_date_time_get_month(now),
+                                             g_date_time_get_day_of_month(now), 0, 0, 0);
+    GDateTime *yesterday = g_date_time_add_days(today, -1);
+    GDateTime *week = g_date_time_add_days(today, 1 - g_date_time_get_day_of_week(today));
+    GDateTime *month = g_date_time_new_local(g_date_time_get_year(now), g_date_time_get_month(now), 1, 0, 0, 0);
+    grouping->bucket_starts[BUCKET_TODAY] = g_date_time_to_unix(today);
+    grouping->bucket_starts[BUCKET_YESTERDAY] = g_date_time_to_unix(yesterday);
+    // Early in a week or a month the buckets can start before yesterday, they are then empty
+    grouping->bucket_starts[BUCKET_WEEK] = MIN(g_date_time_to_unix(week), grouping->bucket_starts[BUCKET_YESTERDAY]);
+    grouping->bucket_starts[BUCKET_MONTH] = MIN(g_date_time_to_unix(month), grouping->bucket_starts[BUCKET_WEEK]);
+    g_date_time_unref(month);
+    g_date_time_unref(week);
+    g_date_time_unref(yesterday);
+    g_date_time_unref(today);
+    g_date_time_unref(now);
+
+    regroup(grouping, entries);
+    return grouping;
+}
+
+void fm_grouping_free(fm_grouping_t *grouping) {
+    if (!grouping) {
+        return;
+    }
+    g_hash_table_unref(grouping->by_label);
+    g_hash_table_unref(grouping->kinds);
+    g_object_unref(grouping->groups);
+    g_free(grouping);
+}
+
+GListModel* fm_grouping_get_groups(fm_grouping_t *grouping) {
+    return G_LIST_MODEL(grouping->groups);
+}
+
+/**
+ * Gets the group of a label, adding a new group to the groups store in order
+ */
+static FmGroup* get_group(fm_grouping_t *grouping, const char *label, guint rank) {
+    gboolean created;
+    FmGroup *group = lookup_group(grouping, label, rank, &created);
+    if (created) {
+        g_list_store_insert_sorted(grouping->groups, group, compare_groups, NULL);
+        g_object_unref(group);
+    }
+    return group;
+}
+
+/**
+ * Drops a group that became empty
+ */
+static void drop_group_if_empty(fm_grouping_t *grouping, FmGroup *group) {
+    guint position;
+    if (g_list_model_get_n_items(G_LIST_MODEL(group->entries)) > 0 ||
+        !g_list_store_find(grouping->groups, group, &position)) {
+        return;
+    }
+    g_hash_table_remove(grouping->by_label, group->label);
+    g_list_store_remove(grouping->groups, position);
+}
+
+void fm_grouping_insert(fm_grouping_t *grouping, FmEntry *entry) {
+    char label[FM_GROUP_LABEL_MAX];
+    guint rank = get_entry_group(grouping, entry, label);
+    FmGroup *group = get_group(grouping, label, rank);
+
+    if (grouping->sorted) {
+        g_list_store_insert_sorted(group->entries, entry, fm_sort_compare, &grouping->sort);
+    } else {
+        g_list_store_append(group->entries, entry);
+    }
+}
+
+gboolean fm_grouping_remove(fm_grouping_t *grouping, FmEntry *entry) {
+    char label[FM_GROUP_LABEL_MAX];
+    get_entry_group(grouping, entry, label);
+    guint position;
+
+    // An entry grouped before its metadata was known is still in the pending group
+    FmGroup *group = g_hash_table_lookup(grouping->by_label, label);
+    if (!group || !g_list_store_find(group->entries, entry, &position)) {
+        group = grouping->key == FM_GROUP_DATE ? g_hash_table_lookup(grouping->by_label, FM_GROUP_PENDING_LABEL) : NULL;
+        if (!group || !g_list_store_find(group->entries, entry, &position)) {
+            return FALSE;
+        }
+    }
+
+    g_list_store_remove(group->entries, position);
+    drop_group_if_empty(grouping, group);
+    return TRUE;
+}
+
+/**
+ * Merges sorted entries into a group with one splice
+ */
+static void merge_entries(fm_grouping_t *grouping, FmGroup *group, GPtrArray *added) {
+    if (!grouping->sorted) {
+        append_entries(group->entries, added);
+        return;
+    }
+
+    g_ptr_array_sort_with_data(added, compare_entry_pointers, &grouping->sort);
+    guint n_items = g_list_model_get_n_items(G_LIST_MODEL(group->entries));
+    GPtrArray *merged = g_ptr_array_new_full(n_items + added->len, g_object_unref);
+    guint next = 0;
+
+    for (guint i = 0; i < n_items; i++) {
+        FmEntry *entry = g_list_model_get_item(G_LIST_MODEL(group->entries), i);
+        while (next < added->len && fm_sort_compare(g_ptr_array_index(added, next), entry, &grouping->sort) < 0) {
+            g_ptr_array_add(merged, g_object_ref(g_ptr_array_index(added, next++)));
+        }
+        g_ptr_array_add(merged, entry);
+    }
+    while (next < added->len) {
+        g_ptr_array_add(merged, g_object_ref(g_ptr_array_index(added, next++)));
+    }
+
+    g_list_store_splice(group->entries, 0, n_items, merged->pdata, merged->len);
+    g_ptr_array_unref(merged);
+}
+
+void fm_grouping_insert_all(fm_grouping_t *grouping, GPtrArray *entries) {
+    GHashTable *members = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)g_ptr_array_unref);
+    char label[FM_GROUP_LABEL_MAX];
+
+    for (guint i = 0; i < entries->len; i++) {
+        FmEntry *entry = g_ptr_array_index(entries, i);
+        guint rank = get_entry_group(grouping, entry, label);
+        FmGroup *group = get_group(grouping, label, rank);
+
+        GPtrArray *added = g_hash_table_lookup(members, group);
+        if (!added) {
+            added = g_ptr_array_new_with_free_func(g_object_unref);
+            g_hash_table_insert(members, group, added);
+        }
+        g_ptr_array_add(added, g_object_ref(entry));
+    }
+
+    GHashTableIter iter;
+    gpointer group, added;
+    g_hash_table_iter_init(&iter, members);
+    while (g_hash_table_iter_next(&iter, &group, &added)) {
+        merge_entries(grouping, group, added);
+    }
+    g_hash_table_unref(members);
+}
+
+guint fm_grouping_update_pending(fm_grouping_t *grouping) {
+    FmGroup *pending = grouping->key == FM_GROUP_DATE ? g_hash_table_lookup(grouping->by_label, FM_GROUP_PENDING_LABEL) : NULL;
+    if (!pending) {
+        return 0;
+    }
+
+    // Split the pending entries into the ones still pending and the ones moving, per target group
+    guint n_items = g_list_model_get_n_items(G_LIST_MODEL(pending->entries));
+    GPtrArray *still_pending = g_ptr_array_new_with_free_func(g_object_unref);
+    GHashTable *moves = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)g_ptr_array_unref);
+    char label[FM_GROUP_LABEL_MAX];
+    guint moved = 0;
+
+    for (guint i = 0; i < n_items; i++) {
+        FmEntry *entry = g_list_model_get_item(G_LIST_MODEL(pending->entries), i);
+        guint rank = get_entry_group(grouping, entry, label);
+        if (rank == BUCKET_PENDING) {
+            g_ptr_array_add(still_pending, entry);
+            continue;
+        }
+
+        FmGroup *group = get_group(grouping, label, rank);
+        GPtrArray *added = g_hash_table_lookup(moves, group);
+        if (!added) {
+            added = g_ptr_array_new_with_free_func(g_object_unref);
+            g_hash_table_insert(moves, group, added);
+        }
+        g_ptr_array_add(added, entry);
+        moved++;
+    }
+
+    if (moved > 0) {
+        GHashTableIter iter;
+        gpointer group, added;
+        g_hash_table_iter_init(&iter, moves);
+        while (g_hash_table_iter_next(&iter, &group, &added)) {
+            merge_entries(grouping, group, added);
+        }
+        g_list_store_splice(pending->entries, 0, n_items, still_pending->pdata, still_pending->len);
+        drop_group_if_empty(grouping, pending);
+    }
+
+    g_hash_table_unref(moves);
+    g_ptr_array_unref(still_pending);
+    return moved;
+}
+
+void fm_grouping_set_order(fm_grouping_t *grouping, GListModel *entries, const fm_sort_t *sort) {
+    grouping->sort = *sort;
+    grouping->sorted = TRUE;
+    regroup(grouping, entries);
+}
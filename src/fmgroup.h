@@ -0,0 +1,136 @@
+#ifndef FMGROUP_H
+#define FMGROUP_H
+
+#include "fm_entry.h"
+#include "fmsort.h"
+
+/**
+ * Grouping of FmEntry items into sections, for the grouped list view
+ *
+ * Entries are grouped by kind (folders, images, audio, ...: the content type
+ * guessed from the name, so nothing is read), by extension or by the age of
+ * their modification time (today, yesterday, earlier this week, earlier this
+ * month, older). The label of every entry is computed once when the grouping is
+ * built from the cached metadata, the entries of a group keep the order of the
+ * fm_sort_t given to the grouping.
+ *
+ * Changes are applied incrementally: fm_grouping_insert() and
+ * fm_grouping_remove() only touch the group of the entry, creating or dropping
+ * it as needed, fm_grouping_insert_all() only touches the groups of a batch of
+ * new entries, and fm_grouping_update_pending() moves the entries grouped as
+ * FM_GROUP_PENDING_LABEL once their metadata is known, instead of a regroup.
+ * Entries created or deleted in a shown directory reach the grouping one by one
+ * through listcache_watch().
+ *
+ * A new order is applied with fm_grouping_set_order(), which regroups in one
+ * pass from the already sorted model of the tab instead of sorting every group.
+ *
+ * The groups are a GListModel of FmGroup, each holding a GListModel of its
+ * entries, which is the shape GtkTreeListModel expects. Must only be used from
+ * the main thread.
+ */
+
+#define FM_GROUP_LABEL_MAX 64 // Longer extensions are cut, entries sharing the first bytes share a group
+#define FM_GROUP_PENDING_LABEL "Not known yet" // Date group of entries whose metadata is still being fetched
+
+typedef enum {
+    FM_GROUP_NONE,
+    FM_GROUP_TYPE, // Kind of file, folders first
+    FM_GROUP_EXTENSION, // Case-insensitive extension, folders first
+    FM_GROUP_DATE // Age of the modification time, newest first
+} fm_group_key_t;
+
+#define FM_TYPE_GROUP (fm_group_get_type())
+G_DECLARE_FINAL_TYPE(FmGroup, fm_group, FM, GROUP, GObject)
+
+/**
+ * Gets the label of a group
+ * @param group The group
+ * @return The label, e.g. "Images", "png" or "Yesterday"
+ */
+const char* fm_group_get_label(FmGroup *group);
+
+/**
+ * Gets the entries of a group
+ * @param group The group
+ * @return Model of FmEntry, owned by the group
+ */
+GListModel* fm_group_get_entries(FmGroup *group);
+
+/**
+ * Groups of a model of FmEntry
+ */
+typedef struct fm_grouping fm_grouping_t;
+
+/**
+ * Parses the names used by the group actions ("none", "type", "extension", "date")
+ * @param name The name
+ * @param key Filled with the key
+ * @return FALSE if the name is unknown
+ */
+gboolean fm_group_parse_key(const char *name, fm_group_key_t *key);
+
+/**
+ * Groups entries
+ * Reads nothing from disk, entries without metadata go to FM_GROUP_PENDING_LABEL when grouped by date
+ * @param key How to group, not FM_GROUP_NONE
+ * @param entries Model of FmEntry, in the order the groups keep
+ * @param sort Order used by later inserts, copied, NULL to append them
+ * @return The grouping, free with fm_grouping_free()
+ */
+fm_grouping_t* fm_grouping_new(fm_group_key_t key, GListModel *entries, const fm_sort_t *sort);
+
+/**
+ * Frees a grouping, the groups stay alive while something references them
+ * @param grouping The grouping
+ */
+void fm_grouping_free(fm_grouping_t *grouping);
+
+/**
+ * Gets the groups
+ * @param grouping The grouping
+ * @return Model of FmGroup in display order, owned by the grouping
+ */
+GListModel* fm_grouping_get_groups(fm_grouping_t *grouping);
+
+/**
+ * Adds an entry to its group, creating the group if needed
+ * @param grouping The grouping
+ * @param entry The entry
+ */
+void fm_grouping_insert(fm_grouping_t *grouping, FmEntry *entry);
+
+/**
+ * Adds entries to their groups, sorting each group's new entries once and
+ * merging them in with one splice per group
+ * @param grouping The grouping
+ * @param entries FmEntry to add
+ */
+void fm_grouping_insert_all(fm_grouping_t *grouping, GPtrArray *entries);
+
+/**
+ * Removes an entry from its group, dropping the group once it is empty
+ * @param grouping The grouping
+ * @param entry The entry
+ * @return FALSE if the entry was not grouped
+ */
+gboolean fm_grouping_remove(fm_grouping_t *grouping, FmEntry *entry);
+
+/**
+ * Moves the entries whose metadata became known out of FM_GROUP_PENDING_LABEL
+ * @param grouping The grouping
+ * @return Number of entries moved
+ */
+guint fm_grouping_update_pending(fm_grouping_t *grouping);
+
+/**
+ * Changes the order of the entries of every group
+ * The entries are regrouped in one pass from a model already in the new order,
+ * so a sort computed on worker threads for the flat view is reused as is
+ * @param grouping The grouping
+ * @param entries Model of FmEntry in the new order, e.g. the sorted model of the tab
+ * @param sort The new order, copied, used by later inserts
+ */
+void fm_grouping_set_order(fm_grouping_t *grouping, GListModel *entries, const fm_sort_t *sort);
+
+#endif //FMGROUP_H
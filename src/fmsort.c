@@ -0,0 +1,512 @@
+#include "fmsort.h"
+#include <string.h>
+#include <sys/stat.h>
+#include "sizecache.h"
+#include "trace.h"
+
+gboolean fm_sort_parse_key(const char *criteria, fm_sort_key_t *key) {
+    if (g_strcmp0(criteria, "name") == 0) {
+        *key = FM_SORT_NAME;
+    } else if (g_strcmp0(criteria, "date") == 0) {
+        *key = FM_SORT_DATE;
+    } else if (g_strcmp0(criteria, "size") == 0) {
+        *key = FM_SORT_SIZE;
+    } else if (g_strcmp0(criteria, "folders") == 0) {
+        *key = FM_SORT_FOLDERS;
+    } else if (g_strcmp0(criteria, "type") == 0) {
+        *key = FM_SORT_TYPE;
+    } else {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/**
+ * Parses a key of a spec with its optional direction
+ */
+static gboolean parse_field(char *token, gboolean ascending, fm_sort_field_t *field) {
+    char *name = g_strstrip(token);
+    gboolean has_direction = TRUE;
+
+    if (g_str_has_suffix(name, "-asc")) {
+        name[strlen(name) - strlen("-asc")] = '\0';
+        ascending = TRUE;
+    } else if (g_str_has_suffix(name, "-desc")) {
+        name[strlen(name) - strlen("-desc")] = '\0';
+        ascending = FALSE;
+    } else {
+        has_direction = FALSE;
+    }
+
+    if (!fm_sort_parse_key(name, &field->key)) {
+        return FALSE;
+    }
+    // Folders come first unless asked otherwise, whatever the direction of the other keys
+    field->ascending = field->key == FM_SORT_FOLDERS && !has_direction ? TRUE : ascending;
+    return TRUE;
+}
+
+gboolean fm_sort_parse(const char *spec, gboolean ascending, fm_sort_t *sort) {
+    if (!spec) {
+        return FALSE;
+    }
+
+    char **tokens = g_strsplit(spec, ",", -1);
+    guint n_tokens = g_strv_length(tokens);
+    gboolean valid = n_tokens > 0 && n_tokens <= FM_SORT_MAX_KEYS;
+
+    sort->n_fields = 0;
+    for (guint i = 0; valid && i < n_tokens; i++) {
+        valid = parse_field(tokens[i], ascending, &sort->fields[sort->n_fields++]);
+    }
+
+    g_strfreev(tokens);
+    return valid;
+}
+
+gboolean fm_sort_has_key(const fm_sort_t *sort, fm_sort_key_t key) {
+    for (guint i = 0; i < sort->n_fields; i++) {
+        if (sort->fields[i].key == key) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+gboolean fm_sort_needs_stats(const fm_sort_t *sort) {
+    return fm_sort_has_key(sort, FM_SORT_DATE) || fm_sort_has_key(sort, FM_SORT_SIZE);
+}
+
+/**
+ * Gets the size an entry is sorted by
+ * Files use their own size. Directories use their recursive size when the size
+ * cache knows it, and their inode size otherwise.
+ * @return FALSE while the metadata of the entry is not known
+ */
+static gboolean get_sort_size(FmEntry *entry, guint64 *size) {
+    guint32 mode;
+    if (!fm_entry_get_stat(entry, size, NULL, &mode)) {
+        return FALSE;
+    }
+
+    if (S_ISDIR(mode)) {
+        char *path = fm_entry_get_path(entry);
+        sizecache_counts_t total;
+        if (sizecache_lookup_path(path, &total)) {
+            *size = total.apparent_size;
+        }
+        g_free(path);
+    }
+    return TRUE;
+}
+
+/**
+ * Packs the first FM_SORT_NAME_PREFIX case-folded bytes of a name, big-endian
+ * so the words compare like g_ascii_strcasecmp() compares the names
+ */
+static guint64 pack_name(const char *name) {
+    guint64 word = 0;
+    guint i = 0;
+    for (; i < FM_SORT_NAME_PREFIX && name[i] != '\0'; i++) {
+        word = (word << 8) | (guchar)g_ascii_tolower(name[i]);
+    }
+    return word << (8 * (FM_SORT_NAME_PREFIX - i));
+}
+
+/**
+ * Packs a metadata value, unknown values come after every known one in either direction
+ */
+static guint64 pack_value(gboolean known, guint64 value, gboolean ascending) {
+    if (!known) {
+        return G_MAXUINT64;
+    }
+    value = MIN(value, (guint64)G_MAXINT64);
+    return ascending ? value : (guint64)G_MAXINT64 - value;
+}
+
+void fm_sort_pack(FmEntry *entry, const fm_sort_t *sort, fm_sort_packed_t *key) {
+    key->name = fm_entry_get_name(entry);
+
+    for (guint i = 0; i < sort->n_fields; i++) {
+        const fm_sort_field_t *field = &sort->fields[i];
+        guint64 word;
+
+        switch (field->key) {
+            case FM_SORT_DATE: {
+                gint64 mtime = 0;
+                gboolean known = fm_entry_get_stat(entry, NULL, &mtime, NULL);
+                // Times before 1970 are sorted as 1970
+                word = pack_value(known, (guint64)MAX(mtime, 0), field->ascending);
+                break;
+            }
+
+            case FM_SORT_SIZE: {
+                guint64 size = 0;
+                gboolean known = get_sort_size(entry, &size);
+                word = pack_value(known, size, field->ascending);
+                break;
+            }
+
+            case FM_SORT_FOLDERS:
+                word = fm_entry_is_directory(entry) == field->ascending ? 0 : 1;
+                break;
+
+            case FM_SORT_TYPE:
+                // Directories in the top byte, the extension prefix below it
+                if (fm_entry_is_directory(entry)) {
+                    word = 0;
+                } else {
+                    word = G_GUINT64_CONSTANT(1) << 56 | pack_name(fm_entry_get_extension(entry)) >> 8;
+                }
+                word = field->ascending ? word : ~word;
+                break;
+
+            default:
+                word = pack_name(key->name);
+                word = field->ascending ? word : ~word;
+                break;
+        }
+        key->words[i] = word;
+    }
+}
+
+gint fm_sort_compare_keys(const fm_sort_packed_t *a, const fm_sort_packed_t *b, const fm_sort_t *sort) {
+    for (guint i = 0; i < sort->n_fields; i++) {
+        if (a->words[i] != b->words[i]) {
+            return a->words[i] < b->words[i] ? -1 : 1;
+        }
+        if (sort->fields[i].key == FM_SORT_NAME) {
+            // The prefixes are equal, the rest of the names decides
+            gint result = g_ascii_strcasecmp(a->name, b->name);
+            if (result != 0) {
+                return sort->fields[i].ascending ? result : -result;
+            }
+        }
+    }
+
+    // Ties are ordered by name, so they come out the same on every reload
+    gint result = g_ascii_strcasecmp(a->name, b->name);
+    return result != 0 ? result : strcmp(a->name, b->name);
+}
+
+G_STATIC_ASSERT(FM_SORT_MAX_KEYS <= FM_ENTRY_SORT_WORDS);
+
+static guint key_generation = 1; // Bumped by fm_sort_invalidate_keys(), main thread only
+
+void fm_sort_invalidate_keys(void) {
+    key_generation++;
+}
+
+/**
+ * Identifies a sort order by its keys and directions, never 0
+ */
+static guint32 get_signature(const fm_sort_t *sort) {
+    guint32 signature = sort->n_fields;
+    for (guint i = 0; i < sort->n_fields; i++) {
+        signature = (signature << 4) | (guint32)sort->fields[i].key << 1 | (sort->fields[i].ascending ? 1 : 0);
+    }
+    return signature << 1 | 1;
+}
+
+/**
+ * Gets the packed key of an entry, from its cache when it is still valid
+ * A key is packed again for another sort, after fm_sort_invalidate_keys(), and
+ * once the metadata of an entry packed without it came in.
+ */
+static void get_cached_key(FmEntry *entry, const fm_sort_t *sort, guint32 signature, fm_sort_packed_t *key) {
+    fm_entry_sort_cache_t *cache = fm_entry_get_sort_cache(entry);
+    gboolean valid = cache->signature == signature && cache->generation == key_generation &&
+                     (cache->stat_known || !fm_sort_needs_stats(sort) || !fm_entry_get_stat(entry, NULL, NULL, NULL));
+
+    if (valid) {
+        key->name = fm_entry_get_name(entry);
+        memcpy(key->words, cache->words, sort->n_fields * sizeof(guint64));
+        return;
+    }
+
+    fm_sort_pack(entry, sort, key);
+    cache->signature = signature;
+    cache->generation = key_generation;
+    cache->stat_known = fm_entry_get_stat(entry, NULL, NULL, NULL);
+    memcpy(cache->words, key->words, sort->n_fields * sizeof(guint64));
+}
+
+gint fm_sort_compare(gconstpointer a, gconstpointer b, gpointer user_data) {
+    const fm_sort_t *sort = user_data;
+    guint32 signature = get_signature(sort);
+    fm_sort_packed_t key_a, key_b;
+    get_cached_key(FM_ENTRY((gpointer)a), sort, signature, &key_a);
+    get_cached_key(FM_ENTRY((gpointer)b), sort, signature, &key_b);
+    return fm_sort_compare_keys(&key_a, &key_b, sort);
+}
+
+/**
+ * An entry and the key it is sorted by
+ */
+typedef struct {
+    fm_sort_packed_t key;
+    FmEntry *entry;
+    guint32 index; // Position before sorting, orders entries with equal names
+} sort_item_t;
+
+/**
+ * Work of one thread in a phase of the sort
+ */
+typedef struct {
+    const fm_sort_t *sort;
+    GPtrArray *entries;
+    sort_item_t *items; // Source of the phase
+    sort_item_t *scratch; // Destination of a merge
+    guint start;
+    guint middle; // End of the first run of a merge
+    guint end;
+} sort_range_t;
+
+typedef void (*sort_range_func)(sort_range_t *range);
+
+static gint compare_items(gconstpointer a, gconstpointer b, gpointer user_data) {
+    const sort_item_t *item_a = a;
+    const sort_item_t *item_b = b;
+    gint result = fm_sort_compare_keys(&item_a->key, &item_b->key, user_data);
+    if (result != 0) {
+        return result;
+    }
+    return (item_a->index > item_b->index) - (item_a->index < item_b->index);
+}
+
+static void extract_keys(sort_range_t *range) {
+    for (guint i = range->start; i < range->end; i++) {
+        sort_item_t *item = &range->items[i];
+        item->entry = g_ptr_array_index(range->entries, i);
+        item->index = i;
+        fm_sort_pack(item->entry, range->sort, &item->key);
+    }
+}
+
+static void sort_run(sort_range_t *range) {
+    g_qsort_with_data(range->items + range->start, range->end - range->start, sizeof(sort_item_t),
+                      compare_items, (gpointer)range->sort);
+}
+
+static void merge_runs(sort_range_t *range) {
+    guint left = range->start;
+    guint right = range->middle;
+    guint out = range->start;
+
+    while (left < range->middle && right < range->end) {
+        if (compare_items(&range->items[right], &range->items[left], (gpointer)range->sort) < 0) {
+            range->scratch[out++] = range->items[right++];
+        } else {
+            range->scratch[out++] = range->items[left++];
+        }
+    }
+    memcpy(&range->scratch[out], &range->items[left], (range->middle - left) * sizeof(sort_item_t));
+    out += range->middle - left;
+    memcpy(&range->scratch[out], &range->items[right], (range->end - right) * sizeof(sort_item_t));
+}
+
+/**
+ * Completion of the ranges of a phase handed to the pool
+ */
+typedef struct {
+    GMutex mutex;
+    GCond cond;
+    guint remaining; // Ranges still running on the pool
+} sort_phase_t;
+
+/**
+ * A range and the phase to run on it in a thread
+ */
+typedef struct {
+    sort_range_func func;
+    sort_range_t *range;
+    sort_phase_t *phase;
+} sort_job_t;
+
+static GThreadPool *sort_pool = NULL;
+
+/**
+ * Thread pool entry point, runs one range and reports it done
+ */
+static void run_job(gpointer data, gpointer user_data) {
+    sort_job_t *job = data;
+    job->func(job->range);
+
+    g_mutex_lock(&job->phase->mutex);
+    if (--job->phase->remaining == 0) {
+        g_cond_signal(&job->phase->cond);
+    }
+    g_mutex_unlock(&job->phase->mutex);
+}
+
+/**
+ * Creates the shared thread pool on first use
+ * The calling thread runs a range of every phase itself, so the pool has one thread less
+ */
+static void ensure_pool(void) {
+    static gsize initialized = 0;
+
+    if (g_once_init_enter(&initialized)) {
+        GError *error = NULL;
+        gint threads = MAX(MIN((gint)g_get_num_processors(), FM_SORT_MAX_THREADS) - 1, 1);
+        sort_pool = g_thread_pool_new(run_job, NULL, threads, FALSE, &error);
+        if (error) {
+            g_warning("Failed to create sort thread pool: %s", error->message);
+            g_error_free(error);
+        }
+        g_once_init_leave(&initialized, 1);
+    }
+}
+
+/**
+ * Runs a phase on every range, the first range on the calling thread and the others on the pool
+ * Jobs never wait on each other, so sorts running at the same time share the pool safely
+ */
+static void run_parallel(sort_range_func func, sort_range_t *ranges, guint count) {
+    if (count == 0) {
+        return;
+    }
+    ensure_pool();
+
+    sort_job_t *jobs = g_new(sort_job_t, count);
+    sort_phase_t phase;
+    g_mutex_init(&phase.mutex);
+    g_cond_init(&phase.cond);
+    phase.remaining = count - 1;
+
+    for (guint i = 1; i < count; i++) {
+        jobs[i] = (sort_job_t){ func, &ranges[i], &phase };
+        if (sort_pool) {
+            g_thread_pool_push(sort_pool, &jobs[i], NULL);
+        } else {
+            run_job(&jobs[i], NULL);
+        }
+    }
+    func(&ranges[0]);
+
+    g_mutex_lock(&phase.mutex);
+    while (phase.remaining > 0) {
+        g_cond_wait(&phase.cond, &phase.mutex);
+    }
+    g_mutex_unlock(&phase.mutex);
+
+    g_cond_clear(&phase.cond);
+    g_mutex_clear(&phase.mutex);
+    g_free(jobs);
+}
+
+/**
+ * Gets the number of runs to split entries into
+ */
+static guint get_run_count(guint n_entries) {
+    guint threads = MIN((guint)g_get_num_processors(), FM_SORT_MAX_THREADS);
+    return CLAMP(n_entries / FM_SORT_MIN_RUN, 1, MAX(threads, 1));
+}
+
+gboolean fm_sort_entries(GPtrArray *entries, const fm_sort_t *sort, GCancellable *cancellable) {
+    guint n_entries = entries->len;
+    if (n_entries < 2) {
+        return !g_cancellable_is_cancelled(cancellable);
+    }
+
+    trace_span_t span = trace_begin("ui", "fm_sort_entries");
+    sort_item_t *items = g_new(sort_item_t, n_entries);
+    sort_item_t *scratch = g_new(sort_item_t, n_entries);
+    guint n_runs = get_run_count(n_entries);
+    sort_range_t *ranges = g_new(sort_range_t, n_runs);
+    // Run boundaries, the end of run i is bounds[i + 1]
+    guint *bounds = g_new(guint, n_runs + 1);
+
+    for (guint i = 0; i <= n_runs; i++) {
+        bounds[i] = (guint)((guint64)n_entries * i / n_runs);
+    }
+    for (guint i = 0; i < n_runs; i++) {
+        ranges[i] = (sort_range_t){ sort, entries, items, scratch, bounds[i], bounds[i + 1], bounds[i + 1] };
+    }
+
+    run_parallel(extract_keys, ranges, n_runs);
+    gboolean cancelled = g_cancellable_is_cancelled(cancellable);
+    if (!cancelled) {
+        run_parallel(sort_run, ranges, n_runs);
+        cancelled = g_cancellable_is_cancelled(cancellable);
+    }
+
+    // Every round merges neighbouring runs into the other buffer and halves their number
+    while (!cancelled && n_runs > 1) {
+        guint n_merges = n_runs / 2;
+        for (guint i = 0; i < n_merges; i++) {
+            ranges[i] = (sort_range_t){ sort, entries, items, scratch,
+                                        bounds[2 * i], bounds[2 * i + 1], bounds[2 * i + 2] };
+        }
+        if (n_runs % 2 == 1) {
+            // The last run has nothing to merge with and is copied over as is
+            guint start = bounds[n_runs - 1];
+            memcpy(&scratch[start], &items[start], (n_entries - start) * sizeof(sort_item_t));
+        }
+        run_parallel(merge_runs, ranges, n_merges);
+
+        for (guint i = 0; i <= n_merges; i++) {
+            bounds[i] = bounds[MIN(2 * i, n_runs)];
+        }
+        n_runs = (n_runs + 1) / 2;
+        bounds[n_runs] = n_entries;
+
+        sort_item_t *swap = items;
+        items = scratch;
+        scratch = swap;
+        cancelled = g_cancellable_is_cancelled(cancellable);
+    }
+
+    if (!cancelled) {
+        for (guint i = 0; i < n_entries; i++) {
+            g_ptr_array_index(entries, i) = items[i].entry;
+        }
+    }
+
+    g_free(bounds);
+    g_free(ranges);
+    g_free(scratch);
+    g_free(items);
+    trace_end(span);
+    return !cancelled;
+}
+
+/**
+ * Data of an fm_sort_entries_async() task
+ */
+typedef struct {
+    GPtrArray *entries;
+    fm_sort_t sort;
+} sort_task_data_t;
+
+static void sort_task_data_free(gpointer data) {
+    sort_task_data_t *task_data = data;
+    g_ptr_array_unref(task_data->entries);
+    g_free(task_data);
+}
+
+static void sort_thread(GTask *task, gpointer source_object, gpointer data, GCancellable *cancellable) {
+    sort_task_data_t *task_data = data;
+    if (fm_sort_entries(task_data->entries, &task_data->sort, cancellable)) {
+        g_task_return_pointer(task, g_ptr_array_ref(task_data->entries), (GDestroyNotify)g_ptr_array_unref);
+    } else {
+        g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_CANCELLED, "Sort cancelled");
+    }
+}
+
+void fm_sort_entries_async(GPtrArray *entries, const fm_sort_t *sort, GCancellable *cancellable,
+                           GAsyncReadyCallback callback, gpointer user_data) {
+    sort_task_data_t *task_data = g_new(sort_task_data_t, 1);
+    task_data->entries = g_ptr_array_ref(entries);
+    task_data->sort = *sort;
+
+    GTask *task = g_task_new(NULL, cancellable, callback, user_data);
+    g_task_set_task_data(task, task_data, sort_task_data_free);
+    g_task_set_return_on_cancel(task, FALSE);
+    g_task_run_in_thread(task, sort_thread);
+    g_object_unref(task);
+}
+
+GPtrArray* fm_sort_entries_finish(GAsyncResult *result, GError **error) {
+    return g_task_propagate_pointer(G_TASK(result), error);
+}
@@ -0,0 +1,172 @@
+#ifndef FMSORT_H
+#define FMSORT_H
+
+#include "fm_entry.h"
+
+/**
+ * Ordering of FmEntry items, shared by the views and the benchmarks
+ *
+ * A sort is a list of up to FM_SORT_MAX_KEYS keys, each ascending or descending,
+ * written as a spec like "folders,date-desc,name": keys are separated by commas
+ * and may end in "-asc" or "-desc". Keys without a direction use the direction
+ * given to fm_sort_parse(), except "folders" which puts directories first unless
+ * it is "folders-desc". Entries equal in every key are ordered by name, then by
+ * the bytes of their name, so the order does not depend on the order a directory
+ * is read in and does not change between reloads.
+ *
+ * Every entry is compiled into a packed key, one 64-bit word per sort key
+ * (see fm_sort_pack()), so comparing two entries compares a few integers
+ * whatever the number of keys. Names are packed as their first
+ * FM_SORT_NAME_PREFIX case-folded bytes and only compared in full when those
+ * are equal, extensions as their first FM_SORT_NAME_PREFIX - 1 bytes.
+ *
+ * fm_sort_compare() is a GCompareDataFunc, so it can back a GtkCustomSorter as
+ * well as g_list_store_sort() or g_ptr_array_sort_with_data(). Sorting by date or
+ * size uses the metadata fetched by statbatch_start(), entries whose metadata is
+ * not known yet are kept after the others in either direction. Directories are
+ * sorted by the size of their contents once the size cache knows it.
+ *
+ * Models of more than FM_SORT_PARALLEL_THRESHOLD entries are sorted off the main
+ * thread with fm_sort_entries_async(): the packed key of every entry is
+ * extracted into an array, chunks of it are sorted on up to FM_SORT_MAX_THREADS
+ * threads and the sorted runs are merged pairwise, the merges of a round running
+ * in parallel. The threads come from a pool shared by every sort, created on
+ * first use. Entries with equal names keep their previous order.
+ */
+
+#define FM_SORT_PARALLEL_THRESHOLD 50000 // Models with more entries are sorted on worker threads
+#define FM_SORT_MAX_THREADS 8 // Threads sorting and merging runs
+#define FM_SORT_MIN_RUN 8192 // Entries per run at least, smaller runs cost more in threads than they save
+#define FM_SORT_MAX_KEYS 4 // Keys of a sort spec
+#define FM_SORT_NAME_PREFIX 8 // Bytes of a name packed into its key word
+
+typedef enum {
+    FM_SORT_NAME, // Case-insensitive name
+    FM_SORT_DATE, // Modification time
+    FM_SORT_SIZE, // Size, recursive size for directories
+    FM_SORT_FOLDERS, // Directories before files
+    FM_SORT_TYPE // Directories, then files by case-insensitive extension
+} fm_sort_key_t;
+
+/**
+ * A key of a sort order
+ */
+typedef struct {
+    fm_sort_key_t key;
+    gboolean ascending;
+} fm_sort_field_t;
+
+/**
+ * A sort order, compared key by key
+ */
+typedef struct {
+    guint n_fields;
+    fm_sort_field_t fields[FM_SORT_MAX_KEYS];
+} fm_sort_t;
+
+/**
+ * The packed sort key of an entry
+ */
+typedef struct {
+    guint64 words[FM_SORT_MAX_KEYS]; // One per field of the sort, compared as unsigned integers
+    const char *name; // Name of the entry, for name fields and ties
+} fm_sort_packed_t;
+
+/**
+ * Parses the name of a key ("name", "date", "size", "folders", "type")
+ * @param criteria The name
+ * @param key Filled with the key
+ * @return FALSE if the name is unknown
+ */
+gboolean fm_sort_parse_key(const char *criteria, fm_sort_key_t *key);
+
+/**
+ * Parses a sort spec, used by the sort actions and the session
+ * @param spec Keys separated by commas, e.g. "folders,date-desc,name"
+ * @param ascending Direction of the keys that do not give one
+ * @param sort Filled with the sort order
+ * @return FALSE if the spec is empty, has an unknown key or too many keys
+ */
+gboolean fm_sort_parse(const char *spec, gboolean ascending, fm_sort_t *sort);
+
+/**
+ * Checks whether a sort uses a key
+ * @param sort The sort order
+ * @param key The key
+ * @return TRUE if one of the fields sorts by key
+ */
+gboolean fm_sort_has_key(const fm_sort_t *sort, fm_sort_key_t key);
+
+/**
+ * Checks whether a sort depends on metadata that is fetched in the background
+ * @param sort The sort order
+ * @return TRUE if entries have to be resorted as their metadata comes in
+ */
+gboolean fm_sort_needs_stats(const fm_sort_t *sort);
+
+/**
+ * Compiles the packed sort key of an entry
+ * May be called from any thread
+ * @param entry The FmEntry
+ * @param sort The sort order
+ * @param key Filled with the key, its name belongs to entry
+ */
+void fm_sort_pack(FmEntry *entry, const fm_sort_t *sort, fm_sort_packed_t *key);
+
+/**
+ * Compares two packed keys
+ * @param a First key
+ * @param b Second key
+ * @param sort The sort order they were packed for
+ * @return Negative if a comes first, positive if b does, 0 only for equal names
+ */
+gint fm_sort_compare_keys(const fm_sort_packed_t *a, const fm_sort_packed_t *b, const fm_sort_t *sort);
+
+/**
+ * Compares two FmEntry
+ * The packed key of an entry is cached on it, so a sort packs every entry once
+ * instead of once per comparison. Main thread only.
+ * @param a First FmEntry
+ * @param b Second FmEntry
+ * @param user_data The fm_sort_t
+ * @return Negative if a comes first, positive if b does, 0 only for equal names
+ */
+gint fm_sort_compare(gconstpointer a, gconstpointer b, gpointer user_data);
+
+/**
+ * Drops the keys cached by fm_sort_compare(), call when the size cache learned
+ * directory sizes. Keys follow changes of the sort and of the metadata of their
+ * entry by themselves. Main thread only.
+ */
+void fm_sort_invalidate_keys(void);
+
+/**
+ * Sorts entries with the parallel merge sort, may be called from any thread
+ * The entries must not change while they are sorted
+ * @param entries Array of FmEntry, reordered in place
+ * @param sort The order
+ * @param cancellable Checked between the phases of the sort, may be NULL
+ * @return FALSE if cancelled, entries are then left in their previous order
+ */
+gboolean fm_sort_entries(GPtrArray *entries, const fm_sort_t *sort, GCancellable *cancellable);
+
+/**
+ * Sorts entries with fm_sort_entries() in a background task
+ * @param entries Array of FmEntry, referenced until the task finishes
+ * @param sort The order, copied
+ * @param cancellable Cancels the sort, may be NULL
+ * @param callback Called on the main thread with the result
+ * @param user_data Data passed to callback
+ */
+void fm_sort_entries_async(GPtrArray *entries, const fm_sort_t *sort, GCancellable *cancellable,
+                           GAsyncReadyCallback callback, gpointer user_data);
+
+/**
+ * Gets the result of fm_sort_entries_async()
+ * @param result The result passed to the callback
+ * @param error Set to G_IO_ERROR_CANCELLED if the sort was cancelled
+ * @return The sorted entries, free with g_ptr_array_unref(), NULL if cancelled
+ */
+GPtrArray* fm_sort_entries_finish(GAsyncResult *result, GError **error);
+
+#endif //FMSORT_H
@@ -0,0 +1,1340 @@
+#include "history.h"
+#include <stdio.h>
+#include <string.h>
+#include <gio/gio.h>
+#include "journal.h"
+#include "trace.h"
+
+// Operation history
+static history_ring_t operation_history;
+// Forward history (for redoing undone operations)
+static history_ring_t forward_history;
+// Batch currently being recorded, NULL when no batch is open
+static GArray *open_batch = NULL;
+static guint open_batch_depth = 0;
+static guint64 open_batch_id = 0;
+// Next id handed out to a journaled batch
+static guint64 next_batch_id = 1;
+// TRUE while an undo/redo job is running in the background
+static gboolean history_job_running = FALSE;
+// Called once an undo/redo job changed the file system
+static history_changed_func history_changed = NULL;
+
+/**
+ * Batch read back from the journal that never finished
+ * Both arrays hold operation_t in their original execution order
+ */
+typedef struct {
+    guint64 id;
+    char direction; // JOURNAL_DIRECTION_DO or JOURNAL_DIRECTION_UNDO
+    GArray *planned; // Operations the batch was going to perform
+    GArray *completed; // Operations it got through before being interrupted
+} journal_batch_t;
+
+// Interrupted batches waiting to be resumed or rolled back (journal_batch_t, oldest first)
+static GQueue interrupted_batches = G_QUEUE_INIT;
+// TRUE once the user asked to resolve the interrupted batches
+static gboolean resolving_interrupted = FALSE;
+// Whether interrupted batches are being resumed (TRUE) or rolled back (FALSE)
+static gboolean resume_interrupted = FALSE;
+
+/**
+ * Structure to hold both source and destination paths for move operations
+ * This is stored in the operation history for possible undo functionality
+ */
+typedef struct {
+    char *source_path;
+    char *dest_path;
+} move_paths_t;
+
+/**
+ * Frees the data owned by an operation (recursively for batches)
+ * @param operation The operation whose data should be freed
+ */
+void free_operation(operation_t *operation) {
+    if (!operation || !operation->data) {
+        return;
+    }
+
+    switch (operation->type) {
+        case OPERATION_TYPE_MOVE:
+        case OPERATION_TYPE_PASTE: {
+            move_paths_t *paths = operation->data;
+            g_free(paths->source_path);
+            g_free(paths->dest_path);
+            g_free(paths);
+            break;
+        }
+
+        case OPERATION_TYPE_BATCH: {
+            GArray *children = operation->data;
+            for (guint i = 0; i < children->len; i++) {
+                free_operation(&g_array_index(children, operation_t, i));
+            }
+            g_array_free(children, TRUE);
+            break;
+        }
+
+        default:
+            // Delete operations (and anything else) store a plain string
+            g_free(operation->data);
+            break;
+    }
+
+    operation->data = NULL;
+}
+
+/**
+ * Pushes an operation onto a history ring, overwriting the oldest one when full
+ * @param ring The ring to push to
+ * @param operation The operation to push (the ring takes ownership of its data)
+ */
+static void history_ring_push(history_ring_t *ring, operation_t operation) {
+    if (ring->len == MAX_HISTORY_SIZE) {
+        // Full, so the newest operation takes the slot of the oldest one
+        free_operation(&ring->items[ring->head]);
+        ring->items[ring->head] = operation;
+        ring->head = (ring->head + 1) % MAX_HISTORY_SIZE;
+        return;
+    }
+
+    ring->items[(ring->head + ring->len) % MAX_HISTORY_SIZE] = operation;
+    ring->len++;
+}
+
+/**
+ * Pops the most recent operation off a history ring
+ * @param ring The ring to pop from
+ * @param operation Pointer to store the operation in (the caller takes ownership of its data)
+ * @return TRUE if an operation was popped, FALSE if the ring is empty
+ */
+static gboolean history_ring_pop(history_ring_t *ring, operation_t *operation) {
+    if (ring->len == 0) {
+        return FALSE;
+    }
+
+    ring->len--;
+    *operation = ring->items[(ring->head + ring->len) % MAX_HISTORY_SIZE];
+    return TRUE;
+}
+
+/**
+ * Frees every operation in a history ring and empties it
+ * @param ring The ring to clear
+ */
+static void history_ring_clear(history_ring_t *ring) {
+    for (guint i = 0; i < ring->len; i++) {
+        free_operation(&ring->items[(ring->head + i) % MAX_HISTORY_SIZE]);
+    }
+    ring->head = 0;
+    ring->len = 0;
+}
+
+/**
+ * Turns an array of operations into a single operation
+ * An empty array gives OPERATION_TYPE_NONE, a single element is returned as is, anything else becomes a batch
+ * @param operations Array of operation_t (consumed by this function)
+ * @return The resulting operation
+ */
+static operation_t operation_from_array(GArray *operations) {
+    operation_t operation = { .type = OPERATION_TYPE_NONE, .data = NULL };
+
+    if (operations->len == 0) {
+        g_array_free(operations, TRUE);
+    } else if (operations->len == 1) {
+        operation = g_array_index(operations, operation_t, 0);
+        g_array_free(operations, TRUE);
+    } else {
+        operation.type = OPERATION_TYPE_BATCH;
+        operation.data = operations;
+    }
+
+    return operation;
+}
+
+/**
+ * Gets the paths stored in a (non batch) operation
+ * @param operation The operation
+ * @param source_path Pointer to store the first path in
+ * @param dest_path Pointer to store the second path in (NULL for operations with a single path)
+ */
+static void get_operation_paths(const operation_t *operation, const char **source_path, const char **dest_path) {
+    *source_path = NULL;
+    *dest_path = NULL;
+
+    switch (operation->type) {
+        case OPERATION_TYPE_MOVE:
+        case OPERATION_TYPE_PASTE: {
+            const move_paths_t *paths = operation->data;
+            *source_path = paths->source_path;
+            *dest_path = paths->dest_path;
+            break;
+        }
+
+        case OPERATION_TYPE_BATCH:
+            break;
+
+        default:
+            *source_path = operation->data;
+            break;
+    }
+}
+
+/**
+ * Creates an operation from its type and paths, the reverse of get_operation_paths()
+ * @return The operation, owning copies of the paths
+ */
+static operation_t operation_from_paths(enum OPERATION_TYPE type, const char *source_path, const char *dest_path) {
+    operation_t operation = { .type = type, .data = NULL };
+
+    if (type == OPERATION_TYPE_MOVE || type == OPERATION_TYPE_PASTE) {
+        move_paths_t *paths = g_malloc(sizeof(move_paths_t));
+        paths->source_path = g_strdup(source_path);
+        paths->dest_path = g_strdup(dest_path);
+        operation.data = paths;
+    } else {
+        operation.data = g_strdup(source_path);
+    }
+
+    return operation;
+}
+
+/**
+ * Gets the character identifying a ring in the journal
+ */
+static char get_ring_id(const history_ring_t *ring) {
+    return ring == &operation_history ? JOURNAL_RING_HISTORY : JOURNAL_RING_FORWARD;
+}
+
+/**
+ * Writes every leaf operation of an operation to the journal, in execution order
+ * @param id Batch id to record them under
+ * @param operation The operation (batches are walked recursively)
+ * @param planned TRUE to record them as planned ('P'), FALSE as completed ('I')
+ */
+static void journal_operation_leaves(guint64 id, const operation_t *operation, gboolean planned) {
+    if (operation->type == OPERATION_TYPE_BATCH) {
+        GArray *children = operation->data;
+        for (guint i = 0; i < children->len; i++) {
+            journal_operation_leaves(id, &g_array_index(children, operation_t, i), planned);
+        }
+        return;
+    }
+
+    const char *source_path, *dest_path;
+    get_operation_paths(operation, &source_path, &dest_path);
+
+    if (planned) {
+        journal_batch_plan(id, operation->type, source_path, dest_path);
+    } else {
+        journal_batch_item(id, operation->type, source_path, dest_path);
+    }
+}
+
+/**
+ * Pushes an operation onto a history ring and records it in the journal
+ * @param ring The ring to push to
+ * @param operation The operation to push, ignored if it's OPERATION_TYPE_NONE
+ */
+static void history_push(history_ring_t *ring, operation_t operation) {
+    if (operation.type == OPERATION_TYPE_NONE) {
+        return;
+    }
+
+    guint64 id = next_batch_id++;
+    journal_batch_begin(id, JOURNAL_DIRECTION_DO);
+    journal_operation_leaves(id, &operation, FALSE);
+    journal_batch_end(id, get_ring_id(ring));
+
+    history_ring_push(ring, operation);
+}
+
+/**
+ * Pops the newest operation off a history ring and records it in the journal
+ * @return TRUE if an operation was popped, FALSE if the ring is empty
+ */
+static gboolean history_pop(history_ring_t *ring, operation_t *operation) {
+    if (!history_ring_pop(ring, operation)) {
+        return FALSE;
+    }
+
+    journal_pop(get_ring_id(ring));
+    return TRUE;
+}
+
+/**
+ * Frees a journal batch and every operation it holds
+ */
+static void free_journal_batch(journal_batch_t *batch) {
+    GArray *arrays[] = { batch->planned, batch->completed };
+
+    for (guint a = 0; a < G_N_ELEMENTS(arrays); a++) {
+        if (!arrays[a]) continue;
+        for (guint i = 0; i < arrays[a]->len; i++) {
+            free_operation(&g_array_index(arrays[a], operation_t, i));
+        }
+        g_array_free(arrays[a], TRUE);
+    }
+
+    g_free(batch);
+}
+
+/**
+ * Applies one journal record to the history rings while replaying the journal
+ * @param record The record
+ * @param user_data GHashTable of open batches (id -> journal_batch_t)
+ */
+static void replay_journal_record(const journal_record_t *record, gpointer user_data) {
+    GHashTable *batches = user_data;
+    history_ring_t *ring = record->flag == JOURNAL_RING_FORWARD ? &forward_history : &operation_history;
+
+    if (record->id >= next_batch_id) {
+        next_batch_id = record->id + 1;
+    }
+
+    switch (record->kind) {
+        case 'B': {
+            journal_batch_t *batch = g_new0(journal_batch_t, 1);
+            batch->id = record->id;
+            batch->direction = record->flag;
+            batch->planned = g_array_new(FALSE, FALSE, sizeof(operation_t));
+            batch->completed = g_array_new(FALSE, FALSE, sizeof(operation_t));
+            g_hash_table_replace(batches, &batch->id, batch);
+            break;
+        }
+
+        case 'P':
+        case 'I': {
+            journal_batch_t *batch = g_hash_table_lookup(batches, &record->id);
+            if (!batch) break;
+
+            operation_t operation = operation_from_paths(record->type, record->source_path, record->dest_path);
+            if (record->kind == 'P') {
+                g_array_append_val(batch->planned, operation);
+            } else if (batch->direction == JOURNAL_DIRECTION_UNDO) {
+                // Undo completes operations last to first
+                g_array_prepend_val(batch->completed, operation);
+            } else {
+                g_array_append_val(batch->completed, operation);
+            }
+            break;
+        }
+
+        case 'E': {
+            journal_batch_t *batch = g_hash_table_lookup(batches, &record->id);
+            if (!batch) break;
+
+            operation_t operation = operation_from_array(batch->completed);
+            batch->completed = NULL;
+            if (operation.type != OPERATION_TYPE_NONE) {
+                history_ring_push(ring, operation);
+            }
+            g_hash_table_remove(batches, &record->id);
+            break;
+        }
+
+        case 'A':
+            g_hash_table_remove(batches, &record->id);
+            break;
+
+        case 'X': {
+            operation_t operation;
+            if (history_ring_pop(ring, &operation)) {
+                free_operation(&operation);
+            }
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
+/**
+ * Sorts interrupted batches by id when queueing them
+ */
+static gint compare_journal_batches(gconstpointer a, gconstpointer b, gpointer user_data) {
+    const journal_batch_t *batch_a = a;
+    const journal_batch_t *batch_b = b;
+    return (batch_a->id > batch_b->id) - (batch_a->id < batch_b->id);
+}
+
+/**
+ * Replaces the journal on disk with the current state of the history
+ * Keeps the journal from growing forever, the old file stays in place until the new one is synced
+ */
+static void write_journal_snapshot(void) {
+    journal_begin_rewrite();
+
+    history_ring_t *rings[] = { &operation_history, &forward_history };
+    for (guint r = 0; r < G_N_ELEMENTS(rings); r++) {
+        for (guint i = 0; i < rings[r]->len; i++) {
+            guint64 id = next_batch_id++;
+            journal_batch_begin(id, JOURNAL_DIRECTION_DO);
+            journal_operation_leaves(id, &rings[r]->items[(rings[r]->head + i) % MAX_HISTORY_SIZE], FALSE);
+            journal_batch_end(id, get_ring_id(rings[r]));
+        }
+    }
+
+    // Interrupted batches stay interrupted until the user decides what to do with them
+    for (GList *l = interrupted_batches.head; l != NULL; l = l->next) {
+        journal_batch_t *batch = l->data;
+        journal_batch_begin(batch->id, batch->direction);
+
+        for (guint i = 0; i < batch->planned->len; i++) {
+            journal_operation_leaves(batch->id, &g_array_index(batch->planned, operation_t, i), TRUE);
+        }
+
+        // Undo batches are replayed last to first, so write them in that order
+        for (guint i = 0; i < batch->completed->len; i++) {
+            guint index = batch->direction == JOURNAL_DIRECTION_UNDO ? batch->completed->len - 1 - i : i;
+            journal_operation_leaves(batch->id, &g_array_index(batch->completed, operation_t, index), FALSE);
+        }
+    }
+
+    journal_commit_rewrite();
+}
+
+/**
+ * Initialize the operation history system
+ * Reloads the history from the journal and starts journaling new operations
+ * Should be called once at program start
+ */
+void init_operation_history(void) {
+    history_ring_clear(&operation_history);
+    history_ring_clear(&forward_history);
+
+    GHashTable *batches = g_hash_table_new_full(g_int64_hash, g_int64_equal, NULL, (GDestroyNotify)free_journal_batch);
+    journal_replay(replay_journal_record, batches);
+
+    // Batches that never got an end record were interrupted
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, batches);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        g_queue_insert_sorted(&interrupted_batches, value, compare_journal_batches, NULL);
+        g_hash_table_iter_steal(&iter);
+    }
+    g_hash_table_unref(batches);
+
+    if (interrupted_batches.length > 0) {
+        g_print("Found %u interrupted operation(s) in the history journal\n", interrupted_batches.length);
+    }
+
+    journal_open();
+    write_journal_snapshot();
+}
+
+/**
+ * Clean up operation history system resources
+ * Flushes the journal so the history is restored on the next start
+ * An undo/redo job still running keeps going but is no longer journaled, its
+ * batch is found unfinished and offered as interrupted on the next start
+ * Should be called before program exit
+ */
+void cleanup_operation_history(void) {
+    journal_close();
+
+    history_ring_clear(&operation_history);
+    history_ring_clear(&forward_history);
+
+    if (open_batch) {
+        operation_t batch = { .type = OPERATION_TYPE_BATCH, .data = open_batch };
+        free_operation(&batch);
+        open_batch = NULL;
+        open_batch_depth = 0;
+    }
+
+    journal_batch_t *batch;
+    while ((batch = g_queue_pop_head(&interrupted_batches)) != NULL) {
+        free_journal_batch(batch);
+    }
+}
+
+/**
+ * Adds an operation to the operation history
+ * If a batch is open the operation is added to the batch instead
+ * @param operation The operation to add (the history takes ownership of its data)
+ */
+void add_operation_to_history(operation_t operation) {
+    if (!open_batch) {
+        // A single operation is journaled as a batch of one
+        begin_operation_batch();
+        add_operation_to_history(operation);
+        end_operation_batch();
+        return;
+    }
+
+    const char *source_path, *dest_path;
+    get_operation_paths(&operation, &source_path, &dest_path);
+    journal_batch_item(open_batch_id, operation.type, source_path, dest_path);
+
+    g_array_append_val(open_batch, operation);
+}
+
+/**
+ * Starts grouping operations into a single undoable unit
+ * Every operation added until the matching end_operation_batch() call becomes part of the batch
+ * Calls can be nested, only the outermost pair creates a history entry
+ */
+void begin_operation_batch(void) {
+    if (open_batch_depth++ == 0) {
+        open_batch = g_array_new(FALSE, FALSE, sizeof(operation_t));
+        open_batch_id = next_batch_id++;
+        journal_batch_begin(open_batch_id, JOURNAL_DIRECTION_DO);
+    }
+}
+
+/**
+ * Records an operation the open batch is about to perform
+ * Only used by the journal, so an interrupted batch can be resumed after a crash
+ * @param type Operation type
+ * @param source_path First path of the operation
+ * @param dest_path Second path of the operation, NULL for operations with a single path
+ */
+void plan_batch_operation(enum OPERATION_TYPE type, const char *source_path, const char *dest_path) {
+    if (!open_batch) {
+        g_warning("plan_batch_operation called without an open batch");
+        return;
+    }
+
+    journal_batch_plan(open_batch_id, type, source_path, dest_path);
+}
+
+/**
+ * Closes the batch opened by begin_operation_batch() and adds it to the history
+ * A batch containing a single operation is stored as that plain operation
+ */
+void end_operation_batch(void) {
+    if (open_batch_depth == 0) {
+        g_warning("end_operation_batch called without an open batch");
+        return;
+    }
+
+    if (--open_batch_depth > 0) {
+        return;
+    }
+
+    operation_t batch = operation_from_array(open_batch);
+    open_batch = NULL;
+
+    if (batch.type == OPERATION_TYPE_NONE) {
+        journal_batch_abandon(open_batch_id);
+        return;
+    }
+
+    // The operations are already in the journal, only the end record is missing
+    journal_batch_end(open_batch_id, JOURNAL_RING_HISTORY);
+    history_ring_push(&operation_history, batch);
+}
+
+/**
+ * Moves a file to the trash without touching the history
+ * @param path Full path to the file
+ * @return TRUE if successful, FALSE otherwise
+ */
+static gboolean trash_path(const char *path) {
+    GFile *file = g_file_new_for_path(path);
+    GError *error = NULL;
+
+    gboolean success = g_file_trash(file, NULL, &error);
+    if (!success) {
+        g_warning("Failed to delete file: %s, error: %s", path, error ? error->message : "Unknown error");
+        if (error) g_error_free(error);
+    }
+
+    g_object_unref(file);
+    return success;
+}
+
+/**
+ * Moves a file without touching the history
+ * @param source_path Full path to the source file
+ * @param dest_path Full path to the destination
+ * @return TRUE if successful, FALSE otherwise
+ */
+static gboolean move_path(const char *source_path, const char *dest_path) {
+    GFile *source_file = g_file_new_for_path(source_path);
+    GFile *dest_file = g_file_new_for_path(dest_path);
+    GError *error = NULL;
+
+    // G_FILE_COPY_OVERWRITE flag will overwrite destination if it exists
+    // G_FILE_COPY_ALL_METADATA ensures all metadata is preserved
+    gboolean success = g_file_move(
+        source_file,
+        dest_file,
+        G_FILE_COPY_OVERWRITE | G_FILE_COPY_ALL_METADATA,
+        NULL, // Cancellable
+        NULL, // Progress callback
+        NULL, // Progress callback data
+        &error
+    );
+
+    if (!success) {
+        g_warning("Failed to move/rename file from %s to %s, error: %s",
+                  source_path, dest_path, error ? error->message : "Unknown error");
+        if (error) g_error_free(error);
+    }
+
+    g_object_unref(source_file);
+    g_object_unref(dest_file);
+    return success;
+}
+
+/**
+ * Copies a file without touching the history, overwriting the destination if it exists
+ * @param source_path Full path to the source file
+ * @param dest_path Full path to the destination
+ * @return TRUE if successful, FALSE otherwise
+ */
+static gboolean copy_path(const char *source_path, const char *dest_path) {
+    GFile *source_file = g_file_new_for_path(source_path);
+    GFile *dest_file = g_file_new_for_path(dest_path);
+    GError *error = NULL;
+
+    gboolean success = g_file_copy(
+        source_file,
+        dest_file,
+        G_FILE_COPY_ALL_METADATA | G_FILE_COPY_OVERWRITE,
+        NULL,  // Cancellable
+        NULL,  // Progress callback
+        NULL,  // Progress callback data
+        &error
+    );
+
+    if (!success) {
+        g_warning("Failed to copy file %s to %s: %s",
+                  source_path, dest_path, error ? error->message : "Unknown error");
+        if (error) g_error_free(error);
+    }
+
+    g_object_unref(source_file);
+    g_object_unref(dest_file);
+    return success;
+}
+
+/**
+ * Deletes a file at the given path and adds the operation to history
+ * @param path Full path to the file to delete
+ * @return TRUE if successful, FALSE otherwise
+ */
+gboolean delete_file(const char* path) {
+    if (!path || strlen(path) == 0) {
+        g_warning("Invalid path provided for deletion");
+        return FALSE;
+    }
+
+    // Check if the file exists
+    GFile *file = g_file_new_for_path(path);
+    gboolean exists = g_file_query_exists(file, NULL);
+    g_object_unref(file);
+
+    if (!exists) {
+        g_warning("File does not exist: %s", path);
+        return FALSE;
+    }
+
+    // Attempt to delete the file
+    trace_span_t span = trace_begin("fileop", "delete_file");
+    gboolean trashed = trash_path(path);
+    trace_end_detail(span, path);
+    if (!trashed) {
+        return FALSE;
+    }
+
+    // Create and add operation to history
+    operation_t op = {
+        .type = OPERATION_TYPE_DELETE,
+        .data = g_strdup(path)  // Store the path for possible undo functionality
+    };
+    add_operation_to_history(op);
+
+    return TRUE;
+}
+
+/**
+ * Moves or renames a file from source path to destination path
+ * If both paths are in the same directory, it acts as rename
+ * If paths are in different directories, it moves the file
+ *
+ * @param source_path Full path to the source file
+ * @param dest_path Full path to the destination (new name or location)
+ * @return TRUE if successful, FALSE otherwise
+ */
+gboolean move_file(const char* source_path, const char* dest_path) {
+    if (!source_path || !dest_path || strlen(source_path) == 0 || strlen(dest_path) == 0) {
+        g_warning("Invalid path provided for move operation");
+        return FALSE;
+    }
+
+    // Check if source file exists
+    GFile *source_file = g_file_new_for_path(source_path);
+    gboolean exists = g_file_query_exists(source_file, NULL);
+    g_object_unref(source_file);
+
+    if (!exists) {
+        g_warning("Source file does not exist: %s", source_path);
+        return FALSE;
+    }
+
+    // Perform the move operation
+    trace_span_t span = trace_begin("fileop", "move_file");
+    gboolean moved = move_path(source_path, dest_path);
+    trace_end_detail(span, source_path);
+    if (!moved) {
+        return FALSE;
+    }
+
+    // Make copies of paths for history data
+    move_paths_t *paths = g_malloc(sizeof(move_paths_t));
+    paths->source_path = g_strdup(source_path);
+    paths->dest_path = g_strdup(dest_path);
+
+    // Create and add operation to history
+    operation_t op = {
+        .type = OPERATION_TYPE_MOVE,
+        .data = paths  // Store both paths for possible undo functionality
+    };
+    add_operation_to_history(op);
+
+    return TRUE;
+}
+
+/**
+ * Undoes a move operation by moving the file back to its original location
+ * @param operation The operation to undo (must be OPERATION_TYPE_MOVE)
+ * @return TRUE if successful, FALSE otherwise
+ */
+gboolean undo_move_file(operation_t operation) {
+    // Verify this is a move operation
+    if (operation.type != OPERATION_TYPE_MOVE) {
+        g_warning("Cannot undo non-move operation with undo_move_file");
+        return FALSE;
+    }
+
+    // Check if data is valid
+    if (!operation.data) {
+        g_warning("Invalid operation data for move undo");
+        return FALSE;
+    }
+
+    // Extract the paths from operation data
+    move_paths_t *paths = (move_paths_t *)operation.data;
+
+    // For undo, we simply swap the source and destination
+    // The original destination is now the source
+    // The original source is now the destination
+    // (move_path is used directly so the undo itself doesn't end up in the history)
+    gboolean success = move_path(paths->dest_path, paths->source_path);
+
+    if (!success) {
+        g_warning("Failed to undo move operation from %s to %s",
+                  paths->dest_path, paths->source_path);
+    }
+
+    return success;
+}
+
+/**
+ * Undoes a delete operation by restoring the file from trash
+ * @param operation The operation to undo (must be OPERATION_TYPE_DELETE)
+ * @return TRUE if successful, FALSE otherwise
+ */
+gboolean undo_delete_file(operation_t operation) {
+    if (operation.type != OPERATION_TYPE_DELETE) {
+        g_warning("Attempted to undo non-delete operation");
+        return FALSE;
+    }
+
+    // The operation data contains the original path of the deleted file
+    const char *orig_path = (const char *)operation.data;
+    if (!orig_path) {
+        g_warning("Invalid operation data for undo delete");
+        return FALSE;
+    }
+
+    // Get the trash directory
+    g_autoptr(GFile) trash_dir = g_file_new_for_uri("trash:///");
+
+    // Enumerate files in the trash to find our file
+    g_autoptr(GFileEnumerator) enumerator =
+        g_file_enumerate_children(trash_dir,
+                                 G_FILE_ATTRIBUTE_STANDARD_NAME "," G_FILE_ATTRIBUTE_TRASH_ORIG_PATH,
+                                 G_FILE_QUERY_INFO_NONE,
+                                 NULL, NULL);
+
+    if (!enumerator) {
+        g_warning("Could not access trash directory");
+        return FALSE;
+    }
+
+    // Find the file in trash that matches our original path
+    g_autoptr(GFile) trashed_file = NULL;
+    GFileInfo* info;
+
+    while ((info = g_file_enumerator_next_file(enumerator, NULL, NULL)) != NULL) {
+        g_autofree char *trash_orig_path =
+            g_file_info_get_attribute_as_string(info, G_FILE_ATTRIBUTE_TRASH_ORIG_PATH);
+
+        if (g_strcmp0(trash_orig_path, orig_path) == 0) {
+            // Found our file
+            const char *name = g_file_info_get_name(info);
+            trashed_file = g_file_get_child(trash_dir, name);
+            g_object_unref(info);
+            break;
+        }
+
+        g_object_unref(info);
+    }
+
+    if (!trashed_file) {
+        g_warning("Could not find the deleted file in trash: %s", orig_path);
+        return FALSE;
+    }
+
+    // Create the target file
+    g_autoptr(GFile) target = g_file_new_for_path(orig_path);
+
+    // Move the file from trash back to original location
+    g_autoptr(GError) error = NULL;
+    gboolean success = g_file_move(trashed_file,
+                                  target,
+                                  G_FILE_COPY_NONE,
+                                  NULL, NULL, NULL,
+                                  &error);
+
+    if (!success) {
+        g_warning("Failed to restore file from trash: %s", error ? error->message : "Unknown error");
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ * Undoes the given operation by calling the appropriate undo function
+ * @param operation The operation to undo (batches are not handled here)
+ * @return TRUE if successful, FALSE otherwise
+ */
+gboolean undo_operation(operation_t operation) {
+    // Handle operation based on its type
+    switch (operation.type) {
+        case OPERATION_TYPE_MOVE:
+            return undo_move_file(operation);
+
+        case OPERATION_TYPE_DELETE:
+            return undo_delete_file(operation);
+
+        case OPERATION_TYPE_PASTE:
+            return undo_paste_file(operation);
+
+        case OPERATION_TYPE_COPY:
+            g_print("Undo for copy operation is not yet implemented\n");
+            return FALSE;
+
+        case OPERATION_TYPE_CREATE_DIRECTORY:
+            g_print("Undo for create directory operation is not yet implemented\n");
+            return FALSE;
+
+        case OPERATION_TYPE_CREATE_FILE:
+            g_print("Undo for create file operation is not yet implemented\n");
+            return FALSE;
+
+        case OPERATION_TYPE_BATCH:
+            g_warning("Batches must be undone through undo_last_operation");
+            return FALSE;
+
+        case OPERATION_TYPE_NONE:
+        default:
+            g_warning("Cannot undo operation of unknown or invalid type: %d", operation.type);
+            return FALSE;
+    }
+}
+
+/**
+ * Applies the given operation again after it has been undone
+ * @param operation The operation to redo (batches are not handled here)
+ * @return TRUE if successful, FALSE otherwise
+ */
+gboolean redo_operation(operation_t operation) {
+    switch (operation.type) {
+        case OPERATION_TYPE_DELETE:
+            // For redo of delete, we need to delete the file again
+            return trash_path((const char *)operation.data);
+
+        case OPERATION_TYPE_MOVE: {
+            // For redo of move, we need to move the file again (original source to dest)
+            move_paths_t *paths = (move_paths_t *)operation.data;
+            return move_path(paths->source_path, paths->dest_path);
+        }
+
+        case OPERATION_TYPE_PASTE: {
+            // For redo of paste, we copy the file to its pasted location again
+            move_paths_t *paths = (move_paths_t *)operation.data;
+            return copy_path(paths->source_path, paths->dest_path);
+        }
+
+        case OPERATION_TYPE_COPY:
+            g_print("Redo for copy operation is not yet implemented\n");
+            return FALSE;
+
+        case OPERATION_TYPE_CREATE_DIRECTORY:
+            g_print("Redo for create directory operation is not yet implemented\n");
+            return FALSE;
+
+        case OPERATION_TYPE_CREATE_FILE:
+            g_print("Redo for create file operation is not yet implemented\n");
+            return FALSE;
+
+        case OPERATION_TYPE_BATCH:
+            g_warning("Batches must be redone through redo_last_undo");
+            return FALSE;
+
+        case OPERATION_TYPE_NONE:
+        default:
+            g_warning("Cannot redo operation of unknown or invalid type: %d", operation.type);
+            return FALSE;
+    }
+}
+
+/**
+ * State of a background undo/redo job
+ * The operation is split into the parts that succeeded and the parts that failed,
+ * so a partially failed batch only moves the successful part to the other history
+ */
+typedef struct {
+    operation_t operation; // Operation being processed, owned by the job
+    gboolean redo; // TRUE to redo, FALSE to undo
+    guint64 journal_id; // Batch id the job's progress is journaled under
+    GArray *done; // Sub-operations that were processed successfully
+    GArray *failed; // Sub-operations that could not be processed
+} history_job_t;
+
+/**
+ * Undoes or redoes an operation, sorting it (or its children for a batch) into done/failed
+ * @param job The job being run
+ * @param operation The operation to process (its data is moved into the job arrays)
+ */
+static void process_history_operation(history_job_t *job, operation_t *operation) {
+    if (operation->type == OPERATION_TYPE_BATCH) {
+        GArray *children = operation->data;
+
+        // Undo walks the batch backwards so later operations are reverted before earlier ones
+        for (guint i = 0; i < children->len; i++) {
+            guint index = job->redo ? i : children->len - 1 - i;
+            process_history_operation(job, &g_array_index(children, operation_t, index));
+        }
+
+        // The children now live in done/failed, only free the container
+        g_array_free(children, TRUE);
+        operation->data = NULL;
+        return;
+    }
+
+    gboolean success = job->redo ? redo_operation(*operation) : undo_operation(*operation);
+    GArray *target = success ? job->done : job->failed;
+
+    if (success) {
+        const char *source_path, *dest_path;
+        get_operation_paths(operation, &source_path, &dest_path);
+        journal_batch_item(job->journal_id, operation->type, source_path, dest_path);
+    }
+
+    // Keep the original execution order in both arrays regardless of direction
+    if (job->redo) {
+        g_array_append_val(target, *operation);
+    } else {
+        g_array_prepend_val(target, *operation);
+    }
+}
+
+/**
+ * Worker thread body of an undo/redo job
+ */
+static void history_job_thread(GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable) {
+    history_job_t *job = task_data;
+    trace_span_t span = trace_begin("fileop", job->redo ? "redo" : "undo");
+
+    // Record the plan first so a crash halfway through can be resumed or rolled back
+    journal_batch_begin(job->journal_id, job->redo ? JOURNAL_DIRECTION_DO : JOURNAL_DIRECTION_UNDO);
+    journal_operation_leaves(job->journal_id, &job->operation, TRUE);
+
+    process_history_operation(job, &job->operation);
+    trace_end(span);
+
+    g_task_return_boolean(task, job->failed->len == 0);
+}
+
+/**
+ * Called on the main thread once an undo/redo job is done
+ * Moves the processed operations to the other history and reloads the current directory
+ */
+static void history_job_finished(GObject *source_object, GAsyncResult *res, gpointer user_data) {
+    history_job_t *job = g_task_get_task_data(G_TASK(res));
+    gboolean success = g_task_propagate_boolean(G_TASK(res), NULL);
+
+    history_ring_t *target = job->redo ? &operation_history : &forward_history;
+    history_ring_t *source = job->redo ? &forward_history : &operation_history;
+
+    operation_t done = operation_from_array(job->done);
+    operation_t failed = operation_from_array(job->failed);
+
+    // The done operations are already journaled as items of the job's batch
+    if (done.type != OPERATION_TYPE_NONE) {
+        journal_batch_end(job->journal_id, get_ring_id(target));
+        history_ring_push(target, done);
+    } else {
+        journal_batch_abandon(job->journal_id);
+    }
+
+    // Whatever failed stays where it was so it can be retried
+    history_push(source, failed);
+
+    if (success) {
+        g_print("%s operation finished successfully\n", job->redo ? "Redo" : "Undo");
+    } else {
+        g_print("Failed to %s operation\n", job->redo ? "redo" : "undo");
+    }
+
+    history_job_running = FALSE;
+    if (history_changed) {
+        history_changed();
+    }
+
+    // Continue with the next interrupted batch if the user asked to resolve them
+    if (resolving_interrupted && !g_queue_is_empty(&interrupted_batches)) {
+        resolve_interrupted_batches(resume_interrupted);
+    }
+}
+
+/**
+ * Pops the last operation off a history and processes it in a background job
+ * @param ring History to take the operation from
+ * @param redo TRUE to redo the operation, FALSE to undo it
+ * @return TRUE if the job was started, FALSE otherwise
+ */
+static gboolean start_history_job(history_ring_t *ring, gboolean redo) {
+    if (history_job_running) {
+        g_print("Another undo/redo operation is still running\n");
+        return FALSE;
+    }
+
+    operation_t operation;
+    if (!history_pop(ring, &operation)) {
+        g_print(redo ? "No operations to redo\n" : "No operations to undo\n");
+        return FALSE;
+    }
+
+    history_job_t *job = g_new0(history_job_t, 1);
+    job->operation = operation;
+    job->redo = redo;
+    job->journal_id = next_batch_id++;
+    job->done = g_array_new(FALSE, FALSE, sizeof(operation_t));
+    job->failed = g_array_new(FALSE, FALSE, sizeof(operation_t));
+
+    history_job_running = TRUE;
+
+    GTask *task = g_task_new(NULL, NULL, history_job_finished, NULL);
+    g_task_set_task_data(task, job, g_free);
+    g_task_run_in_thread(task, history_job_thread);
+    g_object_unref(task);
+
+    return TRUE;
+}
+
+/**
+ * Undoes the last operation in the history in a background job and stores it in forward history for possible redo
+ * The history changed function (see set_history_changed_func()) is called once the job finishes
+ * @return TRUE if the job was started, FALSE if no operations to undo or another job is still running
+ */
+gboolean undo_last_operation(void) {
+    return start_history_job(&operation_history, FALSE);
+}
+
+/**
+ * Redoes the last undone operation in a background job by applying it again
+ * The history changed function (see set_history_changed_func()) is called once the job finishes
+ * @return TRUE if the job was started, FALSE if no operations to redo or another job is still running
+ */
+gboolean redo_last_undo(void) {
+    return start_history_job(&forward_history, TRUE);
+}
+
+/**
+ * Gets the number of batches the journal reported as interrupted at startup
+ * @return Number of interrupted batches still waiting to be resumed or rolled back
+ */
+guint get_interrupted_batch_count(void) {
+    return interrupted_batches.length;
+}
+
+/**
+ * Builds a key identifying an operation, used to match planned and completed operations
+ */
+static char* get_operation_key(const operation_t *operation) {
+    const char *source_path, *dest_path;
+    get_operation_paths(operation, &source_path, &dest_path);
+    return g_strdup_printf("%d\t%s\t%s", operation->type, source_path ? source_path : "", dest_path ? dest_path : "");
+}
+
+/**
+ * Gets the planned operations of an interrupted batch that were never completed
+ * @param batch The batch (its planned array is consumed)
+ * @return Array of operation_t in execution order
+ */
+static GArray* get_remaining_operations(journal_batch_t *batch) {
+    GArray *remaining = g_array_new(FALSE, FALSE, sizeof(operation_t));
+
+    // Count completed operations by key, the same operation can be planned more than once
+    GHashTable *completed = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    for (guint i = 0; i < batch->completed->len; i++) {
+        char *key = get_operation_key(&g_array_index(batch->completed, operation_t, i));
+        guint count = GPOINTER_TO_UINT(g_hash_table_lookup(completed, key));
+        g_hash_table_replace(completed, key, GUINT_TO_POINTER(count + 1));
+    }
+
+    for (guint i = 0; i < batch->planned->len; i++) {
+        operation_t *operation = &g_array_index(batch->planned, operation_t, i);
+        char *key = get_operation_key(operation);
+        guint count = GPOINTER_TO_UINT(g_hash_table_lookup(completed, key));
+
+        if (count > 0) {
+            g_hash_table_insert(completed, key, GUINT_TO_POINTER(count - 1));
+            free_operation(operation);
+        } else {
+            g_free(key);
+            g_array_append_val(remaining, *operation);
+        }
+    }
+
+    g_hash_table_unref(completed);
+    g_array_free(batch->planned, TRUE);
+    batch->planned = NULL;
+
+    return remaining;
+}
+
+/**
+ * Resumes or rolls back the batches that were interrupted in the previous session
+ *
+ * The part of each batch that is currently applied on disk goes onto the history and the
+ * rest onto the forward history, then a regular undo or redo job finishes the batch in its
+ * original direction (resume) or reverts it (roll back). Batches are handled one after the other.
+ *
+ * @param resume TRUE to resume the batches, FALSE to roll them back
+ */
+void resolve_interrupted_batches(gboolean resume) {
+    resolving_interrupted = TRUE;
+    resume_interrupted = resume;
+
+    journal_batch_t *batch;
+    while (!history_job_running && (batch = g_queue_pop_head(&interrupted_batches)) != NULL) {
+        gboolean undo_direction = batch->direction == JOURNAL_DIRECTION_UNDO;
+
+        operation_t rest = operation_from_array(get_remaining_operations(batch));
+        operation_t completed = operation_from_array(batch->completed);
+        batch->completed = NULL;
+
+        // The batch is settled from here on, later replays must not report it again
+        journal_batch_abandon(batch->id);
+        free_journal_batch(batch);
+
+        // Resuming continues in the batch's direction, rolling back goes the other way
+        gboolean redo = resume != undo_direction;
+        operation_t *applied = undo_direction ? &rest : &completed;
+        operation_t *pending = undo_direction ? &completed : &rest;
+        gboolean has_work = redo ? pending->type != OPERATION_TYPE_NONE : applied->type != OPERATION_TYPE_NONE;
+
+        history_push(&operation_history, *applied);
+        history_push(&forward_history, *pending);
+
+        if (has_work) {
+            start_history_job(redo ? &forward_history : &operation_history, redo);
+        }
+    }
+}
+
+/**
+ * Undoes a paste operation by deleting the pasted file
+ * @param operation The paste operation to undo (must be OPERATION_TYPE_PASTE)
+ * @return TRUE if successful, FALSE otherwise
+ */
+gboolean undo_paste_file(operation_t operation) {
+    if (operation.type != OPERATION_TYPE_PASTE) {
+        g_warning("Attempted to undo a non-paste operation with undo_paste_file");
+        return FALSE;
+    }
+
+    move_paths_t *paths = (move_paths_t *)operation.data;
+    if (!paths || !paths->dest_path) {
+        g_warning("Invalid paste operation data");
+        return FALSE;
+    }
+
+    g_print("Undoing paste operation: Deleting %s\n", paths->dest_path);
+
+    // Create a GFile for the destination path
+    GFile *dest_file = g_file_new_for_path(paths->dest_path);
+    if (!dest_file) {
+        g_warning("Failed to create GFile for %s", paths->dest_path);
+        return FALSE;
+    }
+
+    // Check if the file exists
+    if (!g_file_query_exists(dest_file, NULL)) {
+        g_warning("File %s does not exist", paths->dest_path);
+        g_object_unref(dest_file);
+        return FALSE;
+    }
+
+    // Delete the file
+    GError *error = NULL;
+    gboolean success = g_file_delete(dest_file, NULL, &error);
+
+    if (!success) {
+        g_warning("Failed to delete file %s: %s", paths->dest_path, error ? error->message : "Unknown error");
+        if (error) {
+            g_error_free(error);
+        }
+        g_object_unref(dest_file);
+        return FALSE;
+    }
+
+    g_object_unref(dest_file);
+    g_print("Successfully undid paste operation by deleting %s\n", paths->dest_path);
+
+    return TRUE;
+}
+
+/**
+ * Copies files into a directory as one undoable operation
+ * @param uris URIs of the files to copy, stops at the first NULL or empty string
+ * @param directory Directory to copy into
+ * @return Number of files copied
+ */
+guint paste_uris(char **uris, const char *directory) {
+    // Count successful copy operations for reporting
+    guint copied_count = 0;
+
+    // Every file of this paste becomes part of one undoable operation
+    begin_operation_batch();
+
+    // Resolve source and destination of every URI first, so the whole paste can be journaled as a plan
+    GPtrArray *source_paths = g_ptr_array_new_with_free_func(g_free);
+    GPtrArray *dest_paths = g_ptr_array_new_with_free_func(g_free);
+
+    for (char **uri_ptr = uris; *uri_ptr != NULL && **uri_ptr != '\0'; uri_ptr++) {
+        // Create a GFile from the URI
+        GFile *src_file = g_file_new_for_uri(*uri_ptr);
+        char *src_path = g_file_get_path(src_file);
+        char *basename = g_file_get_basename(src_file);
+
+        if (src_path && basename) {
+            // Create destination file path by combining target directory and basename
+            char *dest_path = g_build_filename(directory, basename, NULL);
+            plan_batch_operation(OPERATION_TYPE_PASTE, src_path, dest_path);
+
+            g_ptr_array_add(source_paths, src_path);
+            g_ptr_array_add(dest_paths, dest_path);
+        } else {
+            g_free(src_path);
+        }
+
+        g_free(basename);
+        g_object_unref(src_file);
+    }
+
+    // Process each file
+    trace_span_t span = trace_begin("fileop", "paste");
+    for (guint i = 0; i < source_paths->len; i++) {
+        const char *src_path = g_ptr_array_index(source_paths, i);
+        const char *dest_path = g_ptr_array_index(dest_paths, i);
+
+        // Perform the copy operation
+        if (copy_path(src_path, dest_path)) {
+            copied_count++;
+
+            // Create and add a paste operation to history for possible undo
+            move_paths_t *paste_data = g_malloc(sizeof(move_paths_t));
+            paste_data->source_path = g_strdup(src_path);
+            paste_data->dest_path = g_strdup(dest_path);
+
+            operation_t op = {
+                .type = OPERATION_TYPE_PASTE,
+                .data = paste_data
+            };
+
+            add_operation_to_history(op);
+        }
+    }
+
+    trace_end_detail(span, directory);
+    g_ptr_array_unref(source_paths);
+    g_ptr_array_unref(dest_paths);
+
+    end_operation_batch();
+
+    return copied_count;
+}
+
+/**
+ * Sets the function called once an undo/redo job changed the file system
+ * @param func The function, NULL for none
+ */
+void set_history_changed_func(history_changed_func func) {
+    history_changed = func;
+}
+
+/**
+ * Adds an operation and everything it owns to the history stats
+ */
+static void add_operation_stats(const operation_t *operation, guint *operations, gsize *bytes) {
+    *operations += 1;
+    *bytes += sizeof(*operation);
+    if (!operation->data) {
+        return;
+    }
+
+    switch (operation->type) {
+        case OPERATION_TYPE_MOVE:
+        case OPERATION_TYPE_PASTE: {
+            const move_paths_t *paths = operation->data;
+            *bytes += sizeof(*paths) + strlen(paths->source_path) + 1 + strlen(paths->dest_path) + 1;
+            break;
+        }
+
+        case OPERATION_TYPE_BATCH: {
+            GArray *children = operation->data;
+            *operations -= 1; // Only the operations of a batch are counted
+            for (guint i = 0; i < children->len; i++) {
+                add_operation_stats(&g_array_index(children, operation_t, i), operations, bytes);
+            }
+            break;
+        }
+
+        default:
+            *bytes += strlen(operation->data) + 1;
+            break;
+    }
+}
+
+/**
+ * Gets what the undo and redo histories hold
+ * @param operations Filled with the number of operations, counting every operation of a batch
+ * @param bytes Filled with the estimated size of the operations and their paths
+ */
+void history_get_stats(guint *operations, gsize *bytes) {
+    *operations = 0;
+    *bytes = sizeof(operation_history) + sizeof(forward_history);
+
+    const history_ring_t *rings[] = { &operation_history, &forward_history };
+    for (guint r = 0; r < G_N_ELEMENTS(rings); r++) {
+        for (guint i = 0; i < rings[r]->len; i++) {
+            const operation_t *operation = &rings[r]->items[(rings[r]->head + i) % MAX_HISTORY_SIZE];
+            gsize own_size = 0;
+            add_operation_stats(operation, operations, &own_size);
+            // The slot itself is part of the ring
+            *bytes += own_size - sizeof(*operation);
+        }
+    }
+}
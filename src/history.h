@@ -0,0 +1,203 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <glib.h>
+
+/**
+ * File operations and their undo/redo history
+ *
+ * Deleting, moving and pasting go through here so they can be undone. Undo and
+ * redo run in background jobs and every step is journaled (journal.h), so a batch
+ * interrupted by a crash can be resumed or rolled back on the next start. Nothing
+ * here depends on GTK, the file manager is told about changes through
+ * set_history_changed_func().
+ */
+
+#define MAX_HISTORY_SIZE 50 // Maximum number of operations to store in history
+
+enum OPERATION_TYPE {
+
+    OPERATION_TYPE_NONE, // No operation just in case
+    OPERATION_TYPE_COPY, // The rest is self-explanatory
+    OPERATION_TYPE_PASTE,
+    OPERATION_TYPE_MOVE,
+    OPERATION_TYPE_DELETE,
+    OPERATION_TYPE_CREATE_DIRECTORY,
+    OPERATION_TYPE_CREATE_FILE,
+    OPERATION_TYPE_BATCH // Several operations undone/redone as one unit, data is a GArray of operation_t
+};
+
+// Operation structure for handling history
+typedef struct {
+    enum OPERATION_TYPE type; // Type of operation
+    gpointer data; // Data associated with the operation, can be anything
+} operation_t;
+
+/**
+ * Fixed-capacity ring buffer of operations
+ * Once full, pushing a new operation overwrites (and frees) the oldest one
+ */
+typedef struct {
+    operation_t items[MAX_HISTORY_SIZE];
+    guint head; // Index of the oldest operation
+    guint len; // Number of operations currently stored
+} history_ring_t;
+
+/**
+ * Deletes a file at the given path and adds the operation to history
+ * @param path Full path to the file to delete
+ * @return TRUE if successful, FALSE otherwise
+ */
+gboolean delete_file(const char* path);
+
+/**
+ * Moves or renames a file from source path to destination path
+ * If both paths are in the same directory, it acts as rename
+ * If paths are in different directories, it moves the file
+ *
+ * @param source_path Full path to the source file
+ * @param dest_path Full path to the destination (new name or location)
+ * @return TRUE if successful, FALSE otherwise
+ */
+gboolean move_file(const char* source_path, const char* dest_path);
+
+/**
+ * Undoes a move operation by moving the file back to its original location
+ * @param operation The operation to undo (must be OPERATION_TYPE_MOVE)
+ * @return TRUE if successful, FALSE otherwise
+ */
+gboolean undo_move_file(operation_t operation);
+
+/**
+ * Undoes a delete operation by restoring the file from trash
+ * @param operation The operation to undo (must be OPERATION_TYPE_DELETE)
+ * @return TRUE if successful, FALSE otherwise
+ */
+gboolean undo_delete_file(operation_t operation);
+
+/**
+ * Undoes a paste operation by deleting the pasted file
+ * @param operation The paste operation to undo
+ * @return TRUE if successful, FALSE otherwise
+ */
+gboolean undo_paste_file(operation_t operation);
+
+/**
+ * Undoes the given operation by calling the appropriate undo function
+ * @param operation The operation to undo (batches are not handled here)
+ * @return TRUE if successful, FALSE otherwise
+ */
+gboolean undo_operation(operation_t operation);
+
+/**
+ * Applies the given operation again after it has been undone
+ * @param operation The operation to redo (batches are not handled here)
+ * @return TRUE if successful, FALSE otherwise
+ */
+gboolean redo_operation(operation_t operation);
+
+/**
+ * Undoes the last operation in the history in a background job and stores it in forward history for possible redo
+ * The history changed function (see set_history_changed_func()) is called once the job finishes
+ * @return TRUE if the job was started, FALSE if no operations to undo or another job is still running
+ */
+gboolean undo_last_operation(void);
+
+/**
+ * Redoes the last undone operation in a background job by applying it again
+ * The history changed function (see set_history_changed_func()) is called once the job finishes
+ * @return TRUE if the job was started, FALSE if no operations to redo or another job is still running
+ */
+gboolean redo_last_undo(void);
+
+/**
+ * Adds an operation to the operation history
+ * If a batch is open the operation is added to the batch instead
+ * @param operation The operation to add (the history takes ownership of its data)
+ */
+void add_operation_to_history(operation_t operation);
+
+/**
+ * Starts grouping operations into a single undoable unit
+ * Every operation added until the matching end_operation_batch() call becomes part of the batch
+ * Calls can be nested, only the outermost pair creates a history entry
+ */
+void begin_operation_batch(void);
+
+/**
+ * Records an operation the open batch is about to perform
+ * Only used by the journal, so an interrupted batch can be resumed after a crash
+ * @param type Operation type
+ * @param source_path First path of the operation
+ * @param dest_path Second path of the operation, NULL for operations with a single path
+ */
+void plan_batch_operation(enum OPERATION_TYPE type, const char *source_path, const char *dest_path);
+
+/**
+ * Closes the batch opened by begin_operation_batch() and adds it to the history
+ * A batch containing a single operation is stored as that plain operation
+ */
+void end_operation_batch(void);
+
+/**
+ * Gets the number of batches the journal reported as interrupted at startup
+ * @return Number of interrupted batches still waiting to be resumed or rolled back
+ */
+guint get_interrupted_batch_count(void);
+
+/**
+ * Resumes or rolls back the batches that were interrupted in the previous session
+ * Runs as regular undo/redo jobs, one batch after the other
+ * @param resume TRUE to resume the batches, FALSE to roll them back
+ */
+void resolve_interrupted_batches(gboolean resume);
+
+/**
+ * Frees the data owned by an operation (recursively for batches)
+ * @param operation The operation whose data should be freed
+ */
+void free_operation(operation_t *operation);
+
+/**
+ * Initialize the operation history system
+ * Reloads the history from the journal and starts journaling new operations
+ * Should be called once at program start
+ */
+void init_operation_history();
+
+/**
+ * Clean up operation history system resources
+ * Flushes the journal so the history is restored on the next start
+ * Should be called before program exit
+ */
+void cleanup_operation_history();
+
+/**
+ * Copies files into a directory as one undoable operation
+ * @param uris URIs of the files to copy, stops at the first NULL or empty string
+ * @param directory Directory to copy into
+ * @return Number of files copied
+ */
+guint paste_uris(char **uris, const char *directory);
+
+/**
+ * Called on the main thread once an undo/redo job changed the file system
+ */
+typedef void (*history_changed_func)(void);
+
+/**
+ * Sets the function called once an undo/redo job changed the file system
+ * The file manager reloads the current directory
+ * @param func The function, NULL for none
+ */
+void set_history_changed_func(history_changed_func func);
+
+/**
+ * Gets what the undo and redo histories hold
+ * Must be called from the main thread
+ * @param operations Filled with the number of operations, counting every operation of a batch
+ * @param bytes Filled with the estimated size of the operations and their paths
+ */
+void history_get_stats(guint *operations, gsize *bytes);
+
+#endif //HISTORY_H
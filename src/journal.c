@@ -0,0 +1,425 @@
+#include "journal.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
+
+#define JOURNAL_FLUSH_SIZE (64 * 1024) // Write the buffer out once it grows past this
+
+typedef enum {
+    JOURNAL_MESSAGE_RECORD,
+    JOURNAL_MESSAGE_REWRITE_BEGIN,
+    JOURNAL_MESSAGE_REWRITE_COMMIT,
+    JOURNAL_MESSAGE_SHUTDOWN
+} journal_message_kind_t;
+
+// Message passed from the callers to the writer thread
+typedef struct {
+    journal_message_kind_t kind;
+    char *line; // Formatted record for JOURNAL_MESSAGE_RECORD, NULL otherwise
+} journal_message_t;
+
+static GAsyncQueue *journal_queue = NULL; // Guarded by journal_lock, undo/redo jobs journal from their thread
+static GMutex journal_lock;
+static GThread *journal_thread = NULL;
+static char *journal_path = NULL;
+
+/**
+ * Gets the path of the journal file, creating its directory if needed
+ * @return Path of the journal (owned by this module) or NULL if the directory could not be created
+ */
+static const char* get_journal_path(void) {
+    if (journal_path) {
+        return journal_path;
+    }
+
+    char *dir = g_build_filename(g_get_user_state_dir(), "custom-file-manager", NULL);
+    if (g_mkdir_with_parents(dir, 0700) != 0) {
+        g_warning("Could not create journal directory %s: %s", dir, g_strerror(errno));
+        g_free(dir);
+        return NULL;
+    }
+
+    journal_path = g_build_filename(dir, "history.journal", NULL);
+    g_free(dir);
+    return journal_path;
+}
+
+/**
+ * Writes a whole buffer to a file descriptor, retrying on short writes
+ * @return TRUE if everything was written
+ */
+static gboolean write_all(int fd, const char *data, gsize length) {
+    while (length > 0) {
+        ssize_t written = write(fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            g_warning("Failed to write history journal: %s", g_strerror(errno));
+            return FALSE;
+        }
+        data += written;
+        length -= written;
+    }
+    return TRUE;
+}
+
+/**
+ * Writes the pending buffer to fd and empties it
+ */
+static void flush_buffer(int fd, GString *buffer) {
+    if (buffer->len > 0 && fd >= 0) {
+        write_all(fd, buffer->str, buffer->len);
+    }
+    g_string_truncate(buffer, 0);
+}
+
+/**
+ * Body of the writer thread
+ *
+ * Drains every queued record into one buffer before writing it, and syncs at most
+ * once per JOURNAL_SYNC_INTERVAL_MS. While a sync is pending it waits for more
+ * records with a timeout, so a burst of records shares a single fdatasync().
+ */
+static gpointer journal_writer_thread(gpointer user_data) {
+    const char *path = user_data;
+    char *rewrite_path = g_strconcat(path, ".new", NULL);
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        g_warning("Could not open history journal %s: %s", path, g_strerror(errno));
+    }
+    int rewrite_fd = -1;
+
+    GString *buffer = g_string_new(NULL);
+    gint64 last_sync = 0;
+    gboolean dirty = FALSE;
+    gboolean running = TRUE;
+
+    while (running) {
+        journal_message_t *message;
+
+        if (dirty) {
+            gint64 wait = last_sync + JOURNAL_SYNC_INTERVAL_MS * G_TIME_SPAN_MILLISECOND - g_get_monotonic_time();
+            message = wait > 0 ? g_async_queue_timeout_pop(journal_queue, wait) : NULL;
+        } else {
+            message = g_async_queue_pop(journal_queue);
+        }
+
+        while (message) {
+            switch (message->kind) {
+                case JOURNAL_MESSAGE_RECORD:
+                    g_string_append(buffer, message->line);
+                    break;
+
+                case JOURNAL_MESSAGE_REWRITE_BEGIN:
+                    // Everything queued before the rewrite still belongs to the old file
+                    flush_buffer(fd, buffer);
+                    rewrite_fd = open(rewrite_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+                    if (rewrite_fd < 0) {
+                        g_warning("Could not create %s: %s", rewrite_path, g_strerror(errno));
+                    }
+                    break;
+
+                case JOURNAL_MESSAGE_REWRITE_COMMIT:
+                    if (rewrite_fd < 0) break;
+                    flush_buffer(rewrite_fd, buffer);
+                    if (fdatasync(rewrite_fd) == 0 && rename(rewrite_path, path) == 0) {
+                        if (fd >= 0) close(fd);
+                        fd = rewrite_fd;
+                    } else {
+                        g_warning("Could not replace history journal: %s", g_strerror(errno));
+                        close(rewrite_fd);
+                    }
+                    rewrite_fd = -1;
+                    break;
+
+                case JOURNAL_MESSAGE_SHUTDOWN:
+                    running = FALSE;
+                    break;
+            }
+
+            g_free(message->line);
+            g_free(message);
+
+            if (buffer->len >= JOURNAL_FLUSH_SIZE) {
+                flush_buffer(rewrite_fd >= 0 ? rewrite_fd : fd, buffer);
+                dirty = TRUE;
+            }
+
+            message = running ? g_async_queue_try_pop(journal_queue) : NULL;
+        }
+
+        if (buffer->len > 0) {
+            flush_buffer(rewrite_fd >= 0 ? rewrite_fd : fd, buffer);
+            dirty = TRUE;
+        }
+
+        gint64 now = g_get_monotonic_time();
+        if (dirty && (!running || now - last_sync >= JOURNAL_SYNC_INTERVAL_MS * G_TIME_SPAN_MILLISECOND)) {
+            if (fd >= 0) fdatasync(fd);
+            if (rewrite_fd >= 0) fdatasync(rewrite_fd);
+            last_sync = now;
+            dirty = FALSE;
+        }
+    }
+
+    if (rewrite_fd >= 0) {
+        // Rewrite never committed, keep the old journal
+        close(rewrite_fd);
+        g_unlink(rewrite_path);
+    }
+    if (fd >= 0) close(fd);
+
+    g_string_free(buffer, TRUE);
+    g_free(rewrite_path);
+    return NULL;
+}
+
+/**
+ * Queues a message for the writer thread
+ * @param kind Message kind
+ * @param line Formatted record (ownership is taken), NULL for control messages
+ */
+static void journal_send(journal_message_kind_t kind, char *line) {
+    g_mutex_lock(&journal_lock);
+    if (!journal_queue) {
+        g_mutex_unlock(&journal_lock);
+        g_free(line);
+        return;
+    }
+
+    journal_message_t *message = g_new(journal_message_t, 1);
+    message->kind = kind;
+    message->line = line;
+    g_async_queue_push(journal_queue, message);
+    g_mutex_unlock(&journal_lock);
+}
+
+/**
+ * Parses one journal line into a record
+ * @param line The line, without the trailing newline
+ * @param fields Pointer to store the split fields in (must be freed with g_strfreev)
+ * @param record Record to fill, its strings point into fields
+ * @return TRUE if the line is a valid record
+ */
+static gboolean parse_record(const char *line, char ***fields, journal_record_t *record) {
+    *fields = g_strsplit(line, "\t", 5);
+    char **parts = *fields;
+    guint n_parts = g_strv_length(parts);
+
+    memset(record, 0, sizeof(journal_record_t));
+    if (n_parts < 2 || strlen(parts[0]) != 1) {
+        return FALSE;
+    }
+
+    record->kind = parts[0][0];
+
+    if (record->kind == 'X') {
+        record->flag = parts[1][0];
+        return TRUE;
+    }
+
+    record->id = g_ascii_strtoull(parts[1], NULL, 10);
+
+    switch (record->kind) {
+        case 'B':
+        case 'E':
+            if (n_parts < 3) return FALSE;
+            record->flag = parts[2][0];
+            return TRUE;
+
+        case 'A':
+            return TRUE;
+
+        case 'P':
+        case 'I': {
+            if (n_parts < 4) return FALSE;
+            record->type = (enum OPERATION_TYPE)atoi(parts[2]);
+
+            // Paths are stored escaped, unescape them in place
+            char *source = g_strcompress(parts[3]);
+            g_free(parts[3]);
+            parts[3] = source;
+            record->source_path = source;
+
+            if (n_parts == 5 && parts[4][0] != '\0') {
+                char *dest = g_strcompress(parts[4]);
+                g_free(parts[4]);
+                parts[4] = dest;
+                record->dest_path = dest;
+            }
+            return TRUE;
+        }
+
+        default:
+            return FALSE;
+    }
+}
+
+/**
+ * Reads the journal from disk and calls func for every valid record, in order
+ * Must be called before journal_open()
+ * @param func Callback receiving each record
+ * @param user_data Data passed to func
+ * @return TRUE if a journal was found and read, FALSE otherwise
+ */
+gboolean journal_replay(journal_replay_func func, gpointer user_data) {
+    const char *path = get_journal_path();
+    if (!path) {
+        return FALSE;
+    }
+
+    char *contents = NULL;
+    gsize length = 0;
+    if (!g_file_get_contents(path, &contents, &length, NULL)) {
+        return FALSE;
+    }
+
+    // A crash can leave a partially written last line, which is simply not terminated
+    char *line = contents;
+    char *end = contents + length;
+    while (line < end) {
+        char *newline = memchr(line, '\n', end - line);
+        if (!newline) break;
+        *newline = '\0';
+
+        char **fields = NULL;
+        journal_record_t record;
+        if (parse_record(line, &fields, &record)) {
+            func(&record, user_data);
+        }
+        g_strfreev(fields);
+
+        line = newline + 1;
+    }
+
+    g_free(contents);
+    return TRUE;
+}
+
+/**
+ * Starts the background writer thread, appending to the existing journal
+ * @return TRUE if successful, FALSE if the journal directory could not be created
+ */
+gboolean journal_open(void) {
+    if (journal_thread) {
+        return TRUE;
+    }
+
+    const char *path = get_journal_path();
+    if (!path) {
+        return FALSE;
+    }
+
+    g_mutex_lock(&journal_lock);
+    journal_queue = g_async_queue_new();
+    g_mutex_unlock(&journal_lock);
+    journal_thread = g_thread_new("history-journal", journal_writer_thread, (gpointer)path);
+    return TRUE;
+}
+
+/**
+ * Flushes and syncs every queued record and stops the writer thread
+ * Records sent afterwards, e.g. by an undo/redo job still running at exit, are dropped
+ */
+void journal_close(void) {
+    if (!journal_thread) {
+        return;
+    }
+
+    // Detach the queue as the shutdown message is pushed, so no record is queued behind it
+    journal_message_t *message = g_new(journal_message_t, 1);
+    message->kind = JOURNAL_MESSAGE_SHUTDOWN;
+    message->line = NULL;
+    g_mutex_lock(&journal_lock);
+    GAsyncQueue *queue = journal_queue;
+    journal_queue = NULL;
+    g_async_queue_push(queue, message);
+    g_mutex_unlock(&journal_lock);
+
+    g_thread_join(journal_thread);
+    journal_thread = NULL;
+    g_async_queue_unref(queue);
+}
+
+/**
+ * Starts writing a fresh journal next to the current one
+ * Every record until journal_commit_rewrite() goes to the new file, which then atomically replaces the old one
+ */
+void journal_begin_rewrite(void) {
+    journal_send(JOURNAL_MESSAGE_REWRITE_BEGIN, NULL);
+}
+
+/**
+ * Syncs the journal started by journal_begin_rewrite() and moves it over the old one
+ */
+void journal_commit_rewrite(void) {
+    journal_send(JOURNAL_MESSAGE_REWRITE_COMMIT, NULL);
+}
+
+/**
+ * Formats and queues a 'P' or 'I' record
+ */
+static void journal_operation(char kind, guint64 id, enum OPERATION_TYPE type, const char *source_path, const char *dest_path) {
+    if (!journal_queue) {
+        return;
+    }
+
+    char *source = g_strescape(source_path ? source_path : "", NULL);
+    char *dest = g_strescape(dest_path ? dest_path : "", NULL);
+    journal_send(JOURNAL_MESSAGE_RECORD,
+                 g_strdup_printf("%c\t%" G_GUINT64_FORMAT "\t%d\t%s\t%s\n", kind, id, type, source, dest));
+    g_free(source);
+    g_free(dest);
+}
+
+/**
+ * Records the start of a batch ('B' line)
+ * @param id Unique batch id
+ * @param direction JOURNAL_DIRECTION_DO or JOURNAL_DIRECTION_UNDO
+ */
+void journal_batch_begin(guint64 id, char direction) {
+    if (!journal_queue) return;
+    journal_send(JOURNAL_MESSAGE_RECORD, g_strdup_printf("B\t%" G_GUINT64_FORMAT "\t%c\n", id, direction));
+}
+
+/**
+ * Records an operation the batch is going to perform ('P' line), used to resume an interrupted batch
+ */
+void journal_batch_plan(guint64 id, enum OPERATION_TYPE type, const char *source_path, const char *dest_path) {
+    journal_operation('P', id, type, source_path, dest_path);
+}
+
+/**
+ * Records an operation of the batch that has completed ('I' line)
+ */
+void journal_batch_item(guint64 id, enum OPERATION_TYPE type, const char *source_path, const char *dest_path) {
+    journal_operation('I', id, type, source_path, dest_path);
+}
+
+/**
+ * Records that a batch finished and its completed operations were pushed onto a ring ('E' line)
+ */
+void journal_batch_end(guint64 id, char ring) {
+    if (!journal_queue) return;
+    journal_send(JOURNAL_MESSAGE_RECORD, g_strdup_printf("E\t%" G_GUINT64_FORMAT "\t%c\n", id, ring));
+}
+
+/**
+ * Records that a batch finished without completing anything ('A' line)
+ */
+void journal_batch_abandon(guint64 id) {
+    if (!journal_queue) return;
+    journal_send(JOURNAL_MESSAGE_RECORD, g_strdup_printf("A\t%" G_GUINT64_FORMAT "\n", id));
+}
+
+/**
+ * Records that the newest entry was popped off a ring ('X' line)
+ */
+void journal_pop(char ring) {
+    if (!journal_queue) return;
+    journal_send(JOURNAL_MESSAGE_RECORD, g_strdup_printf("X\t%c\n", ring));
+}
@@ -0,0 +1,126 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <glib.h>
+#include "history.h"
+
+/**
+ * Append-only journal of the undo/redo history
+ *
+ * Every change to the operation history is written as a line of text to
+ * $XDG_STATE_HOME/custom-file-manager/history.journal, so the history can be
+ * rebuilt after the program exits or crashes. Lines are tab separated, paths are
+ * escaped with g_strescape():
+ *
+ *   B <id> <direction>           batch <id> started, direction is 'd' (do/redo) or 'u' (undo)
+ *   P <id> <type> <path> [<path>] operation planned as part of batch <id>
+ *   I <id> <type> <path> [<path>] operation of batch <id> completed
+ *   E <id> <ring>                batch <id> finished, its completed operations go on ring 'h' (history) or 'f' (forward)
+ *   A <id>                       batch <id> abandoned, nothing was completed
+ *   X <ring>                     newest entry popped off ring 'h' or 'f'
+ *
+ * A batch with a 'B' line but no 'E'/'A' line was interrupted.
+ *
+ * Writes are queued and performed by a background thread which batches them and
+ * only calls fdatasync() every JOURNAL_SYNC_INTERVAL_MS, so recording an operation
+ * costs the caller one formatted string and a queue push.
+ */
+
+#define JOURNAL_SYNC_INTERVAL_MS 50 // Minimum time between two fdatasync() calls
+#define JOURNAL_RING_HISTORY 'h'
+#define JOURNAL_RING_FORWARD 'f'
+#define JOURNAL_DIRECTION_DO 'd'
+#define JOURNAL_DIRECTION_UNDO 'u'
+
+/**
+ * A single parsed journal line, handed to the replay callback
+ * Strings are only valid during the callback
+ */
+typedef struct {
+    char kind; // 'B', 'P', 'I', 'E', 'A' or 'X'
+    guint64 id; // Batch id (unused for 'X')
+    char flag; // Direction for 'B', ring for 'E' and 'X'
+    enum OPERATION_TYPE type; // Operation type for 'P' and 'I'
+    const char *source_path; // First path for 'P' and 'I'
+    const char *dest_path; // Second path for 'P' and 'I', NULL if the operation has only one
+} journal_record_t;
+
+typedef void (*journal_replay_func)(const journal_record_t *record, gpointer user_data);
+
+/**
+ * Reads the journal from disk and calls func for every valid record, in order
+ * Must be called before journal_open()
+ * @param func Callback receiving each record
+ * @param user_data Data passed to func
+ * @return TRUE if a journal was found and read, FALSE otherwise
+ */
+gboolean journal_replay(journal_replay_func func, gpointer user_data);
+
+/**
+ * Starts the background writer thread, appending to the existing journal
+ * @return TRUE if successful, FALSE if the journal directory could not be created
+ */
+gboolean journal_open(void);
+
+/**
+ * Flushes and syncs every queued record and stops the writer thread
+ * Records sent afterwards, e.g. by an undo/redo job still running at exit, are dropped
+ */
+void journal_close(void);
+
+/**
+ * Starts writing a fresh journal next to the current one
+ * Every record until journal_commit_rewrite() goes to the new file, which then atomically replaces the old one
+ */
+void journal_begin_rewrite(void);
+
+/**
+ * Syncs the journal started by journal_begin_rewrite() and moves it over the old one
+ */
+void journal_commit_rewrite(void);
+
+/**
+ * Records the start of a batch ('B' line)
+ * @param id Unique batch id
+ * @param direction JOURNAL_DIRECTION_DO or JOURNAL_DIRECTION_UNDO
+ */
+void journal_batch_begin(guint64 id, char direction);
+
+/**
+ * Records an operation the batch is going to perform ('P' line), used to resume an interrupted batch
+ * @param id Batch id
+ * @param type Operation type
+ * @param source_path First path of the operation
+ * @param dest_path Second path of the operation, may be NULL
+ */
+void journal_batch_plan(guint64 id, enum OPERATION_TYPE type, const char *source_path, const char *dest_path);
+
+/**
+ * Records an operation of the batch that has completed ('I' line)
+ * @param id Batch id
+ * @param type Operation type
+ * @param source_path First path of the operation
+ * @param dest_path Second path of the operation, may be NULL
+ */
+void journal_batch_item(guint64 id, enum OPERATION_TYPE type, const char *source_path, const char *dest_path);
+
+/**
+ * Records that a batch finished and its completed operations were pushed onto a ring ('E' line)
+ * @param id Batch id
+ * @param ring JOURNAL_RING_HISTORY or JOURNAL_RING_FORWARD
+ */
+void journal_batch_end(guint64 id, char ring);
+
+/**
+ * Records that a batch finished without completing anything ('A' line)
+ * @param id Batch id
+ */
+void journal_batch_abandon(guint64 id);
+
+/**
+ * Records that the newest entry was popped off a ring ('X' line)
+ * @param ring JOURNAL_RING_HISTORY or JOURNAL_RING_FORWARD
+ */
+void journal_pop(char ring);
+
+#endif //JOURNAL_H
@@ -0,0 +1,338 @@
+#include "listcache.h"
+#include <errno.h>
+#include <sys/stat.h>
+#include <gio/gio.h>
+
+typedef struct {
+    dev_t dev;
+    ino_t ino;
+    gboolean show_hidden;
+} listcache_key_t;
+
+/**
+ * File monitor on a directory, shared by its cached listings and its watchers
+ */
+typedef struct {
+    char *directory; // Key in the monitors table
+    GFileMonitor *monitor;
+    gint ref_count; // One per cached entry and per watcher
+    GList *entries; // listcache_entry_t read from this directory
+    GList *watchers; // listcache_watcher_t
+} listcache_monitor_t;
+
+typedef struct {
+    guint id;
+    listcache_monitor_t *monitor;
+    listcache_change_func func;
+    gpointer user_data;
+} listcache_watcher_t;
+
+typedef struct {
+    listcache_key_t key;
+    gint64 mtime_sec;
+    gint64 mtime_nsec;
+    gint64 ctime_sec;
+    gint64 ctime_nsec;
+    dir_listing_t *listing;
+    gsize size; // dir_listing_get_memory_size() when the entry was last used
+    listcache_monitor_t *monitor;
+    GList link; // Node in the LRU queue, data points back to the entry
+} listcache_entry_t;
+
+static GHashTable *cache = NULL; // listcache_key_t -> listcache_entry_t, the key points into the entry
+static GQueue lru = G_QUEUE_INIT; // Most recently used first
+static gsize cache_size = 0;
+static GHashTable *monitors = NULL; // Directory path -> listcache_monitor_t
+static GHashTable *watchers = NULL; // Watch id -> listcache_watcher_t
+static guint last_watch_id = 0;
+
+static guint key_hash(gconstpointer key) {
+    const listcache_key_t *k = key;
+    return (guint)(k->ino ^ (k->ino >> 32) ^ (k->dev * 31) ^ k->show_hidden);
+}
+
+static gboolean key_equal(gconstpointer a, gconstpointer b) {
+    const listcache_key_t *first = a;
+    const listcache_key_t *second = b;
+    return first->dev == second->dev && first->ino == second->ino && first->show_hidden == second->show_hidden;
+}
+
+static void on_directory_changed(GFileMonitor *file_monitor, GFile *file, GFile *other_file,
+                                 GFileMonitorEvent event_type, gpointer user_data);
+
+/**
+ * Gets the monitor of a directory, creating it if needed
+ * @return New reference, NULL if the directory cannot be monitored
+ */
+static listcache_monitor_t* monitor_ref(const char *directory) {
+    if (!monitors) {
+        monitors = g_hash_table_new(g_str_hash, g_str_equal);
+    }
+
+    listcache_monitor_t *monitor = g_hash_table_lookup(monitors, directory);
+    if (monitor) {
+        monitor->ref_count++;
+        return monitor;
+    }
+
+    GFile *dir = g_file_new_for_path(directory);
+    GFileMonitor *file_monitor = g_file_monitor_directory(dir, G_FILE_MONITOR_WATCH_MOVES, NULL, NULL);
+    g_object_unref(dir);
+    if (!file_monitor) {
+        return NULL;
+    }
+
+    monitor = g_new0(listcache_monitor_t, 1);
+    monitor->directory = g_strdup(directory);
+    monitor->monitor = file_monitor;
+    monitor->ref_count = 1;
+    g_signal_connect(file_monitor, "changed", G_CALLBACK(on_directory_changed), monitor);
+    g_hash_table_insert(monitors, monitor->directory, monitor);
+    return monitor;
+}
+
+static void monitor_unref(listcache_monitor_t *monitor) {
+    if (--monitor->ref_count > 0) {
+        return;
+    }
+
+    g_hash_table_remove(monitors, monitor->directory);
+    g_signal_handlers_disconnect_by_data(monitor->monitor, monitor);
+    g_file_monitor_cancel(monitor->monitor);
+    g_object_unref(monitor->monitor);
+    g_free(monitor->directory);
+    g_free(monitor);
+}
+
+/**
+ * Releases an entry once it was removed from the table
+ */
+static void free_entry(gpointer data) {
+    listcache_entry_t *entry = data;
+
+    g_queue_unlink(&lru, &entry->link);
+    cache_size -= entry->size;
+
+    entry->monitor->entries = g_list_remove(entry->monitor->entries, entry);
+    monitor_unref(entry->monitor);
+    dir_listing_unref(entry->listing);
+    g_free(entry);
+}
+
+static void ensure_cache(void) {
+    if (!cache) {
+        cache = g_hash_table_new_full(key_hash, key_equal, NULL, free_entry);
+    }
+}
+
+/**
+ * Tells the watchers of a directory that one of its entries was created or deleted
+ */
+static void notify_watchers(listcache_monitor_t *monitor, GFile *file, gboolean created) {
+    if (!file || !monitor->watchers) {
+        return;
+    }
+
+    char *name = g_file_get_basename(file);
+    // A watcher may unwatch from its callback, only call the ones still registered
+    GList *ids = NULL;
+    for (GList *link = monitor->watchers; link; link = link->next) {
+        listcache_watcher_t *watcher = link->data;
+        ids = g_list_prepend(ids, GUINT_TO_POINTER(watcher->id));
+    }
+    for (GList *link = ids; link; link = link->next) {
+        listcache_watcher_t *watcher = g_hash_table_lookup(watchers, link->data);
+        if (watcher) {
+            watcher->func(name, created, watcher->user_data);
+        }
+    }
+    g_list_free(ids);
+    g_free(name);
+}
+
+/**
+ * Drops the cached listings of a directory as soon as anything changes in it,
+ * and passes created and deleted entries on to its watchers
+ */
+static void on_directory_changed(GFileMonitor *file_monitor, GFile *file, GFile *other_file,
+                                 GFileMonitorEvent event_type, gpointer user_data) {
+    listcache_monitor_t *monitor = user_data;
+
+    // Always follows another event that already dropped the entries
+    if (event_type == G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT) {
+        return;
+    }
+
+    // Dropping the last entry or a watcher unwatching must not free the monitor yet
+    monitor->ref_count++;
+    while (monitor->entries) {
+        listcache_entry_t *entry = monitor->entries->data;
+        g_hash_table_remove(cache, &entry->key);
+    }
+
+    // Changed contents and attributes leave the entries of a view as they are
+    switch (event_type) {
+        case G_FILE_MONITOR_EVENT_CREATED:
+        case G_FILE_MONITOR_EVENT_MOVED_IN:
+            notify_watchers(monitor, file, TRUE);
+            break;
+        case G_FILE_MONITOR_EVENT_DELETED:
+        case G_FILE_MONITOR_EVENT_MOVED_OUT:
+            notify_watchers(monitor, file, FALSE);
+            break;
+        case G_FILE_MONITOR_EVENT_RENAMED:
+            notify_watchers(monitor, file, FALSE);
+            notify_watchers(monitor, other_file, TRUE);
+            break;
+        default:
+            break;
+    }
+    monitor_unref(monitor);
+}
+
+/**
+ * Drops least recently used entries until the cache fits its budget
+ */
+static void evict(void) {
+    while (lru.tail && (cache_size > LISTCACHE_MAX_BYTES || g_hash_table_size(cache) > LISTCACHE_MAX_ENTRIES)) {
+        listcache_entry_t *entry = lru.tail->data;
+        g_hash_table_remove(cache, &entry->key);
+    }
+}
+
+/**
+ * Checks an entry against the current stat of its directory
+ */
+static gboolean entry_matches(const listcache_entry_t *entry, const struct stat *st) {
+    return entry->mtime_sec == st->st_mtim.tv_sec && entry->mtime_nsec == st->st_mtim.tv_nsec &&
+           entry->ctime_sec == st->st_ctim.tv_sec && entry->ctime_nsec == st->st_ctim.tv_nsec;
+}
+
+/**
+ * Moves an entry to the front of the LRU queue and refreshes its size
+ * The size grows once metadata is fetched for the listing
+ */
+static void touch_entry(listcache_entry_t *entry) {
+    g_queue_unlink(&lru, &entry->link);
+    g_queue_push_head_link(&lru, &entry->link);
+
+    gsize size = dir_listing_get_memory_size(entry->listing);
+    cache_size += size - entry->size;
+    entry->size = size;
+}
+
+dir_listing_t* listcache_get(const char *directory, gboolean show_hidden, GError **error) {
+    ensure_cache();
+
+    struct stat st;
+    if (stat(directory, &st) != 0) {
+        int saved_errno = errno;
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(saved_errno), "Could not open %s: %s", directory, g_strerror(saved_errno));
+        return NULL;
+    }
+
+    listcache_key_t key = { st.st_dev, st.st_ino, show_hidden };
+    listcache_entry_t *entry = g_hash_table_lookup(cache, &key);
+    if (entry && entry_matches(entry, &st)) {
+        touch_entry(entry);
+        return dir_listing_ref(entry->listing);
+    }
+    if (entry) {
+        g_hash_table_remove(cache, &key);
+    }
+
+    dir_listing_t *listing = dir_listing_read(directory, show_hidden, error);
+    if (!listing) {
+        return NULL;
+    }
+
+    entry = g_new0(listcache_entry_t, 1);
+    entry->key = key;
+    entry->mtime_sec = st.st_mtim.tv_sec;
+    entry->mtime_nsec = st.st_mtim.tv_nsec;
+    entry->ctime_sec = st.st_ctim.tv_sec;
+    entry->ctime_nsec = st.st_ctim.tv_nsec;
+    entry->listing = dir_listing_ref(listing);
+    entry->link.data = entry;
+
+    // Without a monitor, changes within the same timestamp tick would go unnoticed, so don't cache
+    entry->monitor = monitor_ref(directory);
+    if (!entry->monitor) {
+        dir_listing_unref(entry->listing);
+        g_free(entry);
+        return listing;
+    }
+    entry->monitor->entries = g_list_prepend(entry->monitor->entries, entry);
+
+    g_queue_push_head_link(&lru, &entry->link);
+    entry->size = dir_listing_get_memory_size(listing);
+    cache_size += entry->size;
+    g_hash_table_insert(cache, &entry->key, entry);
+    evict();
+
+    return listing;
+}
+
+gboolean listcache_is_current(const dir_listing_t *listing) {
+    // The cache is small, a walk is cheaper than keeping a second index
+    for (GList *link = lru.head; link; link = link->next) {
+        listcache_entry_t *entry = link->data;
+        if (entry->listing == listing) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+void listcache_invalidate(const char *directory) {
+    if (!cache) {
+        return;
+    }
+
+    struct stat st;
+    if (stat(directory, &st) != 0) {
+        return;
+    }
+
+    for (int show_hidden = FALSE; show_hidden <= TRUE; show_hidden++) {
+        listcache_key_t key = { st.st_dev, st.st_ino, show_hidden };
+        g_hash_table_remove(cache, &key);
+    }
+}
+
+guint listcache_watch(const char *directory, listcache_change_func func, gpointer user_data) {
+    listcache_monitor_t *monitor = monitor_ref(directory);
+    if (!monitor) {
+        return 0;
+    }
+
+    if (!watchers) {
+        watchers = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+    }
+
+    listcache_watcher_t *watcher = g_new0(listcache_watcher_t, 1);
+    watcher->id = ++last_watch_id;
+    watcher->monitor = monitor;
+    watcher->func = func;
+    watcher->user_data = user_data;
+    monitor->watchers = g_list_prepend(monitor->watchers, watcher);
+    g_hash_table_insert(watchers, GUINT_TO_POINTER(watcher->id), watcher);
+    return watcher->id;
+}
+
+void listcache_unwatch(guint id) {
+    listcache_watcher_t *watcher = watchers ? g_hash_table_lookup(watchers, GUINT_TO_POINTER(id)) : NULL;
+    if (!watcher) {
+        return;
+    }
+
+    listcache_monitor_t *monitor = watcher->monitor;
+    monitor->watchers = g_list_remove(monitor->watchers, watcher);
+    g_hash_table_remove(watchers, GUINT_TO_POINTER(id));
+    monitor_unref(monitor);
+}
+
+void listcache_get_stats(guint *listings, gsize *bytes) {
+    *listings = lru.length;
+    *bytes = cache_size;
+}
@@ -0,0 +1,86 @@
+#ifndef LISTCACHE_H
+#define LISTCACHE_H
+
+#include <glib.h>
+#include "direnum.h"
+
+/**
+ * Process-wide cache of directory listings
+ *
+ * Listings are keyed by the (device, inode) of their directory, so every tab and
+ * every navigation showing the same folder shares one dir_listing_t, including
+ * the metadata fetched for it. A cached listing is reused while the directory's
+ * mtime and ctime are unchanged and no change was reported by the file monitor
+ * set on it; the monitor also catches files edited in place, which do not touch
+ * the directory's mtime.
+ *
+ * The same monitor reports the entries created and deleted in a directory to
+ * the callbacks registered with listcache_watch(), so a view can apply them one
+ * by one instead of being rebuilt from a new listing.
+ *
+ * The least recently used listings are dropped once the cache holds more than
+ * LISTCACHE_MAX_BYTES or LISTCACHE_MAX_ENTRIES listings. Views keep their own
+ * references, so dropping a listing never affects what is on screen.
+ *
+ * Must only be used from the main thread.
+ */
+
+#define LISTCACHE_MAX_BYTES (64 * 1024 * 1024) // Memory budget of the cached listings
+#define LISTCACHE_MAX_ENTRIES 128 // Cached listings, each directory holds a file monitor
+
+/**
+ * Called when an entry was created in or deleted from a watched directory
+ * A rename within the directory is reported as a deletion then a creation
+ * @param name Name of the entry
+ * @param created TRUE if the entry was created or moved in, FALSE if it was deleted or moved out
+ * @param user_data Data passed to listcache_watch()
+ */
+typedef void (*listcache_change_func)(const char *name, gboolean created, gpointer user_data);
+
+/**
+ * Gets the listing of a directory, from the cache when it is still valid
+ * @param directory Directory to list
+ * @param show_hidden Whether to keep entries starting with a dot
+ * @param error Set if the directory could not be read
+ * @return Listing, free with dir_listing_unref(), NULL on error
+ */
+dir_listing_t* listcache_get(const char *directory, gboolean show_hidden, GError **error);
+
+/**
+ * Checks whether a listing is still the cached listing of its directory
+ * Does not touch the disk, it relies on the file monitor to notice changes
+ * @param listing The listing
+ * @return TRUE if no change was noticed in the directory since it was read
+ */
+gboolean listcache_is_current(const dir_listing_t *listing);
+
+/**
+ * Drops the cached listings of a directory, e.g. after changing it
+ * @param directory Path of the directory
+ */
+void listcache_invalidate(const char *directory);
+
+/**
+ * Reports the entries created in and deleted from a directory
+ * Changes to the contents or attributes of existing entries are not reported
+ * @param directory Path of the directory
+ * @param func Called for every created or deleted entry
+ * @param user_data Passed to func
+ * @return Watch id for listcache_unwatch(), 0 if the directory cannot be monitored
+ */
+guint listcache_watch(const char *directory, listcache_change_func func, gpointer user_data);
+
+/**
+ * Stops a watch started with listcache_watch()
+ * @param id The watch id, 0 is ignored
+ */
+void listcache_unwatch(guint id);
+
+/**
+ * Gets what the cache holds
+ * @param listings Filled with the number of cached listings
+ * @param bytes Filled with their estimated size, as counted against LISTCACHE_MAX_BYTES
+ */
+void listcache_get_stats(guint *listings, gsize *bytes);
+
+#endif //LISTCACHE_H
@@ -6,6 +6,21 @@
 #include "ui_builder.h"
 #include "main.h"
 #include "snake.h"
+#include "dirsize.h"
+#include "sizecache.h"
+#include "fm_entry.h"
+#include "fmsort.h"
+#include "fmgroup.h"
+#include "statbatch.h"
+#include "flatwalk.h"
+#include "listcache.h"
+#include "session.h"
+#include "profile.h"
+#include "trace.h"
+#include "stallmon.h"
+#include "memstats.h"
+#include <glib-unix.h>
+#include <signal.h>
 #include <sys/stat.h>
 
 GtkWidget *window;
@@ -13,12 +28,30 @@ GtkWidget *main_file_container;
 GtkWidget *directory_entry;
 GtkWidget *notebook;
 GtkWidget *search_entry;
+static GtkWidget *stall_overlay; // Frame times and stalls, toggled with F12
+static GtkWindow *memory_window = NULL; // Memory report, created on first use with Ctrl+Shift+M
 
 const char *default_directory = "/home"; // Default directory to start in
 gboolean show_hidden_files = FALSE;
+static gboolean sort_folders_first = TRUE; // Sort actions keep directories before files, toggled in the sort menus
+static gboolean list_view_mode = FALSE; // Tabs show the detailed list instead of the icon grid, Ctrl+1 / Ctrl+2
+static gboolean flatten_mode = FALSE; // Tabs list every file under their directory, see populate_flattened()
+static fm_group_key_t group_mode = FM_GROUP_NONE; // Tabs show their files in collapsible groups, always as a list
+static gboolean syncing_column_sort = FALSE; // Set while the column headers are updated to match a sort
+
+#define SIZE_RESORT_DELAY_MS 250 // Directory sizes finishing within this window are applied with one resort
+#define TAB_HIBERNATE_AFTER_S 900 // Default idle time before a background tab is hibernated
+#define TAB_HIBERNATE_CHECK_INTERVAL_S 30 // How often background tabs are checked for hibernation
+
+static gint tab_hibernate_after = TAB_HIBERNATE_AFTER_S; // Set with --hibernate-after, 0 disables idle hibernation
+static gboolean startup_pending = TRUE; // Tabs are not listed until the window was painted once, see finish_startup()
+static char *startup_directory = NULL; // Set with --directory, opened instead of the previous session
+static gboolean profile_startup = FALSE; // Set with --profile-startup
+static char *profile_output = NULL; // Set with --profile-output
+static gboolean exit_after_first_paint = FALSE; // Set with --exit-after-first-paint
 
 // Function declarations
-void file_clicked(GtkGridView *view, guint position, gpointer user_data);
+void file_clicked(GtkWidget *view, guint position, gpointer user_data);
 
 void directory_entry_changed(  GtkEntry* self, gpointer user_data);
 
@@ -50,6 +83,10 @@ static void menu_open_tab_clicked(GSimpleAction *action, GVariant *parameter, gp
 
 static void menu_dir_properties_clicked(GSimpleAction *action, GVariant *parameter, gpointer user_data);
 
+static void menu_disk_usage_clicked(GSimpleAction *action, GVariant *parameter, gpointer user_data);
+
+static void menu_find_duplicates_clicked(GSimpleAction *action, GVariant *parameter, gpointer user_data);
+
 static void menu_copy_clicked(GSimpleAction *action, GVariant *parameter, gpointer user_data);
 
 static void menu_paste_clicked(GSimpleAction *action, GVariant *parameter, gpointer user_data);
@@ -92,13 +129,77 @@ void on_sort_size_desc(GSimpleAction *action, GVariant *param, gpointer user_dat
 
 static void toggle_hidden_action_handler(GSimpleAction *action, GVariant *parameter, gpointer user_data);
 
+static void toggle_folders_first_handler(GSimpleAction *action, GVariant *parameter, gpointer user_data);
+
+static void view_mode_handler(GSimpleAction *action, GVariant *parameter, gpointer user_data);
+
+static void group_by_handler(GSimpleAction *action, GVariant *parameter, gpointer user_data);
+
+static void toggle_flatten_handler(GSimpleAction *action, GVariant *parameter, gpointer user_data);
+
+static void sync_grouping(GtkSortListModel *sort_model);
+
+static void sync_column_sort(TabContext *ctx);
+
 static void menu_preview_clicked(GSimpleAction *action, GVariant *parameter, gpointer user_data);
 
-typedef struct {
-    gboolean ascending;
-} SortContext;
+static void show_interrupted_operations_dialog(void);
+
+static dir_listing_t* get_store_listing(GListStore *files);
+
+static void show_file_model(TabContext *ctx, GtkWidget *container, GtkSortListModel *sort_model);
+
+static void apply_sort(TabContext *ctx, gboolean ascending, const char *criteria);
+static void resort_model(GtkSortListModel *sort_model);
+static void start_parallel_sort(GtkSortListModel *sort_model);
+
+static void on_go_back(GSimpleAction *action, GVariant *parameter, gpointer user_data);
+
+static void on_go_forward(GSimpleAction *action, GVariant *parameter, gpointer user_data);
+
+static void on_toggle_stall_overlay(GSimpleAction *action, GVariant *parameter, gpointer user_data);
+
+static void on_show_memory_stats(GSimpleAction *action, GVariant *parameter, gpointer user_data);
+
+static char* build_memory_report(void);
+
+static gboolean on_memory_dump_signal(gpointer user_data);
+
+static void update_history_actions(const TabContext *ctx);
+
+static void cancel_scroll_restore(TabContext *ctx);
+
+static gboolean check_idle_tabs(gpointer user_data);
+
+static void on_low_memory_warning(GMemoryMonitor *monitor, GMemoryMonitorWarningLevel level, gpointer user_data);
 
+static void restore_session(GPtrArray *tabs, int active_tab);
 
+static gboolean save_session(GtkWindow *window, gpointer user_data);
+
+static void on_window_mapped(GtkWidget *widget, gpointer user_data);
+
+static void on_first_listing_paint(GdkFrameClock *clock, gpointer user_data);
+
+static gint handle_local_options(GApplication *application, GVariantDict *options, gpointer user_data);
+
+static void wake_tab(TabContext *ctx);
+
+static view_snapshot_t* capture_view(TabContext *ctx);
+
+static const GOptionEntry app_options[] = {
+    { "hibernate-after", 0, 0, G_OPTION_ARG_INT, &tab_hibernate_after,
+      "Hibernate background tabs not shown for this many seconds (0 disables)", "SECONDS" },
+    { "directory", 'd', 0, G_OPTION_ARG_FILENAME, &startup_directory,
+      "Open this directory instead of the previous session", "PATH" },
+    { "profile-startup", 0, 0, G_OPTION_ARG_NONE, &profile_startup,
+      "Print how long every startup phase took", NULL },
+    { "profile-output", 0, 0, G_OPTION_ARG_FILENAME, &profile_output,
+      "Write the startup phase times to this file as JSON", "FILE" },
+    { "exit-after-first-paint", 0, 0, G_OPTION_ARG_NONE, &exit_after_first_paint,
+      "Quit once the first directory was painted, in a separate instance", NULL },
+    { NULL }
+};
 
 static const GActionEntry win_actions[] = {
     { "delete", menu_delete_clicked, "s", NULL, NULL },
@@ -110,7 +211,9 @@ static const GActionEntry win_actions[] = {
     { "new_folder", menu_new_folder_clicked, "s", NULL, NULL },
     { "open_terminal", menu_open_terminal_clicked, "s", NULL, NULL },
     { "open_in_tab", menu_open_tab_clicked, "s", NULL, NULL },
-    { "dir_properties", menu_dir_properties_clicked, "s", NULL, NULL }
+    { "dir_properties", menu_dir_properties_clicked, "s", NULL, NULL },
+    { "disk_usage", menu_disk_usage_clicked, "s", NULL, NULL },
+    { "find_duplicates", menu_find_duplicates_clicked, "s", NULL, NULL }
 };
 
 static const GActionEntry win_entries[] = {
@@ -120,6 +223,10 @@ static const GActionEntry win_entries[] = {
     { "sort_date_desc", on_sort_date_desc, NULL, NULL, NULL },
     { "sort_size_asc",  on_sort_size_asc,  NULL, NULL, NULL },
     { "sort_size_desc", on_sort_size_desc, NULL, NULL, NULL },
+    { "go_back",        on_go_back,        NULL, NULL, NULL },
+    { "go_forward",     on_go_forward,     NULL, NULL, NULL },
+    { "toggle_stall_overlay", on_toggle_stall_overlay, NULL, NULL, NULL },
+    { "show_memory_stats", on_show_memory_stats, NULL, NULL, NULL },
 };
 /**
  * Builds the core widget structure of the application
@@ -127,8 +234,21 @@ static const GActionEntry win_entries[] = {
  * @param user_data User data passed to the callback (not used here)
  */
 static void init(GtkApplication *app, gpointer user_data) {
+    profile_mark("activate");
+
     // Initialize the operation history array
     init_operation_history();
+    set_history_changed_func(reload_current_directory);
+    profile_mark("history-loaded");
+
+    // Read the previous session first, it holds the hidden files setting
+    int active_tab = 0;
+    GPtrArray *session_tabs = session_load(&active_tab, &show_hidden_files);
+    if (startup_directory) {
+        g_ptr_array_set_size(session_tabs, 0);
+        default_directory = startup_directory;
+    }
+    profile_mark("session-loaded");
 
     window = gtk_application_window_new(app);
     gtk_window_set_title(GTK_WINDOW(window), "File Manager"); //Really original title
@@ -139,6 +259,7 @@ static void init(GtkApplication *app, gpointer user_data) {
 
     //  Left side panel
     left_box_t left_box = create_left_box();
+    profile_mark("sidebar-built");
 
     g_signal_connect(left_box.undo_button,"clicked",G_CALLBACK(undo_button_clicked),NULL);
     g_signal_connect(left_box.redo_button,"clicked",G_CALLBACK(redo_button_clicked),NULL);
@@ -152,6 +273,7 @@ static void init(GtkApplication *app, gpointer user_data) {
 
     // Toolbar
     toolbar_t toolbar = create_toolbar(default_directory);
+    profile_mark("toolbar-built");
 
     // Search
     search_entry = toolbar.search_entry;
@@ -180,11 +302,53 @@ static void init(GtkApplication *app, gpointer user_data) {
     g_action_map_add_action_entries(G_ACTION_MAP(window), win_actions, G_N_ELEMENTS(win_actions), window);
     g_action_map_add_action_entries(G_ACTION_MAP(window), win_entries, G_N_ELEMENTS(win_entries), window);
 
+    // History navigation, the actions are enabled per tab by update_history_actions()
+    const char *back_accels[] = { "<Alt>Left", "Back", NULL };
+    const char *forward_accels[] = { "<Alt>Right", "Forward", NULL };
+    gtk_application_set_accels_for_action(app, "win.go_back", back_accels);
+    gtk_application_set_accels_for_action(app, "win.go_forward", forward_accels);
+    const char *stall_overlay_accels[] = { "F12", NULL };
+    gtk_application_set_accels_for_action(app, "win.toggle_stall_overlay", stall_overlay_accels);
+    const char *memory_stats_accels[] = { "<Control><Shift>m", NULL };
+    gtk_application_set_accels_for_action(app, "win.show_memory_stats", memory_stats_accels);
+    const char *grid_view_accels[] = { "<Control>1", NULL };
+    gtk_application_set_accels_for_action(app, "win.view_mode::grid", grid_view_accels);
+    const char *list_view_accels[] = { "<Control>2", NULL };
+    gtk_application_set_accels_for_action(app, "win.view_mode::list", list_view_accels);
+    update_history_actions(NULL);
+
     // Show hidden toggle
     GSimpleAction *toggle_action = g_simple_action_new_stateful("toggle_hidden", NULL, g_variant_new_boolean(show_hidden_files));
     g_signal_connect(toggle_action, "change-state", G_CALLBACK(toggle_hidden_action_handler), NULL);
     g_action_map_add_action(G_ACTION_MAP(window), G_ACTION(toggle_action));
 
+    // Folders first toggle of the sort menus
+    GSimpleAction *folders_first_action = g_simple_action_new_stateful("toggle_folders_first", NULL, g_variant_new_boolean(sort_folders_first));
+    g_signal_connect(folders_first_action, "change-state", G_CALLBACK(toggle_folders_first_handler), NULL);
+    g_action_map_add_action(G_ACTION_MAP(window), G_ACTION(folders_first_action));
+
+    // Grid or list view
+    GSimpleAction *view_mode_action = g_simple_action_new_stateful("view_mode", G_VARIANT_TYPE_STRING,
+                                                                   g_variant_new_string(list_view_mode ? "list" : "grid"));
+    g_signal_connect(view_mode_action, "change-state", G_CALLBACK(view_mode_handler), NULL);
+    g_action_map_add_action(G_ACTION_MAP(window), G_ACTION(view_mode_action));
+
+    // Flattened listing of the whole subtree
+    GSimpleAction *flatten_action = g_simple_action_new_stateful("toggle_flatten", NULL, g_variant_new_boolean(flatten_mode));
+    g_signal_connect(flatten_action, "change-state", G_CALLBACK(toggle_flatten_handler), NULL);
+    g_action_map_add_action(G_ACTION_MAP(window), G_ACTION(flatten_action));
+
+    // Grouped list
+    GSimpleAction *group_by_action = g_simple_action_new_stateful("group_by", G_VARIANT_TYPE_STRING, g_variant_new_string("none"));
+    g_signal_connect(group_by_action, "change-state", G_CALLBACK(group_by_handler), NULL);
+    g_action_map_add_action(G_ACTION_MAP(window), G_ACTION(group_by_action));
+
+    // Hibernate background tabs after some idle time or when memory runs low
+    g_timeout_add_seconds(TAB_HIBERNATE_CHECK_INTERVAL_S, check_idle_tabs, NULL);
+    GMemoryMonitor *memory_monitor = g_memory_monitor_dup_default();
+    g_signal_connect(memory_monitor, "low-memory-warning", G_CALLBACK(on_low_memory_warning), NULL);
+    g_object_set_data_full(G_OBJECT(window), "memory-monitor", memory_monitor, g_object_unref);
+
     // File Container Area — using notebook now
     notebook = gtk_notebook_new();
     gtk_notebook_set_show_border(GTK_NOTEBOOK(notebook), FALSE);
@@ -195,7 +359,10 @@ static void init(GtkApplication *app, gpointer user_data) {
     gtk_box_append(GTK_BOX(right_box), toolbar.toolbar);
     gtk_box_append(GTK_BOX(right_box), notebook);
 
-    add_tab_with_directory(default_directory);
+    // Tabs start hibernated, nothing is listed before the window is shown
+    restore_session(session_tabs, active_tab);
+    g_ptr_array_unref(session_tabs);
+    profile_mark("tabs-created");
 
     //  Main container
     GtkWidget *hpaned = gtk_paned_new(GTK_ORIENTATION_HORIZONTAL);
@@ -207,43 +374,95 @@ static void init(GtkApplication *app, gpointer user_data) {
     gtk_paned_set_end_child(GTK_PANED(hpaned), right_box);
     gtk_paned_set_shrink_end_child(GTK_PANED(hpaned), FALSE);
 
-    gtk_window_set_child(GTK_WINDOW(window), hpaned);
+    // Stall overlay above everything, hidden until F12
+    GtkWidget *overlay = gtk_overlay_new();
+    gtk_overlay_set_child(GTK_OVERLAY(overlay), hpaned);
+    stall_overlay = create_stall_overlay();
+    gtk_overlay_add_overlay(GTK_OVERLAY(overlay), stall_overlay);
+
+    gtk_window_set_child(GTK_WINDOW(window), overlay);
 
-    // Show the window
+    // Show the window, directories are only listed after its first frame
+    g_signal_connect(window, "close-request", G_CALLBACK(save_session), NULL);
+    g_signal_connect(window, "map", G_CALLBACK(on_window_mapped), NULL);
     gtk_window_present(GTK_WINDOW(window));
+    profile_mark("window-presented");
+
+    // Offer to finish or revert whatever was interrupted last time
+    if (get_interrupted_batch_count() > 0) {
+        show_interrupted_operations_dialog();
+    }
+}
+
+/**
+ * @brief Handles the answer to the interrupted operations dialog.
+ *
+ * Resumes or rolls back the interrupted batches depending on the chosen button.
+ * Choosing "Later" keeps them in the journal for the next start.
+ *
+ * @param source The GtkAlertDialog.
+ * @param res Result of the dialog.
+ * @param user_data Not used.
+ */
+static void interrupted_operations_answered(GObject *source, GAsyncResult *res, gpointer user_data) {
+    int button = gtk_alert_dialog_choose_finish(GTK_ALERT_DIALOG(source), res, NULL);
+
+    if (button == 0) {
+        resolve_interrupted_batches(TRUE);
+    } else if (button == 1) {
+        resolve_interrupted_batches(FALSE);
+    }
+}
+
+/**
+ * @brief Asks the user what to do with operations that were interrupted by a crash or exit.
+ */
+static void show_interrupted_operations_dialog(void) {
+    const char *buttons[] = { "Resume", "Roll Back", "Later", NULL };
+
+    GtkAlertDialog *dialog = gtk_alert_dialog_new("%u file operation(s) were interrupted", get_interrupted_batch_count());
+    gtk_alert_dialog_set_detail(dialog, "Resume finishes the interrupted operations, roll back reverts the part that was already done.");
+    gtk_alert_dialog_set_buttons(dialog, buttons);
+    gtk_alert_dialog_set_cancel_button(dialog, 2);
+    gtk_alert_dialog_set_default_button(dialog, 0);
+    gtk_alert_dialog_choose(dialog, GTK_WINDOW(window), NULL, interrupted_operations_answered, NULL);
+    g_object_unref(dialog);
 }
 
 
 /**
- * @brief Handles double-click or activation on a file item in the grid view.
+ * @brief Handles double-click or activation on a file item in the grid or list view.
  *
  * Opens the file with the default app if it's a file, or populates the current tab
  * with new directory contents if it's a folder. Hides the preview if navigating away.
  *
- * @param view The GtkGridView where the activation happened.
- * @param position Index of the clicked item.
+ * @param view The GtkGridView or GtkColumnView where the activation happened.
+ * @param position Index of the clicked item, group rows are folded or unfolded.
  * @param user_data Pointer to the current TabContext.
  */
-void file_clicked(GtkGridView *view, const guint position, const gpointer user_data) {
+void file_clicked(GtkWidget *view, const guint position, const gpointer user_data) {
     TabContext *ctx = (TabContext *)user_data;
 
-    GtkSelectionModel *model = gtk_grid_view_get_model(view);
-    GListModel *files = G_LIST_MODEL(gtk_multi_selection_get_model(GTK_MULTI_SELECTION(model)));
-
-    GFile *file = g_list_model_get_item(files, position);
-    GFileInfo *info = g_file_query_info(file, G_FILE_ATTRIBUTE_STANDARD_TYPE, G_FILE_QUERY_INFO_NONE, NULL, NULL);
-    GFileType type = g_file_info_get_file_type(info);
+    FmEntry *entry = get_model_entry(G_LIST_MODEL(ctx->selection), position);
+    if (!entry) {
+        // Group row of the grouped view, activating it folds or unfolds the group
+        GtkTreeListRow *row = g_list_model_get_item(G_LIST_MODEL(ctx->selection), position);
+        if (GTK_IS_TREE_LIST_ROW(row)) {
+            gtk_tree_list_row_set_expanded(row, !gtk_tree_list_row_get_expanded(row));
+        }
+        g_clear_object(&row);
+        return;
+    }
 
-    if (type == G_FILE_TYPE_DIRECTORY) {
-        gtk_revealer_set_reveal_child(GTK_REVEALER(ctx->preview_revealer), FALSE);
-        const char *path = g_file_get_path(file);
-        populate_files_in_container(path, ctx->scrolled_window, ctx);
+    if (fm_entry_is_directory(entry)) {
+        char *path = fm_entry_get_path(entry);
+        navigate_to_directory(ctx, path);
+        g_free(path);
     } else {
-        open_file_with_default_app(file);
+        open_file_with_default_app(fm_entry_get_file(entry));
     }
 
-    g_object_unref(file);
-    g_object_unref(info);
+    g_object_unref(entry);
 }
 
 /**
@@ -266,7 +485,7 @@ void directory_entry_changed(GtkEntry* self, gpointer user_data) {
     }
     if (new_directory != NULL && strlen(new_directory) != 0 && strcmp(new_directory, ctx->current_directory) != 0) {
             if (g_file_test(new_directory, G_FILE_TEST_EXISTS) && g_file_test(new_directory, G_FILE_TEST_IS_DIR)) {
-                populate_files_in_container(new_directory, ctx->scrolled_window, ctx);
+                navigate_to_directory(ctx, new_directory);
             } else {
                 gtk_editable_set_text(GTK_EDITABLE(directory_entry), ctx->current_directory);
             }
@@ -298,7 +517,7 @@ void on_up_clicked() {
         // Get the path of the parent directory
         const char *parent_path = g_file_get_path(parent);
         if (parent_path) {
-            populate_files_in_container(parent_path, ctx->scrolled_window, ctx);
+            navigate_to_directory(ctx, parent_path);
         }
         g_object_unref(parent);
     }
@@ -307,17 +526,37 @@ void on_up_clicked() {
 }
 
 /**
- * @brief Adds a new tab to the notebook displaying the contents of the specified directory.
+ * @brief Frees a TabContext once its page is destroyed.
+ *
+ * The widgets are owned by the page, only the state and history are freed here.
+ *
+ * @param data The TabContext.
+ */
+static void free_tab_context(gpointer data) {
+    TabContext *ctx = data;
+    g_free(ctx->current_directory);
+    g_free(ctx->sort_criteria);
+    g_ptr_array_unref(ctx->back_history);
+    g_ptr_array_unref(ctx->forward_history);
+    view_snapshot_free(ctx->hibernated);
+    g_free(ctx);
+}
+
+/**
+ * @brief Appends an empty tab to the notebook.
  *
  * Initializes a new TabContext with its own GtkScrolledWindow, preview pane,
  * and associated state. The tab is labeled with the basename of the directory
- * and automatically selected.
+ * but nothing is listed yet.
  *
- * @param path Absolute path of the directory to open in the new tab.
+ * @param path Absolute path of the directory the tab is for.
+ * @return The new tab, owned by its notebook page.
  */
-void add_tab_with_directory(const char* path) {
+static TabContext* create_tab(const char *path) {
     TabContext *ctx = g_malloc0(sizeof(TabContext));
     ctx->current_directory = g_strdup(path);
+    ctx->back_history = nav_history_new();
+    ctx->forward_history = nav_history_new();
 
     // File list container
     ctx->scrolled_window = gtk_scrolled_window_new();
@@ -346,12 +585,13 @@ void add_tab_with_directory(const char* path) {
     gtk_paned_set_start_child(GTK_PANED(split), ctx->scrolled_window);
     gtk_paned_set_end_child(GTK_PANED(split), ctx->preview_revealer);
 
-    // Save context to lookup later
-    g_object_set_data(G_OBJECT(split), "tab_ctx", ctx);
+    // Save context to lookup later, it goes away with the page
+    g_object_set_data_full(G_OBJECT(split), "tab_ctx", ctx, free_tab_context);
 
     // Tab label setup
-    const char* tab_name = g_path_get_basename(path);
+    char *tab_name = g_path_get_basename(path);
     ctx->tab_label = gtk_label_new(tab_name);
+    g_free(tab_name);
 
     GtkWidget *tab_header = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, SPACING);
     gtk_widget_set_halign(tab_header, GTK_ALIGN_CENTER);
@@ -368,22 +608,417 @@ void add_tab_with_directory(const char* path) {
 
     g_signal_connect(close_button, "clicked", G_CALLBACK(on_close_tab_clicked), notebook);
 
+    // Add tab
+    gtk_notebook_append_page(GTK_NOTEBOOK(notebook), split, tab_header);
+    return ctx;
+}
+
+/**
+ * @brief Adds a new tab to the notebook displaying the contents of the specified directory.
+ *
+ * The tab is automatically selected.
+ *
+ * @param path Absolute path of the directory to open in the new tab.
+ */
+void add_tab_with_directory(const char* path) {
+    TabContext *ctx = create_tab(path);
+
     // Load file contents
     populate_files_in_container(path, ctx->scrolled_window, ctx);
 
-    // Add tab
-    gtk_notebook_append_page(GTK_NOTEBOOK(notebook), split, tab_header);
     int total_pages = gtk_notebook_get_n_pages(GTK_NOTEBOOK(notebook));
     gtk_notebook_set_current_page(GTK_NOTEBOOK(notebook), total_pages - 1);
 }
 
+/**
+ * @brief Opens the tabs of the previous session, or one tab at the default directory.
+ *
+ * Every tab starts hibernated, so nothing is listed here. The active tab is woken
+ * by `finish_startup()` once the window was painted, the others when they are shown.
+ *
+ * @param tabs view_snapshot_t of the tabs to open, taken over by the tabs.
+ * @param active_tab Index of the tab to select.
+ */
+static void restore_session(GPtrArray *tabs, int active_tab) {
+    if (tabs->len == 0) {
+        view_snapshot_t *snapshot = g_new0(view_snapshot_t, 1);
+        snapshot->directory = g_strdup(default_directory);
+        snapshot->show_hidden = show_hidden_files;
+        g_ptr_array_add(tabs, snapshot);
+        active_tab = 0;
+    }
+
+    // The tabs take over the snapshots
+    g_ptr_array_set_free_func(tabs, NULL);
+    for (guint i = 0; i < tabs->len; i++) {
+        view_snapshot_t *snapshot = g_ptr_array_index(tabs, i);
+        TabContext *ctx = create_tab(snapshot->directory);
+        ctx->hibernated = snapshot;
+    }
+    gtk_notebook_set_current_page(GTK_NOTEBOOK(notebook), active_tab);
+}
+
+/**
+ * @brief Saves the open tabs for the next run.
+ *
+ * Called when the main window is about to close.
+ *
+ * @param window The main window.
+ * @param user_data Not used.
+ * @return FALSE to let the window close.
+ */
+static gboolean save_session(GtkWindow *window, gpointer user_data) {
+    GPtrArray *tabs = g_ptr_array_new_with_free_func((GDestroyNotify)view_snapshot_free);
+    int n_pages = gtk_notebook_get_n_pages(GTK_NOTEBOOK(notebook));
+
+    for (int i = 0; i < n_pages; i++) {
+        GtkWidget *page = gtk_notebook_get_nth_page(GTK_NOTEBOOK(notebook), i);
+        TabContext *ctx = g_object_get_data(G_OBJECT(page), "tab_ctx");
+        if (!ctx) continue;
+
+        // Hibernated tabs already are a snapshot
+        if (ctx->hibernated) {
+            view_snapshot_t *snapshot = g_new0(view_snapshot_t, 1);
+            snapshot->directory = g_strdup(ctx->hibernated->directory);
+            snapshot->sort_criteria = g_strdup(ctx->hibernated->sort_criteria);
+            snapshot->sort_ascending = ctx->hibernated->sort_ascending;
+            snapshot->scroll_offset = ctx->hibernated->scroll_offset;
+            g_ptr_array_add(tabs, snapshot);
+        } else {
+            view_snapshot_t *snapshot = capture_view(ctx);
+            if (snapshot) g_ptr_array_add(tabs, snapshot);
+        }
+    }
+
+    session_save(tabs, gtk_notebook_get_current_page(GTK_NOTEBOOK(notebook)), show_hidden_files);
+    g_ptr_array_unref(tabs);
+    return FALSE;
+}
+
+/**
+ * @brief Does the startup work that was held back until the window was painted.
+ *
+ * Lists the active tab and loads the directory size cache.
+ *
+ * @param user_data Not used.
+ * @return G_SOURCE_REMOVE
+ */
+static gboolean finish_startup(gpointer user_data) {
+    startup_pending = FALSE;
+
+    // Load the directory sizes computed in earlier sessions before the first bind looks them up
+    sizecache_load();
+    profile_mark("size-cache-loaded");
+
+    TabContext *ctx = get_current_tab_context();
+    if (ctx) {
+        wake_tab(ctx);
+        update_history_actions(ctx);
+    }
+    profile_mark("directory-listed");
+
+    // Make sure a frame follows even if the listing did not change anything
+    g_signal_connect(gtk_widget_get_frame_clock(window), "after-paint", G_CALLBACK(on_first_listing_paint), NULL);
+    gtk_widget_queue_draw(window);
+    return G_SOURCE_REMOVE;
+}
+
+/**
+ * @brief Ends the startup profile once the active directory was drawn.
+ *
+ * Prints or writes the phase times if asked to and quits with --exit-after-first-paint.
+ *
+ * @param clock The frame clock of the main window.
+ * @param user_data Not used.
+ */
+static void on_first_listing_paint(GdkFrameClock *clock, gpointer user_data) {
+    g_signal_handlers_disconnect_by_func(clock, on_first_listing_paint, user_data);
+    profile_mark("first-listing-frame");
+
+    if (profile_startup) {
+        profile_print();
+    }
+    if (profile_output) {
+        GError *error = NULL;
+        if (!profile_write_json(profile_output, &error)) {
+            g_warning("Failed to write startup profile: %s", error->message);
+            g_error_free(error);
+        }
+    }
+    if (exit_after_first_paint) {
+        g_application_quit(G_APPLICATION(gtk_window_get_application(GTK_WINDOW(window))));
+    }
+}
+
+/**
+ * @brief Schedules the rest of the startup once the first frame was drawn.
+ *
+ * @param clock The frame clock of the main window.
+ * @param user_data Not used.
+ */
+static void on_first_paint(GdkFrameClock *clock, gpointer user_data) {
+    g_signal_handlers_disconnect_by_func(clock, on_first_paint, user_data);
+    profile_mark("first-frame");
+    g_idle_add(finish_startup, NULL);
+}
+
+/**
+ * @brief Waits for the first frame of the main window once it is mapped.
+ *
+ * @param widget The main window.
+ * @param user_data Not used.
+ */
+static void on_window_mapped(GtkWidget *widget, gpointer user_data) {
+    g_signal_handlers_disconnect_by_func(widget, on_window_mapped, user_data);
+    profile_mark("window-mapped");
+    if (stallmon_is_running()) {
+        stallmon_start(gtk_widget_get_frame_clock(widget));
+    }
+    g_signal_connect(gtk_widget_get_frame_clock(widget), "after-paint", G_CALLBACK(on_first_paint), NULL);
+}
+
+/**
+ * @brief Shows or hides the stall overlay.
+ *
+ * The stall monitor starts the first time the overlay is shown and keeps
+ * counting while it is hidden.
+ *
+ * @param action The action (unused).
+ * @param parameter Not used.
+ * @param user_data Not used.
+ */
+static void on_toggle_stall_overlay(GSimpleAction *action, GVariant *parameter, gpointer user_data) {
+    stallmon_start(gtk_widget_get_frame_clock(window));
+    gtk_widget_set_visible(stall_overlay, !gtk_widget_get_visible(stall_overlay));
+}
+
+/**
+ * @brief Builds the memory report of every tab and cache.
+ *
+ * @return The report, free with g_free().
+ */
+static char* build_memory_report(void) {
+    GPtrArray *tabs = g_ptr_array_new();
+    int n_pages = notebook ? gtk_notebook_get_n_pages(GTK_NOTEBOOK(notebook)) : 0;
+
+    for (int i = 0; i < n_pages; i++) {
+        GtkWidget *page = gtk_notebook_get_nth_page(GTK_NOTEBOOK(notebook), i);
+        TabContext *ctx = g_object_get_data(G_OBJECT(page), "tab_ctx");
+        if (ctx) g_ptr_array_add(tabs, ctx);
+    }
+
+    char *report = memstats_report(tabs);
+    g_ptr_array_unref(tabs);
+    return report;
+}
+
+/**
+ * @brief Shows the memory window.
+ *
+ * @param action The action (unused).
+ * @param parameter Not used.
+ * @param user_data Not used.
+ */
+static void on_show_memory_stats(GSimpleAction *action, GVariant *parameter, gpointer user_data) {
+    if (!memory_window) {
+        memory_window = create_memory_window(GTK_WINDOW(window), build_memory_report);
+    }
+    gtk_window_present(memory_window);
+}
+
+/**
+ * @brief Prints the memory report to stdout when the process gets SIGUSR1.
+ *
+ * @param user_data Not used.
+ * @return G_SOURCE_CONTINUE
+ */
+static gboolean on_memory_dump_signal(gpointer user_data) {
+    char *report = build_memory_report();
+    g_print("%s", report);
+    g_free(report);
+    return G_SOURCE_CONTINUE;
+}
+
+
+/**
+ * @brief Re-applies the sort of a tab and fills its list view and groups when more file metadata is known.
+ *
+ * Called by the stat batch started in `populate_files_in_container()`, at most
+ * once per STATBATCH_NOTIFY_INTERVAL_MS. Sorting by name does not need the resort.
+ *
+ * @param listing The listing being filled (unused).
+ * @param finished Whether this is the last report (unused).
+ * @param user_data The GtkSortListModel of the tab.
+ */
+static void on_listing_stats_ready(dir_listing_t *listing, gboolean finished, gpointer user_data) {
+    GtkSortListModel *sort_model = GTK_SORT_LIST_MODEL(user_data);
+    if (g_object_get_data(G_OBJECT(sort_model), "needs-stats")) {
+        resort_model(sort_model);
+    }
+
+    // Fill the list view cells that were bound before their metadata was known
+    int n_pages = notebook ? gtk_notebook_get_n_pages(GTK_NOTEBOOK(notebook)) : 0;
+    for (int i = 0; i < n_pages; i++) {
+        GtkWidget *page = gtk_notebook_get_nth_page(GTK_NOTEBOOK(notebook), i);
+        TabContext *ctx = g_object_get_data(G_OBJECT(page), "tab_ctx");
+        if (!ctx || ctx->sort_model != sort_model) continue;
+        // Without a resort nothing regroups the entries whose date became known
+        if (ctx->grouping && !g_object_get_data(G_OBJECT(sort_model), "needs-stats")) {
+            fm_grouping_update_pending(ctx->grouping);
+        }
+        if (ctx->file_column_view) {
+            refresh_file_column_view(ctx->file_column_view);
+        }
+    }
+}
+
+/**
+ * @brief Adds the directories read by the walk of a flattened view to its store.
+ *
+ * Sorts set with a GtkCustomSorter take the new entries in by themselves, the
+ * parallel sort of large models is started again, coalesced with a sort that
+ * is still running. Grouped views add the new entries to their groups.
+ *
+ * @param listings Listings read since the last batch.
+ * @param finished Whether the walk is done.
+ * @param user_data The GtkSortListModel of the tab.
+ */
+static void on_flatten_batch(GPtrArray *listings, gboolean finished, gpointer user_data) {
+    GtkSortListModel *sort_model = GTK_SORT_LIST_MODEL(user_data);
+    GListStore *store = G_LIST_STORE(gtk_sort_list_model_get_model(sort_model));
+    guint first = g_list_model_get_n_items(G_LIST_MODEL(store));
+
+    trace_span_t span = trace_begin("ui", "flatten_batch");
+    fm_entry_append_files(store, listings);
+    trace_end(span);
+
+    if (g_object_get_data(G_OBJECT(sort_model), "parallel-sort")) {
+        start_parallel_sort(sort_model);
+    }
+
+    guint n_items = g_list_model_get_n_items(G_LIST_MODEL(store));
+    int n_pages = notebook ? gtk_notebook_get_n_pages(GTK_NOTEBOOK(notebook)) : 0;
+    for (int i = 0; i < n_pages; i++) {
+        GtkWidget *page = gtk_notebook_get_nth_page(GTK_NOTEBOOK(notebook), i);
+        TabContext *ctx = g_object_get_data(G_OBJECT(page), "tab_ctx");
+        if (!ctx || ctx->sort_model != sort_model || !ctx->grouping) continue;
+
+        GPtrArray *added = g_ptr_array_new_full(n_items - first, g_object_unref);
+        for (guint position = first; position < n_items; position++) {
+            g_ptr_array_add(added, g_list_model_get_item(G_LIST_MODEL(store), position));
+        }
+        // One splice per group instead of one sorted insert per entry
+        trace_span_t group_span = trace_begin("ui", "flatten_group_batch");
+        fm_grouping_insert_all(ctx->grouping, added);
+        trace_end(group_span);
+        g_ptr_array_unref(added);
+    }
+}
+
+/**
+ * @brief Applies an entry created in or deleted from a shown directory.
+ *
+ * Only the entry is added to or removed from the store, and grouped views only
+ * touch its group. Models kept by the navigation history are left alone, they
+ * are relisted when shown again since their listing is no longer current.
+ *
+ * @param name Name of the entry.
+ * @param created Whether the entry was created or deleted.
+ * @param user_data The GtkSortListModel of the tab.
+ */
+static void on_directory_entry_changed(const char *name, gboolean created, gpointer user_data) {
+    GtkSortListModel *sort_model = GTK_SORT_LIST_MODEL(user_data);
+    if (!show_hidden_files && name[0] == '.') return;
+
+    TabContext *ctx = NULL;
+    int n_pages = notebook ? gtk_notebook_get_n_pages(GTK_NOTEBOOK(notebook)) : 0;
+    for (int i = 0; i < n_pages && !ctx; i++) {
+        GtkWidget *page = gtk_notebook_get_nth_page(GTK_NOTEBOOK(notebook), i);
+        TabContext *page_ctx = g_object_get_data(G_OBJECT(page), "tab_ctx");
+        if (page_ctx && page_ctx->sort_model == sort_model) ctx = page_ctx;
+    }
+    if (!ctx) return;
+
+    GListStore *store = G_LIST_STORE(gtk_sort_list_model_get_model(sort_model));
+    FmEntry *existing = NULL;
+    guint position = 0;
+    guint n_items = g_list_model_get_n_items(G_LIST_MODEL(store));
+    for (; position < n_items; position++) {
+        FmEntry *entry = g_list_model_get_item(G_LIST_MODEL(store), position);
+        if (g_strcmp0(fm_entry_get_name(entry), name) == 0) {
+            existing = entry;
+            break;
+        }
+        g_object_unref(entry);
+    }
+
+    if (!created) {
+        if (!existing) return;
+        if (ctx->grouping) fm_grouping_remove(ctx->grouping, existing);
+        g_list_store_remove(store, position);
+        g_object_unref(existing);
+        return;
+    }
+
+    // A rename can report an entry the listing already had
+    if (existing) {
+        g_object_unref(existing);
+        return;
+    }
+
+    GError *error = NULL;
+    dir_listing_t *listing = dir_listing_read_entry(ctx->current_directory, name, &error);
+    if (!listing) {
+        // Already gone again, its deletion follows
+        g_error_free(error);
+        return;
+    }
+    FmEntry *entry = fm_entry_new(listing, 0);
+    dir_listing_unref(listing);
+
+    g_list_store_append(store, entry);
+    if (g_object_get_data(G_OBJECT(sort_model), "parallel-sort")) {
+        start_parallel_sort(sort_model);
+    }
+    if (ctx->grouping) fm_grouping_insert(ctx->grouping, entry);
+    g_object_unref(entry);
+}
+
+static void unwatch_directory(gpointer data) {
+    listcache_unwatch(GPOINTER_TO_UINT(data));
+}
+
+/**
+ * @brief Shows every file under the current directory of a tab as one flat list.
+ *
+ * The subtree is read by a parallel walk that streams its directories into the
+ * store, the view can be sorted and grouped while the walk is running. Entries
+ * point into the listing of their directory, so memory per file stays small.
+ * The walk is cancelled with the model.
+ *
+ * @param ctx The tab, its current_directory is walked.
+ * @param container The GtkScrolledWindow to place the file view inside.
+ */
+static void populate_flattened(TabContext *ctx, GtkWidget *container) {
+    GListStore *files = g_list_store_new(FM_TYPE_ENTRY);
+    GtkSortListModel *sort_model = gtk_sort_list_model_new(G_LIST_MODEL(files), NULL);
+    gtk_sort_list_model_set_incremental(sort_model, FALSE); // full sorting
+    g_clear_pointer(&ctx->sort_criteria, g_free);
+
+    flatwalk_t *walk = flatwalk_start(ctx->current_directory, show_hidden_files, on_flatten_batch, sort_model);
+    g_object_set_data_full(G_OBJECT(sort_model), "flat-walk", walk, (GDestroyNotify)flatwalk_cancel_and_unref);
+
+    show_file_model(ctx, container, sort_model);
+}
 
 /**
  * Populates a given scrolled window container with file views from a directory,
  * using a given TabContext to track the view state and label title.
  *
- * This function sets up the file grid, handles file icons, and sets the activate signal.
- * It replaces the content inside the container with a new grid view of the files.
+ * The directory is listed (or taken from the listing cache) and shown with
+ * `show_file_model()` in directory order. Entries created in or deleted from
+ * the directory afterwards are applied by `on_directory_entry_changed()`. In `flatten_mode` every file under
+ * the directory is shown instead, see `populate_flattened()`.
  *
  * @param directory The full path to the directory to load
  * @param container The GtkScrolledWindow to place the file grid inside
@@ -392,49 +1027,387 @@ void add_tab_with_directory(const char* path) {
 
 void populate_files_in_container(const char *directory, GtkWidget *container, TabContext *ctx) {
     // Clean up old data
+    cancel_scroll_restore(ctx);
     g_clear_pointer(&ctx->current_directory, g_free);
     ctx->current_directory = g_strdup(directory);
 
+    if (flatten_mode) {
+        populate_flattened(ctx, container);
+        return;
+    }
+
+    trace_span_t span = trace_begin("io", "get_files_in_directory");
     size_t file_count = 0;
     GListStore* files = get_files_in_directory(directory, &file_count, show_hidden_files);
+    trace_end_detail(span, directory);
     if (!files) return;
 
-    // Save the raw file store in context
-    ctx->file_store = files;
-
     // Create a GtkSortListModel wrapping the file store
     GtkSortListModel *sort_model = gtk_sort_list_model_new(G_LIST_MODEL(files), NULL);
     gtk_sort_list_model_set_incremental(sort_model, FALSE); // full sorting
+    g_clear_pointer(&ctx->sort_criteria, g_free);
+
+    // Fetch sizes and dates in the background, the batch is cancelled with the model
+    dir_listing_t *listing = get_store_listing(files);
+    if (listing) {
+        statbatch_t *batch = statbatch_start(listing, on_listing_stats_ready, sort_model);
+        g_object_set_data_full(G_OBJECT(sort_model), "stat-batch", batch, (GDestroyNotify)statbatch_cancel_and_unref);
+    }
+
+    // Created and deleted entries are applied one by one while the model lives
+    guint watch = listcache_watch(directory, on_directory_entry_changed, sort_model);
+    if (watch) {
+        g_object_set_data_full(G_OBJECT(sort_model), "watch", GUINT_TO_POINTER(watch), unwatch_directory);
+    }
+
+    show_file_model(ctx, container, sort_model);
+}
+
+/**
+ * @brief Gets the listing a store of FmEntry was built from.
+ *
+ * @param files Store of FmEntry.
+ * @return The listing (owned by the store or its entries), NULL for an empty store of another origin.
+ */
+static dir_listing_t* get_store_listing(GListStore *files) {
+    // Set by get_files_in_directory(), also for empty directories
+    dir_listing_t *listing = g_object_get_data(G_OBJECT(files), "listing");
+    if (listing) {
+        return listing;
+    }
+
+    FmEntry *first = g_list_model_get_item(G_LIST_MODEL(files), 0);
+    if (!first) {
+        return NULL;
+    }
+
+    listing = fm_entry_get_listing(first);
+    g_object_unref(first);
+    return listing;
+}
+
+/**
+ * @brief Called when the header of a list view column is clicked.
+ *
+ * Sorts the tab by the column through `sort_files_by()`, so the list view uses
+ * the same packed keys and worker threads as the sort menus.
+ *
+ * @param sorter The GtkColumnViewSorter of the view.
+ * @param change How the sorter changed (unused).
+ * @param user_data The GtkColumnView.
+ */
+static void on_column_sort_changed(GtkSorter *sorter, GtkSorterChange change, gpointer user_data) {
+    if (syncing_column_sort) {
+        return;
+    }
+
+    gboolean ascending;
+    const char *criteria = get_column_view_sort(GTK_COLUMN_VIEW(user_data), &ascending);
+    if (criteria) {
+        sort_files_by(ascending, criteria);
+    }
+}
+
+/**
+ * @brief Creates the grid or list view of a tab, depending on `list_view_mode`.
+ *
+ * Both views show the same selection model, switching between them keeps the
+ * order and the selection. Grouped tabs are always shown as a list.
+ *
+ * @param ctx The tab, its view fields are updated.
+ * @param selection Selection over the model of FmEntry, ownership is taken.
+ * @return The view, to be placed in the scrolled window of the tab.
+ */
+static GtkWidget* create_file_view(TabContext *ctx, GtkSelectionModel *selection) {
+    GtkWidget *view;
+    ctx->selection = selection;
+
+    if (list_view_mode || ctx->grouping) {
+        view = GTK_WIDGET(create_file_column_view(selection));
+        ctx->file_column_view = GTK_COLUMN_VIEW(view);
+        ctx->file_grid_view = NULL;
+        g_signal_connect(gtk_column_view_get_sorter(ctx->file_column_view), "changed",
+                         G_CALLBACK(on_column_sort_changed), view);
+    } else {
+        GtkListItemFactory *factory = gtk_signal_list_item_factory_new();
+        g_signal_connect(factory, "setup", G_CALLBACK(setup_file_item), NULL);
+        g_signal_connect(factory, "bind", G_CALLBACK(bind_file_item), NULL);
+        g_signal_connect(factory, "unbind", G_CALLBACK(unbind_file_item), NULL);
+
+        view = gtk_grid_view_new(selection, factory);
+        gtk_grid_view_set_single_click_activate(GTK_GRID_VIEW(view), FALSE);
+        ctx->file_grid_view = GTK_GRID_VIEW(view);
+        ctx->file_column_view = NULL;
+    }
+
+    // Set click and right-click handlers
+    g_signal_connect(view, "activate", G_CALLBACK(file_clicked), ctx);
+
+    GtkGesture *right_click = gtk_gesture_click_new();
+    gtk_gesture_single_set_button(GTK_GESTURE_SINGLE(right_click), GDK_BUTTON_SECONDARY);
+    gtk_widget_add_controller(view, GTK_EVENT_CONTROLLER(right_click));
+    g_signal_connect(right_click, "released", G_CALLBACK(directory_right_clicked), ctx);
+    return view;
+}
+
+/**
+ * @brief Gives the entries of a group row to the grouped view.
+ *
+ * @param item The FmGroup of the row, or an FmEntry which has no children.
+ * @param user_data Not used.
+ * @return The entries of the group, NULL for entries.
+ */
+static GListModel* create_group_children_model(gpointer item, gpointer user_data) {
+    return FM_IS_GROUP(item) ? g_object_ref(fm_group_get_entries(item)) : NULL;
+}
+
+/**
+ * @brief Creates the model of the grouped view of a tab.
+ *
+ * A tree of the groups of `group_mode`, each expanded into its entries. The
+ * grouping is kept in the order of the sorted model by `sync_grouping()`.
+ *
+ * @param ctx The tab, its grouping is set.
+ * @param sort_model Sorted model of FmEntry, ownership is taken.
+ * @return Model of GtkTreeListRow.
+ */
+static GListModel* create_grouped_model(TabContext *ctx, GtkSortListModel *sort_model) {
+    const fm_sort_t *sort = g_object_get_data(G_OBJECT(sort_model), "sort");
+    fm_grouping_t *grouping = fm_grouping_new(group_mode, G_LIST_MODEL(sort_model), sort);
+
+    GListModel *groups = g_object_ref(fm_grouping_get_groups(grouping));
+    GtkTreeListModel *tree = gtk_tree_list_model_new(groups, FALSE, TRUE, create_group_children_model, NULL, NULL);
+
+    // The tree keeps the sorted model (metadata fetch, sort state) and the grouping alive with the view
+    g_object_set_data_full(G_OBJECT(tree), "sort-model", sort_model, g_object_unref);
+    g_object_set_data_full(G_OBJECT(tree), "grouping", grouping, (GDestroyNotify)fm_grouping_free);
+    ctx->grouping = grouping;
+    return G_LIST_MODEL(tree);
+}
 
+/**
+ * @brief Shows a sorted model of files in a tab.
+ *
+ * Sets up the file grid or list and replaces the content inside the container
+ * with it. When `group_mode` is set, the files are shown in groups.
+ *
+ * @param ctx The tab, its current_directory must already point to the shown directory.
+ * @param container The GtkScrolledWindow to place the file view inside.
+ * @param sort_model Sorted model of FmEntry, ownership is taken.
+ */
+static void show_file_model(TabContext *ctx, GtkWidget *container, GtkSortListModel *sort_model) {
+    // Save the models in context, they are owned by the view
+    ctx->file_store = G_LIST_STORE(gtk_sort_list_model_get_model(sort_model));
     ctx->sort_model = sort_model;
+    ctx->grouping = NULL;
+
+    GListModel *shown = G_LIST_MODEL(sort_model);
+    if (group_mode != FM_GROUP_NONE) {
+        shown = create_grouped_model(ctx, sort_model);
+    }
+
+    GtkMultiSelection *selection = gtk_multi_selection_new(shown);
+    GtkWidget *view = create_file_view(ctx, GTK_SELECTION_MODEL(selection));
+
+    // Swap in the new view
+    gtk_scrolled_window_set_child(GTK_SCROLLED_WINDOW(container), view);
+    sync_column_sort(ctx);
+
+    // Update path and tab label
+    gtk_editable_set_text(GTK_EDITABLE(directory_entry), ctx->current_directory);
+    char *basename = g_path_get_basename(ctx->current_directory);
+    gtk_label_set_text(GTK_LABEL(ctx->tab_label), basename);
+    g_free(basename);
+}
+
+/**
+ * @brief Records the current view of a tab so it can be restored later.
+ *
+ * @param ctx The tab.
+ * @return New snapshot, NULL if the tab shows nothing yet.
+ */
+static view_snapshot_t* capture_view(TabContext *ctx) {
+    if (!ctx->current_directory) {
+        return NULL;
+    }
+
+    view_snapshot_t *snapshot = g_new0(view_snapshot_t, 1);
+    snapshot->directory = g_strdup(ctx->current_directory);
+    snapshot->show_hidden = show_hidden_files;
+    snapshot->sort_criteria = g_strdup(ctx->sort_criteria);
+    snapshot->sort_ascending = ctx->sort_ascending;
+
+    GtkAdjustment *vadjustment = gtk_scrolled_window_get_vadjustment(GTK_SCROLLED_WINDOW(ctx->scrolled_window));
+    snapshot->scroll_offset = gtk_adjustment_get_value(vadjustment);
+
+    // Flattened views are walked again rather than kept walking in the history, search results are filtered again
+    if (ctx->sort_model && ctx->selection && !g_object_get_data(G_OBJECT(ctx->sort_model), "flat-walk") &&
+        !g_object_get_data(G_OBJECT(ctx->sort_model), "filter")) {
+        snapshot->sort_model = g_object_ref(ctx->sort_model);
+        dir_listing_t *listing = get_store_listing(ctx->file_store);
+        snapshot->listing = listing ? dir_listing_ref(listing) : NULL;
+        // Positions of the grouped view do not match the sorted model
+        snapshot->selection = ctx->grouping ? NULL : gtk_selection_model_get_selection(ctx->selection);
+    }
+    return snapshot;
+}
 
-    // Set up selection and factory
-    GtkMultiSelection *selection = gtk_multi_selection_new(G_LIST_MODEL(sort_model));
-    GtkListItemFactory *factory = gtk_signal_list_item_factory_new();
-    g_signal_connect(factory, "setup", G_CALLBACK(setup_file_item), NULL);
-    g_signal_connect(factory, "bind", G_CALLBACK(bind_file_item), NULL);
+/**
+ * @brief Applies a saved scroll offset once the restored view was laid out.
+ *
+ * The offset can only be set once the view is allocated for the first time. The
+ * handler only waits for that first layout: the offset is clamped to what the
+ * view covers then, and the handler is gone before any later directory is shown.
+ *
+ * @param adjustment The vertical adjustment of the tab.
+ * @param user_data Pointer to the offset (freed with the handler).
+ */
+static void on_restore_scroll_changed(GtkAdjustment *adjustment, gpointer user_data) {
+    if (gtk_adjustment_get_page_size(adjustment) <= 0) {
+        // Not allocated yet
+        return;
+    }
+
+    // GtkAdjustment clamps the value between lower and upper - page_size
+    gtk_adjustment_set_value(adjustment, *(double*)user_data);
+    g_signal_handlers_disconnect_by_func(adjustment, on_restore_scroll_changed, user_data);
+}
+
+/**
+ * @brief Drops a scroll offset of a tab still waiting for its view to be laid out.
+ *
+ * Called before the tab shows another view, so the offset never lands on it.
+ *
+ * @param ctx The tab.
+ */
+static void cancel_scroll_restore(TabContext *ctx) {
+    if (!ctx->restore_scroll_id) {
+        return;
+    }
 
-    // Create the grid view
-    GtkWidget *view = gtk_grid_view_new(GTK_SELECTION_MODEL(selection), factory);
-    gtk_grid_view_set_single_click_activate(GTK_GRID_VIEW(view), FALSE);
+    GtkAdjustment *vadjustment = gtk_scrolled_window_get_vadjustment(GTK_SCROLLED_WINDOW(ctx->scrolled_window));
+    // Already gone if the offset was applied
+    if (g_signal_handler_is_connected(vadjustment, ctx->restore_scroll_id)) {
+        g_signal_handler_disconnect(vadjustment, ctx->restore_scroll_id);
+    }
+    ctx->restore_scroll_id = 0;
+}
 
-    // Save the view in context
-    ctx->file_grid_view = GTK_GRID_VIEW(view);
+/**
+ * @brief Shows a snapshot again in a tab.
+ *
+ * The snapshot's model is reused when the listing cache did not notice any change in
+ * its directory, which restores the order and selection without reading anything.
+ * Otherwise the directory is listed again with the sort mode of the snapshot.
+ *
+ * @param ctx The tab.
+ * @param snapshot The snapshot to show.
+ */
+static void restore_view(TabContext *ctx, view_snapshot_t *snapshot) {
+    cancel_scroll_restore(ctx);
+    gtk_revealer_set_reveal_child(GTK_REVEALER(ctx->preview_revealer), FALSE);
+
+    // Empty directories keep their listing too, so every model is checked against the cache
+    gboolean reuse = snapshot->sort_model && snapshot->show_hidden == show_hidden_files &&
+                     snapshot->listing && listcache_is_current(snapshot->listing);
+
+    if (reuse) {
+        g_clear_pointer(&ctx->current_directory, g_free);
+        ctx->current_directory = g_strdup(snapshot->directory);
+        g_free(ctx->sort_criteria);
+        ctx->sort_criteria = g_strdup(snapshot->sort_criteria);
+        ctx->sort_ascending = snapshot->sort_ascending;
+
+        show_file_model(ctx, ctx->scrolled_window, g_object_ref(snapshot->sort_model));
+        if (snapshot->selection && !ctx->grouping) {
+            GtkBitset *mask = gtk_bitset_new_range(0, g_list_model_get_n_items(G_LIST_MODEL(snapshot->sort_model)));
+            gtk_selection_model_set_selection(ctx->selection, snapshot->selection, mask);
+            gtk_bitset_unref(mask);
+        }
+    } else {
+        populate_files_in_container(snapshot->directory, ctx->scrolled_window, ctx);
+        if (snapshot->sort_criteria) {
+            apply_sort(ctx, snapshot->sort_ascending, snapshot->sort_criteria);
+        }
+    }
+
+    if (snapshot->scroll_offset > 0) {
+        GtkAdjustment *vadjustment = gtk_scrolled_window_get_vadjustment(GTK_SCROLLED_WINDOW(ctx->scrolled_window));
+        double *offset = g_new(double, 1);
+        *offset = snapshot->scroll_offset;
+        ctx->restore_scroll_id = g_signal_connect_data(vadjustment, "changed", G_CALLBACK(on_restore_scroll_changed),
+                                                       offset, (GClosureNotify)g_free, 0);
+    }
+}
+
+/**
+ * @brief Enables the back and forward actions according to the history of a tab.
+ *
+ * @param ctx The current tab, may be NULL.
+ */
+static void update_history_actions(const TabContext *ctx) {
+    GAction *back = g_action_map_lookup_action(G_ACTION_MAP(window), "go_back");
+    GAction *forward = g_action_map_lookup_action(G_ACTION_MAP(window), "go_forward");
+    if (back) {
+        g_simple_action_set_enabled(G_SIMPLE_ACTION(back), ctx && ctx->back_history->len > 0);
+    }
+    if (forward) {
+        g_simple_action_set_enabled(G_SIMPLE_ACTION(forward), ctx && ctx->forward_history->len > 0);
+    }
+}
+
+void navigate_to_directory(TabContext *ctx, const char *directory) {
+    view_snapshot_t *snapshot = capture_view(ctx);
+    if (snapshot) {
+        nav_history_push(ctx->back_history, snapshot);
+    }
+    g_ptr_array_set_size(ctx->forward_history, 0);
+
+    gtk_revealer_set_reveal_child(GTK_REVEALER(ctx->preview_revealer), FALSE);
+    populate_files_in_container(directory, ctx->scrolled_window, ctx);
+    update_history_actions(ctx);
+}
+
+/**
+ * @brief Moves a tab one step through its history.
+ *
+ * @param from Stack to take the snapshot from.
+ * @param to Stack receiving the view being left.
+ */
+static void step_history(TabContext *ctx, GPtrArray *from, GPtrArray *to) {
+    view_snapshot_t *target = nav_history_pop(from);
+    if (!target) {
+        return;
+    }
 
-    // Set click and right-click handlers
-    g_signal_connect(view, "activate", G_CALLBACK(file_clicked), ctx);
+    view_snapshot_t *current = capture_view(ctx);
+    if (current) {
+        nav_history_push(to, current);
+    }
 
-    GtkGesture *right_click = gtk_gesture_click_new();
-    gtk_gesture_single_set_button(GTK_GESTURE_SINGLE(right_click), GDK_BUTTON_SECONDARY);
-    gtk_widget_add_controller(view, GTK_EVENT_CONTROLLER(right_click));
-    g_signal_connect(right_click, "released", G_CALLBACK(directory_right_clicked), ctx);
+    restore_view(ctx, target);
+    view_snapshot_free(target);
+    update_history_actions(ctx);
+}
 
-    // Swap in the new view
-    gtk_scrolled_window_set_child(GTK_SCROLLED_WINDOW(container), view);
+/**
+ * @brief Goes back to the previous directory of the current tab.
+ */
+static void on_go_back(GSimpleAction *action, GVariant *parameter, gpointer user_data) {
+    TabContext *ctx = get_current_tab_context();
+    if (ctx) {
+        step_history(ctx, ctx->back_history, ctx->forward_history);
+    }
+}
 
-    // Update path and tab label
-    gtk_editable_set_text(GTK_EDITABLE(directory_entry), ctx->current_directory);
-    gtk_label_set_text(GTK_LABEL(ctx->tab_label), g_path_get_basename(directory));
+/**
+ * @brief Goes forward again after going back in the current tab.
+ */
+static void on_go_forward(GSimpleAction *action, GVariant *parameter, gpointer user_data) {
+    TabContext *ctx = get_current_tab_context();
+    if (ctx) {
+        step_history(ctx, ctx->forward_history, ctx->back_history);
+    }
 }
 
 /**
@@ -540,6 +1513,8 @@ TabContext* get_current_tab_context() {
  *
  * Filters files in the current tab's directory to only those containing the filter
  * substring in their basename. If no matches are found, the view is left unchanged.
+ * The matches are shown with `show_file_model()` in the sort of the tab, so the
+ * tab's models always belong to the view it shows.
  *
  * @param filter String used to filter file basenames (case-sensitive).
  */
@@ -552,18 +1527,10 @@ void populate_files_with_filter(const char *filter) {
     if (!raw_files) return;
 
     // Prepare filtered list
-    GListStore *filtered_files = g_list_store_new(G_TYPE_FILE);
-    for (guint i = 0; i < g_list_model_get_n_items(G_LIST_MODEL(raw_files)); i++) {
-        GFile *file = g_list_model_get_item(G_LIST_MODEL(raw_files), i);
-        const char *basename = g_file_get_basename(file);
-
-        if (!filter || strlen(filter) == 0 || g_strrstr(basename, filter)) {
-            g_list_store_append(filtered_files, file);
-        }
-
-        g_object_unref(file);
-    }
+    trace_span_t span = trace_begin("ui", "filter");
+    GListStore *filtered_files = fm_entry_filter_store(G_LIST_MODEL(raw_files), filter);
     g_object_unref(raw_files);
+    trace_end_detail(span, filter);
 
     // If no matches found, avoid updating the view
     if (g_list_model_get_n_items(G_LIST_MODEL(filtered_files)) == 0) {
@@ -571,25 +1538,26 @@ void populate_files_with_filter(const char *filter) {
         return;
     }
 
-    GtkWidget *view = gtk_grid_view_new(
-        GTK_SELECTION_MODEL(gtk_multi_selection_new(G_LIST_MODEL(filtered_files))),
-        gtk_signal_list_item_factory_new()
-    );
-
-    g_signal_connect(view, "activate", G_CALLBACK(file_clicked), ctx);
-
-    // Setup factory
-    GtkListItemFactory *factory = gtk_grid_view_get_factory(GTK_GRID_VIEW(view));
-    g_signal_connect(factory, "setup", G_CALLBACK(setup_file_item), NULL);
-    g_signal_connect(factory, "bind", G_CALLBACK(bind_file_item), NULL);
+    // Shown like a listing, so the tab's models point at the new view and the sort is kept
+    GtkSortListModel *sort_model = gtk_sort_list_model_new(G_LIST_MODEL(filtered_files), NULL);
+    gtk_sort_list_model_set_incremental(sort_model, FALSE); // full sorting
+    // Search results are listed again rather than kept in the history
+    g_object_set_data_full(G_OBJECT(sort_model), "filter", g_strdup(filter), g_free);
 
-    // Replace old view safely
-    GtkWidget *old_view = gtk_scrolled_window_get_child(GTK_SCROLLED_WINDOW(ctx->scrolled_window));
-    if (GTK_IS_WIDGET(old_view)) {
-        gtk_scrolled_window_set_child(GTK_SCROLLED_WINDOW(ctx->scrolled_window), NULL);
+    dir_listing_t *listing = get_store_listing(filtered_files);
+    if (listing) {
+        statbatch_t *batch = statbatch_start(listing, on_listing_stats_ready, sort_model);
+        g_object_set_data_full(G_OBJECT(sort_model), "stat-batch", batch, (GDestroyNotify)statbatch_cancel_and_unref);
     }
 
-    gtk_scrolled_window_set_child(GTK_SCROLLED_WINDOW(ctx->scrolled_window), view);
+    cancel_scroll_restore(ctx);
+    show_file_model(ctx, ctx->scrolled_window, sort_model);
+    if (ctx->sort_criteria) {
+        // apply_sort() replaces ctx->sort_criteria
+        char *criteria = g_strdup(ctx->sort_criteria);
+        apply_sort(ctx, ctx->sort_ascending, criteria);
+        g_free(criteria);
+    }
 }
 
 
@@ -607,10 +1575,110 @@ void search_entry_changed(GtkEditable *editable, gpointer user_data) {
     populate_files_with_filter(query);
 }
 
+/**
+ * @brief Releases the views and models of a background tab.
+ *
+ * Keeps what is needed to show the tab again (directory, scroll offset and sort
+ * mode) as a snapshot without model. The preview buffer and the models held by
+ * the tab's history are released as well.
+ *
+ * @param ctx The tab, must not be the current one.
+ */
+static void hibernate_tab(TabContext *ctx) {
+    if (ctx->hibernated || !ctx->current_directory) {
+        return;
+    }
+
+    ctx->hibernated = capture_view(ctx);
+    view_snapshot_drop_model(ctx->hibernated);
+
+    // Destroys the grid, its item widgets, the selection and the models
+    gtk_scrolled_window_set_child(GTK_SCROLLED_WINDOW(ctx->scrolled_window), NULL);
+    ctx->file_grid_view = NULL;
+    ctx->file_column_view = NULL;
+    ctx->selection = NULL;
+    ctx->grouping = NULL;
+    ctx->sort_model = NULL;
+    ctx->file_store = NULL;
+
+    // A fresh buffer, the previewed file may have been large
+    gtk_revealer_set_reveal_child(GTK_REVEALER(ctx->preview_revealer), FALSE);
+    gtk_text_view_set_buffer(GTK_TEXT_VIEW(ctx->preview_text_view), NULL);
+
+    nav_history_drop_models(ctx->back_history);
+    nav_history_drop_models(ctx->forward_history);
+}
+
+/**
+ * @brief Rebuilds the view of a hibernated tab.
+ *
+ * The listing usually still is in the listing cache, so this does not read the disk.
+ *
+ * @param ctx The tab.
+ */
+static void wake_tab(TabContext *ctx) {
+    if (!ctx->hibernated) {
+        return;
+    }
+
+    view_snapshot_t *snapshot = ctx->hibernated;
+    ctx->hibernated = NULL;
+    restore_view(ctx, snapshot);
+    view_snapshot_free(snapshot);
+}
+
+/**
+ * @brief Hibernates background tabs.
+ *
+ * @param idle_us Only tabs not shown for this long are hibernated, 0 for all of them.
+ */
+static void hibernate_background_tabs(gint64 idle_us) {
+    gint64 now = g_get_monotonic_time();
+    int current = gtk_notebook_get_current_page(GTK_NOTEBOOK(notebook));
+    int n_pages = gtk_notebook_get_n_pages(GTK_NOTEBOOK(notebook));
+
+    for (int i = 0; i < n_pages; i++) {
+        GtkWidget *page = gtk_notebook_get_nth_page(GTK_NOTEBOOK(notebook), i);
+        TabContext *ctx = g_object_get_data(G_OBJECT(page), "tab_ctx");
+        if (!ctx) continue;
+
+        if (i == current) {
+            ctx->last_active_time = now;
+        } else if (now - ctx->last_active_time >= idle_us) {
+            hibernate_tab(ctx);
+        }
+    }
+}
+
+/**
+ * @brief Periodically hibernates the tabs that were not shown for a while.
+ *
+ * @param user_data Not used.
+ * @return G_SOURCE_CONTINUE
+ */
+static gboolean check_idle_tabs(gpointer user_data) {
+    if (tab_hibernate_after > 0) {
+        hibernate_background_tabs((gint64)tab_hibernate_after * G_USEC_PER_SEC);
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+/**
+ * @brief Hibernates every background tab when the system runs low on memory.
+ *
+ * @param monitor The memory monitor.
+ * @param level How low memory is.
+ * @param user_data Not used.
+ */
+static void on_low_memory_warning(GMemoryMonitor *monitor, GMemoryMonitorWarningLevel level, gpointer user_data) {
+    hibernate_background_tabs(0);
+}
+
 /**
  * @brief Callback triggered when the active tab in the notebook changes.
  *
- * Updates the directory entry to reflect the path of the newly selected tab.
+ * Updates the directory entry to reflect the path of the newly selected tab,
+ * rebuilding its view first if it was hibernated.
  * Falls back to the default directory if no context is found.
  *
  * @param self The GtkNotebook instance.
@@ -619,7 +1687,14 @@ void search_entry_changed(GtkEditable *editable, gpointer user_data) {
  * @param user_data Not used.
  */
 void tab_changed(GtkNotebook* self, GtkWidget* page, const guint page_num, gpointer user_data) {
-    const TabContext* ctx = g_object_get_data(G_OBJECT(page), "tab_ctx");
+    TabContext* ctx = g_object_get_data(G_OBJECT(page), "tab_ctx");
+    update_history_actions(ctx);
+    if (ctx) {
+        ctx->last_active_time = g_get_monotonic_time();
+        if (!startup_pending) {
+            wake_tab(ctx);
+        }
+    }
     if (ctx) {
         gtk_editable_set_text(GTK_EDITABLE(directory_entry), ctx->current_directory);
     } else {
@@ -642,6 +1717,7 @@ void update_preview_text(TabContext *ctx, GFile *file) {
     char *path = g_file_get_path(file);
     if (!path) return;
 
+    trace_span_t span = trace_begin("ui", "preview");
     gchar *content = NULL;
     gsize length;
     GError *error = NULL;
@@ -657,6 +1733,7 @@ void update_preview_text(TabContext *ctx, GFile *file) {
     }
 
     gtk_revealer_set_reveal_child(GTK_REVEALER(ctx->preview_revealer), TRUE);
+    trace_end_detail(span, path);
     g_free(path);
 }
 
@@ -664,11 +1741,13 @@ void update_preview_text(TabContext *ctx, GFile *file) {
  * @brief Reloads the current directory in the active tab.
  *
  * Repopulates the file list using the current path stored in the tab context.
- * Useful after file operations such as create, delete, or rename.
+ * Useful after file operations such as create, delete, or rename. The cached
+ * listing is dropped first, the file monitor may not have reported the change yet.
  */
 void reload_current_directory() {
     TabContext *ctx = get_current_tab_context();
     if (ctx && ctx->current_directory) {
+        listcache_invalidate(ctx->current_directory);
         populate_files_in_container(strdup(ctx->current_directory), ctx->scrolled_window, ctx);
     }
 }
@@ -692,13 +1771,12 @@ void file_right_clicked(GtkGestureClick *gesture, int n_press, double x, double
     size_t count;
     // Get the current tab context
     TabContext *ctx = get_current_tab_context();
-    if (!ctx || !ctx->file_grid_view) {
+    if (!ctx || !ctx->selection) {
         g_warning("Invalid tab context or scrolled window");
         return;
     }
 
-    GtkGridView* view = ctx->file_grid_view;
-    GFile** selected_files = get_selection(view, &count);
+    GFile** selected_files = get_selection(ctx->selection, &count);
 
     GtkListItem *list_item = GTK_LIST_ITEM(g_object_get_data(G_OBJECT(box), "list-item"));
     if (!list_item) {
@@ -707,7 +1785,13 @@ void file_right_clicked(GtkGestureClick *gesture, int n_press, double x, double
         return;
     }
 
-    GFile *file = G_FILE(gtk_list_item_get_item(list_item));
+    FmEntry *entry = get_list_item_entry(list_item);
+    if (!entry && GTK_IS_TREE_LIST_ROW(gtk_list_item_get_item(list_item))) {
+        // Group row of the grouped view, it has no file menu
+        g_free(selected_files);
+        return;
+    }
+    GFile *file = entry ? fm_entry_get_file(entry) : NULL;
     if (!file) {
         g_warning("Invalid file");
         if (selected_files) g_free(selected_files);
@@ -766,27 +1850,40 @@ static void menu_delete_clicked(GSimpleAction *action, GVariant *parameter, gpoi
     const char *params = g_variant_get_string(parameter, NULL);
     size_t count;
     char** files = split_basenames(params,";", &count);
+
+    // All selected files are deleted as one undoable operation
+    begin_operation_batch();
+
+    GPtrArray *paths = g_ptr_array_new_with_free_func(g_free);
     if (count == 1) {
-        delete_file(files[0]);
+        g_ptr_array_add(paths, g_strdup(files[0]));
     } else {
         // Extract directory path from the first element
-        char *dir_path = strdup(get_directory(files[0]));
+        char *dir_path = get_directory(files[0]);
 
         // Loop through remaining files (starting from index 1)
         for (size_t i = 1; i < count; i++) {
             // Construct absolute path by combining directory path and filename
-            char *abs_path = g_build_filename(dir_path, files[i], NULL);
-            // Delete the file
-            delete_file(abs_path);
-
-            // Free the constructed path
-            g_free(abs_path);
+            g_ptr_array_add(paths, g_build_filename(dir_path, files[i], NULL));
         }
 
         // Free the directory path
         g_free(dir_path);
     }
 
+    // Journal the whole plan first, so an interrupted delete can be resumed
+    for (guint i = 0; i < paths->len; i++) {
+        plan_batch_operation(OPERATION_TYPE_DELETE, g_ptr_array_index(paths, i), NULL);
+    }
+
+    // Delete the files
+    for (guint i = 0; i < paths->len; i++) {
+        delete_file(g_ptr_array_index(paths, i));
+    }
+    g_ptr_array_unref(paths);
+
+    end_operation_batch();
+
     // Free the split basenames array
     g_strfreev(files);
     reload_current_directory();
@@ -1007,28 +2104,27 @@ static void menu_paste_clicked(GSimpleAction *action, GVariant *parameter, gpoin
 /**
  * @brief Callback for the Undo button in the UI.
  *
- * Undoes the most recent file operation recorded in the operation history,
- * and refreshes the current directory view.
+ * Undoes the most recent file operation recorded in the operation history.
+ * The undo runs in the background and refreshes the current directory view when done.
  *
  * @param button The GtkButton clicked.
  * @param user_data Not used.
  */
 void undo_button_clicked(GtkButton *button, gpointer user_data) {
     undo_last_operation();
-    reload_current_directory();
 }
 
 /**
  * @brief Callback for the Redo button in the UI.
  *
- * Redoes the last undone operation in the history stack and refreshes the directory.
+ * Redoes the last undone operation in the history stack in the background and
+ * refreshes the directory when done.
  *
  * @param button The GtkButton clicked.
  * @param user_data Not used.
  */
 void redo_button_clicked(GtkButton *button, gpointer user_data) {
     redo_last_undo();
-    reload_current_directory();
 }
 
 /**
@@ -1117,6 +2213,40 @@ static void menu_dir_properties_clicked(GSimpleAction *action, GVariant *paramet
     gtk_window_present(properties_window);
 }
 
+/**
+ * @brief Opens a disk usage window showing the specified directory as a treemap.
+ *
+ * @param action The GSimpleAction triggered.
+ * @param parameter GVariant string representing the directory path.
+ * @param user_data Not used.
+ */
+static void menu_disk_usage_clicked(GSimpleAction *action, GVariant *parameter, gpointer user_data) {
+    const gchar* dir = g_variant_get_string(parameter, NULL);
+    if (!dir) return;
+
+    GtkWindow* disk_usage_window = create_treemap_window(dir, show_hidden_files);
+    gtk_window_set_transient_for(disk_usage_window, GTK_WINDOW(window));
+
+    gtk_window_present(disk_usage_window);
+}
+
+/**
+ * @brief Opens a window searching the specified directory for duplicate files.
+ *
+ * @param action The GSimpleAction triggered.
+ * @param parameter GVariant string representing the directory path.
+ * @param user_data Not used.
+ */
+static void menu_find_duplicates_clicked(GSimpleAction *action, GVariant *parameter, gpointer user_data) {
+    const gchar* dir = g_variant_get_string(parameter, NULL);
+    if (!dir) return;
+
+    GtkWindow* duplicates_window = create_duplicates_window(dir, show_hidden_files);
+    gtk_window_set_transient_for(duplicates_window, GTK_WINDOW(window));
+
+    gtk_window_present(duplicates_window);
+}
+
 /**
  * @brief Opens the directory context menu when the settings button is clicked.
  *
@@ -1138,112 +2268,372 @@ void on_settings_button_clicked(GtkButton *button, gpointer user_data) {
 }
 
 /**
- * @brief Comparator function for sorting files alphabetically by name.
+ * @brief Re-applies the sort of a model after directory sizes became known.
+ *
+ * @param user_data The GtkSortListModel (referenced).
+ * @return G_SOURCE_REMOVE
+ */
+static gboolean resort_by_size(gpointer user_data) {
+    GtkSortListModel *sort_model = GTK_SORT_LIST_MODEL(user_data);
+    g_object_set_data(G_OBJECT(sort_model), "resort-pending", NULL);
+    // The cached keys of the directories still hold their previous size
+    fm_sort_invalidate_keys();
+    resort_model(sort_model);
+    return G_SOURCE_REMOVE;
+}
+
+/**
+ * @brief Schedules a resort when the size of a directory in the sorted view is computed.
+ *
+ * Results arriving close together are coalesced into one resort.
+ *
+ * @param path The computed directory.
+ * @param totals Its totals (unused, the comparator reads the size cache).
+ * @param user_data The GtkSortListModel (referenced).
+ */
+static void on_sort_size_ready(const char *path, const dirsize_totals_t *totals, gpointer user_data) {
+    GtkSortListModel *sort_model = GTK_SORT_LIST_MODEL(user_data);
+    if (g_object_get_data(G_OBJECT(sort_model), "resort-pending")) {
+        return;
+    }
+    g_object_set_data(G_OBJECT(sort_model), "resort-pending", GINT_TO_POINTER(TRUE));
+    g_timeout_add_full(G_PRIORITY_DEFAULT, SIZE_RESORT_DELAY_MS, resort_by_size, g_object_ref(sort_model), g_object_unref);
+}
+
+/**
+ * @brief Cancels a GCancellable and drops a reference to it.
+ *
+ * @param data The GCancellable.
+ */
+static void cancel_and_unref(gpointer data) {
+    g_cancellable_cancel(G_CANCELLABLE(data));
+    g_object_unref(data);
+}
+
+/**
+ * @brief Computes the size of every directory of a tab whose size is not cached yet.
  *
- * Performs a case-insensitive comparison of file basenames. Sort direction is
- * determined by the SortContext.
+ * The sort of the tab is re-applied as the results come in. The walks stay on
+ * the file system of the directory and stop once the tab shows another one.
  *
- * @param a First GFile pointer.
- * @param b Second GFile pointer.
- * @param user_data Pointer to SortContext with ascending/descending flag.
- * @return Negative if a < b, positive if a > b, 0 if equal.
+ * @param ctx The tab.
  */
-gint compare_by_name(gconstpointer a, gconstpointer b, gpointer user_data) {
-    const char *name_a = g_file_get_basename(G_FILE(a));
-    const char *name_b = g_file_get_basename(G_FILE(b));
-    int result = g_ascii_strcasecmp(name_a, name_b);
-    SortContext *ctx = (SortContext *)user_data;
-    return ctx->ascending ? result : -result;
+static void request_directory_sizes(TabContext *ctx) {
+    // Cancelled with the sorted model when the tab leaves the directory, or by the next call
+    GCancellable *cancellable = g_cancellable_new();
+    g_object_set_data_full(G_OBJECT(ctx->sort_model), "size-cancellable", cancellable, cancel_and_unref);
+
+    guint n_items = g_list_model_get_n_items(G_LIST_MODEL(ctx->file_store));
+    for (guint i = 0; i < n_items; i++) {
+        FmEntry *entry = g_list_model_get_item(G_LIST_MODEL(ctx->file_store), i);
+        if (fm_entry_is_directory(entry)) {
+            char *path = fm_entry_get_path(entry);
+            sizecache_counts_t total;
+            if (!sizecache_lookup_path(path, &total)) {
+                dirsize_request(path, cancellable, on_sort_size_ready, g_object_ref(ctx->sort_model), g_object_unref);
+            }
+            g_free(path);
+        }
+        g_object_unref(entry);
+    }
 }
 
 /**
- * @brief Comparator function for sorting files by last modified timestamp.
+ * @brief Applies the result of a parallel sort to the store of a model.
  *
- * Compares files based on the `G_FILE_ATTRIBUTE_TIME_MODIFIED` attribute.
- * Direction is controlled by the SortContext.
+ * The sorter of the model is dropped and the store is replaced by the sorted
+ * entries in one splice, so the view goes from the old order to the new one at
+ * once. Results of a sort that was replaced by a newer one are dropped.
+ * Entries appended by a flattened view while sorting are kept after the sorted ones.
  *
- * @param a First GFile pointer.
- * @param b Second GFile pointer.
- * @param user_data Pointer to SortContext with ascending/descending flag.
- * @return Negative if a < b, positive if a > b, 0 if equal or on error.
+ * @param source_object Unused.
+ * @param result The result of fm_sort_entries_async().
+ * @param user_data The GtkSortListModel (referenced).
  */
-gint compare_by_date(gconstpointer a, gconstpointer b, gpointer user_data) {
-    GFileInfo *info_a = g_file_query_info(G_FILE(a), G_FILE_ATTRIBUTE_TIME_MODIFIED, G_FILE_QUERY_INFO_NONE, NULL, NULL);
-    GFileInfo *info_b = g_file_query_info(G_FILE(b), G_FILE_ATTRIBUTE_TIME_MODIFIED, G_FILE_QUERY_INFO_NONE, NULL, NULL);
-    if (!info_a || !info_b) {
-        if (info_a) g_object_unref(info_a);
-        if (info_b) g_object_unref(info_b);
-        return 0;
+static void on_parallel_sort_done(GObject *source_object, GAsyncResult *result, gpointer user_data) {
+    GtkSortListModel *sort_model = GTK_SORT_LIST_MODEL(user_data);
+    GPtrArray *sorted = fm_sort_entries_finish(result, NULL);
+    gboolean current = g_task_get_cancellable(G_TASK(result)) ==
+                       g_object_get_data(G_OBJECT(sort_model), "sort-cancellable");
+
+    if (current) {
+        g_object_set_data(G_OBJECT(sort_model), "sort-running", NULL);
+    }
+
+    // A flattened view may have appended entries meanwhile, they stay at the end until the next sort
+    GListStore *store = G_LIST_STORE(gtk_sort_list_model_get_model(sort_model));
+    if (sorted && current && sorted->len <= g_list_model_get_n_items(G_LIST_MODEL(store))) {
+        trace_span_t span = trace_begin("ui", "apply_sort");
+        gtk_sort_list_model_set_sorter(sort_model, NULL);
+        g_list_store_splice(store, 0, sorted->len, sorted->pdata, sorted->len);
+        trace_end(span);
+        sync_grouping(sort_model);
+    }
+    g_clear_pointer(&sorted, g_ptr_array_unref);
+
+    if (current && g_object_get_data(G_OBJECT(sort_model), "resort-again")) {
+        g_object_set_data(G_OBJECT(sort_model), "resort-again", NULL);
+        start_parallel_sort(sort_model);
     }
-    guint64 mod_a = g_file_info_get_attribute_uint64(info_a, G_FILE_ATTRIBUTE_TIME_MODIFIED);
-    guint64 mod_b = g_file_info_get_attribute_uint64(info_b, G_FILE_ATTRIBUTE_TIME_MODIFIED);
-    g_object_unref(info_a);
-    g_object_unref(info_b);
-    gint result = (mod_a > mod_b) - (mod_a < mod_b);
-    SortContext *ctx = (SortContext *)user_data;
-    return ctx->ascending ? result : -result;
+    g_object_unref(sort_model);
 }
 
 /**
- * @brief Comparator function for sorting files by size in bytes.
+ * @brief Sorts the store of a model on worker threads.
+ *
+ * The current order stays visible until `on_parallel_sort_done()` applies the
+ * new one. A resort asked for while a sort is running (metadata or directory
+ * sizes coming in) runs once that sort is done.
  *
- * Retrieves file sizes using `G_FILE_ATTRIBUTE_STANDARD_SIZE` and compares them.
- * Uses ascending or descending order based on SortContext.
+ * @param sort_model The model, with the order set by `apply_sort()`.
+ */
+static void start_parallel_sort(GtkSortListModel *sort_model) {
+    const fm_sort_t *sort = g_object_get_data(G_OBJECT(sort_model), "parallel-sort");
+    if (!sort) {
+        return;
+    }
+    if (g_object_get_data(G_OBJECT(sort_model), "sort-running")) {
+        g_object_set_data(G_OBJECT(sort_model), "resort-again", GINT_TO_POINTER(TRUE));
+        return;
+    }
+
+    GCancellable *cancellable = g_cancellable_new();
+    // Replacing it later cancels this sort
+    g_object_set_data_full(G_OBJECT(sort_model), "sort-cancellable", cancellable, cancel_and_unref);
+    g_object_set_data(G_OBJECT(sort_model), "sort-running", GINT_TO_POINTER(TRUE));
+
+    GListModel *store = gtk_sort_list_model_get_model(sort_model);
+    guint n_items = g_list_model_get_n_items(store);
+    GPtrArray *entries = g_ptr_array_new_full(n_items, g_object_unref);
+    for (guint i = 0; i < n_items; i++) {
+        g_ptr_array_add(entries, g_list_model_get_item(store, i));
+    }
+
+    fm_sort_entries_async(entries, sort, cancellable, on_parallel_sort_done, g_object_ref(sort_model));
+    g_ptr_array_unref(entries);
+}
+
+/**
+ * @brief Re-applies the sort of a model after the metadata it sorts by changed.
  *
- * @param a First GFile pointer.
- * @param b Second GFile pointer.
- * @param user_data Pointer to SortContext with sort order flag.
- * @return Comparison result as per qsort convention.
+ * @param sort_model The model.
  */
-gint compare_by_size(gconstpointer a, gconstpointer b, gpointer user_data) {
-    GFileInfo *info_a = g_file_query_info(G_FILE(a), G_FILE_ATTRIBUTE_STANDARD_SIZE, G_FILE_QUERY_INFO_NONE, NULL, NULL);
-    GFileInfo *info_b = g_file_query_info(G_FILE(b), G_FILE_ATTRIBUTE_STANDARD_SIZE, G_FILE_QUERY_INFO_NONE, NULL, NULL);
-    if (!info_a || !info_b) {
-        if (info_a) g_object_unref(info_a);
-        if (info_b) g_object_unref(info_b);
-        return 0;
+static void resort_model(GtkSortListModel *sort_model) {
+    if (g_object_get_data(G_OBJECT(sort_model), "parallel-sort")) {
+        start_parallel_sort(sort_model);
+        return;
+    }
+
+    GtkSorter *sorter = gtk_sort_list_model_get_sorter(sort_model);
+    if (sorter) {
+        trace_span_t span = trace_begin("ui", "resort");
+        gtk_sorter_changed(sorter, GTK_SORTER_CHANGE_DIFFERENT);
+        trace_end(span);
+        sync_grouping(sort_model);
     }
-    goffset size_a = g_file_info_get_size(info_a);
-    goffset size_b = g_file_info_get_size(info_b);
-    g_object_unref(info_a);
-    g_object_unref(info_b);
-    gint result = (size_a > size_b) - (size_a < size_b);
-    SortContext *ctx = (SortContext *)user_data;
-    return ctx->ascending ? result : -result;
 }
 
 /**
  * @brief Sorts files in the current tab based on the specified criteria and direction.
  *
- * Creates a GtkSorter dynamically using the provided criteria ("name", "date", "size")
- * and applies it to the sort model of the current tab.
+ * Directories are kept before files when `sort_folders_first` is set, and files
+ * equal in the criteria are ordered by name.
  *
  * @param ascending TRUE for ascending sort, FALSE for descending.
  * @param criteria Sorting key, must be "name", "date", or "size".
  */
 void sort_files_by(gboolean ascending, const char *criteria) {
     TabContext *ctx = get_current_tab_context();
-    if (!ctx || !ctx->file_store || !ctx->file_grid_view || !ctx->sort_model) return;
-
-    GtkSorter *sorter = NULL;
-    SortContext *sort_ctx = g_new(SortContext, 1);
-    sort_ctx->ascending = ascending;
-
-    if (g_strcmp0(criteria, "name") == 0) {
-        sorter = GTK_SORTER(gtk_custom_sorter_new(compare_by_name, sort_ctx, g_free));
-    } else if (g_strcmp0(criteria, "date") == 0) {
-        sorter = GTK_SORTER(gtk_custom_sorter_new(compare_by_date, sort_ctx, g_free));
-    } else if (g_strcmp0(criteria, "size") == 0) {
-        sorter = GTK_SORTER(gtk_custom_sorter_new(compare_by_size, sort_ctx, g_free));
+    if (!ctx) return;
+
+    char *spec = sort_folders_first ? g_strconcat("folders,", criteria, NULL) : g_strdup(criteria);
+    apply_sort(ctx, ascending, spec);
+    g_free(spec);
+}
+
+/**
+ * @brief Sorts the files of a tab and remembers the sort mode for its history.
+ *
+ * @param ctx The tab.
+ * @param ascending Direction of the keys of the spec that do not give one.
+ * @param criteria Sort spec, see `fm_sort_parse()` (e.g. "size" or "folders,date-desc,name").
+ */
+static void apply_sort(TabContext *ctx, gboolean ascending, const char *criteria) {
+    if (!ctx->file_store || !ctx->selection || !ctx->sort_model) return;
+
+    fm_sort_t *sort = g_new(fm_sort_t, 1);
+    if (!fm_sort_parse(criteria, ascending, sort)) {
+        g_warning("Unknown sort: %s", criteria);
+        g_free(sort);
+        return;
+    }
+
+    g_free(ctx->sort_criteria);
+    ctx->sort_criteria = g_strdup(criteria);
+    ctx->sort_ascending = ascending;
+    gboolean by_size = fm_sort_has_key(sort, FM_SORT_SIZE);
+
+    // Re-applied by on_listing_stats_ready() while the metadata is being fetched
+    g_object_set_data(G_OBJECT(ctx->sort_model), "needs-stats", GINT_TO_POINTER(fm_sort_needs_stats(sort)));
+    // Order of the groups of the grouped view
+    fm_sort_t *group_sort = g_new(fm_sort_t, 1);
+    *group_sort = *sort;
+    g_object_set_data_full(G_OBJECT(ctx->sort_model), "sort", group_sort, g_free);
+
+    GObject *model = G_OBJECT(ctx->sort_model);
+    guint n_items = g_list_model_get_n_items(G_LIST_MODEL(ctx->file_store));
+    if (n_items > FM_SORT_PARALLEL_THRESHOLD) {
+        // Replacing the cancellable cancels a sort still running for the previous order
+        g_object_set_data_full(model, "parallel-sort", sort, g_free);
+        g_object_set_data(model, "sort-cancellable", NULL);
+        g_object_set_data(model, "sort-running", NULL);
+        g_object_set_data(model, "resort-again", NULL);
+        start_parallel_sort(ctx->sort_model);
     } else {
-        g_free(sort_ctx);
+        g_object_set_data(model, "parallel-sort", NULL);
+        g_object_set_data(model, "sort-cancellable", NULL);
+        g_object_set_data(model, "sort-running", NULL);
+
+        GtkSorter *sorter = GTK_SORTER(gtk_custom_sorter_new(fm_sort_compare, sort, g_free));
+        trace_span_t span = trace_begin("ui", "sort");
+        gtk_sort_list_model_set_sorter(ctx->sort_model, sorter);
+        trace_end_detail(span, criteria);
+        g_object_unref(sorter);
+        sync_grouping(ctx->sort_model);
+    }
+
+    if (by_size) {
+        request_directory_sizes(ctx);
+    }
+    sync_column_sort(ctx);
+}
+
+/**
+ * @brief Shows the primary sort key of a tab in the headers of its list view.
+ *
+ * "folders," put in front by `sort_files_by()` is skipped, the header of the
+ * next key is shown.
+ *
+ * @param ctx The tab.
+ */
+static void sync_column_sort(TabContext *ctx) {
+    if (!ctx->file_column_view) return;
+
+    char *criteria = NULL;
+    if (ctx->sort_criteria) {
+        const char *primary = ctx->sort_criteria;
+        if (g_str_has_prefix(primary, "folders,")) {
+            primary += strlen("folders,");
+        }
+        criteria = g_strndup(primary, strcspn(primary, ",-"));
+    }
+
+    syncing_column_sort = TRUE;
+    set_column_view_sort(ctx->file_column_view, criteria, ctx->sort_ascending);
+    syncing_column_sort = FALSE;
+    g_free(criteria);
+}
+
+/**
+ * @brief Switches every tab between the icon grid and the detailed list.
+ *
+ * The new view takes over the selection model of the old one, so the order,
+ * the selection and the running metadata fetch are kept. Grouped tabs stay lists.
+ *
+ * @param action The GSimpleAction triggered.
+ * @param state GVariant string, "grid" or "list".
+ * @param user_data Not used.
+ */
+static void view_mode_handler(GSimpleAction *action, GVariant *state, gpointer user_data) {
+    list_view_mode = g_strcmp0(g_variant_get_string(state, NULL), "list") == 0;
+    g_simple_action_set_state(action, state);
+
+    int n_pages = gtk_notebook_get_n_pages(GTK_NOTEBOOK(notebook));
+    for (int i = 0; i < n_pages; i++) {
+        GtkWidget *page = gtk_notebook_get_nth_page(GTK_NOTEBOOK(notebook), i);
+        TabContext *ctx = g_object_get_data(G_OBJECT(page), "tab_ctx");
+        if (!ctx || !ctx->selection || ctx->grouping || (list_view_mode == (ctx->file_column_view != NULL))) continue;
+
+        // The old view drops its reference when it is replaced
+        GtkWidget *view = create_file_view(ctx, g_object_ref(ctx->selection));
+        gtk_scrolled_window_set_child(GTK_SCROLLED_WINDOW(ctx->scrolled_window), view);
+        sync_column_sort(ctx);
+    }
+}
+
+/**
+ * @brief Regroups the grouped views of a model in its new order.
+ *
+ * Called once the sorted model changed its order, the groups are refilled in
+ * one pass instead of being sorted one by one.
+ *
+ * @param sort_model The sorted model of FmEntry.
+ */
+static void sync_grouping(GtkSortListModel *sort_model) {
+    const fm_sort_t *sort = g_object_get_data(G_OBJECT(sort_model), "sort");
+    int n_pages = notebook ? gtk_notebook_get_n_pages(GTK_NOTEBOOK(notebook)) : 0;
+    for (int i = 0; i < n_pages && sort; i++) {
+        GtkWidget *page = gtk_notebook_get_nth_page(GTK_NOTEBOOK(notebook), i);
+        TabContext *ctx = g_object_get_data(G_OBJECT(page), "tab_ctx");
+        if (ctx && ctx->sort_model == sort_model && ctx->grouping) {
+            trace_span_t span = trace_begin("ui", "regroup");
+            fm_grouping_set_order(ctx->grouping, G_LIST_MODEL(sort_model), sort);
+            trace_end(span);
+        }
+    }
+}
+
+/**
+ * @brief Switches every tab between the flat view and the grouped list.
+ *
+ * The sorted model of a tab is kept, only the groups are built on top of it.
+ *
+ * @param action The GSimpleAction triggered.
+ * @param state GVariant string, "none", "type", "extension" or "date".
+ * @param user_data Not used.
+ */
+static void group_by_handler(GSimpleAction *action, GVariant *state, gpointer user_data) {
+    fm_group_key_t key;
+    if (!fm_group_parse_key(g_variant_get_string(state, NULL), &key)) {
+        g_warning("Unknown grouping: %s", g_variant_get_string(state, NULL));
         return;
     }
+    group_mode = key;
+    g_simple_action_set_state(action, state);
 
-    gtk_sort_list_model_set_sorter(ctx->sort_model, sorter);
-    g_object_unref(sorter);
+    int n_pages = gtk_notebook_get_n_pages(GTK_NOTEBOOK(notebook));
+    for (int i = 0; i < n_pages; i++) {
+        GtkWidget *page = gtk_notebook_get_nth_page(GTK_NOTEBOOK(notebook), i);
+        TabContext *ctx = g_object_get_data(G_OBJECT(page), "tab_ctx");
+        if (!ctx || !ctx->sort_model || !ctx->selection) continue;
+
+        // The old view drops its reference when it is replaced
+        show_file_model(ctx, ctx->scrolled_window, g_object_ref(ctx->sort_model));
+    }
 }
 
+/**
+ * @brief Toggles keeping directories before files and re-sorts the current tab.
+ *
+ * @param action The GSimpleAction triggered.
+ * @param state GVariant containing the new boolean state.
+ * @param user_data Not used.
+ */
+static void toggle_folders_first_handler(GSimpleAction *action, GVariant *state, gpointer user_data) {
+    sort_folders_first = g_variant_get_boolean(state);
+    g_simple_action_set_state(action, state);
+
+    TabContext *ctx = get_current_tab_context();
+    if (!ctx || !ctx->sort_criteria) return;
+
+    const char *criteria = ctx->sort_criteria;
+    if (g_str_has_prefix(criteria, "folders,")) {
+        criteria += strlen("folders,");
+    }
+    char *primary = g_strdup(criteria);
+    sort_files_by(ctx->sort_ascending, primary);
+    g_free(primary);
+}
 
 void on_sort_name_asc(GSimpleAction *action, GVariant *param, gpointer user_data) {
     sort_files_by(TRUE, "name");
@@ -1264,6 +2654,31 @@ void on_sort_size_desc(GSimpleAction *action, GVariant *param, gpointer user_dat
     sort_files_by(FALSE, "size");
 }
 
+/**
+ * @brief Toggles listing every file under the directory and reloads the current tab.
+ *
+ * @param action The GSimpleAction triggered.
+ * @param state GVariant containing the new boolean state.
+ * @param user_data Not used.
+ */
+static void toggle_flatten_handler(GSimpleAction *action, GVariant *state, gpointer user_data) {
+    flatten_mode = g_variant_get_boolean(state);
+    g_simple_action_set_state(action, state);
+
+    TabContext *ctx = get_current_tab_context();
+    if (!ctx || !ctx->current_directory) return;
+
+    // Listed again, keeping the sort of the tab
+    char *directory = g_strdup(ctx->current_directory);
+    char *criteria = g_strdup(ctx->sort_criteria);
+    populate_files_in_container(directory, ctx->scrolled_window, ctx);
+    if (criteria) {
+        apply_sort(ctx, ctx->sort_ascending, criteria);
+    }
+    g_free(criteria);
+    g_free(directory);
+}
+
 /**
  * @brief Toggles the visibility of hidden files in the directory view.
  *
@@ -1319,6 +2734,24 @@ static void menu_preview_clicked(GSimpleAction *action, GVariant *parameter, gpo
     g_object_unref(file);
 }
 
+/**
+ * @brief Applies the command line options that must be known before registration.
+ *
+ * With --exit-after-first-paint the application does not register as the unique
+ * instance, so a benchmark run never hands its startup over to a running window.
+ *
+ * @param application The GtkApplication instance.
+ * @param options The parsed options (not used, they are bound to variables).
+ * @param user_data Not used.
+ * @return -1 to let the application run.
+ */
+static gint handle_local_options(GApplication *application, GVariantDict *options, gpointer user_data) {
+    if (exit_after_first_paint) {
+        g_application_set_flags(application, g_application_get_flags(application) | G_APPLICATION_NON_UNIQUE);
+    }
+    return -1;
+}
+
 /**
  * @brief Application entry point.
  *
@@ -1333,10 +2766,31 @@ int main(int argc, char **argv) {
     GtkApplication *app;
     int status;
 
+    profile_start();
+    trace_init();
+    if (trace_is_recording()) {
+        // Stalls are part of the trace
+        stallmon_start(NULL);
+    }
+
+    // kill -USR1 prints the memory report
+    g_unix_signal_add(SIGUSR1, on_memory_dump_signal, NULL);
+
     app = gtk_application_new("org.gtk.fileman", G_APPLICATION_DEFAULT_FLAGS);
+    g_application_add_main_option_entries(G_APPLICATION(app), app_options);
+    g_signal_connect(app, "handle-local-options", G_CALLBACK(handle_local_options), NULL);
     g_signal_connect(app, "activate", G_CALLBACK(init), NULL);
     status = g_application_run(G_APPLICATION(app), argc, argv);
     g_object_unref(app);
 
+    // Write the trace if FM_TRACE is set
+    trace_shutdown();
+
+    // Flush the history journal
+    cleanup_operation_history();
+
+    // Keep the directory sizes for the next session
+    sizecache_save();
+
     return status;
 }
@@ -2,6 +2,8 @@
 #define MAIN_H
 
 #include <gtk/gtk.h>
+#include "navigation.h"
+#include "fmgroup.h"
 
 /**
  * @brief Holds state and widgets related to a single notebook tab.
@@ -15,9 +17,19 @@ typedef struct {
     char *current_directory;
     GtkWidget *preview_text_view;
     GtkWidget *preview_revealer;
-    GtkGridView *file_grid_view;
+    GtkGridView *file_grid_view; // Icon view, NULL in list mode
+    GtkColumnView *file_column_view; // Detailed list view, NULL in grid mode
+    GtkSelectionModel *selection; // Selection of the shown view, owned by it
+    fm_grouping_t *grouping; // Groups of the grouped view, owned by its model, NULL when not grouped
     GtkSortListModel *sort_model;
     GListStore *file_store;
+    char *sort_criteria; // Sort applied with sort_files_by(), NULL for directory order
+    gboolean sort_ascending;
+    GPtrArray *back_history; // view_snapshot_t of the directories left, most recent last
+    GPtrArray *forward_history; // view_snapshot_t of the directories gone back from, most recent last
+    gint64 last_active_time; // Monotonic time the tab was last seen as the current tab
+    view_snapshot_t *hibernated; // View to rebuild when the tab is shown again, NULL while awake
+    gulong restore_scroll_id; // Handler applying a restored scroll offset at the next layout, 0 if none
 } TabContext;
 
 /**
@@ -37,7 +49,7 @@ TabContext* get_current_tab_context();
 /**
  * @brief Populates the given container with the contents of a directory.
  *
- * Sets up a new GtkGridView for the files and updates the associated tab state.
+ * Sets up a new grid or list view for the files and updates the associated tab state.
  *
  * @param directory Directory path to list files from.
  * @param container GtkScrolledWindow to host the file grid.
@@ -45,6 +57,17 @@ TabContext* get_current_tab_context();
  */
 void populate_files_in_container(const char *directory, GtkWidget *container, TabContext *ctx);
 
+/**
+ * @brief Navigates a tab to a directory, recording the current view in its back history.
+ *
+ * Used for every user navigation (opening a folder, going up, typing a path,
+ * the sidebar). Clears the forward history.
+ *
+ * @param ctx The tab.
+ * @param directory Directory to show.
+ */
+void navigate_to_directory(TabContext *ctx, const char *directory);
+
 /**
  * @brief Handles right-clicks on individual file items.
  *
@@ -0,0 +1,148 @@
+#include "memstats.h"
+#include <malloc.h>
+#include <string.h>
+#include "dirsize.h"
+#include "fm_entry.h"
+#include "history.h"
+#include "listcache.h"
+#include "sizecache.h"
+#include "trace.h"
+
+/**
+ * Appends a line with a count and a size
+ */
+static void append_line(GString *report, const char *name, guint64 count, const char *unit, guint64 bytes) {
+    char *size = dirsize_format_size(bytes);
+    g_string_append_printf(report, "  %-18s %10" G_GUINT64_FORMAT " %-10s %12s\n", name, count, unit, size);
+    g_free(size);
+}
+
+/**
+ * Reads a size in kB from /proc/self/status
+ * @return The size in bytes, 0 if it is not known
+ */
+static guint64 read_status_size(const char *contents, const char *key) {
+    const char *line = contents ? strstr(contents, key) : NULL;
+    if (!line) {
+        return 0;
+    }
+    return g_ascii_strtoull(line + strlen(key), NULL, 10) * 1024;
+}
+
+static void append_process(GString *report) {
+    char *status = NULL;
+    g_file_get_contents("/proc/self/status", &status, NULL, NULL);
+    char *rss = dirsize_format_size(read_status_size(status, "VmRSS:"));
+    char *peak = dirsize_format_size(read_status_size(status, "VmHWM:"));
+    g_free(status);
+
+    struct mallinfo2 heap = mallinfo2();
+    char *used = dirsize_format_size(heap.uordblks);
+    char *free_size = dirsize_format_size(heap.fordblks);
+    char *mapped = dirsize_format_size(heap.hblkhd);
+
+    g_string_append(report, "Process\n");
+    g_string_append_printf(report, "  %-18s %s, peak %s\n", "RSS", rss, peak);
+    g_string_append_printf(report, "  %-18s %s in use, %s free, %s in large blocks\n", "malloc heap", used, free_size, mapped);
+
+    g_free(rss);
+    g_free(peak);
+    g_free(used);
+    g_free(free_size);
+    g_free(mapped);
+}
+
+/**
+ * Gets the listing a model of FmEntry shows
+ * @return The listing, NULL for an empty model
+ */
+static dir_listing_t* get_model_listing(GListModel *model) {
+    FmEntry *first = g_list_model_get_item(model, 0);
+    if (!first) {
+        return NULL;
+    }
+    dir_listing_t *listing = fm_entry_get_listing(first);
+    g_object_unref(first);
+    return listing;
+}
+
+/**
+ * Appends the snapshots of a back or forward stack
+ */
+static void append_snapshots(GString *report, const char *name, GPtrArray *stack) {
+    guint models = 0;
+    guint64 bytes = 0;
+    for (guint i = 0; i < stack->len; i++) {
+        view_snapshot_t *snapshot = g_ptr_array_index(stack, i);
+        if (snapshot->sort_model) {
+            models++;
+            guint n_items = g_list_model_get_n_items(G_LIST_MODEL(snapshot->sort_model));
+            bytes += (guint64)n_items * MEMSTATS_SORT_ITEM_BYTES;
+        }
+        if (snapshot->listing) {
+            bytes += dir_listing_get_memory_size(snapshot->listing);
+        }
+    }
+
+    char *unit = g_strdup_printf("(%u models)", models);
+    append_line(report, name, stack->len, unit, bytes);
+    g_free(unit);
+}
+
+static void append_tab(GString *report, guint index, TabContext *ctx, gsize entry_size) {
+    const char *directory = ctx->hibernated ? ctx->hibernated->directory : ctx->current_directory;
+    g_string_append_printf(report, "Tab %u: %s%s\n", index, directory ? directory : "(nothing shown)",
+                           ctx->hibernated ? " (hibernated)" : "");
+
+    if (ctx->file_store && ctx->sort_model) {
+        guint n_items = g_list_model_get_n_items(G_LIST_MODEL(ctx->file_store));
+        append_line(report, "store", n_items, "entries", (guint64)n_items * (entry_size + MEMSTATS_STORE_NODE_BYTES));
+
+        dir_listing_t *listing = get_model_listing(G_LIST_MODEL(ctx->file_store));
+        append_line(report, "listing", listing ? dir_listing_get_count(listing) : 0, "names",
+                    listing ? dir_listing_get_memory_size(listing) : 0);
+
+        guint sorted = g_list_model_get_n_items(G_LIST_MODEL(ctx->sort_model));
+        append_line(report, "sort model", sorted, "items", (guint64)sorted * MEMSTATS_SORT_ITEM_BYTES);
+    }
+
+    // At least a byte per character, counting the bytes would copy the whole text
+    GtkTextBuffer *buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(ctx->preview_text_view));
+    guint chars = gtk_text_buffer_get_char_count(buffer);
+    append_line(report, "preview", chars, "chars", chars);
+
+    append_snapshots(report, "back history", ctx->back_history);
+    append_snapshots(report, "forward history", ctx->forward_history);
+}
+
+static void append_caches(GString *report) {
+    guint count;
+    gsize bytes;
+
+    g_string_append(report, "Caches\n");
+    listcache_get_stats(&count, &bytes);
+    append_line(report, "listing cache", count, "listings", bytes);
+    sizecache_get_stats(&count, &bytes);
+    append_line(report, "size cache", count, "dirs", bytes);
+    history_get_stats(&count, &bytes);
+    append_line(report, "undo/redo history", count, "operations", bytes);
+    trace_get_stats(&count, &bytes);
+    append_line(report, "trace buffer", count, "events", bytes);
+}
+
+char* memstats_report(GPtrArray *tabs) {
+    GString *report = g_string_new(NULL);
+    append_process(report);
+
+    GTypeQuery query;
+    g_type_query(FM_TYPE_ENTRY, &query);
+    for (guint i = 0; i < tabs->len; i++) {
+        append_tab(report, i + 1, g_ptr_array_index(tabs, i), query.instance_size);
+    }
+
+    append_caches(report);
+    g_string_append(report, "Alive\n");
+    g_string_append_printf(report, "  %-18s %10u\n", "listings", dir_listing_get_live_count());
+    g_string_append_printf(report, "  %-18s %10u\n", "entries", fm_entry_get_live_count());
+    return g_string_free(report, FALSE);
+}
@@ -0,0 +1,38 @@
+#ifndef MEMSTATS_H
+#define MEMSTATS_H
+
+#include <gtk/gtk.h>
+#include "main.h"
+
+/**
+ * Memory accounting of the tabs and the caches
+ *
+ * Reports, for every tab, the entries of its store, the listing they share, the
+ * sort model, the preview buffer and the models kept by its back/forward
+ * history, then the byte and entry counts of every process-wide cache (listing
+ * cache, directory size cache, operation history, trace buffer) and the number
+ * of listings and entries still alive. Live counts well above what the tabs and
+ * caches hold point at leaked stores.
+ *
+ * GTK does not expose the memory of its models, so stores and sort models are
+ * estimated per item (MEMSTATS_STORE_NODE_BYTES, MEMSTATS_SORT_ITEM_BYTES).
+ * Listings are shared between tabs, snapshots and the listing cache, so the
+ * per-tab and cache sizes can overlap. The process RSS and the malloc heap
+ * (which GLib allocations go through) give the real totals.
+ *
+ * The report is shown by the memory window (Ctrl+Shift+M) and printed to
+ * stdout when the process gets SIGUSR1.
+ */
+
+#define MEMSTATS_STORE_NODE_BYTES 48 // GSequence node holding an item of a GListStore
+#define MEMSTATS_SORT_ITEM_BYTES 16 // Position and sort key kept per item by a GtkSortListModel
+
+/**
+ * Builds the memory report
+ * Must be called from the main thread
+ * @param tabs TabContext of every tab, in notebook order
+ * @return The report as text, free with g_free()
+ */
+char* memstats_report(GPtrArray *tabs);
+
+#endif //MEMSTATS_H
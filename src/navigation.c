@@ -0,0 +1,49 @@
+#include "navigation.h"
+
+void view_snapshot_free(view_snapshot_t *snapshot) {
+    if (!snapshot) {
+        return;
+    }
+
+    g_free(snapshot->directory);
+    g_clear_object(&snapshot->sort_model);
+    g_clear_pointer(&snapshot->listing, dir_listing_unref);
+    g_clear_pointer(&snapshot->selection, gtk_bitset_unref);
+    g_free(snapshot->sort_criteria);
+    g_free(snapshot);
+}
+
+void view_snapshot_drop_model(view_snapshot_t *snapshot) {
+    g_clear_object(&snapshot->sort_model);
+    g_clear_pointer(&snapshot->listing, dir_listing_unref);
+    // Positions only make sense in the model they were taken from
+    g_clear_pointer(&snapshot->selection, gtk_bitset_unref);
+}
+
+GPtrArray* nav_history_new(void) {
+    return g_ptr_array_new_with_free_func((GDestroyNotify)view_snapshot_free);
+}
+
+void nav_history_push(GPtrArray *stack, view_snapshot_t *snapshot) {
+    g_ptr_array_add(stack, snapshot);
+
+    if (stack->len > NAV_HISTORY_MAX_ENTRIES) {
+        g_ptr_array_remove_range(stack, 0, stack->len - NAV_HISTORY_MAX_ENTRIES);
+    }
+    if (stack->len > NAV_HISTORY_MAX_MODELS) {
+        view_snapshot_drop_model(g_ptr_array_index(stack, stack->len - NAV_HISTORY_MAX_MODELS - 1));
+    }
+}
+
+view_snapshot_t* nav_history_pop(GPtrArray *stack) {
+    if (stack->len == 0) {
+        return NULL;
+    }
+    return g_ptr_array_steal_index(stack, stack->len - 1);
+}
+
+void nav_history_drop_models(GPtrArray *stack) {
+    for (guint i = 0; i < stack->len; i++) {
+        view_snapshot_drop_model(g_ptr_array_index(stack, i));
+    }
+}
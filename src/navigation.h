@@ -0,0 +1,73 @@
+#ifndef NAVIGATION_H
+#define NAVIGATION_H
+
+#include <gtk/gtk.h>
+#include "direnum.h"
+
+/**
+ * Per-tab back/forward history
+ *
+ * Every navigation pushes a snapshot of the view it leaves: the directory, the
+ * sorted model it was showing, the scroll offset, the selection and the sort
+ * mode. Going back to a snapshot whose listing is still the cached one reuses
+ * its model as is, so nothing is read from the disk and the view comes back
+ * exactly as it was left. Only the most recent NAV_HISTORY_MAX_MODELS snapshots
+ * of a stack keep their model, older ones are rebuilt from their directory.
+ */
+
+#define NAV_HISTORY_MAX_ENTRIES 50 // Snapshots kept per stack, the oldest are dropped
+#define NAV_HISTORY_MAX_MODELS 8 // Snapshots per stack that keep their model alive
+
+/**
+ * A view as it was when the tab navigated away from it
+ */
+typedef struct {
+    char *directory;
+    GtkSortListModel *sort_model; // NULL once dropped
+    dir_listing_t *listing; // Listing shown by sort_model, also for empty directories, NULL for flattened views or once dropped
+    gboolean show_hidden; // Hidden files setting the listing was read with
+    double scroll_offset; // Value of the vertical adjustment
+    GtkBitset *selection; // Selected positions in sort_model, NULL once dropped
+    char *sort_criteria; // Sort spec (see fm_sort_parse()), NULL for directory order
+    gboolean sort_ascending;
+} view_snapshot_t;
+
+/**
+ * Frees a snapshot
+ * @param snapshot The snapshot
+ */
+void view_snapshot_free(view_snapshot_t *snapshot);
+
+/**
+ * Releases the model of a snapshot, keeping what is needed to rebuild the view
+ * @param snapshot The snapshot
+ */
+void view_snapshot_drop_model(view_snapshot_t *snapshot);
+
+/**
+ * Creates a stack of snapshots
+ * @return New stack, free with g_ptr_array_unref()
+ */
+GPtrArray* nav_history_new(void);
+
+/**
+ * Pushes a snapshot, dropping the oldest ones and their models above the limits
+ * @param stack The stack
+ * @param snapshot The snapshot, owned by the stack
+ */
+void nav_history_push(GPtrArray *stack, view_snapshot_t *snapshot);
+
+/**
+ * Pops the most recent snapshot
+ * @param stack The stack
+ * @return The snapshot, owned by the caller, NULL if the stack is empty
+ */
+view_snapshot_t* nav_history_pop(GPtrArray *stack);
+
+/**
+ * Releases the models of every snapshot of a stack
+ * @param stack The stack
+ */
+void nav_history_drop_models(GPtrArray *stack);
+
+#endif //NAVIGATION_H
@@ -0,0 +1,58 @@
+#include "profile.h"
+#include <string.h>
+
+typedef struct {
+    const char *phase;
+    gint64 time; // Microseconds since profile_start()
+} profile_mark_t;
+
+static profile_mark_t marks[PROFILE_MAX_MARKS];
+static guint mark_count = 0;
+static gint64 origin = 0;
+
+void profile_start(void) {
+    origin = g_get_monotonic_time();
+    mark_count = 0;
+    profile_mark("main");
+}
+
+void profile_mark(const char *phase) {
+    if (mark_count == PROFILE_MAX_MARKS) {
+        return;
+    }
+    marks[mark_count].phase = phase;
+    marks[mark_count].time = g_get_monotonic_time() - origin;
+    mark_count++;
+}
+
+gint64 profile_get_elapsed(const char *phase) {
+    for (guint i = 0; i < mark_count; i++) {
+        if (strcmp(marks[i].phase, phase) == 0) {
+            return marks[i].time;
+        }
+    }
+    return -1;
+}
+
+void profile_print(void) {
+    g_printerr("Startup profile (time since start, time since previous phase):\n");
+    for (guint i = 0; i < mark_count; i++) {
+        gint64 previous = i > 0 ? marks[i - 1].time : 0;
+        g_printerr("%9.3f ms %9.3f ms  %s\n",
+                   marks[i].time / 1000.0, (marks[i].time - previous) / 1000.0, marks[i].phase);
+    }
+}
+
+gboolean profile_write_json(const char *path, GError **error) {
+    GString *json = g_string_new("{\"unit\": \"ms\", \"phases\": [\n");
+    for (guint i = 0; i < mark_count; i++) {
+        // Phase names are identifiers, nothing to escape
+        g_string_append_printf(json, "  {\"phase\": \"%s\", \"time\": %.3f}%s\n",
+                               marks[i].phase, marks[i].time / 1000.0, i + 1 < mark_count ? "," : "");
+    }
+    g_string_append(json, "]}\n");
+
+    gboolean success = g_file_set_contents(path, json->str, (gssize)json->len, error);
+    g_string_free(json, TRUE);
+    return success;
+}
@@ -0,0 +1,50 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <glib.h>
+
+/**
+ * Startup phase timestamps
+ *
+ * profile_start() is called first thing in main() and every phase of the startup
+ * then records a monotonic timestamp with profile_mark(). Marks are always taken,
+ * they cost a clock read each, and are only printed or written out when asked for
+ * with --profile-startup or --profile-output.
+ */
+
+#define PROFILE_MAX_MARKS 64 // Later marks are dropped
+
+/**
+ * Resets the marks and takes the time origin
+ */
+void profile_start(void);
+
+/**
+ * Records the end of a startup phase
+ * Must be called from the main thread
+ * @param phase Name of the phase, a static string
+ */
+void profile_mark(const char *phase);
+
+/**
+ * Gets the time of a mark
+ * @param phase Name of the phase
+ * @return Microseconds since profile_start(), -1 if the phase was not marked
+ */
+gint64 profile_get_elapsed(const char *phase);
+
+/**
+ * Prints every mark with its time since the start and since the previous mark to stderr
+ */
+void profile_print(void);
+
+/**
+ * Writes every mark as JSON, one phase per line:
+ * {"unit": "ms", "phases": [{"phase": "main", "time": 0.000}, ...]}
+ * @param path File to write
+ * @param error Set if the file could not be written
+ * @return FALSE on error
+ */
+gboolean profile_write_json(const char *path, GError **error);
+
+#endif //PROFILE_H
@@ -0,0 +1,104 @@
+#include "session.h"
+#include <errno.h>
+#include <glib/gstdio.h>
+
+#define SESSION_GROUP "session"
+#define SESSION_TAB_GROUP_FORMAT "tab %u"
+
+/**
+ * Gets the path of the session file, creating its directory if needed
+ * @return Newly allocated path or NULL if the directory could not be created
+ */
+static char* get_session_path(void) {
+    char *dir = g_build_filename(g_get_user_state_dir(), "custom-file-manager", NULL);
+    if (g_mkdir_with_parents(dir, 0700) != 0) {
+        g_warning("Could not create state directory %s: %s", dir, g_strerror(errno));
+        g_free(dir);
+        return NULL;
+    }
+
+    char *path = g_build_filename(dir, "session.ini", NULL);
+    g_free(dir);
+    return path;
+}
+
+GPtrArray* session_load(int *active_tab, gboolean *show_hidden) {
+    GPtrArray *tabs = g_ptr_array_new_with_free_func((GDestroyNotify)view_snapshot_free);
+    *active_tab = 0;
+
+    char *path = get_session_path();
+    GKeyFile *key_file = g_key_file_new();
+    GError *error = NULL;
+    if (!path || !g_key_file_load_from_file(key_file, path, G_KEY_FILE_NONE, &error)) {
+        if (error && !g_error_matches(error, G_FILE_ERROR, G_FILE_ERROR_NOENT)) {
+            g_warning("Failed to read session %s: %s", path, error->message);
+        }
+        g_clear_error(&error);
+        g_key_file_free(key_file);
+        g_free(path);
+        return tabs;
+    }
+
+    guint tab_count = (guint)MAX(0, g_key_file_get_integer(key_file, SESSION_GROUP, "tabs", NULL));
+    *active_tab = g_key_file_get_integer(key_file, SESSION_GROUP, "active", NULL);
+    if (g_key_file_has_key(key_file, SESSION_GROUP, "show-hidden", NULL)) {
+        *show_hidden = g_key_file_get_boolean(key_file, SESSION_GROUP, "show-hidden", NULL);
+    }
+
+    for (guint i = 0; i < tab_count; i++) {
+        char *group = g_strdup_printf(SESSION_TAB_GROUP_FORMAT, i);
+        char *directory = g_key_file_get_string(key_file, group, "directory", NULL);
+        if (!directory) {
+            g_free(group);
+            continue;
+        }
+
+        view_snapshot_t *snapshot = g_new0(view_snapshot_t, 1);
+        snapshot->directory = directory;
+        snapshot->show_hidden = *show_hidden;
+        snapshot->sort_criteria = g_key_file_get_string(key_file, group, "sort", NULL);
+        snapshot->sort_ascending = g_key_file_get_boolean(key_file, group, "ascending", NULL);
+        snapshot->scroll_offset = g_key_file_get_double(key_file, group, "scroll", NULL);
+        g_ptr_array_add(tabs, snapshot);
+        g_free(group);
+    }
+
+    if (*active_tab < 0 || (guint)*active_tab >= tabs->len) {
+        *active_tab = 0;
+    }
+
+    g_key_file_free(key_file);
+    g_free(path);
+    return tabs;
+}
+
+void session_save(GPtrArray *tabs, int active_tab, gboolean show_hidden) {
+    GKeyFile *key_file = g_key_file_new();
+
+    g_key_file_set_integer(key_file, SESSION_GROUP, "tabs", (gint)tabs->len);
+    g_key_file_set_integer(key_file, SESSION_GROUP, "active", active_tab);
+    g_key_file_set_boolean(key_file, SESSION_GROUP, "show-hidden", show_hidden);
+
+    for (guint i = 0; i < tabs->len; i++) {
+        const view_snapshot_t *snapshot = g_ptr_array_index(tabs, i);
+        char *group = g_strdup_printf(SESSION_TAB_GROUP_FORMAT, i);
+
+        g_key_file_set_string(key_file, group, "directory", snapshot->directory);
+        if (snapshot->sort_criteria) {
+            g_key_file_set_string(key_file, group, "sort", snapshot->sort_criteria);
+            g_key_file_set_boolean(key_file, group, "ascending", snapshot->sort_ascending);
+        }
+        g_key_file_set_double(key_file, group, "scroll", snapshot->scroll_offset);
+        g_free(group);
+    }
+
+    char *path = get_session_path();
+    GError *error = NULL;
+    if (path && !g_key_file_save_to_file(key_file, path, &error)) {
+        g_warning("Failed to write session: %s", error->message);
+        g_error_free(error);
+    }
+
+    g_free(path);
+    g_key_file_free(key_file);
+}
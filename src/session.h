@@ -0,0 +1,33 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <glib.h>
+#include "navigation.h"
+
+/**
+ * Persistence of the open tabs between runs
+ *
+ * The session is a key file in $XDG_STATE_HOME/custom-file-manager/session.ini
+ * holding the directory, sort mode and scroll offset of every tab, which tab was
+ * active and whether hidden files were shown. Tabs are stored as model-less
+ * view snapshots, the same way hibernated tabs are kept, so restoring a session
+ * does not read any directory until a tab is shown.
+ */
+
+/**
+ * Reads the saved session
+ * @param active_tab Filled with the index of the active tab
+ * @param show_hidden Filled with the hidden files setting, left unchanged if it was not saved
+ * @return view_snapshot_t of the saved tabs (without models), empty if there is no session
+ */
+GPtrArray* session_load(int *active_tab, gboolean *show_hidden);
+
+/**
+ * Writes the session, replacing the previous one atomically
+ * @param tabs view_snapshot_t of the open tabs, in order
+ * @param active_tab Index of the active tab
+ * @param show_hidden Whether hidden files are shown
+ */
+void session_save(GPtrArray *tabs, int active_tab, gboolean show_hidden);
+
+#endif //SESSION_H
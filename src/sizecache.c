@@ -0,0 +1,302 @@
+#include "sizecache.h"
+#include <errno.h>
+#include <string.h>
+#include <glib/gstdio.h>
+
+#define SIZECACHE_MAGIC "FMDSIZE1"
+#define SIZECACHE_MAGIC_LENGTH 8
+
+typedef struct {
+    dev_t dev;
+    ino_t ino;
+} sizecache_key_t;
+
+typedef struct {
+    sizecache_key_t key;
+    gint64 mtime_sec;
+    gint64 mtime_nsec;
+    gint64 ctime_sec;
+    gint64 ctime_nsec;
+    sizecache_counts_t own;
+    sizecache_counts_t total;
+    char **children;
+    gboolean used; // Looked up or stored during this session
+} sizecache_record_t;
+
+// On-disk layout of a record, followed by the child names as length prefixed strings
+typedef struct {
+    guint64 dev;
+    guint64 ino;
+    gint64 mtime_sec;
+    gint64 mtime_nsec;
+    gint64 ctime_sec;
+    gint64 ctime_nsec;
+    sizecache_counts_t own;
+    sizecache_counts_t total;
+    guint32 child_count;
+} sizecache_disk_record_t;
+
+static GMutex cache_mutex;
+static GHashTable *cache = NULL; // sizecache_key_t -> sizecache_record_t, the key points into the record
+static gboolean cache_dirty = FALSE;
+
+static guint key_hash(gconstpointer key) {
+    const sizecache_key_t *k = key;
+    return (guint)(k->ino ^ (k->ino >> 32) ^ (k->dev * 31));
+}
+
+static gboolean key_equal(gconstpointer a, gconstpointer b) {
+    const sizecache_key_t *first = a;
+    const sizecache_key_t *second = b;
+    return first->dev == second->dev && first->ino == second->ino;
+}
+
+static void free_record(gpointer data) {
+    sizecache_record_t *record = data;
+    g_strfreev(record->children);
+    g_free(record);
+}
+
+/**
+ * Gets the path of the cache file, creating its directory if needed
+ * @return Newly allocated path or NULL if the directory could not be created
+ */
+static char* get_cache_path(void) {
+    char *dir = g_build_filename(g_get_user_cache_dir(), "custom-file-manager", NULL);
+    if (g_mkdir_with_parents(dir, 0700) != 0) {
+        g_warning("Could not create cache directory %s: %s", dir, g_strerror(errno));
+        g_free(dir);
+        return NULL;
+    }
+
+    char *path = g_build_filename(dir, "dirsizes.cache", NULL);
+    g_free(dir);
+    return path;
+}
+
+
+/**
+ * Checks an entry against the current stat of its directory
+ */
+static gboolean record_matches(const sizecache_record_t *record, const struct stat *st) {
+    return record->mtime_sec == st->st_mtim.tv_sec && record->mtime_nsec == st->st_mtim.tv_nsec &&
+           record->ctime_sec == st->st_ctim.tv_sec && record->ctime_nsec == st->st_ctim.tv_nsec;
+}
+
+/**
+ * Parses the contents of the cache file into the table
+ * @return FALSE if the file is corrupted, entries read before the error are kept
+ */
+static gboolean parse_cache(const char *data, gsize length) {
+    if (length < SIZECACHE_MAGIC_LENGTH || memcmp(data, SIZECACHE_MAGIC, SIZECACHE_MAGIC_LENGTH) != 0) {
+        return FALSE;
+    }
+
+    gsize offset = SIZECACHE_MAGIC_LENGTH;
+    while (offset < length) {
+        sizecache_disk_record_t disk;
+        if (length - offset < sizeof(disk)) return FALSE;
+        memcpy(&disk, data + offset, sizeof(disk));
+        offset += sizeof(disk);
+
+        char **children = g_new0(char*, disk.child_count + 1);
+        for (guint32 i = 0; i < disk.child_count; i++) {
+            guint16 name_length;
+            if (length - offset < sizeof(name_length)) {
+                g_strfreev(children);
+                return FALSE;
+            }
+            memcpy(&name_length, data + offset, sizeof(name_length));
+            offset += sizeof(name_length);
+
+            if (length - offset < name_length) {
+                g_strfreev(children);
+                return FALSE;
+            }
+            children[i] = g_strndup(data + offset, name_length);
+            offset += name_length;
+        }
+
+        sizecache_record_t *record = g_new0(sizecache_record_t, 1);
+        record->key.dev = (dev_t)disk.dev;
+        record->key.ino = (ino_t)disk.ino;
+        record->mtime_sec = disk.mtime_sec;
+        record->mtime_nsec = disk.mtime_nsec;
+        record->ctime_sec = disk.ctime_sec;
+        record->ctime_nsec = disk.ctime_nsec;
+        record->own = disk.own;
+        record->total = disk.total;
+        record->children = children;
+        g_hash_table_replace(cache, &record->key, record);
+    }
+
+    return TRUE;
+}
+
+/**
+ * Creates the table and reads the cache file into it on first use, must be called with the mutex held
+ * Every access goes through here, so a lookup made before sizecache_load() cannot hide the file
+ */
+static void ensure_cache(void) {
+    if (cache) {
+        return;
+    }
+    cache = g_hash_table_new_full(key_hash, key_equal, NULL, free_record);
+
+    char *path = get_cache_path();
+    char *data = NULL;
+    gsize length = 0;
+    if (path && g_file_get_contents(path, &data, &length, NULL)) {
+        if (!parse_cache(data, length)) {
+            g_warning("Directory size cache %s is corrupted, ignoring the rest of it", path);
+        }
+        g_free(data);
+    }
+    g_free(path);
+}
+
+void sizecache_load(void) {
+    g_mutex_lock(&cache_mutex);
+    ensure_cache();
+    g_mutex_unlock(&cache_mutex);
+}
+
+void sizecache_save(void) {
+    g_mutex_lock(&cache_mutex);
+    if (!cache || !cache_dirty) {
+        g_mutex_unlock(&cache_mutex);
+        return;
+    }
+
+    // Forget what was not used this session once the cache grows too large
+    gboolean prune = g_hash_table_size(cache) > SIZECACHE_MAX_ENTRIES;
+
+    GString *buffer = g_string_new_len(SIZECACHE_MAGIC, SIZECACHE_MAGIC_LENGTH);
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, cache);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        sizecache_record_t *record = value;
+        if (prune && !record->used) {
+            g_hash_table_iter_remove(&iter);
+            continue;
+        }
+
+        sizecache_disk_record_t disk = {0};
+        disk.dev = record->key.dev;
+        disk.ino = record->key.ino;
+        disk.mtime_sec = record->mtime_sec;
+        disk.mtime_nsec = record->mtime_nsec;
+        disk.ctime_sec = record->ctime_sec;
+        disk.ctime_nsec = record->ctime_nsec;
+        disk.own = record->own;
+        disk.total = record->total;
+        disk.child_count = record->children ? g_strv_length(record->children) : 0;
+        g_string_append_len(buffer, (const char*)&disk, sizeof(disk));
+
+        for (guint32 i = 0; i < disk.child_count; i++) {
+            guint16 name_length = (guint16)MIN(strlen(record->children[i]), G_MAXUINT16);
+            g_string_append_len(buffer, (const char*)&name_length, sizeof(name_length));
+            g_string_append_len(buffer, record->children[i], name_length);
+        }
+    }
+    cache_dirty = FALSE;
+    g_mutex_unlock(&cache_mutex);
+
+    char *path = get_cache_path();
+    GError *error = NULL;
+    if (path && !g_file_set_contents(path, buffer->str, buffer->len, &error)) {
+        g_warning("Failed to write directory size cache: %s", error->message);
+        g_error_free(error);
+    }
+    g_free(path);
+    g_string_free(buffer, TRUE);
+}
+
+gboolean sizecache_lookup(const struct stat *st, sizecache_entry_t *entry) {
+    sizecache_key_t key = { st->st_dev, st->st_ino };
+    gboolean found = FALSE;
+
+    g_mutex_lock(&cache_mutex);
+    ensure_cache();
+    sizecache_record_t *record = g_hash_table_lookup(cache, &key);
+    if (record && record_matches(record, st)) {
+        record->used = TRUE;
+        if (entry) {
+            entry->own = record->own;
+            entry->total = record->total;
+            entry->children = g_strdupv(record->children);
+        }
+        found = TRUE;
+    }
+    g_mutex_unlock(&cache_mutex);
+
+    return found;
+}
+
+gboolean sizecache_lookup_path(const char *path, sizecache_counts_t *total) {
+    struct stat st;
+    if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        return FALSE;
+    }
+
+    sizecache_key_t key = { st.st_dev, st.st_ino };
+    gboolean found = FALSE;
+
+    g_mutex_lock(&cache_mutex);
+    ensure_cache();
+    sizecache_record_t *record = g_hash_table_lookup(cache, &key);
+    if (record && record_matches(record, &st)) {
+        record->used = TRUE;
+        *total = record->total;
+        found = TRUE;
+    }
+    g_mutex_unlock(&cache_mutex);
+
+    return found;
+}
+
+void sizecache_store(const struct stat *st, const sizecache_counts_t *own, const sizecache_counts_t *total, char **children) {
+    sizecache_record_t *record = g_new0(sizecache_record_t, 1);
+    record->key.dev = st->st_dev;
+    record->key.ino = st->st_ino;
+    record->mtime_sec = st->st_mtim.tv_sec;
+    record->mtime_nsec = st->st_mtim.tv_nsec;
+    record->ctime_sec = st->st_ctim.tv_sec;
+    record->ctime_nsec = st->st_ctim.tv_nsec;
+    record->own = *own;
+    record->total = *total;
+    record->children = g_strdupv(children);
+    record->used = TRUE;
+
+    g_mutex_lock(&cache_mutex);
+    ensure_cache();
+    g_hash_table_replace(cache, &record->key, record);
+    cache_dirty = TRUE;
+    g_mutex_unlock(&cache_mutex);
+}
+
+void sizecache_entry_clear(sizecache_entry_t *entry) {
+    g_clear_pointer(&entry->children, g_strfreev);
+}
+
+void sizecache_get_stats(guint *records, gsize *bytes) {
+    *records = 0;
+    *bytes = 0;
+
+    g_mutex_lock(&cache_mutex);
+    if (cache) {
+        GHashTableIter iter;
+        gpointer value;
+        g_hash_table_iter_init(&iter, cache);
+        while (g_hash_table_iter_next(&iter, NULL, &value)) {
+            sizecache_record_t *record = value;
+            *bytes += sizeof(*record);
+            for (char **child = record->children; child && *child; child++) {
+                *bytes += sizeof(char*) + strlen(*child) + 1;
+            }
+        }
+        *records = g_hash_table_size(cache);
+    }
+    g_mutex_unlock(&cache_mutex);
+}
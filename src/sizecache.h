@@ -0,0 +1,94 @@
+#ifndef SIZECACHE_H
+#define SIZECACHE_H
+
+#include <glib.h>
+#include <sys/stat.h>
+
+/**
+ * Persistent cache of recursive directory sizes
+ *
+ * Entries are keyed by the (device, inode) of a directory and are only valid while
+ * the directory's mtime and ctime are unchanged, i.e. while no entry was added,
+ * removed or renamed in it. Every entry keeps the totals of the directory's own
+ * files separately from the totals of its whole subtree, plus the names of its
+ * subdirectories, so a walk can reuse an unchanged directory without reading it
+ * and only descend into the subdirectories to validate them in turn.
+ *
+ * Editing a file in place does not touch its directory's mtime, so a cached total
+ * can lag behind such changes until the directory itself changes.
+ *
+ * The cache lives in $XDG_CACHE_HOME/custom-file-manager/dirsizes.cache and is safe
+ * to use from any thread.
+ */
+
+#define SIZECACHE_MAX_ENTRIES 1000000 // Entries not used this session are dropped on save above this
+
+/**
+ * Size counters of a set of directory entries
+ */
+typedef struct {
+    guint64 apparent_size; // Sum of st_size
+    guint64 disk_size; // Sum of st_blocks * 512
+    guint64 file_count; // Everything that is not a directory
+    guint64 dir_count; // Directories
+} sizecache_counts_t;
+
+/**
+ * A cached directory, as returned by sizecache_lookup()
+ */
+typedef struct {
+    sizecache_counts_t own; // Non-directory entries directly inside the directory
+    sizecache_counts_t total; // Whole subtree, including subdirectory inodes but not the directory's own inode
+    char **children; // Names of the subdirectories
+} sizecache_entry_t;
+
+/**
+ * Reads the cache file, does nothing if it was already loaded
+ * Optional, the first lookup or store loads it otherwise
+ */
+void sizecache_load(void);
+
+/**
+ * Writes the cache file if anything changed since it was loaded
+ */
+void sizecache_save(void);
+
+/**
+ * Looks up a directory and checks that the entry still matches it
+ * @param st Current stat of the directory
+ * @param entry Filled with a copy of the entry, free with sizecache_entry_clear()
+ * @return TRUE if a valid entry was found
+ */
+gboolean sizecache_lookup(const struct stat *st, sizecache_entry_t *entry);
+
+/**
+ * Looks up the subtree totals of a directory by path
+ * @param path Path of the directory
+ * @param total Filled with the cached totals of the subtree
+ * @return TRUE if a valid entry was found
+ */
+gboolean sizecache_lookup_path(const char *path, sizecache_counts_t *total);
+
+/**
+ * Stores the result of scanning a directory and its subtree
+ * @param st Stat of the directory taken before it was read
+ * @param own Totals of the non-directory entries directly inside it
+ * @param total Totals of the whole subtree
+ * @param children NULL terminated names of its subdirectories, copied
+ */
+void sizecache_store(const struct stat *st, const sizecache_counts_t *own, const sizecache_counts_t *total, char **children);
+
+/**
+ * Frees the contents of an entry filled by sizecache_lookup()
+ * @param entry The entry
+ */
+void sizecache_entry_clear(sizecache_entry_t *entry);
+
+/**
+ * Gets what the cache holds in memory
+ * @param records Filled with the number of cached directories
+ * @param bytes Filled with the estimated size of the records and their child names
+ */
+void sizecache_get_stats(guint *records, gsize *bytes);
+
+#endif //SIZECACHE_H
@@ -0,0 +1,190 @@
+#include "stallmon.h"
+#include "trace.h"
+#include <string.h>
+
+static gboolean running = FALSE;
+static GdkFrameClock *watched_clock = NULL;
+static gint64 trace_threshold = STALLMON_TRACE_STALL_MS * G_TIME_SPAN_MILLISECOND;
+
+// Current iteration
+static gint64 dispatch_start = 0; // 0 when no dispatch is being measured
+static const char *longest_section = NULL;
+static gint64 longest_duration = 0;
+
+// Current frame
+static gint64 frame_start = 0;
+static gint64 phase_start = 0;
+
+static gint64 frame_times[STALLMON_FRAME_HISTORY]; // Ring buffer
+static guint frame_head = 0;
+static stallmon_stall_t worst_stalls[STALLMON_WORST_STALLS]; // Longest first
+static guint worst_count = 0;
+static stallmon_counts_t counts;
+
+/**
+ * Keeps the longest section or phase of the current iteration
+ */
+static void note_section(const char *name, gint64 duration) {
+    if (dispatch_start != 0 && duration > longest_duration) {
+        longest_section = name;
+        longest_duration = duration;
+    }
+}
+
+static void on_section_finished(const char *name, gint64 start, gint64 duration, gpointer user_data) {
+    note_section(name, duration);
+}
+
+/**
+ * Keeps a stall if it is among the longest
+ */
+static void add_worst_stall(const stallmon_stall_t *stall) {
+    guint position = worst_count;
+    while (position > 0 && worst_stalls[position - 1].duration < stall->duration) {
+        position--;
+    }
+    if (position == STALLMON_WORST_STALLS) {
+        return;
+    }
+
+    guint last = MIN(worst_count, STALLMON_WORST_STALLS - 1);
+    memmove(&worst_stalls[position + 1], &worst_stalls[position], (last - position) * sizeof(*worst_stalls));
+    worst_stalls[position] = *stall;
+    worst_count = MIN(worst_count + 1, STALLMON_WORST_STALLS);
+}
+
+/**
+ * Ends the measurement of the iteration that just dispatched
+ */
+static void finish_iteration(gint64 now) {
+    gint64 duration = now - dispatch_start;
+    if (duration >= STALLMON_FRAME_BUDGET_MS * G_TIME_SPAN_MILLISECOND) {
+        // A section still running means a nested main loop inside it
+        const char *section = longest_section ? longest_section : trace_get_current_section();
+        stallmon_stall_t stall = { dispatch_start, duration, section ? section : "unattributed" };
+
+        counts.stalls++;
+        if (duration >= STALLMON_SEVERE_MS * G_TIME_SPAN_MILLISECOND) {
+            counts.severe_stalls++;
+        }
+        add_worst_stall(&stall);
+
+        if (duration >= trace_threshold && trace_is_recording()) {
+            trace_record("main-loop", "stall", dispatch_start, duration, stall.section);
+        }
+    }
+
+    dispatch_start = 0;
+    longest_section = NULL;
+    longest_duration = 0;
+}
+
+static gboolean stall_source_prepare(GSource *source, gint *timeout) {
+    if (dispatch_start != 0) {
+        finish_iteration(g_get_monotonic_time());
+    }
+
+    *timeout = -1;
+    return FALSE;
+}
+
+static gboolean stall_source_check(GSource *source) {
+    dispatch_start = g_get_monotonic_time();
+    return FALSE;
+}
+
+// Main loop source measuring every iteration, see the description in stallmon.h
+static GSourceFuncs stall_source_funcs = {
+    stall_source_prepare,
+    stall_source_check,
+    NULL,
+    NULL
+};
+
+static void on_before_paint(GdkFrameClock *clock, gpointer user_data) {
+    frame_start = g_get_monotonic_time();
+    phase_start = frame_start;
+}
+
+static void on_layout(GdkFrameClock *clock, gpointer user_data) {
+    gint64 now = g_get_monotonic_time();
+    note_section("GTK layout", now - phase_start);
+    phase_start = now;
+}
+
+static void on_paint(GdkFrameClock *clock, gpointer user_data) {
+    gint64 now = g_get_monotonic_time();
+    note_section("GTK paint", now - phase_start);
+    phase_start = now;
+}
+
+static void on_after_paint(GdkFrameClock *clock, gpointer user_data) {
+    if (frame_start == 0) {
+        return;
+    }
+    frame_times[frame_head] = g_get_monotonic_time() - frame_start;
+    frame_head = (frame_head + 1) % STALLMON_FRAME_HISTORY;
+    counts.frames++;
+    frame_start = 0;
+}
+
+/**
+ * Connects to the phases of a frame clock, our handlers run after GTK's
+ */
+static void watch_frame_clock(GdkFrameClock *clock) {
+    if (!clock || watched_clock) {
+        return;
+    }
+    watched_clock = clock;
+    g_signal_connect(clock, "before-paint", G_CALLBACK(on_before_paint), NULL);
+    g_signal_connect(clock, "layout", G_CALLBACK(on_layout), NULL);
+    g_signal_connect(clock, "paint", G_CALLBACK(on_paint), NULL);
+    g_signal_connect(clock, "after-paint", G_CALLBACK(on_after_paint), NULL);
+}
+
+void stallmon_start(GdkFrameClock *clock) {
+    watch_frame_clock(clock);
+    if (running) {
+        return;
+    }
+    running = TRUE;
+
+    const char *threshold = g_getenv("FM_TRACE_STALL_MS");
+    if (threshold && *threshold != '\0') {
+        trace_threshold = (gint64)g_ascii_strtoull(threshold, NULL, 10) * G_TIME_SPAN_MILLISECOND;
+    }
+
+    trace_watch_sections(on_section_finished, NULL);
+
+    GSource *source = g_source_new(&stall_source_funcs, sizeof(GSource));
+    g_source_set_priority(source, G_PRIORITY_HIGH - 1000);
+    g_source_set_name(source, "stall monitor");
+    g_source_attach(source, NULL);
+    g_source_unref(source);
+}
+
+gboolean stallmon_is_running(void) {
+    return running;
+}
+
+guint stallmon_get_frame_times(gint64 *times, guint max_times) {
+    guint available = MIN(counts.frames, STALLMON_FRAME_HISTORY);
+    guint count = MIN(available, max_times);
+
+    // The newest count entries, oldest first
+    for (guint i = 0; i < count; i++) {
+        guint index = (frame_head + STALLMON_FRAME_HISTORY - count + i) % STALLMON_FRAME_HISTORY;
+        times[i] = frame_times[index];
+    }
+    return count;
+}
+
+guint stallmon_get_worst_stalls(stallmon_stall_t *stalls, guint max_stalls) {
+    guint count = MIN(worst_count, max_stalls);
+    memcpy(stalls, worst_stalls, count * sizeof(*stalls));
+    return count;
+}
+
+void stallmon_get_counts(stallmon_counts_t *result) {
+    *result = counts;
+}
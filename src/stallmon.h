@@ -0,0 +1,84 @@
+#ifndef STALLMON_H
+#define STALLMON_H
+
+#include <gtk/gtk.h>
+
+/**
+ * Main loop stall monitor
+ *
+ * A main loop source of the highest priority measures how long every iteration
+ * spends dispatching: it is prepared and checked first, so the time from its
+ * check to its next prepare is everything the iteration ran. Iterations longer
+ * than a frame budget are stalls. Each stall is attributed to the longest traced
+ * section (trace.h) or frame clock phase (GTK layout or paint) that ran during
+ * it, so a hitch can be blamed on a preview, a paste, a sort or GTK itself.
+ *
+ * The frame clock of the main window is watched as well, the time from its
+ * before-paint to its after-paint is kept for the last frames. Layout and paint
+ * are measured from GTK's own handlers to ours, which run after them.
+ *
+ * The monitor is started by the stall overlay (F12) or when tracing with
+ * FM_TRACE, then stalls of at least FM_TRACE_STALL_MS (STALLMON_TRACE_STALL_MS
+ * by default) are added to the trace. It runs until the application exits.
+ */
+
+#define STALLMON_FRAME_BUDGET_MS 16 // Iterations longer than a 60 Hz frame are stalls
+#define STALLMON_SEVERE_MS 33 // Iterations longer than a 30 Hz frame are severe stalls
+#define STALLMON_TRACE_STALL_MS 50 // Stalls at least this long are added to the trace
+#define STALLMON_FRAME_HISTORY 120 // Frame times kept for the overlay
+#define STALLMON_WORST_STALLS 8 // Longest stalls kept for the overlay
+
+/**
+ * A main loop iteration that ran longer than the frame budget
+ */
+typedef struct {
+    gint64 time; // Monotonic time the iteration started dispatching
+    gint64 duration; // Microseconds
+    const char *section; // Longest section or frame phase that ran, "unattributed" if none
+} stallmon_stall_t;
+
+/**
+ * Totals since the monitor started
+ */
+typedef struct {
+    guint frames;
+    guint stalls; // Iterations over STALLMON_FRAME_BUDGET_MS
+    guint severe_stalls; // Iterations over STALLMON_SEVERE_MS
+} stallmon_counts_t;
+
+/**
+ * Starts the monitor, does nothing but watch the clock if it already runs
+ * Must be called from the main thread
+ * @param clock Frame clock of the main window, may be NULL until it is realized
+ */
+void stallmon_start(GdkFrameClock *clock);
+
+/**
+ * Checks whether the monitor was started
+ * @return TRUE once stallmon_start() was called
+ */
+gboolean stallmon_is_running(void);
+
+/**
+ * Gets the durations of the last frames
+ * @param times Filled with durations in microseconds, oldest first
+ * @param max_times Length of times
+ * @return Number of durations written
+ */
+guint stallmon_get_frame_times(gint64 *times, guint max_times);
+
+/**
+ * Gets the longest stalls
+ * @param stalls Filled with the stalls, longest first
+ * @param max_stalls Length of stalls
+ * @return Number of stalls written
+ */
+guint stallmon_get_worst_stalls(stallmon_stall_t *stalls, guint max_stalls);
+
+/**
+ * Gets the totals since the monitor started
+ * @param counts Filled with the totals
+ */
+void stallmon_get_counts(stallmon_counts_t *counts);
+
+#endif //STALLMON_H
@@ -0,0 +1,416 @@
+#define _GNU_SOURCE // statx()
+#include "statbatch.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+#define STATBATCH_MASK (STATX_TYPE | STATX_MODE | STATX_SIZE | STATX_MTIME)
+
+struct statbatch {
+    gint ref_count;
+    dir_listing_t *listing;
+    int dir_fd; // The listed directory, names are resolved relative to it
+    gint cancelled;
+    gint remaining_chunks; // Thread pool tasks that did not finish yet
+    gint finished; // Every entry was fetched or the batch was cancelled
+    gint notify_pending; // A progress report is scheduled
+    gboolean reported_finished; // Main thread only
+    statbatch_progress_func func;
+    gpointer user_data;
+#ifdef HAVE_LIBURING
+    struct io_uring ring;
+#endif
+};
+
+/**
+ * A range of entries fetched by one thread pool task
+ */
+typedef struct {
+    statbatch_t *batch;
+    guint start;
+    guint end;
+} statbatch_chunk_t;
+
+static GThreadPool *statbatch_pool = NULL;
+
+/**
+ * Reports progress on the main thread, scheduled by schedule_notify()
+ */
+static gboolean notify_progress(gpointer data) {
+    statbatch_t *batch = data;
+
+    // Cleared before reading finished, so a batch finishing right now schedules another report
+    g_atomic_int_set(&batch->notify_pending, FALSE);
+    gboolean finished = g_atomic_int_get(&batch->finished);
+
+    if (g_atomic_int_get(&batch->cancelled) || batch->reported_finished) {
+        return G_SOURCE_REMOVE;
+    }
+    batch->reported_finished = finished;
+    if (batch->func) {
+        batch->func(batch->listing, finished, batch->user_data);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+/**
+ * Schedules a progress report unless one is already pending, can be called from any thread
+ */
+static void schedule_notify(statbatch_t *batch) {
+    if (g_atomic_int_get(&batch->cancelled) ||
+        !g_atomic_int_compare_and_exchange(&batch->notify_pending, FALSE, TRUE)) {
+        return;
+    }
+
+    // The end of the batch is reported right away, progress at most once per interval
+    guint interval = g_atomic_int_get(&batch->finished) ? 0 : STATBATCH_NOTIFY_INTERVAL_MS;
+    g_atomic_int_inc(&batch->ref_count);
+    g_timeout_add_full(G_PRIORITY_DEFAULT, interval, notify_progress, batch, (GDestroyNotify)statbatch_unref);
+}
+
+/**
+ * Marks the batch as done and reports it
+ */
+static void finish_batch(statbatch_t *batch) {
+    if (dir_listing_get_pending_stats(batch->listing) > 0) {
+        // Stopped early, another view of the listing can take over the rest
+        dir_listing_release_stats(batch->listing);
+    }
+    g_atomic_int_set(&batch->finished, TRUE);
+    schedule_notify(batch);
+}
+
+/**
+ * Copies a statx result into the listing
+ */
+static void store_statx(dir_listing_t *listing, guint index, const struct statx *stx) {
+    gint64 mtime = (gint64)stx->stx_mtime.tv_sec * G_GINT64_CONSTANT(1000000000) + stx->stx_mtime.tv_nsec;
+    dir_listing_set_stat(listing, index, stx->stx_size, mtime, stx->stx_mode);
+}
+
+/**
+ * Fetches the metadata of one entry synchronously
+ */
+static void fetch_entry(statbatch_t *batch, guint index) {
+    if (!dir_listing_stat_is_pending(batch->listing, index)) {
+        // Fetched by an earlier batch that was cancelled halfway
+        return;
+    }
+
+    struct statx stx;
+    // Links are followed like GIO does, so a link shows the size and date of its target
+    if (statx(batch->dir_fd, dir_listing_get_name(batch->listing, index), AT_STATX_SYNC_AS_STAT, STATBATCH_MASK, &stx) == 0) {
+        store_statx(batch->listing, index, &stx);
+    } else {
+        dir_listing_set_stat_failed(batch->listing, index);
+    }
+}
+
+/**
+ * Fetches a chunk of entries, runs on the shared thread pool
+ */
+static void statbatch_worker(gpointer data, gpointer user_data) {
+    statbatch_chunk_t *chunk = data;
+    statbatch_t *batch = chunk->batch;
+
+    for (guint i = chunk->start; i < chunk->end && !g_atomic_int_get(&batch->cancelled); i++) {
+        fetch_entry(batch, i);
+    }
+
+    if (g_atomic_int_dec_and_test(&batch->remaining_chunks)) {
+        finish_batch(batch);
+    } else {
+        schedule_notify(batch);
+    }
+
+    statbatch_unref(batch);
+    g_free(chunk);
+}
+
+/**
+ * Creates the shared thread pool on first use
+ */
+static void ensure_pool(void) {
+    static gsize initialized = 0;
+
+    if (g_once_init_enter(&initialized)) {
+        GError *error = NULL;
+        statbatch_pool = g_thread_pool_new(statbatch_worker, NULL, STATBATCH_MAX_THREADS, FALSE, &error);
+        if (error) {
+            g_warning("Failed to create metadata thread pool: %s", error->message);
+            g_error_free(error);
+        }
+        g_once_init_leave(&initialized, 1);
+    }
+}
+
+/**
+ * Splits the listing into chunks and queues them on the thread pool
+ */
+static void start_pool(statbatch_t *batch) {
+    ensure_pool();
+
+    guint count = dir_listing_get_count(batch->listing);
+    if (!statbatch_pool) {
+        // Still fill the listing, just without any concurrency
+        for (guint i = 0; i < count; i++) {
+            fetch_entry(batch, i);
+        }
+        finish_batch(batch);
+        return;
+    }
+
+    guint chunks = (count + STATBATCH_CHUNK_SIZE - 1) / STATBATCH_CHUNK_SIZE;
+    g_atomic_int_set(&batch->remaining_chunks, (gint)chunks);
+
+    for (guint start = 0; start < count; start += STATBATCH_CHUNK_SIZE) {
+        statbatch_chunk_t *chunk = g_new(statbatch_chunk_t, 1);
+        chunk->batch = batch;
+        chunk->start = start;
+        chunk->end = MIN(start + STATBATCH_CHUNK_SIZE, count);
+
+        g_atomic_int_inc(&batch->ref_count);
+        g_thread_pool_push(statbatch_pool, chunk, NULL);
+    }
+}
+
+#ifdef HAVE_LIBURING
+/**
+ * Keeps up to STATBATCH_QUEUE_DEPTH statx requests in flight until every entry is fetched
+ * @return FALSE if the ring failed, entries not fetched yet are left pending
+ */
+static gboolean run_uring(statbatch_t *batch, guint *next_entry) {
+    dir_listing_t *listing = batch->listing;
+    struct io_uring *ring = &batch->ring;
+    guint count = dir_listing_get_count(listing);
+
+    // Every request in flight owns a slot holding its statx buffer and entry index
+    struct statx *buffers = g_new(struct statx, STATBATCH_QUEUE_DEPTH);
+    guint *slot_entries = g_new(guint, STATBATCH_QUEUE_DEPTH);
+    guint *free_slots = g_new(guint, STATBATCH_QUEUE_DEPTH);
+    guint free_count = STATBATCH_QUEUE_DEPTH;
+    for (guint i = 0; i < STATBATCH_QUEUE_DEPTH; i++) {
+        free_slots[i] = i;
+        slot_entries[i] = G_MAXUINT;
+    }
+
+    guint next = 0;
+    guint in_flight = 0;
+    gboolean success = TRUE;
+
+    while (next < count || in_flight > 0) {
+        // Once cancelled only the requests already in flight are waited for
+        while (next < count && free_count > 0 && !g_atomic_int_get(&batch->cancelled)) {
+            if (!dir_listing_stat_is_pending(listing, next)) {
+                next++;
+                continue;
+            }
+
+            struct io_uring_sqe *sqe = io_uring_get_sqe(ring);
+            if (!sqe) break;
+
+            guint slot = free_slots[--free_count];
+            slot_entries[slot] = next;
+            io_uring_prep_statx(sqe, batch->dir_fd, dir_listing_get_name(listing, next),
+                                AT_STATX_SYNC_AS_STAT, STATBATCH_MASK, &buffers[slot]);
+            io_uring_sqe_set_data(sqe, GUINT_TO_POINTER(slot));
+            next++;
+            in_flight++;
+        }
+        if (in_flight == 0) {
+            break;
+        }
+
+        int ret = io_uring_submit_and_wait(ring, 1);
+        if (ret < 0 && ret != -EINTR) {
+            g_warning("io_uring submission failed: %s", g_strerror(-ret));
+            success = FALSE;
+            break;
+        }
+
+        unsigned head;
+        unsigned seen = 0;
+        struct io_uring_cqe *cqe;
+        io_uring_for_each_cqe(ring, head, cqe) {
+            guint slot = GPOINTER_TO_UINT(io_uring_cqe_get_data(cqe));
+            if (cqe->res == 0) {
+                store_statx(listing, slot_entries[slot], &buffers[slot]);
+            } else {
+                dir_listing_set_stat_failed(listing, slot_entries[slot]);
+            }
+            slot_entries[slot] = G_MAXUINT;
+            free_slots[free_count++] = slot;
+            in_flight--;
+            seen++;
+        }
+        io_uring_cq_advance(ring, seen);
+
+        if (seen > 0) {
+            schedule_notify(batch);
+        }
+    }
+
+    if (!success) {
+        // Requests still in flight may write into their buffers later, so those are never freed
+        for (guint slot = 0; slot < STATBATCH_QUEUE_DEPTH; slot++) {
+            if (slot_entries[slot] != G_MAXUINT) {
+                fetch_entry(batch, slot_entries[slot]);
+            }
+        }
+        g_free(slot_entries);
+        g_free(free_slots);
+        *next_entry = next;
+        return FALSE;
+    }
+
+    g_free(buffers);
+    g_free(slot_entries);
+    g_free(free_slots);
+    *next_entry = next;
+    return TRUE;
+}
+
+/**
+ * Thread driving the io_uring of a batch
+ */
+static gpointer uring_thread(gpointer data) {
+    statbatch_t *batch = data;
+
+    guint next = 0;
+    if (!run_uring(batch, &next)) {
+        // Finish what the ring did not get to synchronously
+        guint count = dir_listing_get_count(batch->listing);
+        for (guint i = next; i < count && !g_atomic_int_get(&batch->cancelled); i++) {
+            fetch_entry(batch, i);
+        }
+    }
+    io_uring_queue_exit(&batch->ring);
+
+    finish_batch(batch);
+    statbatch_unref(batch);
+    return NULL;
+}
+
+/**
+ * Sets up an io_uring for a batch and starts its thread
+ * @return FALSE if io_uring is not available
+ */
+static gboolean start_uring(statbatch_t *batch) {
+    int ret = io_uring_queue_init(STATBATCH_QUEUE_DEPTH, &batch->ring, 0);
+    if (ret < 0) {
+        g_debug("io_uring not available (%s), using the thread pool", g_strerror(-ret));
+        return FALSE;
+    }
+
+    g_atomic_int_inc(&batch->ref_count);
+    g_thread_unref(g_thread_new("statbatch", uring_thread, batch));
+    return TRUE;
+}
+#endif
+
+/**
+ * Fetches the pending entries of a batch that claimed its listing
+ */
+static void start_fetch(statbatch_t *batch) {
+    if (batch->dir_fd < 0) {
+        batch->dir_fd = open(batch->listing->directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    }
+    if (batch->dir_fd < 0) {
+        g_warning("Could not open %s: %s", batch->listing->directory, g_strerror(errno));
+        guint count = dir_listing_get_count(batch->listing);
+        for (guint i = 0; i < count; i++) {
+            if (dir_listing_stat_is_pending(batch->listing, i)) {
+                dir_listing_set_stat_failed(batch->listing, i);
+            }
+        }
+        finish_batch(batch);
+        return;
+    }
+
+#ifdef HAVE_LIBURING
+    if (start_uring(batch)) {
+        return;
+    }
+#endif
+    start_pool(batch);
+}
+
+/**
+ * Follows a listing whose metadata is fetched by another batch, runs on the main thread
+ * Takes over the fetch if that batch stops before it is complete
+ */
+static gboolean follow_fetch(gpointer data) {
+    statbatch_t *batch = data;
+
+    if (g_atomic_int_get(&batch->cancelled)) {
+        return G_SOURCE_REMOVE;
+    }
+    if (dir_listing_get_pending_stats(batch->listing) == 0) {
+        g_atomic_int_set(&batch->finished, TRUE);
+        batch->reported_finished = TRUE;
+        if (batch->func) {
+            batch->func(batch->listing, TRUE, batch->user_data);
+        }
+        return G_SOURCE_REMOVE;
+    }
+    if (dir_listing_claim_stats(batch->listing)) {
+        start_fetch(batch);
+        return G_SOURCE_REMOVE;
+    }
+
+    if (batch->func) {
+        batch->func(batch->listing, FALSE, batch->user_data);
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+statbatch_t* statbatch_start(dir_listing_t *listing, statbatch_progress_func func, gpointer user_data) {
+    dir_listing_alloc_stats(listing);
+
+    statbatch_t *batch = g_new0(statbatch_t, 1);
+    batch->ref_count = 1;
+    batch->listing = dir_listing_ref(listing);
+    batch->func = func;
+    batch->user_data = user_data;
+    batch->dir_fd = -1;
+
+    if (dir_listing_get_pending_stats(listing) == 0) {
+        // Everything is known already, e.g. a cached listing shown again
+        finish_batch(batch);
+        return batch;
+    }
+    if (!dir_listing_claim_stats(listing)) {
+        // Another view of the same listing is fetching it
+        g_atomic_int_inc(&batch->ref_count);
+        g_timeout_add_full(G_PRIORITY_DEFAULT, STATBATCH_NOTIFY_INTERVAL_MS, follow_fetch, batch, (GDestroyNotify)statbatch_unref);
+        return batch;
+    }
+
+    start_fetch(batch);
+    return batch;
+}
+
+void statbatch_cancel(statbatch_t *batch) {
+    g_atomic_int_set(&batch->cancelled, TRUE);
+}
+
+void statbatch_unref(statbatch_t *batch) {
+    if (!g_atomic_int_dec_and_test(&batch->ref_count)) {
+        return;
+    }
+
+    if (batch->dir_fd >= 0) {
+        close(batch->dir_fd);
+    }
+    dir_listing_unref(batch->listing);
+    g_free(batch);
+}
+
+void statbatch_cancel_and_unref(statbatch_t *batch) {
+    statbatch_cancel(batch);
+    statbatch_unref(batch);
+}
@@ -0,0 +1,72 @@
+#ifndef STATBATCH_H
+#define STATBATCH_H
+
+#include <glib.h>
+#include "direnum.h"
+
+/**
+ * Batched metadata fetching for directory listings
+ *
+ * Fills the size, modification time and mode of every entry of a dir_listing_t
+ * in the background, with statx() relative to the directory's file descriptor.
+ *
+ * When built with liburing (HAVE_LIBURING) the requests are submitted through
+ * an io_uring with up to STATBATCH_QUEUE_DEPTH of them in flight at once, from a
+ * single thread. Otherwise, or when the kernel refuses to create a ring, the
+ * entries are split into chunks that run on a shared thread pool. Both keep
+ * many requests outstanding, which is what matters on network file systems
+ * where every stat is a round trip.
+ *
+ * Results are published entry by entry (dir_listing_get_stat()) and progress is
+ * reported on the main thread, coalesced to one call per STATBATCH_NOTIFY_INTERVAL_MS.
+ *
+ * Listings can be shown by several views at once (see listcache.h). Only one batch
+ * fetches a listing at a time, the others follow its progress and take over the
+ * entries still pending if it is cancelled.
+ */
+
+#define STATBATCH_QUEUE_DEPTH 128 // statx requests in flight on the io_uring
+#define STATBATCH_CHUNK_SIZE 256 // Entries per thread pool task
+#define STATBATCH_MAX_THREADS 32 // Threads of the fallback pool, stats mostly wait on I/O
+#define STATBATCH_NOTIFY_INTERVAL_MS 50 // Minimum time between two progress reports
+
+typedef struct statbatch statbatch_t;
+
+/**
+ * Called on the main thread when more metadata of a listing is available
+ * @param listing The listing being filled
+ * @param finished TRUE for the last call, once every entry was fetched
+ * @param user_data Data passed to statbatch_start()
+ */
+typedef void (*statbatch_progress_func)(dir_listing_t *listing, gboolean finished, gpointer user_data);
+
+/**
+ * Starts fetching the metadata of every entry of a listing
+ * Must be called from the main thread
+ * @param listing The listing, a reference is held until the fetch stops
+ * @param func Called on the main thread as results come in, may be NULL
+ * @param user_data Data passed to func
+ * @return New batch, free with statbatch_unref()
+ */
+statbatch_t* statbatch_start(dir_listing_t *listing, statbatch_progress_func func, gpointer user_data);
+
+/**
+ * Stops a batch as soon as possible, func is not called anymore once this returns
+ * Must be called from the main thread
+ * @param batch The batch
+ */
+void statbatch_cancel(statbatch_t *batch);
+
+/**
+ * Releases a batch, the background work holds its own reference until it stops
+ * @param batch The batch
+ */
+void statbatch_unref(statbatch_t *batch);
+
+/**
+ * Cancels and releases a batch, usable as a GDestroyNotify
+ * @param batch The batch
+ */
+void statbatch_cancel_and_unref(statbatch_t *batch);
+
+#endif //STATBATCH_H
@@ -0,0 +1,208 @@
+#define _GNU_SOURCE
+#include "trace.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+gint trace_enabled = FALSE;
+
+/**
+ * A recorded span or thread name
+ */
+typedef struct {
+    const char *category; // NULL for a thread name record
+    const char *name;
+    gint64 start;
+    gint64 duration;
+    char *detail; // Thread name for a thread name record
+    gint tid;
+} trace_event_t;
+
+static GMutex trace_mutex;
+static GArray *events = NULL; // trace_event_t, guarded by trace_mutex
+static gint recording = FALSE; // Atomic, whether spans are written to the trace file
+static guint dropped_events = 0;
+static char *trace_path = NULL;
+static gint64 trace_origin = 0;
+static __thread gint thread_id = 0; // Kernel thread id, 0 until the thread records its first event
+
+// Section tracking, only touched from the main thread
+static pthread_t main_thread;
+static const char *current_section = NULL;
+static trace_section_func section_func = NULL;
+static gpointer section_func_data = NULL;
+
+/**
+ * Gets the id of the calling thread, recording its name with its first event
+ * Must be called with trace_mutex held
+ */
+static gint get_thread_id(void) {
+    if (thread_id != 0) {
+        return thread_id;
+    }
+
+    thread_id = (gint)syscall(SYS_gettid);
+    char name[32] = "";
+    pthread_getname_np(pthread_self(), name, sizeof(name));
+
+    trace_event_t event = { NULL, NULL, 0, 0, g_strdup(name), thread_id };
+    g_array_append_val(events, event);
+    return thread_id;
+}
+
+void trace_record(const char *category, const char *name, gint64 start, gint64 duration, const char *detail) {
+    g_mutex_lock(&trace_mutex);
+    if (!events) {
+        // Span that ended after trace_shutdown()
+    } else if (events->len >= TRACE_MAX_EVENTS) {
+        dropped_events++;
+    } else {
+        trace_event_t event = { category, name, start, duration, g_strdup(detail), get_thread_id() };
+        g_array_append_val(events, event);
+    }
+    g_mutex_unlock(&trace_mutex);
+}
+
+void trace_span_start(trace_span_t *span) {
+    span->start = g_get_monotonic_time();
+    if (pthread_equal(pthread_self(), main_thread)) {
+        span->outer = current_section;
+        current_section = span->name;
+    }
+}
+
+void trace_span_finish(trace_span_t *span, const char *detail) {
+    gint64 duration = g_get_monotonic_time() - span->start;
+    if (g_atomic_int_get(&recording)) {
+        trace_record(span->category, span->name, span->start, duration, detail);
+    }
+    if (pthread_equal(pthread_self(), main_thread)) {
+        current_section = span->outer;
+        if (section_func) {
+            section_func(span->name, span->start, duration, section_func_data);
+        }
+    }
+}
+
+void trace_init(void) {
+    const char *path = g_getenv("FM_TRACE");
+    if (!path || *path == '\0') {
+        return;
+    }
+
+    main_thread = pthread_self();
+    trace_path = g_strdup(path);
+    trace_origin = g_get_monotonic_time();
+    events = g_array_sized_new(FALSE, FALSE, sizeof(trace_event_t), 4096);
+    g_atomic_int_set(&recording, TRUE);
+    g_atomic_int_set(&trace_enabled, TRUE);
+}
+
+gboolean trace_is_recording(void) {
+    return g_atomic_int_get(&recording);
+}
+
+void trace_watch_sections(trace_section_func func, gpointer user_data) {
+    main_thread = pthread_self();
+    section_func = func;
+    section_func_data = user_data;
+    g_atomic_int_set(&trace_enabled, TRUE);
+}
+
+const char* trace_get_current_section(void) {
+    return current_section;
+}
+
+void trace_get_stats(guint *event_count, gsize *bytes) {
+    *event_count = 0;
+    *bytes = 0;
+
+    g_mutex_lock(&trace_mutex);
+    if (events) {
+        *event_count = events->len;
+        *bytes = (gsize)events->len * sizeof(trace_event_t);
+        for (guint i = 0; i < events->len; i++) {
+            const char *detail = g_array_index(events, trace_event_t, i).detail;
+            *bytes += detail ? strlen(detail) + 1 : 0;
+        }
+    }
+    g_mutex_unlock(&trace_mutex);
+}
+
+/**
+ * Appends a string as a JSON string literal
+ */
+static void append_json_string(GString *json, const char *string) {
+    char *valid = g_utf8_make_valid(string, -1);
+    g_string_append_c(json, '"');
+    for (const char *c = valid; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            g_string_append_c(json, '\\');
+            g_string_append_c(json, *c);
+        } else if ((guchar)*c < 0x20) {
+            g_string_append_printf(json, "\\u%04x", (guchar)*c);
+        } else {
+            g_string_append_c(json, *c);
+        }
+    }
+    g_string_append_c(json, '"');
+    g_free(valid);
+}
+
+void trace_shutdown(void) {
+    if (!trace_is_recording()) {
+        return;
+    }
+
+    // Spans stay measured for the section watcher
+    g_mutex_lock(&trace_mutex);
+    g_atomic_int_set(&recording, FALSE);
+    g_atomic_int_set(&trace_enabled, section_func != NULL);
+
+    // Complete events ("X"), with thread name metadata ("M") so Perfetto labels the tracks
+    int pid = getpid();
+    GString *json = g_string_new("{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    for (guint i = 0; i < events->len; i++) {
+        trace_event_t *event = &g_array_index(events, trace_event_t, i);
+        if (i > 0) {
+            g_string_append(json, ",\n");
+        }
+
+        if (!event->category) {
+            g_string_append_printf(json, "{\"ph\": \"M\", \"name\": \"thread_name\", \"pid\": %d, \"tid\": %d, \"args\": {\"name\": ",
+                                   pid, event->tid);
+            append_json_string(json, event->detail);
+            g_string_append(json, "}}");
+        } else {
+            g_string_append_printf(json, "{\"ph\": \"X\", \"cat\": \"%s\", \"name\": \"%s\", \"pid\": %d, \"tid\": %d, "
+                                   "\"ts\": %" G_GINT64_FORMAT ", \"dur\": %" G_GINT64_FORMAT,
+                                   event->category, event->name, pid, event->tid,
+                                   event->start - trace_origin, event->duration);
+            if (event->detail) {
+                g_string_append(json, ", \"args\": {\"detail\": ");
+                append_json_string(json, event->detail);
+                g_string_append_c(json, '}');
+            }
+            g_string_append_c(json, '}');
+        }
+        g_free(event->detail);
+    }
+    g_string_append(json, "\n]}\n");
+
+    if (dropped_events > 0) {
+        g_warning("Trace buffer full, %u events were dropped", dropped_events);
+    }
+
+    GError *error = NULL;
+    if (!g_file_set_contents(trace_path, json->str, (gssize)json->len, &error)) {
+        g_warning("Failed to write trace %s: %s", trace_path, error->message);
+        g_error_free(error);
+    }
+
+    g_string_free(json, TRUE);
+    g_clear_pointer(&events, g_array_unref);
+    g_clear_pointer(&trace_path, g_free);
+    g_mutex_unlock(&trace_mutex);
+}
@@ -0,0 +1,146 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <glib.h>
+
+/**
+ * Tracing of the hot paths, exported as a Chrome trace
+ *
+ * Setting FM_TRACE to a file path enables tracing for the whole run: every span
+ * is recorded with its thread, and trace_shutdown() writes them as Chrome trace
+ * JSON that can be opened in Perfetto (ui.perfetto.dev) or chrome://tracing.
+ * The stall monitor (stallmon.h) adds main loop stalls to the trace.
+ *
+ * Spans ending on the main thread are also reported to the section watcher set
+ * with trace_watch_sections(), which is how stalls are attributed to sections.
+ *
+ * Spans are plain values on the caller's stack:
+ *
+ *     trace_span_t span = trace_begin("io", "dir_listing_read");
+ *     ...
+ *     trace_end(span);
+ *
+ * When neither tracing nor a section watcher is enabled each end of a span is a
+ * single well predicted branch on trace_enabled, nothing is allocated or locked.
+ * trace_enabled is written on the main thread and read by workers, so it is only
+ * accessed with g_atomic_int_get() and g_atomic_int_set().
+ */
+
+#define TRACE_MAX_EVENTS (1 << 20) // Later events are dropped so a long run can not use unbounded memory
+
+extern gint trace_enabled; // Atomic, spans are measured, set by trace_init() or trace_watch_sections()
+
+/**
+ * A span being measured
+ */
+typedef struct {
+    const char *category; // Static string, groups spans in the viewer ("io", "ui", "fileop")
+    const char *name; // Static string
+    gint64 start; // Monotonic time in microseconds, 0 when tracing is disabled
+    const char *outer; // Section that was running on the main thread when the span started
+} trace_span_t;
+
+/**
+ * Called for every span ending on the main thread
+ * @param name Name of the span
+ * @param start Monotonic start time in microseconds
+ * @param duration Duration in microseconds
+ * @param user_data Data passed to trace_watch_sections()
+ */
+typedef void (*trace_section_func)(const char *name, gint64 start, gint64 duration, gpointer user_data);
+
+/**
+ * Enables tracing if FM_TRACE is set, must be called once from the main thread before any span
+ */
+void trace_init(void);
+
+/**
+ * Writes the trace file and stops tracing, does nothing if tracing is disabled
+ */
+void trace_shutdown(void);
+
+/**
+ * Checks whether spans are written to a trace file
+ * @return TRUE between trace_init() with FM_TRACE set and trace_shutdown()
+ */
+gboolean trace_is_recording(void);
+
+/**
+ * Measures every span from now on and reports the ones of the main thread
+ * Must be called from the main thread, replaces the previous watcher
+ * @param func Called when a span ends on the main thread
+ * @param user_data Data passed to func
+ */
+void trace_watch_sections(trace_section_func func, gpointer user_data);
+
+/**
+ * Gets the innermost span running on the main thread
+ * Only known while spans are measured
+ * @return Name of the span, NULL if none is running
+ */
+const char* trace_get_current_section(void);
+
+/**
+ * Gets what the trace buffer holds
+ * @param events Filled with the number of recorded events
+ * @param bytes Filled with the size of the buffer and the details of the events
+ */
+void trace_get_stats(guint *events, gsize *bytes);
+
+/**
+ * Starts measuring a span, called by trace_begin() when spans are measured
+ * @param span The span
+ */
+void trace_span_start(trace_span_t *span);
+
+/**
+ * Finishes a span started with trace_span_start()
+ * @param span The span
+ * @param detail Shown with the span, copied, may be NULL
+ */
+void trace_span_finish(trace_span_t *span, const char *detail);
+
+/**
+ * Records a finished span, may be called from any thread
+ * @param category Static category of the span
+ * @param name Static name of the span
+ * @param start Monotonic start time in microseconds
+ * @param duration Duration in microseconds
+ * @param detail Shown with the span (e.g. a path), copied, may be NULL
+ */
+void trace_record(const char *category, const char *name, gint64 start, gint64 duration, const char *detail);
+
+/**
+ * Starts a span
+ * @param category Static category of the span
+ * @param name Static name of the span
+ * @return The span, to be passed to trace_end()
+ */
+static inline trace_span_t trace_begin(const char *category, const char *name) {
+    trace_span_t span = { category, name, 0, NULL };
+    if (G_UNLIKELY(g_atomic_int_get(&trace_enabled))) {
+        trace_span_start(&span);
+    }
+    return span;
+}
+
+/**
+ * Ends a span with a detail string
+ * @param span The span returned by trace_begin()
+ * @param detail Shown with the span (e.g. a path), copied, may be NULL
+ */
+static inline void trace_end_detail(trace_span_t span, const char *detail) {
+    if (G_UNLIKELY(span.start != 0)) {
+        trace_span_finish(&span, detail);
+    }
+}
+
+/**
+ * Ends a span
+ * @param span The span returned by trace_begin()
+ */
+static inline void trace_end(trace_span_t span) {
+    trace_end_detail(span, NULL);
+}
+
+#endif //TRACE_H
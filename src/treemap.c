@@ -0,0 +1,516 @@
+#include "treemap.h"
+#include "dirsize.h"
+#include "listcache.h"
+#include "sizecache.h"
+#include "statbatch.h"
+#include <dirent.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#define TREEMAP_OWN_FILES G_MAXUINT // Item index of the files directly inside a nested directory
+
+struct treemap {
+    char *path;
+    dir_listing_t *listing; // NULL if the directory could not be read
+    statbatch_t *stats;
+    dirsize_walk_t **walks; // Walk of every entry that is a directory, NULL for the others, indexed like the listing
+    guint64 *estimates; // Size of every directory from the size cache when the map was created, 0 if not cached
+    GHashTable *levels; // Path of a fully scanned directory to its treemap_level_t, filled as directories get nested
+
+    gboolean dirty; // Sizes changed since the last layout
+    double width;
+    double height;
+    treemap_node_t *root;
+};
+
+/**
+ * Sizes of the entries of a fully scanned directory, from the size cache
+ */
+typedef struct {
+    char **names; // Subdirectories found in the cache
+    guint64 *sizes; // Size of every subdirectory, including its own inode
+    guint count;
+    sizecache_counts_t own; // Files directly inside the directory
+} treemap_level_t;
+
+/**
+ * An item to lay out, before it gets a node
+ */
+typedef struct {
+    guint64 size;
+    guint index; // In the listing or the treemap_level_t, or TREEMAP_OWN_FILES
+} treemap_item_t;
+
+/**
+ * Creates the node of an item
+ */
+typedef treemap_node_t* (*treemap_make_node_func)(treemap_t *map, const treemap_node_t *parent, const treemap_item_t *item, gpointer data);
+
+static void layout_children(treemap_t *map, treemap_node_t *parent, treemap_item_t *items, guint count,
+                            treemap_make_node_func make_node, gpointer data);
+
+void treemap_squarify(const guint64 *sizes, guint count, const treemap_rect_t *bounds, treemap_rect_t *rects) {
+    double total = 0;
+    for (guint i = 0; i < count; i++) {
+        total += (double)sizes[i];
+    }
+
+    treemap_rect_t free_rect = *bounds;
+    double scale = total > 0 ? bounds->width * bounds->height / total : 0;
+    guint start = 0;
+
+    while (start < count) {
+        double side = MIN(free_rect.width, free_rect.height);
+        if (side <= 0 || scale <= 0) {
+            break;
+        }
+
+        // Grow the row along the short side while it makes its worst aspect ratio better
+        double largest = (double)sizes[start] * scale;
+        double row_area = 0;
+        double worst = G_MAXDOUBLE;
+        guint end = start;
+        while (end < count) {
+            double area = (double)sizes[end] * scale;
+            double grown = row_area + area;
+            double ratio = MAX(side * side * largest / (grown * grown), grown * grown / (side * side * area));
+            if (end > start && ratio > worst) {
+                break;
+            }
+            row_area = grown;
+            worst = ratio;
+            end++;
+        }
+
+        gboolean vertical = free_rect.width >= free_rect.height;
+        double thickness = row_area / side;
+        double offset = 0;
+        for (guint i = start; i < end; i++) {
+            double length = thickness > 0 ? (double)sizes[i] * scale / thickness : 0;
+            if (vertical) {
+                rects[i] = (treemap_rect_t){ free_rect.x, free_rect.y + offset, thickness, length };
+            } else {
+                rects[i] = (treemap_rect_t){ free_rect.x + offset, free_rect.y, length, thickness };
+            }
+            offset += length;
+        }
+
+        if (vertical) {
+            free_rect.x += thickness;
+            free_rect.width = MAX(0, free_rect.width - thickness);
+        } else {
+            free_rect.y += thickness;
+            free_rect.height = MAX(0, free_rect.height - thickness);
+        }
+        start = end;
+    }
+
+    // Nothing left to split, e.g. only empty items or an empty rectangle
+    for (guint i = start; i < count; i++) {
+        rects[i] = (treemap_rect_t){ free_rect.x, free_rect.y, 0, 0 };
+    }
+}
+
+static void free_node(gpointer data) {
+    treemap_node_t *node = data;
+    if (node->children) {
+        g_ptr_array_unref(node->children);
+    }
+    g_free(node->name);
+    g_free(node->path);
+    g_free(node);
+}
+
+static void free_level(gpointer data) {
+    treemap_level_t *level = data;
+    g_strfreev(level->names);
+    g_free(level->sizes);
+    g_free(level);
+}
+
+/**
+ * Gets the current size of an entry of the shown directory
+ * @param complete Set to FALSE while the size is still being computed
+ */
+static guint64 get_entry_size(treemap_t *map, guint index, gboolean *complete) {
+    if (map->walks[index]) {
+        dirsize_totals_t totals;
+        dirsize_walk_get_totals(map->walks[index], &totals);
+        // A walk that could not start counts nothing and never finishes
+        *complete = totals.finished || totals.dir_count == 0;
+        return *complete ? totals.apparent_size : MAX(totals.apparent_size, map->estimates[index]);
+    }
+
+    guint64 size = 0;
+    *complete = !dir_listing_stat_is_pending(map->listing, index);
+    dir_listing_get_stat(map->listing, index, &size, NULL, NULL);
+    return size;
+}
+
+/**
+ * Starts the size walk of an entry of the shown directory
+ */
+static void start_walk(treemap_t *map, guint index) {
+    char *path = dir_listing_get_path(map->listing, index);
+    sizecache_counts_t cached;
+    if (sizecache_lookup_path(path, &cached)) {
+        map->estimates[index] = cached.apparent_size;
+    }
+    map->walks[index] = dirsize_walk_start(path, DIRSIZE_FLAG_USE_CACHE);
+    g_free(path);
+}
+
+treemap_t* treemap_new(const char *path, gboolean show_hidden) {
+    treemap_t *map = g_new0(treemap_t, 1);
+    map->path = g_strdup(path);
+    map->levels = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, free_level);
+    map->dirty = TRUE;
+
+    GError *error = NULL;
+    map->listing = listcache_get(path, show_hidden, &error);
+    if (!map->listing) {
+        g_warning("Could not list %s: %s", path, error->message);
+        g_error_free(error);
+        return map;
+    }
+
+    // Progress is polled by treemap_refresh(), so the batch needs no callback
+    map->stats = statbatch_start(map->listing, NULL, NULL);
+
+    guint count = dir_listing_get_count(map->listing);
+    map->walks = g_new0(dirsize_walk_t*, count);
+    map->estimates = g_new0(guint64, count);
+    sizecache_load();
+    for (guint i = 0; i < count; i++) {
+        // Entries of unknown type are walked by treemap_refresh() once their metadata is known
+        if (map->listing->types[i] == DT_DIR) {
+            start_walk(map, i);
+        }
+    }
+    return map;
+}
+
+gboolean treemap_refresh(treemap_t *map) {
+    map->dirty = TRUE;
+    if (!map->listing) {
+        return FALSE;
+    }
+
+    gboolean running = dir_listing_get_pending_stats(map->listing) > 0;
+    guint count = dir_listing_get_count(map->listing);
+    for (guint i = 0; i < count; i++) {
+        guint32 mode;
+        if (!map->walks[i] && map->listing->types[i] == DT_UNKNOWN &&
+            dir_listing_get_stat(map->listing, i, NULL, NULL, &mode) && S_ISDIR(mode)) {
+            start_walk(map, i);
+        }
+        if (map->walks[i]) {
+            gboolean complete;
+            get_entry_size(map, i, &complete);
+            running |= !complete;
+        }
+    }
+    return running;
+}
+
+static int compare_items(const void *a, const void *b) {
+    const treemap_item_t *item_a = a;
+    const treemap_item_t *item_b = b;
+    if (item_a->size != item_b->size) {
+        return item_a->size < item_b->size ? 1 : -1;
+    }
+    return item_a->index < item_b->index ? -1 : item_a->index > item_b->index;
+}
+
+/**
+ * Restores the min-heap order below a slot of a heap of items
+ */
+static void sift_down(treemap_item_t *heap, guint count, guint slot) {
+    for (;;) {
+        guint smallest = slot;
+        guint left = 2 * slot + 1;
+        guint right = left + 1;
+        if (left < count && compare_items(&heap[left], &heap[smallest]) > 0) {
+            smallest = left;
+        }
+        if (right < count && compare_items(&heap[right], &heap[smallest]) > 0) {
+            smallest = right;
+        }
+        if (smallest == slot) {
+            return;
+        }
+        treemap_item_t swap = heap[slot];
+        heap[slot] = heap[smallest];
+        heap[smallest] = swap;
+        slot = smallest;
+    }
+}
+
+/**
+ * Moves the largest items to the start of an array, in decreasing size
+ * Uses a heap of limit items, so a directory with millions of entries is not fully sorted
+ * @return Number of items kept, at most limit
+ */
+static guint keep_largest(treemap_item_t *items, guint count, guint limit) {
+    if (count > limit) {
+        for (guint i = limit / 2; i-- > 0;) {
+            sift_down(items, limit, i);
+        }
+        for (guint i = limit; i < count; i++) {
+            if (compare_items(&items[i], &items[0]) < 0) {
+                items[0] = items[i];
+                sift_down(items, limit, 0);
+            }
+        }
+        count = limit;
+    }
+    qsort(items, count, sizeof(treemap_item_t), compare_items);
+    return count;
+}
+
+static treemap_node_t* new_node(const treemap_node_t *parent, char *name, char *path, guint64 size) {
+    treemap_node_t *node = g_new0(treemap_node_t, 1);
+    node->name = name;
+    node->path = path;
+    node->size = size;
+    node->item_count = 1;
+    node->is_directory = path != NULL;
+    node->complete = TRUE;
+    node->depth = parent ? parent->depth + 1 : 0;
+    node->branch = parent ? parent->branch : 0;
+    return node;
+}
+
+/**
+ * Creates the node of an entry of the shown directory
+ */
+static treemap_node_t* make_entry_node(treemap_t *map, const treemap_node_t *parent, const treemap_item_t *item, gpointer data) {
+    const char *name = dir_listing_get_name(map->listing, item->index);
+    char *path = map->walks[item->index] ? g_build_filename(map->path, name, NULL) : NULL;
+    treemap_node_t *node = new_node(parent, g_strdup(name), path, item->size);
+    get_entry_size(map, item->index, &node->complete);
+    return node;
+}
+
+/**
+ * Creates the node of an entry of a nested directory
+ */
+static treemap_node_t* make_level_node(treemap_t *map, const treemap_node_t *parent, const treemap_item_t *item, gpointer data) {
+    treemap_level_t *level = data;
+    if (item->index == TREEMAP_OWN_FILES) {
+        treemap_node_t *node = new_node(parent, g_strdup_printf("%" G_GUINT64_FORMAT " files", level->own.file_count),
+                                        NULL, item->size);
+        node->item_count = level->own.file_count;
+        return node;
+    }
+    const char *name = level->names[item->index];
+    return new_node(parent, g_strdup(name), g_build_filename(parent->path, name, NULL), item->size);
+}
+
+/**
+ * Gets the sizes of the entries of a fully scanned directory from the size cache, once per map
+ * @return The sizes, NULL if the directory is not cached
+ */
+static treemap_level_t* get_level(treemap_t *map, const char *path) {
+    treemap_level_t *level = g_hash_table_lookup(map->levels, path);
+    if (level) {
+        return level;
+    }
+
+    struct stat st;
+    sizecache_entry_t entry;
+    if (stat(path, &st) != 0 || !sizecache_lookup(&st, &entry)) {
+        return NULL;
+    }
+
+    level = g_new0(treemap_level_t, 1);
+    level->own = entry.own;
+    guint capacity = entry.children ? g_strv_length(entry.children) : 0;
+    level->names = g_new0(char*, capacity + 1);
+    level->sizes = g_new(guint64, MAX(capacity, 1));
+    for (guint i = 0; i < capacity; i++) {
+        char *child = g_build_filename(path, entry.children[i], NULL);
+        struct stat child_st;
+        sizecache_counts_t total;
+        // The cached total leaves out the inode of the directory itself, like its parent counts it
+        if (stat(child, &child_st) == 0 && sizecache_lookup_path(child, &total)) {
+            level->names[level->count] = g_strdup(entry.children[i]);
+            level->sizes[level->count] = total.apparent_size + child_st.st_size;
+            level->count++;
+        }
+        g_free(child);
+    }
+    sizecache_entry_clear(&entry);
+
+    g_hash_table_insert(map->levels, g_strdup(path), level);
+    return level;
+}
+
+/**
+ * Subdivides a fully scanned directory if its rectangle is large enough
+ */
+static void nest_directory(treemap_t *map, treemap_node_t *node) {
+    if (!node->is_directory || !node->complete || node->depth >= TREEMAP_MAX_DEPTH ||
+        node->rect.width < TREEMAP_NEST_MIN_SIZE || node->rect.height < TREEMAP_NEST_MIN_SIZE) {
+        return;
+    }
+
+    treemap_level_t *level = get_level(map, node->path);
+    if (!level) {
+        return;
+    }
+
+    treemap_item_t *items = g_new(treemap_item_t, level->count + 1);
+    for (guint i = 0; i < level->count; i++) {
+        items[i] = (treemap_item_t){ level->sizes[i], i };
+    }
+    items[level->count] = (treemap_item_t){ level->own.apparent_size, TREEMAP_OWN_FILES };
+    layout_children(map, node, items, level->count + 1, make_level_node, level);
+    g_free(items);
+}
+
+static gint compare_nodes(gconstpointer a, gconstpointer b) {
+    const treemap_node_t *node_a = *(treemap_node_t* const*)a;
+    const treemap_node_t *node_b = *(treemap_node_t* const*)b;
+    return node_a->size < node_b->size ? 1 : node_a->size > node_b->size ? -1 : 0;
+}
+
+/**
+ * Lays out the largest items inside a node and nests into the directories that are large enough
+ * @param items Items to lay out, reordered
+ */
+static void layout_children(treemap_t *map, treemap_node_t *parent, treemap_item_t *items, guint count,
+                            treemap_make_node_func make_node, gpointer data) {
+    treemap_rect_t bounds = parent->rect;
+    if (parent->depth > 0) {
+        bounds.x += TREEMAP_PADDING;
+        bounds.y += TREEMAP_PADDING + TREEMAP_LABEL_HEIGHT;
+        bounds.width -= 2 * TREEMAP_PADDING;
+        bounds.height -= 2 * TREEMAP_PADDING + TREEMAP_LABEL_HEIGHT;
+    }
+    if (bounds.width <= 0 || bounds.height <= 0) {
+        return;
+    }
+
+    guint64 total = 0;
+    for (guint i = 0; i < count; i++) {
+        total += items[i].size;
+    }
+    guint kept = keep_largest(items, count, TREEMAP_MAX_ITEMS);
+
+    GPtrArray *children = g_ptr_array_new_full(kept + 1, free_node);
+    guint64 kept_size = 0;
+    for (guint i = 0; i < kept && items[i].size > 0; i++) {
+        g_ptr_array_add(children, make_node(map, parent, &items[i], data));
+        kept_size += items[i].size;
+    }
+    if (count > kept && total > kept_size) {
+        treemap_node_t *rest = new_node(parent, NULL, NULL, total - kept_size);
+        rest->item_count = count - kept;
+        g_ptr_array_add(children, rest);
+        g_ptr_array_sort(children, compare_nodes);
+    }
+    if (children->len == 0) {
+        g_ptr_array_unref(children);
+        return;
+    }
+
+    guint64 *sizes = g_new(guint64, children->len);
+    treemap_rect_t *rects = g_new(treemap_rect_t, children->len);
+    for (guint i = 0; i < children->len; i++) {
+        sizes[i] = ((treemap_node_t*)children->pdata[i])->size;
+    }
+    treemap_squarify(sizes, children->len, &bounds, rects);
+
+    for (guint i = 0; i < children->len; i++) {
+        treemap_node_t *child = children->pdata[i];
+        child->rect = rects[i];
+        if (parent->depth == 0) {
+            child->branch = i;
+        }
+        nest_directory(map, child);
+    }
+    parent->children = children;
+
+    g_free(rects);
+    g_free(sizes);
+}
+
+const treemap_node_t* treemap_layout(treemap_t *map, double width, double height) {
+    if (map->root && !map->dirty && map->width == width && map->height == height) {
+        return map->root;
+    }
+    if (map->root) {
+        free_node(map->root);
+    }
+
+    map->root = new_node(NULL, g_path_get_basename(map->path), g_strdup(map->path), 0);
+    map->root->rect = (treemap_rect_t){ 0, 0, width, height };
+    map->width = width;
+    map->height = height;
+    map->dirty = FALSE;
+
+    guint count = map->listing ? dir_listing_get_count(map->listing) : 0;
+    treemap_item_t *items = g_new(treemap_item_t, MAX(count, 1));
+    for (guint i = 0; i < count; i++) {
+        gboolean complete;
+        items[i].size = get_entry_size(map, i, &complete);
+        items[i].index = i;
+        map->root->size += items[i].size;
+        map->root->complete &= complete;
+    }
+    map->root->item_count = count;
+
+    layout_children(map, map->root, items, count, make_entry_node, NULL);
+    g_free(items);
+    return map->root;
+}
+
+static gboolean rect_contains(const treemap_rect_t *rect, double x, double y) {
+    return x >= rect->x && y >= rect->y && x < rect->x + rect->width && y < rect->y + rect->height;
+}
+
+const treemap_node_t* treemap_find(const treemap_node_t *root, double x, double y, guint max_depth) {
+    if (!root || !rect_contains(&root->rect, x, y)) {
+        return NULL;
+    }
+
+    const treemap_node_t *found = root;
+    while (found->children && found->depth < max_depth) {
+        const treemap_node_t *next = NULL;
+        for (guint i = 0; i < found->children->len && !next; i++) {
+            const treemap_node_t *child = found->children->pdata[i];
+            if (rect_contains(&child->rect, x, y)) {
+                next = child;
+            }
+        }
+        if (!next) {
+            // Padding or label of a directory
+            break;
+        }
+        found = next;
+    }
+    return found;
+}
+
+void treemap_free(treemap_t *map) {
+    if (map->listing) {
+        guint count = dir_listing_get_count(map->listing);
+        for (guint i = 0; i < count; i++) {
+            if (map->walks[i]) {
+                dirsize_walk_cancel(map->walks[i]);
+                dirsize_walk_unref(map->walks[i]);
+            }
+        }
+        statbatch_cancel_and_unref(map->stats);
+        dir_listing_unref(map->listing);
+    }
+    if (map->root) {
+        free_node(map->root);
+    }
+    g_hash_table_destroy(map->levels);
+    g_free(map->walks);
+    g_free(map->estimates);
+    g_free(map->path);
+    g_free(map);
+}
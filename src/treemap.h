@@ -0,0 +1,111 @@
+#ifndef TREEMAP_H
+#define TREEMAP_H
+
+#include <glib.h>
+
+/**
+ * Squarified treemap of the disk usage of a directory
+ *
+ * The entries of the directory come from the listing cache and its files are
+ * sized by a statbatch. Every subdirectory gets its own dirsize walk on the
+ * shared thread pool with DIRSIZE_FLAG_USE_CACHE, so the subtrees are scanned in
+ * parallel and unchanged ones are not read again. Until a walk finishes, its
+ * directory is drawn with the larger of the size counted so far and the size
+ * recorded in the size cache, so coarse rectangles are shown right away and
+ * treemap_refresh() refines them as the walks progress.
+ *
+ * A layout only goes as deep as the pixels allow: a directory shows at most
+ * TREEMAP_MAX_ITEMS rectangles, the smaller items sharing one, and a directory
+ * is only subdivided once its walk finished and its rectangle is at least
+ * TREEMAP_NEST_MIN_SIZE on both sides, from the size cache, without reading
+ * the disk. The number of rectangles is bounded by the size of the view, not
+ * by the number of files under the directory.
+ *
+ * Must only be used from the main thread.
+ */
+
+#define TREEMAP_MAX_ITEMS 2048 // Largest items laid out per directory, the others share one rectangle
+#define TREEMAP_NEST_MIN_SIZE 48.0 // Smallest width and height of a directory rectangle that is subdivided
+#define TREEMAP_MAX_DEPTH 8 // Levels laid out below the shown directory
+#define TREEMAP_PADDING 2.0 // Space between a subdivided directory and its children
+#define TREEMAP_LABEL_HEIGHT 14.0 // Space kept above the children of a subdivided directory for its name
+
+/**
+ * A rectangle, in pixels
+ */
+typedef struct {
+    double x;
+    double y;
+    double width;
+    double height;
+} treemap_rect_t;
+
+/**
+ * A rectangle of a layout
+ */
+typedef struct treemap_node treemap_node_t;
+struct treemap_node {
+    char *name; // NULL for the rectangle shared by the smaller items
+    char *path; // Full path of directories, NULL otherwise
+    guint64 size; // Apparent size in bytes
+    guint64 item_count; // Items drawn as this rectangle, more than 1 for shared rectangles
+    gboolean is_directory;
+    gboolean complete; // FALSE while the size is still being computed
+    guint depth; // 0 for the shown directory
+    guint branch; // Index of the top-level rectangle this one is part of, e.g. to pick its color
+    treemap_rect_t rect;
+    GPtrArray *children; // treemap_node_t laid out inside rect, NULL if the node is not subdivided
+};
+
+typedef struct treemap treemap_t;
+
+/**
+ * Splits a rectangle into rectangles proportional to sizes, keeping them as close to squares as possible
+ * @param sizes Sizes in decreasing order
+ * @param count Number of sizes
+ * @param bounds Rectangle to split
+ * @param rects Filled with the rectangle of every size, in the same order
+ */
+void treemap_squarify(const guint64 *sizes, guint count, const treemap_rect_t *bounds, treemap_rect_t *rects);
+
+/**
+ * Starts computing the disk usage of a directory in the background
+ * @param path The directory
+ * @param show_hidden Whether entries starting with a dot are part of the map
+ * @return The treemap, free with treemap_free()
+ */
+treemap_t* treemap_new(const char *path, gboolean show_hidden);
+
+/**
+ * Picks up the progress of the scan, the next layout uses the new sizes
+ * @param map The treemap
+ * @return TRUE while sizes are still being computed
+ */
+gboolean treemap_refresh(treemap_t *map);
+
+/**
+ * Lays out the treemap, reusing the last layout if neither the size nor the sizes changed
+ * @param map The treemap
+ * @param width Width of the view
+ * @param height Height of the view
+ * @return Root of the layout, for the shown directory, owned by the map and valid until the next layout
+ */
+const treemap_node_t* treemap_layout(treemap_t *map, double width, double height);
+
+/**
+ * Finds the rectangle under a point
+ * @param root Root of a layout
+ * @param x Horizontal position
+ * @param y Vertical position
+ * @param max_depth Deepest level to consider, 1 for the entries of the shown directory
+ * @return The deepest node containing the point, NULL if the point is outside of root
+ */
+const treemap_node_t* treemap_find(const treemap_node_t *root, double x, double y, guint max_depth);
+
+/**
+ * Stops the scan and frees a treemap
+ * @param map The treemap
+ */
+void treemap_free(treemap_t *map);
+
+#endif //TREEMAP_H
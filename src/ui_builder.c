@@ -1,12 +1,129 @@
 #include "ui_builder.h"
 #include "utils.h"
 #include "main.h"
+#include "dirsize.h"
+#include "sizecache.h"
+#include "direnum.h"
+#include "fm_entry.h"
+#include "fmgroup.h"
+#include "trace.h"
+#include "stallmon.h"
+#include "treemap.h"
+#include "dupfind.h"
 #include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
 
 /**
- * @brief Callback for async file info queries, used to set file icons.
+ * @brief Shows a computed directory size in a grid item.
  *
- * Sets the GIcon for a file item asynchronously once its file info is retrieved.
+ * Called by `dirsize_request()` once the walk is finished. The label may have been
+ * rebound to another file in the meantime, in which case nothing is changed.
+ *
+ * @param path The directory that was computed.
+ * @param totals Totals of the directory.
+ * @param user_data The size GtkLabel (referenced).
+ */
+static void on_dir_size_ready(const char *path, const dirsize_totals_t *totals, gpointer user_data) {
+    GtkLabel *size_label = GTK_LABEL(user_data);
+
+    if (g_strcmp0(g_object_get_data(G_OBJECT(size_label), "size-path"), path) != 0) {
+        return;
+    }
+
+    char *size_str = dirsize_format_size(totals->apparent_size);
+    gtk_label_set_text(size_label, size_str);
+    g_free(size_str);
+}
+
+/**
+ * @brief Cancels a GCancellable and drops a reference to it.
+ *
+ * @param data The GCancellable.
+ */
+static void cancel_and_unref(gpointer data) {
+    g_cancellable_cancel(G_CANCELLABLE(data));
+    g_object_unref(data);
+}
+
+/**
+ * @brief Computes the size of a directory for a size label in the background.
+ *
+ * The request lives as long as the label shows the directory: replacing or
+ * clearing the label's "size-cancellable" cancels it. A request still running
+ * for the same directory is kept.
+ *
+ * @param size_label The label, its "size-path" must be path.
+ * @param path The directory.
+ */
+static void request_label_size(GtkLabel *size_label, const char *path) {
+    GCancellable *previous = g_object_get_data(G_OBJECT(size_label), "size-cancellable");
+    if (previous && !g_cancellable_is_cancelled(previous) &&
+        g_strcmp0(g_object_get_data(G_OBJECT(size_label), "size-request"), path) == 0) {
+        return;
+    }
+
+    GCancellable *cancellable = g_cancellable_new();
+    g_object_set_data_full(G_OBJECT(size_label), "size-cancellable", cancellable, cancel_and_unref);
+    g_object_set_data_full(G_OBJECT(size_label), "size-request", g_strdup(path), g_free);
+    dirsize_request(path, cancellable, on_dir_size_ready, g_object_ref(size_label), g_object_unref);
+}
+
+/**
+ * @brief Detaches a size label from the file it showed.
+ *
+ * Results still arriving for it are dropped and its directory size request is cancelled.
+ *
+ * @param size_label The label.
+ */
+static void clear_label_size(GtkLabel *size_label) {
+    g_object_set_data(G_OBJECT(size_label), "size-path", NULL);
+    g_object_set_data(G_OBJECT(size_label), "size-request", NULL);
+    g_object_set_data(G_OBJECT(size_label), "size-cancellable", NULL);
+}
+
+/**
+ * @brief Fills the size label of a grid item.
+ *
+ * Files show their own size. Directories show their recursive size from the size
+ * cache, or are queued for a background computation when it is not known yet.
+ *
+ * @param size_label The size label of the item.
+ * @param file The file shown by the item.
+ * @param info File info holding at least the type and size.
+ */
+static void update_size_label(GtkLabel *size_label, GFile *file, GFileInfo *info) {
+    char *path = g_file_get_path(file);
+    if (!path || g_strcmp0(g_object_get_data(G_OBJECT(size_label), "size-path"), path) != 0) {
+        // The item was rebound while the info was being queried
+        g_free(path);
+        return;
+    }
+
+    if (g_file_info_get_file_type(info) != G_FILE_TYPE_DIRECTORY) {
+        char *size_str = dirsize_format_size(g_file_info_get_size(info));
+        gtk_label_set_text(size_label, size_str);
+        g_free(size_str);
+        g_free(path);
+        return;
+    }
+
+    sizecache_counts_t total;
+    if (sizecache_lookup_path(path, &total)) {
+        char *size_str = dirsize_format_size(total.apparent_size);
+        gtk_label_set_text(size_label, size_str);
+        g_free(size_str);
+    } else {
+        gtk_label_set_text(size_label, "…");
+        request_label_size(size_label, path);
+    }
+    g_free(path);
+}
+
+/**
+ * @brief Callback for async file info queries, used to set file icons and sizes.
+ *
+ * Sets the GIcon and the size label for a file item asynchronously once its file info is retrieved.
  * Called by `g_file_query_info_async()` in `bind_file_item()`.
  *
  * @param source_object The GFile that was queried.
@@ -22,6 +139,9 @@ static void on_file_info_ready(GObject *source_object, GAsyncResult *res, gpoint
     if (info != NULL) {
         GIcon *gicon = g_file_info_get_icon(info);
         gtk_image_set_from_gicon(GTK_IMAGE(icon), gicon);
+
+        GtkWidget *size_label = gtk_widget_get_last_child(gtk_widget_get_parent(icon));
+        update_size_label(GTK_LABEL(size_label), file, info);
         g_object_unref(info);
     } else if (error != NULL) {
         g_warning("Error getting file icon: %s", error->message);
@@ -68,6 +188,12 @@ void setup_file_item(GtkListItemFactory *factory, GtkListItem *list_item) {
     gtk_widget_set_halign(label, GTK_ALIGN_CENTER);
     gtk_widget_set_valign(label, GTK_ALIGN_END);
 
+    // Creating size label
+    GtkWidget *size_label = gtk_label_new("");
+    gtk_widget_add_css_class(size_label, "dim-label");
+    gtk_widget_set_halign(size_label, GTK_ALIGN_CENTER);
+    gtk_box_append(GTK_BOX(box), size_label);
+
     gtk_list_item_set_child(list_item, box);
 }
 
@@ -87,278 +213,860 @@ void bind_file_item(GtkListItemFactory *factory, GtkListItem *list_item) {
     GtkWidget *box = gtk_list_item_get_child(list_item);
     GtkWidget *icon = gtk_widget_get_first_child(box);
     GtkWidget *label = gtk_widget_get_next_sibling(icon);
+    GtkWidget *size_label = gtk_widget_get_next_sibling(label);
 
-    GFile *file = G_FILE(gtk_list_item_get_item(list_item));
-    if (!file) {
+    FmEntry *entry = gtk_list_item_get_item(list_item);
+    if (!entry) {
         g_warning("No file available for list item");
         return;
     }
+    trace_span_t span = trace_begin("ui", "bind_file_item");
+
+    // Bound items are the ones that need a GFile, it is created here on first use
+    GFile *file = fm_entry_get_file(entry);
 
     // Store list item in the box data for later retrieval in right-click handler
     g_object_set_data(G_OBJECT(box), "list-item", list_item);
 
-    // Add right-click gesture controller
+    // Add right-click gesture controller, removed again by unbind_file_item()
     GtkGesture *right_click = gtk_gesture_click_new();
     gtk_gesture_single_set_button(GTK_GESTURE_SINGLE(right_click), GDK_BUTTON_SECONDARY);  // Right mouse button
     gtk_widget_add_controller(box, GTK_EVENT_CONTROLLER(right_click));
     g_signal_connect(right_click, "released", G_CALLBACK(file_right_clicked), box);
+    g_object_set_data(G_OBJECT(box), "right-click", right_click);
 
     // Update the label
-    gtk_label_set_text(GTK_LABEL(label), g_file_get_basename(file));
+    gtk_label_set_text(GTK_LABEL(label), fm_entry_get_name(entry));
     gtk_image_set_pixel_size(GTK_IMAGE(icon), 100);
 
-    // Get file icon asynchronously
+    // Remember which file the size label belongs to, async results for older bindings are dropped
+    gtk_label_set_text(GTK_LABEL(size_label), "");
+    clear_label_size(GTK_LABEL(size_label));
+    g_object_set_data_full(G_OBJECT(size_label), "size-path", fm_entry_get_path(entry), g_free);
+
+    // Get file icon and size asynchronously
     g_file_query_info_async(file,
-                            G_FILE_ATTRIBUTE_STANDARD_ICON,
+                            G_FILE_ATTRIBUTE_STANDARD_ICON ","
+                            G_FILE_ATTRIBUTE_STANDARD_TYPE ","
+                            G_FILE_ATTRIBUTE_STANDARD_SIZE,
                             G_FILE_QUERY_INFO_NONE,
                             G_PRIORITY_DEFAULT,
                             NULL,
                             on_file_info_ready,
                             icon);
+    trace_end(span);
+}
+
+void unbind_file_item(GtkListItemFactory *factory, GtkListItem *list_item) {
+    GtkWidget *box = gtk_list_item_get_child(list_item);
+    if (!box) {
+        return;
+    }
+    trace_span_t span = trace_begin("ui", "unbind_file_item");
+
+    // A rebind adds its own gesture, so drop the one of this binding
+    GtkEventController *right_click = g_object_steal_data(G_OBJECT(box), "right-click");
+    if (right_click) {
+        gtk_widget_remove_controller(box, right_click);
+    }
+
+    // Async results still arriving for this binding are dropped, its size walk is cancelled
+    clear_label_size(GTK_LABEL(gtk_widget_get_last_child(box)));
+    trace_end(span);
 }
 
 /**
- * @brief Sets up the layout for a directory entry in the sidebar.
+ * Columns of the detailed list view
+ */
+typedef enum {
+    LIST_COLUMN_NAME,
+    LIST_COLUMN_SIZE,
+    LIST_COLUMN_DATE,
+    LIST_COLUMN_TYPE,
+    LIST_COLUMN_PERMISSIONS
+} list_column_t;
+
+/**
+ * Title, sort key and width of every list column, in list_column_t order
+ */
+static const struct {
+    const char *title;
+    const char *sort_key; // Key of fm_sort_parse(), NULL if the column can not be sorted
+    int width; // Fixed width, -1 for the expanding name column
+} list_columns[] = {
+    { "Name", "name", -1 },
+    { "Size", "size", LIST_SIZE_WIDTH },
+    { "Modified", "date", LIST_DATE_WIDTH },
+    { "Type", "type", LIST_TYPE_WIDTH },
+    { "Permissions", NULL, LIST_PERMISSIONS_WIDTH }
+};
+
+/**
+ * @brief Formats a file mode the way `ls -l` does (e.g. "drwxr-xr-x").
+ *
+ * @param mode The mode.
+ * @param buffer Filled with the text, at least 11 bytes.
+ */
+static void format_mode(guint32 mode, char *buffer) {
+    const char *bits = "rwxrwxrwx";
+    buffer[0] = S_ISDIR(mode) ? 'd' : S_ISLNK(mode) ? 'l' : '-';
+    for (int i = 0; i < 9; i++) {
+        buffer[i + 1] = mode & (1u << (8 - i)) ? bits[i] : '-';
+    }
+    buffer[10] = '\0';
+}
+
+/**
+ * @brief Fills the size cell of a list row.
  *
- * Adds a left-aligned label to display the directory name.
+ * Directories show their recursive size like the grid does, computed in the
+ * background when the size cache does not know it.
  *
- * @param factory The list item factory.
- * @param list_item The list item to set up.
+ * @return FALSE while the metadata of the entry is not known.
  */
-void setup_dir_item(GtkListItemFactory *factory, GtkListItem *list_item) {
-    // This should set up the, well, directories in the sidebar
-    GtkWidget *label = gtk_label_new(NULL);
-    gtk_list_item_set_child(list_item, label);
+static gboolean fill_size_cell(GtkLabel *label, FmEntry *entry) {
+    guint64 size;
+    guint32 mode;
+    gboolean known = fm_entry_get_stat(entry, &size, NULL, &mode);
+    if (!known || !S_ISDIR(mode)) {
+        // Drops the request of a directory the cell showed before
+        clear_label_size(label);
+    }
+    if (!known) {
+        gtk_label_set_text(label, "");
+        return FALSE;
+    }
 
-    gtk_widget_set_halign(label, GTK_ALIGN_START);
-    gtk_label_set_xalign(GTK_LABEL(label), 0.0f);
+    if (S_ISDIR(mode)) {
+        char *path = fm_entry_get_path(entry);
+        sizecache_counts_t total;
+        g_object_set_data_full(G_OBJECT(label), "size-path", g_strdup(path), g_free);
+        if (!sizecache_lookup_path(path, &total)) {
+            gtk_label_set_text(label, "…");
+            request_label_size(label, path);
+            g_free(path);
+            return TRUE;
+        }
+        size = total.apparent_size;
+        g_free(path);
+    }
+
+    char *size_str = dirsize_format_size(size);
+    gtk_label_set_text(label, size_str);
+    g_free(size_str);
+    return TRUE;
 }
 
 /**
- * @brief Binds the directory name to a sidebar list item.
+ * @brief Fills a cell of a list row from the metadata cached in the listing.
  *
- * Extracts the name from GFileInfo and sets it on the label.
+ * Nothing is read from disk here so binding stays cheap at any number of rows.
  *
- * @param factory The list item factory.
- * @param list_item The list item to bind data to.
+ * @param cell The child widget of the cell.
+ * @param entry The entry of the row.
+ * @param column The column of the cell.
+ * @return FALSE if the cell still waits for the metadata of the entry.
  */
-void bind_dir_item(GtkListItemFactory *factory, GtkListItem *list_item) {
-    GFileInfo *file_info = G_FILE_INFO(gtk_list_item_get_item(list_item));
-    const char *filename = g_file_info_get_name(file_info);
+static gboolean fill_list_cell(GtkWidget *cell, FmEntry *entry, list_column_t column) {
+    gint64 mtime;
+    guint32 mode;
+
+    switch (column) {
+        case LIST_COLUMN_NAME: {
+            GtkWidget *icon = gtk_widget_get_first_child(gtk_tree_expander_get_child(GTK_TREE_EXPANDER(cell)));
+            gtk_image_set_from_icon_name(GTK_IMAGE(icon), fm_entry_is_directory(entry) ? "folder" : "text-x-generic");
+            gtk_label_set_text(GTK_LABEL(gtk_widget_get_next_sibling(icon)), fm_entry_get_name(entry));
+            return TRUE;
+        }
+
+        case LIST_COLUMN_SIZE:
+            return fill_size_cell(GTK_LABEL(cell), entry);
+
+        case LIST_COLUMN_DATE: {
+            if (!fm_entry_get_stat(entry, NULL, &mtime, NULL)) {
+                gtk_label_set_text(GTK_LABEL(cell), "");
+                return FALSE;
+            }
+            GDateTime *time = g_date_time_new_from_unix_local(mtime / G_GINT64_CONSTANT(1000000000));
+            char *text = time ? g_date_time_format(time, "%Y-%m-%d %H:%M") : NULL;
+            gtk_label_set_text(GTK_LABEL(cell), text ? text : "");
+            g_free(text);
+            g_clear_pointer(&time, g_date_time_unref);
+            return TRUE;
+        }
 
-    GtkWidget *label = gtk_list_item_get_child(list_item);
-    gtk_label_set_text(GTK_LABEL(label), filename);
+        case LIST_COLUMN_TYPE: {
+            const char *extension = fm_entry_get_extension(entry);
+            gtk_label_set_text(GTK_LABEL(cell), fm_entry_is_directory(entry) ? "Folder" : extension[0] ? extension : "File");
+            return TRUE;
+        }
+
+        default: {
+            if (!fm_entry_get_stat(entry, NULL, NULL, &mode)) {
+                gtk_label_set_text(GTK_LABEL(cell), "");
+                return FALSE;
+            }
+            char text[11];
+            format_mode(mode, text);
+            gtk_label_set_text(GTK_LABEL(cell), text);
+            return TRUE;
+        }
+    }
 }
 
 /**
- * @brief Creates a collapsible sidebar row for a directory.
+ * @brief Fills a cell of a group row of the grouped list view.
  *
- * Includes an arrow icon and label, handles click gestures for expanding/collapsing.
+ * The name cell shows the label and the number of entries of the group, the
+ * other cells stay empty.
  *
- * @param file GFile representing the directory.
- * @return GtkWidget containing the sidebar row.
+ * @param cell The child widget of the cell.
+ * @param group The group of the row.
+ * @param column The column of the cell.
+ * @return FALSE for the name cell, its count changes while metadata moves entries between groups.
  */
-static GtkWidget* create_directory_row(GFile *file) {
-    GtkWidget *row_box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
-    GtkWidget *header = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
+static gboolean fill_group_cell(GtkWidget *cell, FmGroup *group, list_column_t column) {
+    if (column != LIST_COLUMN_NAME) {
+        clear_label_size(GTK_LABEL(cell));
+        gtk_label_set_text(GTK_LABEL(cell), "");
+        return TRUE;
+    }
 
-    // Create an arrow icon for expansion indicator
-    GtkWidget *arrow = gtk_image_new_from_icon_name("pan-end-symbolic");
-    gtk_widget_set_margin_start(arrow, 2);
-    gtk_widget_set_margin_end(arrow, 5);
+    GtkWidget *icon = gtk_widget_get_first_child(gtk_tree_expander_get_child(GTK_TREE_EXPANDER(cell)));
+    gtk_image_clear(GTK_IMAGE(icon));
+    char *text = g_strdup_printf("%s (%u)", fm_group_get_label(group),
+                                 g_list_model_get_n_items(fm_group_get_entries(group)));
+    gtk_label_set_text(GTK_LABEL(gtk_widget_get_next_sibling(icon)), text);
+    g_free(text);
+    return FALSE;
+}
 
-    // Create the label for the directory name
-    GtkWidget *label = gtk_label_new(g_file_get_basename(file));
-    gtk_label_set_xalign(GTK_LABEL(label), 0.0);
-    gtk_widget_set_hexpand(label, TRUE);
+/**
+ * @brief Fills a cell of the list view from the item of its row.
+ *
+ * @param list_item The cell.
+ * @return FALSE if the cell has to be filled again by `refresh_file_column_view()`.
+ */
+static gboolean fill_list_item(GtkListItem *list_item) {
+    GtkWidget *cell = gtk_list_item_get_child(list_item);
+    list_column_t column = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(cell), "column"));
 
-    // Add the arrow and label to the header
-    gtk_box_append(GTK_BOX(header), arrow);
-    gtk_box_append(GTK_BOX(header), label);
-    gtk_box_append(GTK_BOX(row_box), header);
+    FmEntry *entry = get_list_item_entry(list_item);
+    if (entry) {
+        return fill_list_cell(cell, entry, column);
+    }
 
-    // Store the arrow widget for later access
-    g_object_set_data(G_OBJECT(row_box), "arrow-icon", arrow);
+    GtkTreeListRow *row = gtk_list_item_get_item(list_item);
+    if (!GTK_IS_TREE_LIST_ROW(row)) {
+        return TRUE;
+    }
+    FmGroup *group = gtk_tree_list_row_get_item(row);
+    gboolean filled = FM_IS_GROUP(group) ? fill_group_cell(cell, group, column) : TRUE;
+    g_clear_object(&group);
+    return filled;
+}
 
-    // Attach gesture for click handling
-    GtkGesture *click = gtk_gesture_click_new();
-    gtk_event_controller_set_propagation_phase(GTK_EVENT_CONTROLLER(click), GTK_PHASE_CAPTURE);
-    gtk_gesture_single_set_button(GTK_GESTURE_SINGLE(click), GDK_BUTTON_PRIMARY);
-    g_signal_connect(click, "pressed", G_CALLBACK(on_directory_row_clicked), row_box);
-    gtk_widget_add_controller(header, GTK_EVENT_CONTROLLER(click));
+/**
+ * @brief Sets up a cell of the list view.
+ *
+ * The name column holds an icon and a label inside an expander, which indents
+ * and folds the rows of the grouped view, the others a label. Right-clicks
+ * open the file context menu like on grid items.
+ *
+ * @param factory The factory of the column, knows the column.
+ * @param list_item The cell to set up.
+ */
+static void setup_list_cell(GtkListItemFactory *factory, GtkListItem *list_item) {
+    list_column_t column = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(factory), "column"));
+    GtkWidget *cell;
+
+    if (column == LIST_COLUMN_NAME) {
+        GtkWidget *box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, SPACING);
+        GtkWidget *icon = gtk_image_new();
+        gtk_image_set_pixel_size(GTK_IMAGE(icon), LIST_ICON_SIZE);
+        gtk_box_append(GTK_BOX(box), icon);
+        GtkWidget *label = gtk_label_new("");
+        gtk_label_set_ellipsize(GTK_LABEL(label), PANGO_ELLIPSIZE_END);
+        gtk_label_set_xalign(GTK_LABEL(label), 0);
+        gtk_box_append(GTK_BOX(box), label);
+        cell = gtk_tree_expander_new();
+        gtk_tree_expander_set_child(GTK_TREE_EXPANDER(cell), box);
+    } else {
+        cell = gtk_label_new("");
+        gtk_label_set_xalign(GTK_LABEL(cell), column == LIST_COLUMN_SIZE ? 1 : 0);
+        gtk_label_set_ellipsize(GTK_LABEL(cell), PANGO_ELLIPSIZE_END);
+        if (column != LIST_COLUMN_TYPE) {
+            gtk_widget_add_css_class(cell, "numeric");
+        }
+    }
 
-    // Store the file as data for later expansion
-    g_object_set_data_full(G_OBJECT(row_box), "file", g_object_ref(file), g_object_unref);
+    // Once per cell widget, cells are reused for other rows
+    g_object_set_data(G_OBJECT(cell), "column", GINT_TO_POINTER(column));
+    g_object_set_data(G_OBJECT(cell), "list-item", list_item);
+    GtkGesture *right_click = gtk_gesture_click_new();
+    gtk_gesture_single_set_button(GTK_GESTURE_SINGLE(right_click), GDK_BUTTON_SECONDARY);
+    gtk_widget_add_controller(cell, GTK_EVENT_CONTROLLER(right_click));
+    g_signal_connect(right_click, "released", G_CALLBACK(file_right_clicked), cell);
 
-    return row_box;
+    gtk_list_item_set_child(list_item, cell);
 }
 
 /**
- * @brief Handles clicks on sidebar directory rows.
+ * @brief Binds a cell of the list view to its entry or group.
  *
- * Expands/collapses child directories. Populates child rows and loads file view for clicked dir.
+ * Cells whose entry has no metadata yet are remembered in the pending set of the
+ * view and filled by `refresh_file_column_view()`.
  *
- * @param gesture The gesture controller that triggered the event.
- * @param n_press Number of clicks.
- * @param x X coordinate.
- * @param y Y coordinate.
- * @param user_data Pointer to the row GtkWidget.
+ * @param factory The factory of the column.
+ * @param list_item The cell to bind.
  */
-static void on_directory_row_clicked(GtkGestureClick *gesture, int n_press, double x, double y, gpointer user_data) {
-    GtkWidget *row_box = GTK_WIDGET(user_data);
-    GtkWidget *arrow = g_object_get_data(G_OBJECT(row_box), "arrow-icon");
+static void bind_list_cell(GtkListItemFactory *factory, GtkListItem *list_item) {
+    gpointer item = gtk_list_item_get_item(list_item);
+    if (!item) {
+        return;
+    }
+    trace_span_t span = trace_begin("ui", "bind_list_cell");
 
-    GtkWidget *existing_list = g_object_get_data(G_OBJECT(row_box), "child-list");
-    if (existing_list) {
-        // Collapse the directory
-        gtk_widget_unparent(existing_list);
-        g_object_set_data(G_OBJECT(row_box), "child-list", NULL);
+    GtkWidget *cell = gtk_list_item_get_child(list_item);
+    if (GTK_IS_TREE_EXPANDER(cell)) {
+        gtk_tree_expander_set_list_row(GTK_TREE_EXPANDER(cell), GTK_IS_TREE_LIST_ROW(item) ? item : NULL);
+    }
+    if (!fill_list_item(list_item)) {
+        g_hash_table_add(g_object_get_data(G_OBJECT(factory), "pending-cells"), list_item);
+    }
+    trace_end(span);
+}
 
-        // Change arrow to point right (collapsed)
-        gtk_image_set_from_icon_name(GTK_IMAGE(arrow), "pan-end-symbolic");
-        return;
+/**
+ * @brief Forgets a cell that is unbound or destroyed.
+ *
+ * The directory size walk of a size cell is cancelled.
+ *
+ * @param factory The factory of the column.
+ * @param list_item The cell.
+ */
+static void unbind_list_cell(GtkListItemFactory *factory, GtkListItem *list_item) {
+    trace_span_t span = trace_begin("ui", "unbind_list_cell");
+    g_hash_table_remove(g_object_get_data(G_OBJECT(factory), "pending-cells"), list_item);
+
+    GtkWidget *cell = gtk_list_item_get_child(list_item);
+    if (cell && GPOINTER_TO_INT(g_object_get_data(G_OBJECT(factory), "column")) == LIST_COLUMN_SIZE) {
+        clear_label_size(GTK_LABEL(cell));
     }
+    trace_end(span);
+}
 
-    // Change arrow to point down (expanded)
-    gtk_image_set_from_icon_name(GTK_IMAGE(arrow), "pan-down-symbolic");
+GtkColumnView* create_file_column_view(GtkSelectionModel *model) {
+    GtkColumnView *view = GTK_COLUMN_VIEW(gtk_column_view_new(model));
+    gtk_column_view_set_show_column_separators(view, FALSE);
+    gtk_widget_add_css_class(GTK_WIDGET(view), "data-table");
+
+    // Cells waiting for metadata (set of GtkListItem), shared by the factories
+    GHashTable *pending = g_hash_table_new(NULL, NULL);
+    g_object_set_data_full(G_OBJECT(view), "pending-cells", pending, (GDestroyNotify)g_hash_table_unref);
+
+    for (guint i = 0; i < G_N_ELEMENTS(list_columns); i++) {
+        GtkListItemFactory *factory = gtk_signal_list_item_factory_new();
+        g_object_set_data(G_OBJECT(factory), "column", GINT_TO_POINTER(i));
+        g_object_set_data_full(G_OBJECT(factory), "pending-cells", g_hash_table_ref(pending), (GDestroyNotify)g_hash_table_unref);
+        g_signal_connect(factory, "setup", G_CALLBACK(setup_list_cell), NULL);
+        g_signal_connect(factory, "bind", G_CALLBACK(bind_list_cell), NULL);
+        g_signal_connect(factory, "unbind", G_CALLBACK(unbind_list_cell), NULL);
+        g_signal_connect(factory, "teardown", G_CALLBACK(unbind_list_cell), NULL);
+
+        GtkColumnViewColumn *column = gtk_column_view_column_new(list_columns[i].title, factory);
+        gtk_column_view_column_set_resizable(column, TRUE);
+        if (list_columns[i].width < 0) {
+            gtk_column_view_column_set_expand(column, TRUE);
+        } else {
+            gtk_column_view_column_set_fixed_width(column, list_columns[i].width);
+        }
 
-    GFile *dir = g_object_get_data(G_OBJECT(row_box), "file");
-    if (!dir) return;
+        if (list_columns[i].sort_key) {
+            // Only makes the header clickable, the order is computed by fmsort on the shared model
+            GtkSorter *sorter = GTK_SORTER(gtk_custom_sorter_new(NULL, NULL, NULL));
+            gtk_column_view_column_set_sorter(column, sorter);
+            g_object_unref(sorter);
+            g_object_set_data(G_OBJECT(column), "sort-key", (gpointer)list_columns[i].sort_key);
+        }
 
-    GError *error = NULL;
-    GFileEnumerator *enumerator = g_file_enumerate_children(dir, "standard::name,standard::type", G_FILE_QUERY_INFO_NONE, NULL, &error);
-    if (!enumerator) {
-        g_warning("Failed to enumerate directory: %s", error->message);
-        g_error_free(error);
-        return;
+        gtk_column_view_append_column(view, column);
+        g_object_unref(column);
     }
+    return view;
+}
 
-    GtkWidget *child_list = gtk_list_box_new();
-    gtk_widget_set_margin_start(child_list, 10);
+void refresh_file_column_view(GtkColumnView *view) {
+    GHashTable *pending = g_object_get_data(G_OBJECT(view), "pending-cells");
+    GHashTableIter iter;
+    gpointer key;
 
-    GFileInfo *info;
-    while ((info = g_file_enumerator_next_file(enumerator, NULL, NULL)) != NULL) {
-        if (g_file_info_get_file_type(info) == G_FILE_TYPE_DIRECTORY) {
-            GFile *child_file = g_file_get_child(dir, g_file_info_get_name(info));
-            GtkWidget *child_row = create_directory_row(child_file);
-            gtk_list_box_append(GTK_LIST_BOX(child_list), child_row);
-            g_object_unref(child_file);
-            g_object_unref(info);
+    g_hash_table_iter_init(&iter, pending);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        if (fill_list_item(key)) {
+            g_hash_table_iter_remove(&iter);
         }
     }
+}
 
-    GFile *clicked_dir = g_object_get_data(G_OBJECT(user_data), "file");
-    char *path = g_file_get_path(clicked_dir);
-    TabContext* ctx = get_current_tab_context();
-    populate_files_in_container(path, ctx->scrolled_window, ctx);
-    g_free(path);
+const char* get_column_view_sort(GtkColumnView *view, gboolean *ascending) {
+    GtkColumnViewSorter *sorter = GTK_COLUMN_VIEW_SORTER(gtk_column_view_get_sorter(view));
+    GtkColumnViewColumn *column = gtk_column_view_sorter_get_primary_sort_column(sorter);
+    if (!column) {
+        return NULL;
+    }
+    *ascending = gtk_column_view_sorter_get_primary_sort_order(sorter) == GTK_SORT_ASCENDING;
+    return g_object_get_data(G_OBJECT(column), "sort-key");
+}
+
+void set_column_view_sort(GtkColumnView *view, const char *sort_key, gboolean ascending) {
+    GListModel *columns = gtk_column_view_get_columns(view);
+    GtkColumnViewColumn *sorted = NULL;
+
+    for (guint i = 0; i < g_list_model_get_n_items(columns) && !sorted; i++) {
+        GtkColumnViewColumn *column = g_list_model_get_item(columns, i);
+        if (sort_key && g_strcmp0(g_object_get_data(G_OBJECT(column), "sort-key"), sort_key) == 0) {
+            sorted = column;
+        } else {
+            g_object_unref(column);
+        }
+    }
+
+    // A NULL column clears the sort indicators
+    gtk_column_view_sort_by_column(view, sorted, ascending ? GTK_SORT_ASCENDING : GTK_SORT_DESCENDING);
+    g_clear_object(&sorted);
+}
 
-    g_object_unref(enumerator);
+// Children of every directory expanded in the sidebar (path -> GListStore of GFile, not referenced)
+// A store and its monitor go away when its row collapses, the tree list model holds the only reference
+static GHashTable *sidebar_children = NULL;
 
-    gtk_box_append(GTK_BOX(row_box), child_list);
-    g_object_set_data(G_OBJECT(row_box), "child-list", child_list);
+/**
+ * @brief Orders sidebar entries by name, case-insensitively.
+ *
+ * @param a First GFile.
+ * @param b Second GFile.
+ * @param user_data Not used.
+ * @return Comparison result as per qsort convention.
+ */
+static gint compare_sidebar_files(gconstpointer a, gconstpointer b, gpointer user_data) {
+    char *name_a = g_file_get_basename(G_FILE((gpointer)a));
+    char *name_b = g_file_get_basename(G_FILE((gpointer)b));
+    gint result = g_ascii_strcasecmp(name_a, name_b);
+    g_free(name_a);
+    g_free(name_b);
+    return result;
 }
 
 /**
- * @brief Builds the left side panel (sidebar) with undo/redo and directory list.
+ * @brief Lists the subdirectories of a sidebar directory, runs on a worker thread.
  *
- * Creates a vertical layout including buttons and a list of root-level directories.
+ * Uses the getdents64 enumerator, which skips everything that is not a directory
+ * without allocating or stat'ing it.
  *
- * @return Struct containing the sidebar GtkBox and buttons.
+ * @param task The GTask.
+ * @param source_object The directory GFile.
+ * @param task_data Not used.
+ * @param cancellable Not used.
  */
-left_box_t create_left_box() {
-
-    left_box_t left_box;
-
-    left_box.side_panel = gtk_box_new(GTK_ORIENTATION_VERTICAL, SPACING);
+static void list_sidebar_directory_thread(GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable) {
+    GFile *dir = G_FILE(source_object);
+    GError *error = NULL;
 
-    GtkWidget *hbox = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, SPACING);
+    char *path = g_file_get_path(dir);
+    direnum_names_t *names = path ? direnum_list_directories(path, &error) : NULL;
+    g_free(path);
+    if (!names) {
+        if (error) {
+            g_task_return_error(task, error);
+        } else {
+            g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED, "Not a local directory");
+        }
+        return;
+    }
 
-    left_box.undo_button = GTK_BUTTON(gtk_button_new_from_icon_name("edit-undo-symbolic"));
-    gtk_widget_set_tooltip_text(GTK_WIDGET(left_box.undo_button), "Undo last operation");
+    direnum_names_sort(names);
 
-    left_box.redo_button = GTK_BUTTON(gtk_button_new_from_icon_name("edit-redo-symbolic"));
-    gtk_widget_set_tooltip_text(GTK_WIDGET(left_box.redo_button), "Redo last undone operation");
+    GPtrArray *children = g_ptr_array_new_full(names->count, g_object_unref);
+    for (guint i = 0; i < names->count; i++) {
+        g_ptr_array_add(children, g_file_get_child(dir, direnum_names_get(names, i)));
+    }
+    direnum_names_free(names);
 
-    gtk_box_append(GTK_BOX(hbox), GTK_WIDGET(left_box.undo_button));
-    gtk_box_append(GTK_BOX(hbox), GTK_WIDGET(left_box.redo_button));
-    gtk_box_append(GTK_BOX(left_box.side_panel), hbox);
+    g_task_return_pointer(task, children, (GDestroyNotify)g_ptr_array_unref);
+}
 
-    gtk_widget_set_margin_start(left_box.side_panel, SPACING);
-    gtk_widget_set_margin_end(left_box.side_panel, SPACING);
-    gtk_widget_set_margin_top(left_box.side_panel, SPACING);
-    gtk_widget_set_margin_bottom(left_box.side_panel, SPACING);
+/**
+ * @brief Brings a sidebar store in line with a new listing of its directory.
+ *
+ * The first listing is swapped in with a single splice, so the view only updates
+ * once. Later ones only add and remove what changed: rows already listed keep
+ * their GFile, so their expanded children stay open.
+ *
+ * @param store The sidebar store.
+ * @param children GFile of every subdirectory, sorted.
+ */
+static void merge_sidebar_children(GListStore *store, GPtrArray *children) {
+    guint n_items = g_list_model_get_n_items(G_LIST_MODEL(store));
+    if (n_items == 0) {
+        g_list_store_splice(store, 0, 0, children->pdata, children->len);
+        return;
+    }
 
-    GtkWidget *sw = gtk_scrolled_window_new();
-    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(sw), GTK_POLICY_NEVER, GTK_POLICY_AUTOMATIC);
-    gtk_box_append(GTK_BOX(left_box.side_panel), sw);
+    GHashTable *added = g_hash_table_new(g_file_hash, (GEqualFunc)g_file_equal);
+    for (guint i = 0; i < children->len; i++) {
+        g_hash_table_add(added, g_ptr_array_index(children, i));
+    }
 
-    GtkWidget *list = gtk_list_box_new();
-    gtk_scrolled_window_set_child(GTK_SCROLLED_WINDOW(sw), list);
-    gtk_widget_set_vexpand(list, TRUE);
-    gtk_widget_set_hexpand(list, TRUE);
+    // Backwards, so removing a row does not move the ones still to visit
+    for (guint i = n_items; i-- > 0;) {
+        GFile *file = g_list_model_get_item(G_LIST_MODEL(store), i);
+        if (!g_hash_table_remove(added, file)) {
+            g_list_store_remove(store, i);
+        }
+        g_object_unref(file);
+    }
 
-    // Disable the default blue highlighting of list items using CSS
-    gtk_widget_add_css_class(list, "sidebar-list");
+    GHashTableIter iter;
+    gpointer file;
+    g_hash_table_iter_init(&iter, added);
+    while (g_hash_table_iter_next(&iter, &file, NULL)) {
+        g_list_store_insert_sorted(store, file, compare_sidebar_files, NULL);
+    }
+    g_hash_table_unref(added);
+}
 
-    GtkCssProvider *provider = gtk_css_provider_new();
-    gtk_css_provider_load_from_string(provider,
-        ".sidebar-list { background-color: transparent; }"
-        ".sidebar-list row:selected { background-color: transparent; }"
-        ".sidebar-list row:hover { background-color: rgba(128, 128, 128, 0.1); }");
+static void on_sidebar_directory_listed(GObject *source_object, GAsyncResult *res, gpointer user_data);
 
-    GdkDisplay *display = gtk_widget_get_display(list);
-    gtk_style_context_add_provider_for_display(display, GTK_STYLE_PROVIDER(provider), GTK_STYLE_PROVIDER_PRIORITY_APPLICATION);
-    g_object_unref(provider);
+/**
+ * @brief Lists the subdirectories of a sidebar directory into its store in the background.
+ *
+ * The d_type of the entries decides what is a directory, nothing is queried per
+ * file. A listing asked for while one is running is started once it finished, so
+ * a burst of changes costs at most two listings.
+ *
+ * @param store The sidebar store, with its directory as "directory" data.
+ */
+static void list_sidebar_directory(GListStore *store) {
+    if (g_object_get_data(G_OBJECT(store), "listing")) {
+        g_object_set_data(G_OBJECT(store), "list-again", GINT_TO_POINTER(TRUE));
+        return;
+    }
+    g_object_set_data(G_OBJECT(store), "listing", GINT_TO_POINTER(TRUE));
 
-    GFile *root = g_file_new_for_path("/");
+    GTask *task = g_task_new(g_object_get_data(G_OBJECT(store), "directory"), NULL,
+                             on_sidebar_directory_listed, g_object_ref(store));
+    g_task_run_in_thread(task, list_sidebar_directory_thread);
+    g_object_unref(task);
+}
 
+/**
+ * @brief Applies a finished listing to a sidebar store.
+ *
+ * @param source_object The directory GFile.
+ * @param res The GTask.
+ * @param user_data The sidebar store of the directory (referenced).
+ */
+static void on_sidebar_directory_listed(GObject *source_object, GAsyncResult *res, gpointer user_data) {
+    GListStore *store = G_LIST_STORE(user_data);
     GError *error = NULL;
-    GFileEnumerator *enumerator = g_file_enumerate_children(root, "standard::name,standard::type", G_FILE_QUERY_INFO_NONE, NULL, &error);
-    if (!enumerator) {
-        g_warning("Failed to enumerate root: %s", error->message);
+
+    GPtrArray *children = g_task_propagate_pointer(G_TASK(res), &error);
+    if (children) {
+        merge_sidebar_children(store, children);
+        g_ptr_array_unref(children);
+    } else {
+        g_warning("Failed to enumerate directory: %s", error->message);
         g_error_free(error);
     }
 
-    GFileInfo *info;
-    while ((info = g_file_enumerator_next_file(enumerator, NULL, NULL)) != NULL) {
-        if (g_file_info_get_file_type(info) == G_FILE_TYPE_DIRECTORY) {
-            GFile *child = g_file_get_child(root, g_file_info_get_name(info));
-            GtkWidget *row = create_directory_row(child);
-            gtk_list_box_append(GTK_LIST_BOX(list), row);
-            g_object_unref(child);
-            g_object_unref(info);
-        }
+    g_object_set_data(G_OBJECT(store), "listing", NULL);
+    if (g_object_steal_data(G_OBJECT(store), "list-again")) {
+        list_sidebar_directory(store);
     }
+    g_object_unref(store);
+}
 
-    g_object_unref(enumerator);
-    g_object_unref(root);
+/**
+ * @brief Removes a directory from a sidebar store, if it is listed.
+ *
+ * @param store The sidebar store of the parent directory.
+ * @param file The removed child.
+ */
+static void sidebar_store_remove(GListStore *store, GFile *file) {
+    guint position;
+    if (g_list_store_find_with_equal_func(store, file, (GEqualFunc)g_file_equal, &position)) {
+        g_list_store_remove(store, position);
+    }
+}
 
-    return left_box;
+/**
+ * @brief Keeps a cached sidebar store in sync with its directory.
+ *
+ * @param monitor The directory monitor.
+ * @param file The file that changed.
+ * @param other_file The new name for renames, NULL otherwise.
+ * @param event_type What happened.
+ * @param user_data The sidebar store of the directory.
+ */
+static void on_sidebar_directory_changed(GFileMonitor *monitor, GFile *file, GFile *other_file, GFileMonitorEvent event_type, gpointer user_data) {
+    GListStore *store = G_LIST_STORE(user_data);
+
+    // New names are picked up by listing the directory again, which knows their type from d_type
+    switch (event_type) {
+        case G_FILE_MONITOR_EVENT_CREATED:
+        case G_FILE_MONITOR_EVENT_MOVED_IN:
+            list_sidebar_directory(store);
+            break;
+        case G_FILE_MONITOR_EVENT_DELETED:
+        case G_FILE_MONITOR_EVENT_MOVED_OUT:
+            sidebar_store_remove(store, file);
+            break;
+        case G_FILE_MONITOR_EVENT_RENAMED:
+            sidebar_store_remove(store, file);
+            list_sidebar_directory(store);
+            break;
+        default:
+            break;
+    }
 }
 
+/**
+ * @brief Forgets the children of a sidebar directory once their store is finalized.
+ *
+ * @param data The key of the store in `sidebar_children`.
+ * @param store The finalized store.
+ */
+static void on_sidebar_children_finalized(gpointer data, GObject *store) {
+    g_hash_table_remove(sidebar_children, data);
+}
 
 /**
- * @brief Constructs the top toolbar with navigation and search controls.
+ * @brief Gets the store holding the subdirectories of a directory shown in the sidebar.
  *
- * Includes "Up" button, directory entry, and search bar.
+ * The first call creates the store, starts listing the directory asynchronously and
+ * watches it for changes. The store is only cached while it is alive: once its row
+ * collapses, the tree list model drops it and the store, its monitor and its cache
+ * entry go away together.
  *
- * @param default_directory Initial directory shown in the entry.
- * @return Struct with all toolbar widgets.
+ * @param dir The directory.
+ * @return A new reference to the store.
  */
-toolbar_t create_toolbar(const char* default_directory) {
-    toolbar_t toolbar;
+static GListStore* get_sidebar_children(GFile *dir) {
+    if (!sidebar_children) {
+        sidebar_children = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    }
 
-    // Create the toolbar container
-    toolbar.toolbar = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, SPACING);
+    char *path = g_file_get_path(dir);
+    GListStore *store = g_hash_table_lookup(sidebar_children, path);
+    if (store) {
+        g_free(path);
+        return g_object_ref(store);
+    }
 
-    // Create the "Up" button
-    toolbar.up_button = gtk_button_new_from_icon_name("go-up-symbolic");
-    gtk_widget_set_tooltip_text(toolbar.up_button, "Go to Parent Directory");
+    store = g_list_store_new(G_TYPE_FILE);
+    g_hash_table_insert(sidebar_children, path, store);
+    g_object_weak_ref(G_OBJECT(store), on_sidebar_children_finalized, path);
+    g_object_set_data_full(G_OBJECT(store), "directory", g_object_ref(dir), g_object_unref);
 
-    // Create the directory entry
-    toolbar.directory_entry = gtk_entry_new();
-    gtk_widget_set_hexpand(toolbar.directory_entry, TRUE);
+    // The monitor belongs to the store, so it lives exactly as long as the cached children
+    GFileMonitor *monitor = g_file_monitor_directory(dir, G_FILE_MONITOR_WATCH_MOVES, NULL, NULL);
+    if (monitor) {
+        g_signal_connect(monitor, "changed", G_CALLBACK(on_sidebar_directory_changed), store);
+        g_object_set_data_full(G_OBJECT(store), "monitor", monitor, g_object_unref);
+    }
+
+    list_sidebar_directory(store);
+    return store;
+}
+
+/**
+ * @brief Provides the children of a sidebar row when it is expanded.
+ *
+ * Called by the GtkTreeListModel.
+ *
+ * @param item The GFile of the row.
+ * @param user_data Not used.
+ * @return The children model of the directory.
+ */
+static GListModel* create_sidebar_children_model(gpointer item, gpointer user_data) {
+    return G_LIST_MODEL(get_sidebar_children(G_FILE(item)));
+}
+
+/**
+ * @brief Sets up the layout for a directory entry in the sidebar.
+ *
+ * Adds an expander holding a left-aligned label to display the directory name.
+ *
+ * @param factory The list item factory.
+ * @param list_item The list item to set up.
+ */
+void setup_dir_item(GtkListItemFactory *factory, GtkListItem *list_item) {
+    // This should set up the, well, directories in the sidebar
+    GtkWidget *label = gtk_label_new(NULL);
+    gtk_widget_set_halign(label, GTK_ALIGN_START);
+    gtk_label_set_xalign(GTK_LABEL(label), 0.0f);
+    gtk_label_set_ellipsize(GTK_LABEL(label), PANGO_ELLIPSIZE_END);
+
+    GtkWidget *expander = gtk_tree_expander_new();
+    gtk_tree_expander_set_child(GTK_TREE_EXPANDER(expander), label);
+    gtk_list_item_set_child(list_item, expander);
+}
+
+/**
+ * @brief Binds the directory name to a sidebar list item.
+ *
+ * Connects the expander to the tree row and shows the directory's name.
+ *
+ * @param factory The list item factory.
+ * @param list_item The list item to bind data to.
+ */
+void bind_dir_item(GtkListItemFactory *factory, GtkListItem *list_item) {
+    GtkTreeListRow *row = GTK_TREE_LIST_ROW(gtk_list_item_get_item(list_item));
+    GtkWidget *expander = gtk_list_item_get_child(list_item);
+    gtk_tree_expander_set_list_row(GTK_TREE_EXPANDER(expander), row);
+
+    GFile *dir = G_FILE(gtk_tree_list_row_get_item(row));
+    char *name = g_file_get_basename(dir);
+
+    GtkWidget *label = gtk_tree_expander_get_child(GTK_TREE_EXPANDER(expander));
+    gtk_label_set_text(GTK_LABEL(label), name);
+
+    g_free(name);
+    g_object_unref(dir);
+}
+
+/**
+ * @brief Handles clicks on sidebar directory rows.
+ *
+ * Expands/collapses the row and loads the file view for the clicked directory.
+ *
+ * @param view The sidebar list view.
+ * @param position Position of the clicked row.
+ * @param user_data The GtkTreeListModel of the sidebar.
+ */
+static void on_sidebar_row_activated(GtkListView *view, guint position, gpointer user_data) {
+    GtkTreeListRow *row = gtk_tree_list_model_get_row(GTK_TREE_LIST_MODEL(user_data), position);
+    if (!row) return;
+
+    gtk_tree_list_row_set_expanded(row, !gtk_tree_list_row_get_expanded(row));
+
+    GFile *dir = G_FILE(gtk_tree_list_row_get_item(row));
+    char *path = g_file_get_path(dir);
+    TabContext* ctx = get_current_tab_context();
+    if (ctx && path) {
+        navigate_to_directory(ctx, path);
+    }
+
+    g_free(path);
+    g_object_unref(dir);
+    g_object_unref(row);
+}
+
+/**
+ * @brief Builds the left side panel (sidebar) with undo/redo and directory tree.
+ *
+ * Creates a vertical layout including buttons and a virtualized tree of directories,
+ * starting at the root. Every level is listed asynchronously when it is first shown.
+ *
+ * @return Struct containing the sidebar GtkBox and buttons.
+ */
+left_box_t create_left_box() {
+
+    left_box_t left_box;
+
+    left_box.side_panel = gtk_box_new(GTK_ORIENTATION_VERTICAL, SPACING);
+
+    GtkWidget *hbox = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, SPACING);
+
+    left_box.undo_button = GTK_BUTTON(gtk_button_new_from_icon_name("edit-undo-symbolic"));
+    gtk_widget_set_tooltip_text(GTK_WIDGET(left_box.undo_button), "Undo last operation");
+
+    left_box.redo_button = GTK_BUTTON(gtk_button_new_from_icon_name("edit-redo-symbolic"));
+    gtk_widget_set_tooltip_text(GTK_WIDGET(left_box.redo_button), "Redo last undone operation");
+
+    gtk_box_append(GTK_BOX(hbox), GTK_WIDGET(left_box.undo_button));
+    gtk_box_append(GTK_BOX(hbox), GTK_WIDGET(left_box.redo_button));
+    gtk_box_append(GTK_BOX(left_box.side_panel), hbox);
+
+    gtk_widget_set_margin_start(left_box.side_panel, SPACING);
+    gtk_widget_set_margin_end(left_box.side_panel, SPACING);
+    gtk_widget_set_margin_top(left_box.side_panel, SPACING);
+    gtk_widget_set_margin_bottom(left_box.side_panel, SPACING);
+
+    GtkWidget *sw = gtk_scrolled_window_new();
+    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(sw), GTK_POLICY_NEVER, GTK_POLICY_AUTOMATIC);
+    gtk_box_append(GTK_BOX(left_box.side_panel), sw);
+
+    // The root level is listed asynchronously like every other level
+    GFile *root = g_file_new_for_path("/");
+    GListStore *root_store = get_sidebar_children(root);
+    g_object_unref(root);
+
+    GtkTreeListModel *tree = gtk_tree_list_model_new(G_LIST_MODEL(root_store), FALSE, FALSE, create_sidebar_children_model, NULL, NULL);
+
+    GtkSingleSelection *selection = gtk_single_selection_new(G_LIST_MODEL(tree));
+    gtk_single_selection_set_autoselect(selection, FALSE);
+    gtk_single_selection_set_can_unselect(selection, TRUE);
+
+    GtkListItemFactory *factory = gtk_signal_list_item_factory_new();
+    g_signal_connect(factory, "setup", G_CALLBACK(setup_dir_item), NULL);
+    g_signal_connect(factory, "bind", G_CALLBACK(bind_dir_item), NULL);
+
+    GtkWidget *list = gtk_list_view_new(GTK_SELECTION_MODEL(selection), factory);
+    gtk_list_view_set_single_click_activate(GTK_LIST_VIEW(list), TRUE);
+    g_signal_connect(list, "activate", G_CALLBACK(on_sidebar_row_activated), tree);
+    gtk_scrolled_window_set_child(GTK_SCROLLED_WINDOW(sw), list);
+    gtk_widget_set_vexpand(list, TRUE);
+    gtk_widget_set_hexpand(list, TRUE);
+
+    // Disable the default blue highlighting of list items using CSS
+    gtk_widget_add_css_class(list, "sidebar-list");
+
+    GtkCssProvider *provider = gtk_css_provider_new();
+    gtk_css_provider_load_from_string(provider,
+        ".sidebar-list { background-color: transparent; }"
+        ".sidebar-list row:selected { background-color: transparent; }"
+        ".sidebar-list row:hover { background-color: rgba(128, 128, 128, 0.1); }");
+
+    GdkDisplay *display = gtk_widget_get_display(list);
+    gtk_style_context_add_provider_for_display(display, GTK_STYLE_PROVIDER(provider), GTK_STYLE_PROVIDER_PRIORITY_APPLICATION);
+    g_object_unref(provider);
+
+    return left_box;
+}
+
+
+/**
+ * @brief Constructs the top toolbar with navigation and search controls.
+ *
+ * Includes "Back", "Forward" and "Up" buttons, directory entry, and search bar.
+ *
+ * @param default_directory Initial directory shown in the entry.
+ * @return Struct with all toolbar widgets.
+ */
+toolbar_t create_toolbar(const char* default_directory) {
+    toolbar_t toolbar;
+
+    // Create the toolbar container
+    toolbar.toolbar = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, SPACING);
+
+    // Create the history buttons, enabled through their actions
+    toolbar.back_button = gtk_button_new_from_icon_name("go-previous-symbolic");
+    gtk_widget_set_tooltip_text(toolbar.back_button, "Back");
+    gtk_actionable_set_action_name(GTK_ACTIONABLE(toolbar.back_button), "win.go_back");
+
+    toolbar.forward_button = gtk_button_new_from_icon_name("go-next-symbolic");
+    gtk_widget_set_tooltip_text(toolbar.forward_button, "Forward");
+    gtk_actionable_set_action_name(GTK_ACTIONABLE(toolbar.forward_button), "win.go_forward");
+
+    // Create the "Up" button
+    toolbar.up_button = gtk_button_new_from_icon_name("go-up-symbolic");
+    gtk_widget_set_tooltip_text(toolbar.up_button, "Go to Parent Directory");
+
+    // Create the directory entry
+    toolbar.directory_entry = gtk_entry_new();
+    gtk_widget_set_hexpand(toolbar.directory_entry, TRUE);
 
     if (default_directory) {
         gtk_editable_set_text(GTK_EDITABLE(toolbar.directory_entry), default_directory);
@@ -388,6 +1096,8 @@ toolbar_t create_toolbar(const char* default_directory) {
     toolbar.search_entry = gtk_search_entry_new();
 
     // Add widgets to toolbar
+    gtk_box_append(GTK_BOX(toolbar.toolbar), toolbar.back_button);
+    gtk_box_append(GTK_BOX(toolbar.toolbar), toolbar.forward_button);
     gtk_box_append(GTK_BOX(toolbar.toolbar), toolbar.up_button);
     gtk_box_append(GTK_BOX(toolbar.toolbar), toolbar.directory_entry);
     gtk_box_append(GTK_BOX(toolbar.toolbar), toolbar.search_entry);
@@ -509,6 +1219,7 @@ GtkPopoverMenu* create_file_context_menu(const char* params, GtkWidget *window)
         g_menu_append_item(sort_menu, item);
         g_object_unref(item);
     }
+    g_menu_append(sort_menu, "Folders First", "win.toggle_folders_first");
 
     GMenuModel *menu_model = G_MENU_MODEL(menu);
 
@@ -586,12 +1297,46 @@ GtkPopoverMenu* create_directory_context_menu(const char* params, GtkWidget *win
         g_menu_append_item(sort_menu, item);
         g_object_unref(item);
     }
+    g_menu_append(sort_menu, "Folders First", "win.toggle_folders_first");
 
     GMenuItem *sort_submenu = g_menu_item_new_submenu("Sort by", G_MENU_MODEL(sort_menu));
     g_menu_append_item(menu, sort_submenu);
     g_object_unref(sort_submenu);
     g_object_unref(sort_menu);
 
+    // View mode items, shown as radio items of the view_mode action
+    GMenu *view_menu = g_menu_new();
+    g_menu_append(view_menu, "Icons", "win.view_mode::grid");
+    g_menu_append(view_menu, "List", "win.view_mode::list");
+    g_menu_append(view_menu, "All Files in Subfolders", "win.toggle_flatten");
+    GMenuItem *view_submenu = g_menu_item_new_submenu("View as", G_MENU_MODEL(view_menu));
+    g_menu_append_item(menu, view_submenu);
+    g_object_unref(view_submenu);
+    g_object_unref(view_menu);
+
+    // Grouping items, radio items of the group_by action
+    GMenu *group_menu = g_menu_new();
+    g_menu_append(group_menu, "None", "win.group_by::none");
+    g_menu_append(group_menu, "Type", "win.group_by::type");
+    g_menu_append(group_menu, "Extension", "win.group_by::extension");
+    g_menu_append(group_menu, "Date Modified", "win.group_by::date");
+    GMenuItem *group_submenu = g_menu_item_new_submenu("Group by", G_MENU_MODEL(group_menu));
+    g_menu_append_item(menu, group_submenu);
+    g_object_unref(group_submenu);
+    g_object_unref(group_menu);
+
+    // Duplicates item
+    GMenuItem *duplicates_item = g_menu_item_new("Find Duplicates", "win.find_duplicates");
+    g_menu_item_set_action_and_target_value(duplicates_item, "win.find_duplicates", g_variant_new_string(params));
+    g_menu_append_item(menu, duplicates_item);
+    g_object_unref(duplicates_item);
+
+    // Disk usage item
+    GMenuItem *disk_usage_item = g_menu_item_new("Disk Usage", "win.disk_usage");
+    g_menu_item_set_action_and_target_value(disk_usage_item, "win.disk_usage", g_variant_new_string(params));
+    g_menu_append_item(menu, disk_usage_item);
+    g_object_unref(disk_usage_item);
+
     // Properties item
     GMenuItem *properties_item = g_menu_item_new("Properties", "win.dir_properties");
     g_menu_item_set_action_and_target_value(properties_item, "win.dir_properties", g_variant_new_string(params));
@@ -623,8 +1368,9 @@ GtkPopoverMenu* create_directory_context_menu(const char* params, GtkWidget *win
  * @param label_text Label text (left side).
  * @param value_text Value text (right side).
  * @param row Row number to insert at.
+ * @return The value label, so it can be updated later.
  */
-static void add_property_row(GtkWidget *grid_widget, const char *label_text, const char *value_text, int row) {
+static GtkWidget* add_property_row(GtkWidget *grid_widget, const char *label_text, const char *value_text, int row) {
     GtkWidget *label = gtk_label_new(label_text);
     gtk_widget_set_halign(label, GTK_ALIGN_END); // Align labels to the right
     gtk_grid_attach(GTK_GRID(grid_widget), label, 0, row, 1, 1);
@@ -634,6 +1380,85 @@ static void add_property_row(GtkWidget *grid_widget, const char *label_text, con
     gtk_label_set_selectable(GTK_LABEL(value_label), TRUE); // Allow selecting text
     gtk_label_set_wrap(GTK_LABEL(value_label), TRUE); // Wrap long text
     gtk_grid_attach(GTK_GRID(grid_widget), value_label, 1, row, 1, 1);
+
+    return value_label;
+}
+
+/**
+ * State of the live directory size rows of a properties window
+ */
+typedef struct {
+    dirsize_walk_t *walk;
+    GtkLabel *size_label;
+    GtkLabel *disk_size_label;
+    GtkLabel *contents_label;
+    guint timeout_id;
+} properties_size_t;
+
+/**
+ * @brief Copies the current totals of the directory walk into the properties window.
+ *
+ * Called periodically while the walk runs.
+ *
+ * @param user_data The properties_size_t of the window.
+ * @return G_SOURCE_CONTINUE until the walk is finished.
+ */
+static gboolean update_properties_size(gpointer user_data) {
+    properties_size_t *state = user_data;
+
+    dirsize_totals_t totals;
+    dirsize_walk_get_totals(state->walk, &totals);
+
+    const char *suffix = totals.finished ? "" : "…";
+
+    char *size_str = dirsize_format_size(totals.apparent_size);
+    char *size_text = g_strdup_printf("%s%s", size_str, suffix);
+    gtk_label_set_text(state->size_label, size_text);
+
+    char *disk_size_str = dirsize_format_size(totals.disk_size);
+    char *disk_size_text = g_strdup_printf("%s%s", disk_size_str, suffix);
+    gtk_label_set_text(state->disk_size_label, disk_size_text);
+
+    // The root directory itself is not part of its contents
+    char *contents_text = g_strdup_printf("%llu files, %llu folders%s",
+        (unsigned long long)totals.file_count,
+        (unsigned long long)(totals.dir_count > 0 ? totals.dir_count - 1 : 0),
+        suffix);
+    if (totals.error_count > 0) {
+        char *with_errors = g_strdup_printf("%s (%llu unreadable)", contents_text, (unsigned long long)totals.error_count);
+        g_free(contents_text);
+        contents_text = with_errors;
+    }
+    gtk_label_set_text(state->contents_label, contents_text);
+
+    g_free(size_str);
+    g_free(size_text);
+    g_free(disk_size_str);
+    g_free(disk_size_text);
+    g_free(contents_text);
+
+    if (totals.finished) {
+        state->timeout_id = 0;
+        return G_SOURCE_REMOVE;
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+/**
+ * @brief Stops the directory walk when its properties window is closed.
+ *
+ * @param widget The properties window.
+ * @param user_data The properties_size_t of the window.
+ */
+static void on_properties_destroy(GtkWidget *widget, gpointer user_data) {
+    properties_size_t *state = user_data;
+
+    if (state->timeout_id != 0) {
+        g_source_remove(state->timeout_id);
+    }
+    dirsize_walk_cancel(state->walk);
+    dirsize_walk_unref(state->walk);
+    g_free(state);
 }
 
 /**
@@ -696,17 +1521,7 @@ GtkWindow* create_properties_window(const char* file_path) {
     }
 
     goffset file_size = g_file_info_get_size(info);
-    size_str = g_strdup_printf("%lld bytes", (long long)file_size);
-    if (file_size >= (1LL << 30)) {
-        g_free(size_str);
-        size_str = g_strdup_printf("%.2f GB", (double)file_size / (1LL << 30));
-    } else if (file_size >= (1LL << 20)) {
-        g_free(size_str);
-        size_str = g_strdup_printf("%.2f MB", (double)file_size / (1LL << 20));
-    } else if (file_size >= (1LL << 10)) {
-        g_free(size_str);
-        size_str = g_strdup_printf("%.2f KB", (double)file_size / (1LL << 10));
-    }
+    size_str = dirsize_format_size(file_size);
 
     guint64 created_unix = g_file_info_get_attribute_uint64(info, G_FILE_ATTRIBUTE_TIME_CREATED);
     if (created_unix != 0) {
@@ -749,10 +1564,24 @@ GtkWindow* create_properties_window(const char* file_path) {
     // Use the helper function to add properties to the grid
     add_property_row(grid, "Path:", file_path, 0);
     add_property_row(grid, "Kind:", kind_str, 1);
-    add_property_row(grid, "Size:", size_str, 2);
+    GtkWidget *size_label = add_property_row(grid, "Size:", size_str, 2);
     add_property_row(grid, "Created:", created_str, 3);
     add_property_row(grid, "Modified:", modified_str, 4);
 
+    // The size of a directory inode says nothing about its contents, so walk the subtree instead
+    if (file_type == G_FILE_TYPE_DIRECTORY) {
+        properties_size_t *state = g_new0(properties_size_t, 1);
+        state->walk = dirsize_walk_start(file_path, DIRSIZE_FLAG_NONE);
+        state->size_label = GTK_LABEL(size_label);
+        state->disk_size_label = GTK_LABEL(add_property_row(grid, "Size on disk:", "…", 5));
+        state->contents_label = GTK_LABEL(add_property_row(grid, "Contents:", "…", 6));
+
+        if (update_properties_size(state)) {
+            state->timeout_id = g_timeout_add(PROPERTIES_UPDATE_INTERVAL_MS, update_properties_size, state);
+        }
+        g_signal_connect(dialog, "destroy", G_CALLBACK(on_properties_destroy), state);
+    }
+
     g_free(kind_str);
     g_free(size_str);
     g_free(created_str);
@@ -761,4 +1590,859 @@ GtkWindow* create_properties_window(const char* file_path) {
     g_object_unref(file);
 
     return GTK_WINDOW(dialog);
-}
\ No newline at end of file
+}
+/**
+ * @brief Draws the last frame times as bars.
+ *
+ * Bars are green within the frame budget, orange up to the severe threshold and
+ * red above it. Both thresholds are drawn as lines, the scale tops out at twice
+ * the severe threshold.
+ *
+ * @param area The drawing area.
+ * @param cr Cairo context.
+ * @param width Width of the area.
+ * @param height Height of the area.
+ * @param user_data Not used.
+ */
+static void on_frame_graph_draw(GtkDrawingArea *area, cairo_t *cr, int width, int height, gpointer user_data) {
+    gint64 times[STALLMON_FRAME_HISTORY];
+    guint count = stallmon_get_frame_times(times, STALLMON_FRAME_HISTORY);
+    double scale = height / (2.0 * STALLMON_SEVERE_MS * G_TIME_SPAN_MILLISECOND);
+    double bar_width = (double)width / STALLMON_FRAME_HISTORY;
+
+    for (guint i = 0; i < count; i++) {
+        if (times[i] < STALLMON_FRAME_BUDGET_MS * G_TIME_SPAN_MILLISECOND) {
+            cairo_set_source_rgb(cr, 0.3, 0.8, 0.3);
+        } else if (times[i] < STALLMON_SEVERE_MS * G_TIME_SPAN_MILLISECOND) {
+            cairo_set_source_rgb(cr, 0.9, 0.6, 0.1);
+        } else {
+            cairo_set_source_rgb(cr, 0.9, 0.2, 0.2);
+        }
+        double bar_height = MIN(height, times[i] * scale);
+        double x = (STALLMON_FRAME_HISTORY - count + i) * bar_width;
+        cairo_rectangle(cr, x, height - bar_height, MAX(1.0, bar_width - 1), bar_height);
+        cairo_fill(cr);
+    }
+
+    cairo_set_source_rgba(cr, 1, 1, 1, 0.5);
+    cairo_set_line_width(cr, 1);
+    const int thresholds[] = { STALLMON_FRAME_BUDGET_MS, STALLMON_SEVERE_MS };
+    for (guint i = 0; i < G_N_ELEMENTS(thresholds); i++) {
+        double y = height - thresholds[i] * G_TIME_SPAN_MILLISECOND * scale;
+        cairo_move_to(cr, 0, y);
+        cairo_line_to(cr, width, y);
+    }
+    cairo_stroke(cr);
+}
+
+/**
+ * @brief Refreshes the frame graph and the stall list of the overlay.
+ *
+ * @param user_data The overlay box.
+ * @return G_SOURCE_CONTINUE
+ */
+static gboolean refresh_stall_overlay(gpointer user_data) {
+    GtkWidget *box = user_data;
+    GtkWidget *graph = gtk_widget_get_first_child(box);
+    GtkWidget *label = gtk_widget_get_next_sibling(graph);
+
+    stallmon_counts_t counts;
+    stallmon_get_counts(&counts);
+    gint64 last_frame = 0;
+    stallmon_get_frame_times(&last_frame, 1);
+
+    GString *text = g_string_new(NULL);
+    g_string_append_printf(text, "%u frames, last %.1f ms\n", counts.frames, last_frame / 1000.0);
+    g_string_append_printf(text, "%u stalls > %d ms, %u > %d ms",
+                           counts.stalls, STALLMON_FRAME_BUDGET_MS, counts.severe_stalls, STALLMON_SEVERE_MS);
+
+    stallmon_stall_t stalls[STALLMON_WORST_STALLS];
+    guint count = stallmon_get_worst_stalls(stalls, STALLMON_WORST_STALLS);
+    gint64 now = g_get_monotonic_time();
+    for (guint i = 0; i < count; i++) {
+        g_string_append_printf(text, "\n%7.1f ms  %-20s %5.0f s ago",
+                               stalls[i].duration / 1000.0, stalls[i].section,
+                               (now - stalls[i].time) / (double)G_TIME_SPAN_SECOND);
+    }
+
+    gtk_label_set_text(GTK_LABEL(label), text->str);
+    g_string_free(text, TRUE);
+    gtk_widget_queue_draw(graph);
+    return G_SOURCE_CONTINUE;
+}
+
+/**
+ * @brief Starts refreshing the overlay when it is shown.
+ *
+ * @param box The overlay box.
+ * @param user_data Not used.
+ */
+static void on_stall_overlay_map(GtkWidget *box, gpointer user_data) {
+    refresh_stall_overlay(box);
+    guint source_id = g_timeout_add(STALL_OVERLAY_REFRESH_MS, refresh_stall_overlay, box);
+    g_object_set_data(G_OBJECT(box), "refresh-source", GUINT_TO_POINTER(source_id));
+}
+
+/**
+ * @brief Stops refreshing the overlay when it is hidden.
+ *
+ * @param box The overlay box.
+ * @param user_data Not used.
+ */
+static void on_stall_overlay_unmap(GtkWidget *box, gpointer user_data) {
+    guint source_id = GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(box), "refresh-source"));
+    if (source_id != 0) {
+        g_source_remove(source_id);
+        g_object_set_data(G_OBJECT(box), "refresh-source", NULL);
+    }
+}
+
+GtkWidget* create_stall_overlay(void) {
+    GtkWidget *box = gtk_box_new(GTK_ORIENTATION_VERTICAL, SPACING);
+    gtk_widget_add_css_class(box, "osd");
+    gtk_widget_set_halign(box, GTK_ALIGN_END);
+    gtk_widget_set_valign(box, GTK_ALIGN_END);
+    gtk_widget_set_margin_end(box, SPACING * 2);
+    gtk_widget_set_margin_bottom(box, SPACING * 2);
+    gtk_widget_set_can_target(box, FALSE);
+    gtk_widget_set_visible(box, FALSE);
+
+    GtkWidget *graph = gtk_drawing_area_new();
+    gtk_drawing_area_set_content_width(GTK_DRAWING_AREA(graph), 2 * STALLMON_FRAME_HISTORY);
+    gtk_drawing_area_set_content_height(GTK_DRAWING_AREA(graph), 60);
+    gtk_drawing_area_set_draw_func(GTK_DRAWING_AREA(graph), on_frame_graph_draw, NULL, NULL);
+    gtk_box_append(GTK_BOX(box), graph);
+
+    GtkWidget *label = gtk_label_new(NULL);
+    gtk_label_set_xalign(GTK_LABEL(label), 0);
+    gtk_widget_add_css_class(label, "monospace");
+    gtk_box_append(GTK_BOX(box), label);
+
+    g_signal_connect(box, "map", G_CALLBACK(on_stall_overlay_map), NULL);
+    g_signal_connect(box, "unmap", G_CALLBACK(on_stall_overlay_unmap), NULL);
+    return box;
+}
+
+/**
+ * @brief Rebuilds the report shown by the memory window.
+ *
+ * @param user_data The window.
+ * @return G_SOURCE_CONTINUE
+ */
+static gboolean refresh_memory_window(gpointer user_data) {
+    GtkWidget *window = user_data;
+    report_func report = g_object_get_data(G_OBJECT(window), "report-func");
+    GtkWidget *label = g_object_get_data(G_OBJECT(window), "report-label");
+
+    char *text = report();
+    gtk_label_set_text(GTK_LABEL(label), text);
+    g_free(text);
+    return G_SOURCE_CONTINUE;
+}
+
+/**
+ * @brief Starts refreshing the memory window when it is shown.
+ *
+ * @param window The memory window.
+ * @param user_data Not used.
+ */
+static void on_memory_window_map(GtkWidget *window, gpointer user_data) {
+    refresh_memory_window(window);
+    guint source_id = g_timeout_add(MEMORY_WINDOW_REFRESH_MS, refresh_memory_window, window);
+    g_object_set_data(G_OBJECT(window), "refresh-source", GUINT_TO_POINTER(source_id));
+}
+
+/**
+ * @brief Stops refreshing the memory window when it is hidden.
+ *
+ * @param window The memory window.
+ * @param user_data Not used.
+ */
+static void on_memory_window_unmap(GtkWidget *window, gpointer user_data) {
+    guint source_id = GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(window), "refresh-source"));
+    if (source_id != 0) {
+        g_source_remove(source_id);
+        g_object_set_data(G_OBJECT(window), "refresh-source", NULL);
+    }
+}
+
+GtkWindow* create_memory_window(GtkWindow *parent, report_func report) {
+    GtkWidget *window = gtk_window_new();
+    gtk_window_set_title(GTK_WINDOW(window), "Memory");
+    gtk_window_set_transient_for(GTK_WINDOW(window), parent);
+    gtk_window_set_default_size(GTK_WINDOW(window), 640, 480);
+    gtk_window_set_hide_on_close(GTK_WINDOW(window), TRUE);
+
+    GtkWidget *label = gtk_label_new(NULL);
+    gtk_label_set_xalign(GTK_LABEL(label), 0);
+    gtk_label_set_yalign(GTK_LABEL(label), 0);
+    gtk_label_set_selectable(GTK_LABEL(label), TRUE);
+    gtk_widget_add_css_class(label, "monospace");
+    gtk_widget_set_margin_start(label, SPACING);
+    gtk_widget_set_margin_end(label, SPACING);
+    gtk_widget_set_margin_top(label, SPACING);
+    gtk_widget_set_margin_bottom(label, SPACING);
+
+    GtkWidget *scroll = gtk_scrolled_window_new();
+    gtk_scrolled_window_set_child(GTK_SCROLLED_WINDOW(scroll), label);
+    gtk_window_set_child(GTK_WINDOW(window), scroll);
+
+    g_object_set_data(G_OBJECT(window), "report-func", report);
+    g_object_set_data(G_OBJECT(window), "report-label", label);
+    g_signal_connect(window, "map", G_CALLBACK(on_memory_window_map), NULL);
+    g_signal_connect(window, "unmap", G_CALLBACK(on_memory_window_unmap), NULL);
+    return GTK_WINDOW(window);
+}
+
+/**
+ * State of a disk usage window
+ */
+typedef struct {
+    treemap_t *map;
+    char *path;
+    gboolean show_hidden;
+    GtkWidget *area;
+    GtkLabel *path_label;
+    GtkLabel *total_label;
+    GtkWidget *up_button;
+    guint timeout_id;
+} treemap_window_t;
+
+/**
+ * @brief Gets the layout matching the current size of the treemap area.
+ *
+ * @param state The treemap_window_t of the window.
+ * @return Root of the layout, owned by the treemap.
+ */
+static const treemap_node_t* get_treemap_layout(treemap_window_t *state) {
+    return treemap_layout(state->map, gtk_widget_get_width(state->area), gtk_widget_get_height(state->area));
+}
+
+/**
+ * @brief Picks up the progress of the size scan and redraws the treemap.
+ *
+ * @param user_data The treemap_window_t of the window.
+ * @return G_SOURCE_CONTINUE until every size is known.
+ */
+static gboolean refresh_treemap_window(gpointer user_data) {
+    treemap_window_t *state = user_data;
+
+    gboolean running = treemap_refresh(state->map);
+    const treemap_node_t *root = get_treemap_layout(state);
+
+    char *size_str = dirsize_format_size(root->size);
+    char *total_text = g_strdup_printf("%s in %llu items%s", size_str, (unsigned long long)root->item_count,
+                                       running ? "…" : "");
+    gtk_label_set_text(state->total_label, total_text);
+    g_free(size_str);
+    g_free(total_text);
+
+    gtk_widget_queue_draw(state->area);
+    if (!running) {
+        state->timeout_id = 0;
+        return G_SOURCE_REMOVE;
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+/**
+ * @brief Shows another directory in a disk usage window and starts its size scan.
+ *
+ * @param state The treemap_window_t of the window.
+ * @param path The directory to show.
+ */
+static void set_treemap_path(treemap_window_t *state, const char *path) {
+    char *new_path = g_strdup(path);
+    g_free(state->path);
+    state->path = new_path;
+    if (state->map) {
+        treemap_free(state->map);
+    }
+    state->map = treemap_new(path, state->show_hidden);
+
+    gtk_label_set_text(state->path_label, path);
+    char *parent = g_path_get_dirname(path);
+    gtk_widget_set_sensitive(state->up_button, g_strcmp0(parent, path) != 0);
+    g_free(parent);
+
+    if (refresh_treemap_window(state) && state->timeout_id == 0) {
+        state->timeout_id = g_timeout_add(TREEMAP_REFRESH_MS, refresh_treemap_window, state);
+    }
+}
+
+/**
+ * @brief Draws the rectangles of a treemap node and of its children.
+ *
+ * Rectangles smaller than a pixel are skipped, names are only drawn where they fit.
+ *
+ * @param cr Cairo context.
+ * @param node The node.
+ */
+static void draw_treemap_node(cairo_t *cr, const treemap_node_t *node) {
+    const treemap_rect_t *rect = &node->rect;
+    if (rect->width < 1 || rect->height < 1) {
+        return;
+    }
+
+    if (node->depth > 0) {
+        float red = 0.6f, green = 0.6f, blue = 0.6f;
+        if (node->name) {
+            // Every top-level entry gets its own hue, deeper levels and files get lighter
+            float value = MIN(1.0f, 0.65f + 0.05f * node->depth + (node->is_directory ? 0.0f : 0.1f));
+            float saturation = node->complete ? 0.55f : 0.2f;
+            gtk_hsv_to_rgb((node->branch * 137 % 360) / 360.0f, saturation, value, &red, &green, &blue);
+        }
+        cairo_rectangle(cr, rect->x, rect->y, rect->width, rect->height);
+        cairo_set_source_rgb(cr, red, green, blue);
+        cairo_fill_preserve(cr);
+        cairo_set_source_rgba(cr, 0, 0, 0, 0.4);
+        cairo_set_line_width(cr, 1);
+        cairo_stroke(cr);
+
+        if (rect->width > TREEMAP_LABEL_MIN_WIDTH && rect->height > TREEMAP_LABEL_HEIGHT) {
+            cairo_save(cr);
+            cairo_rectangle(cr, rect->x, rect->y, rect->width - TREEMAP_PADDING, rect->height);
+            cairo_clip(cr);
+            cairo_set_source_rgb(cr, 0.1, 0.1, 0.1);
+            cairo_set_font_size(cr, TREEMAP_LABEL_HEIGHT - 4);
+            cairo_move_to(cr, rect->x + TREEMAP_PADDING + 1, rect->y + TREEMAP_PADDING + TREEMAP_LABEL_HEIGHT - 4);
+            cairo_show_text(cr, node->name ? node->name : "Smaller items");
+            cairo_restore(cr);
+        }
+    }
+
+    if (node->children) {
+        for (guint i = 0; i < node->children->len; i++) {
+            draw_treemap_node(cr, node->children->pdata[i]);
+        }
+    }
+}
+
+/**
+ * @brief Draws the treemap of a disk usage window.
+ *
+ * @param area The drawing area.
+ * @param cr Cairo context.
+ * @param width Width of the area.
+ * @param height Height of the area.
+ * @param user_data The treemap_window_t of the window.
+ */
+static void on_treemap_draw(GtkDrawingArea *area, cairo_t *cr, int width, int height, gpointer user_data) {
+    treemap_window_t *state = user_data;
+    draw_treemap_node(cr, treemap_layout(state->map, width, height));
+}
+
+/**
+ * @brief Drills into the directory under the pointer, or goes up on a secondary click.
+ *
+ * @param gesture The click gesture of the treemap area.
+ * @param n_press Number of presses.
+ * @param x Horizontal position of the click.
+ * @param y Vertical position of the click.
+ * @param user_data The treemap_window_t of the window.
+ */
+static void on_treemap_clicked(GtkGestureClick *gesture, int n_press, double x, double y, gpointer user_data) {
+    treemap_window_t *state = user_data;
+
+    if (gtk_gesture_single_get_current_button(GTK_GESTURE_SINGLE(gesture)) != GDK_BUTTON_PRIMARY) {
+        char *parent = g_path_get_dirname(state->path);
+        if (g_strcmp0(parent, state->path) != 0) {
+            set_treemap_path(state, parent);
+        }
+        g_free(parent);
+        return;
+    }
+
+    const treemap_node_t *node = treemap_find(get_treemap_layout(state), x, y, 1);
+    if (node && node->depth == 1 && node->is_directory) {
+        char *path = g_strdup(node->path);
+        set_treemap_path(state, path);
+        g_free(path);
+    }
+}
+
+/**
+ * @brief Goes to the parent of the shown directory.
+ *
+ * @param button The up button.
+ * @param user_data The treemap_window_t of the window.
+ */
+static void on_treemap_up_clicked(GtkButton *button, gpointer user_data) {
+    treemap_window_t *state = user_data;
+    char *parent = g_path_get_dirname(state->path);
+    set_treemap_path(state, parent);
+    g_free(parent);
+}
+
+/**
+ * @brief Shows the name and size of the rectangle under the pointer.
+ *
+ * @return TRUE if there is a rectangle under the pointer.
+ */
+static gboolean on_treemap_query_tooltip(GtkWidget *widget, int x, int y, gboolean keyboard_mode, GtkTooltip *tooltip, gpointer user_data) {
+    treemap_window_t *state = user_data;
+
+    const treemap_node_t *node = treemap_find(get_treemap_layout(state), x, y, G_MAXUINT);
+    if (!node || node->depth == 0) {
+        return FALSE;
+    }
+
+    char *size_str = dirsize_format_size(node->size);
+    char *text;
+    if (node->name) {
+        text = g_strdup_printf("%s\n%s%s", node->name, size_str, node->complete ? "" : "…");
+    } else {
+        text = g_strdup_printf("%llu smaller items\n%s", (unsigned long long)node->item_count, size_str);
+    }
+    gtk_tooltip_set_text(tooltip, text);
+    g_free(size_str);
+    g_free(text);
+    return TRUE;
+}
+
+/**
+ * @brief Stops the size scan when its disk usage window is closed.
+ *
+ * @param widget The disk usage window.
+ * @param user_data The treemap_window_t of the window.
+ */
+static void on_treemap_window_destroy(GtkWidget *widget, gpointer user_data) {
+    treemap_window_t *state = user_data;
+
+    if (state->timeout_id != 0) {
+        g_source_remove(state->timeout_id);
+    }
+    treemap_free(state->map);
+    g_free(state->path);
+    g_free(state);
+}
+
+GtkWindow* create_treemap_window(const char *path, gboolean show_hidden) {
+    GtkWidget *window = gtk_window_new();
+    gtk_window_set_title(GTK_WINDOW(window), "Disk Usage");
+    gtk_window_set_default_size(GTK_WINDOW(window), 800, 600);
+
+    treemap_window_t *state = g_new0(treemap_window_t, 1);
+    state->show_hidden = show_hidden;
+
+    GtkWidget *box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
+    gtk_window_set_child(GTK_WINDOW(window), box);
+
+    GtkWidget *header = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, SPACING);
+    gtk_widget_set_margin_start(header, SPACING);
+    gtk_widget_set_margin_end(header, SPACING);
+    gtk_widget_set_margin_top(header, SPACING);
+    gtk_widget_set_margin_bottom(header, SPACING);
+    gtk_box_append(GTK_BOX(box), header);
+
+    state->up_button = gtk_button_new_from_icon_name("go-up-symbolic");
+    gtk_widget_set_tooltip_text(state->up_button, "Parent Folder");
+    g_signal_connect(state->up_button, "clicked", G_CALLBACK(on_treemap_up_clicked), state);
+    gtk_box_append(GTK_BOX(header), state->up_button);
+
+    GtkWidget *path_label = gtk_label_new(NULL);
+    gtk_label_set_ellipsize(GTK_LABEL(path_label), PANGO_ELLIPSIZE_START);
+    gtk_label_set_xalign(GTK_LABEL(path_label), 0);
+    gtk_widget_set_hexpand(path_label, TRUE);
+    gtk_box_append(GTK_BOX(header), path_label);
+    state->path_label = GTK_LABEL(path_label);
+
+    GtkWidget *total_label = gtk_label_new(NULL);
+    gtk_box_append(GTK_BOX(header), total_label);
+    state->total_label = GTK_LABEL(total_label);
+
+    state->area = gtk_drawing_area_new();
+    gtk_widget_set_hexpand(state->area, TRUE);
+    gtk_widget_set_vexpand(state->area, TRUE);
+    gtk_widget_set_has_tooltip(state->area, TRUE);
+    gtk_drawing_area_set_draw_func(GTK_DRAWING_AREA(state->area), on_treemap_draw, state, NULL);
+    g_signal_connect(state->area, "query-tooltip", G_CALLBACK(on_treemap_query_tooltip), state);
+    gtk_box_append(GTK_BOX(box), state->area);
+
+    GtkGesture *click = gtk_gesture_click_new();
+    gtk_gesture_single_set_button(GTK_GESTURE_SINGLE(click), 0);
+    g_signal_connect(click, "released", G_CALLBACK(on_treemap_clicked), state);
+    gtk_widget_add_controller(state->area, GTK_EVENT_CONTROLLER(click));
+
+    set_treemap_path(state, path);
+    g_signal_connect(window, "destroy", G_CALLBACK(on_treemap_window_destroy), state);
+    return GTK_WINDOW(window);
+}
+
+/**
+ * State of a duplicates window
+ */
+typedef struct {
+    dupfind_t *search;
+    GListStore *groups; // GtkStringObject labels, holding their dupfind_group_t as "group"
+    GtkSingleSelection *selection;
+    GtkLabel *status_label;
+    GtkWidget *hardlink_button;
+    GtkWidget *reflink_button;
+    GCancellable *cancellable; // Cancelled when the window is closed, so running link jobs leave it alone
+    guint timeout_id;
+} duplicates_window_t;
+
+/**
+ * Duplicates of a group to replace with links, run by a GTask
+ */
+typedef struct {
+    char *original;
+    GPtrArray *duplicates; // Paths
+    dupfind_link_mode_t mode;
+    GObject *group_item; // GtkStringObject of the group in the store
+    guint64 size; // Size of every file
+} duplicates_link_job_t;
+
+/**
+ * @brief Frees a link job once its GTask is done.
+ *
+ * @param data The duplicates_link_job_t.
+ */
+static void free_duplicates_link_job(gpointer data) {
+    duplicates_link_job_t *job = data;
+    g_free(job->original);
+    g_ptr_array_unref(job->duplicates);
+    g_object_unref(job->group_item);
+    g_free(job);
+}
+
+/**
+ * @brief Gives the paths of a group as the children of its row.
+ *
+ * @param item GtkStringObject of a group or of a path.
+ * @param user_data Not used.
+ * @return Model of the paths for groups, NULL for paths.
+ */
+static GListModel* create_duplicate_children_model(gpointer item, gpointer user_data) {
+    dupfind_group_t *group = g_object_get_data(G_OBJECT(item), "group");
+    return group ? G_LIST_MODEL(gtk_string_list_new((const char* const*)group->paths)) : NULL;
+}
+
+/**
+ * @brief Creates the widgets of a row of the duplicates list: an expander holding a label.
+ *
+ * @param factory The list item factory.
+ * @param list_item The list item being set up.
+ */
+static void setup_duplicate_row(GtkListItemFactory *factory, GtkListItem *list_item) {
+    GtkWidget *label = gtk_label_new(NULL);
+    gtk_label_set_xalign(GTK_LABEL(label), 0);
+    gtk_label_set_ellipsize(GTK_LABEL(label), PANGO_ELLIPSIZE_MIDDLE);
+    GtkWidget *expander = gtk_tree_expander_new();
+    gtk_tree_expander_set_child(GTK_TREE_EXPANDER(expander), label);
+    gtk_list_item_set_child(list_item, expander);
+}
+
+/**
+ * @brief Shows a group label or a path in a row of the duplicates list.
+ *
+ * @param factory The list item factory.
+ * @param list_item The list item being bound, its item is a GtkTreeListRow.
+ */
+static void bind_duplicate_row(GtkListItemFactory *factory, GtkListItem *list_item) {
+    GtkTreeListRow *row = gtk_list_item_get_item(list_item);
+    GtkWidget *expander = gtk_list_item_get_child(list_item);
+    gtk_tree_expander_set_list_row(GTK_TREE_EXPANDER(expander), row);
+
+    GtkStringObject *item = gtk_tree_list_row_get_item(row);
+    GtkWidget *label = gtk_tree_expander_get_child(GTK_TREE_EXPANDER(expander));
+    gtk_label_set_text(GTK_LABEL(label), gtk_string_object_get_string(item));
+    g_object_unref(item);
+}
+
+/**
+ * @brief Shows the progress of the search, then its groups once it is done.
+ *
+ * @param user_data The duplicates_window_t of the window.
+ * @return G_SOURCE_CONTINUE until the search is done.
+ */
+static gboolean refresh_duplicates_window(gpointer user_data) {
+    duplicates_window_t *state = user_data;
+
+    dupfind_progress_t progress;
+    dupfind_get_progress(state->search, &progress);
+
+    char *text = NULL;
+    switch (progress.stage) {
+        case DUPFIND_STAGE_WALK:
+            text = g_strdup_printf("Listing files: %llu found…", (unsigned long long)progress.file_count);
+            break;
+        case DUPFIND_STAGE_EDGES:
+            text = g_strdup_printf("Comparing the start and end of %llu files: %llu done…",
+                                   (unsigned long long)progress.candidate_count, (unsigned long long)progress.hashed_count);
+            break;
+        case DUPFIND_STAGE_CONTENTS: {
+            char *done_str = dirsize_format_size(progress.bytes_hashed);
+            char *total_str = dirsize_format_size(progress.bytes_to_hash);
+            text = g_strdup_printf("Comparing the contents of %llu files: %s of %s…",
+                                   (unsigned long long)progress.candidate_count, done_str, total_str);
+            g_free(done_str);
+            g_free(total_str);
+            break;
+        }
+        case DUPFIND_STAGE_DONE: {
+            GPtrArray *groups = dupfind_get_groups(state->search);
+            GPtrArray *items = g_ptr_array_new_full(groups->len, g_object_unref);
+            guint64 wasted = 0;
+            for (guint i = 0; i < groups->len; i++) {
+                dupfind_group_t *group = groups->pdata[i];
+                char *size_str = dirsize_format_size(group->size);
+                char *label = g_strdup_printf("%u copies of %s", group->count, size_str);
+                GtkStringObject *item = gtk_string_object_new(label);
+                g_object_set_data(G_OBJECT(item), "group", group);
+                g_ptr_array_add(items, item);
+                wasted += group->size * (group->count - 1);
+                g_free(size_str);
+                g_free(label);
+            }
+            // One splice, so the view only updates once
+            g_list_store_splice(state->groups, 0, 0, items->pdata, items->len);
+            g_ptr_array_unref(items);
+
+            char *wasted_str = dirsize_format_size(wasted);
+            text = g_strdup_printf("%u groups of duplicates, %s could be freed. Select a group or the file to keep.",
+                                   groups->len, wasted_str);
+            g_free(wasted_str);
+            gtk_widget_set_sensitive(state->hardlink_button, TRUE);
+            gtk_widget_set_sensitive(state->reflink_button, TRUE);
+            break;
+        }
+    }
+    if (progress.error_count > 0) {
+        char *with_errors = g_strdup_printf("%s (%llu unreadable)", text, (unsigned long long)progress.error_count);
+        g_free(text);
+        text = with_errors;
+    }
+    gtk_label_set_text(state->status_label, text);
+    g_free(text);
+
+    if (progress.stage == DUPFIND_STAGE_DONE) {
+        state->timeout_id = 0;
+        return G_SOURCE_REMOVE;
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+/**
+ * @brief Replaces the duplicates of a group with links, runs on a worker thread.
+ *
+ * Every duplicate is tried, the first failure is reported.
+ *
+ * @param task The GTask.
+ * @param source_object Not used.
+ * @param task_data The duplicates_link_job_t.
+ * @param cancellable Not used, a started job finishes so no group is left half done.
+ */
+static void link_duplicates_thread(GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable) {
+    duplicates_link_job_t *job = task_data;
+    GError *first_error = NULL;
+    guint linked = 0;
+
+    for (guint i = 0; i < job->duplicates->len; i++) {
+        GError *error = NULL;
+        if (dupfind_link(job->original, job->duplicates->pdata[i], job->mode, &error)) {
+            linked++;
+        } else if (!first_error) {
+            first_error = error;
+        } else {
+            g_error_free(error);
+        }
+    }
+
+    if (first_error) {
+        g_task_return_new_error(task, first_error->domain, first_error->code, "Replaced %u of %u duplicates: %s",
+                                linked, job->duplicates->len, first_error->message);
+        g_error_free(first_error);
+    } else {
+        g_task_return_int(task, linked);
+    }
+}
+
+/**
+ * @brief Shows the outcome of a link job and drops its group once it is fully linked.
+ *
+ * @param source_object Not used.
+ * @param res The GTask.
+ * @param user_data The duplicates_window_t of the window, only used if the window is still open.
+ */
+static void on_duplicates_linked(GObject *source_object, GAsyncResult *res, gpointer user_data) {
+    GTask *task = G_TASK(res);
+    if (g_cancellable_is_cancelled(g_task_get_cancellable(task))) {
+        return;
+    }
+
+    duplicates_window_t *state = user_data;
+    duplicates_link_job_t *job = g_task_get_task_data(task);
+    GError *error = NULL;
+    gssize linked = g_task_propagate_int(task, &error);
+
+    if (error) {
+        gtk_label_set_text(state->status_label, error->message);
+        g_error_free(error);
+    } else {
+        guint position;
+        if (g_list_store_find(state->groups, job->group_item, &position)) {
+            g_list_store_remove(state->groups, position);
+        }
+        char *freed_str = dirsize_format_size(job->size * linked);
+        char *text = g_strdup_printf("Replaced %" G_GSSIZE_FORMAT " duplicates of %s, %s freed", linked, job->original, freed_str);
+        gtk_label_set_text(state->status_label, text);
+        g_free(freed_str);
+        g_free(text);
+    }
+    gtk_widget_set_sensitive(state->hardlink_button, TRUE);
+    gtk_widget_set_sensitive(state->reflink_button, TRUE);
+}
+
+/**
+ * @brief Replaces the duplicates of the selected group with links in the background.
+ *
+ * The selected file is kept, or the first one of the group when the group itself is selected.
+ *
+ * @param state The duplicates_window_t of the window.
+ * @param mode Kind of link.
+ */
+static void link_selected_duplicates(duplicates_window_t *state, dupfind_link_mode_t mode) {
+    GtkTreeListRow *row = gtk_single_selection_get_selected_item(state->selection);
+    if (!row) {
+        gtk_label_set_text(state->status_label, "Select a group or the file to keep first");
+        return;
+    }
+
+    GtkTreeListRow *parent = gtk_tree_list_row_get_parent(row);
+    GtkTreeListRow *group_row = parent ? parent : g_object_ref(row);
+    GObject *group_item = gtk_tree_list_row_get_item(group_row);
+    dupfind_group_t *group = g_object_get_data(group_item, "group");
+
+    duplicates_link_job_t *job = g_new0(duplicates_link_job_t, 1);
+    if (parent) {
+        GtkStringObject *item = gtk_tree_list_row_get_item(row);
+        job->original = g_strdup(gtk_string_object_get_string(item));
+        g_object_unref(item);
+    } else {
+        job->original = g_strdup(group->paths[0]);
+    }
+    job->duplicates = g_ptr_array_new_with_free_func(g_free);
+    for (guint i = 0; i < group->count; i++) {
+        if (strcmp(group->paths[i], job->original) != 0) {
+            g_ptr_array_add(job->duplicates, g_strdup(group->paths[i]));
+        }
+    }
+    job->mode = mode;
+    job->group_item = group_item;
+    job->size = group->size;
+    g_object_unref(group_row);
+
+    gtk_widget_set_sensitive(state->hardlink_button, FALSE);
+    gtk_widget_set_sensitive(state->reflink_button, FALSE);
+    gtk_label_set_text(state->status_label, "Replacing duplicates…");
+
+    GTask *task = g_task_new(NULL, state->cancellable, on_duplicates_linked, state);
+    g_task_set_task_data(task, job, free_duplicates_link_job);
+    g_task_run_in_thread(task, link_duplicates_thread);
+    g_object_unref(task);
+}
+
+/**
+ * @brief Replaces the selected duplicates with hard links.
+ *
+ * @param button The button.
+ * @param user_data The duplicates_window_t of the window.
+ */
+static void on_hardlink_duplicates_clicked(GtkButton *button, gpointer user_data) {
+    link_selected_duplicates(user_data, DUPFIND_LINK_HARD);
+}
+
+/**
+ * @brief Replaces the selected duplicates with reflinks.
+ *
+ * @param button The button.
+ * @param user_data The duplicates_window_t of the window.
+ */
+static void on_reflink_duplicates_clicked(GtkButton *button, gpointer user_data) {
+    link_selected_duplicates(user_data, DUPFIND_LINK_REFLINK);
+}
+
+/**
+ * @brief Stops the search when its duplicates window is closed.
+ *
+ * @param widget The duplicates window.
+ * @param user_data The duplicates_window_t of the window.
+ */
+static void on_duplicates_window_destroy(GtkWidget *widget, gpointer user_data) {
+    duplicates_window_t *state = user_data;
+
+    if (state->timeout_id != 0) {
+        g_source_remove(state->timeout_id);
+    }
+    g_cancellable_cancel(state->cancellable);
+    g_object_unref(state->cancellable);
+    g_object_unref(state->groups);
+    dupfind_cancel_and_unref(state->search);
+    g_free(state);
+}
+
+GtkWindow* create_duplicates_window(const char *path, gboolean show_hidden) {
+    GtkWidget *window = gtk_window_new();
+    char *title = g_strdup_printf("Duplicates in %s", path);
+    gtk_window_set_title(GTK_WINDOW(window), title);
+    g_free(title);
+    gtk_window_set_default_size(GTK_WINDOW(window), 720, 520);
+
+    duplicates_window_t *state = g_new0(duplicates_window_t, 1);
+    state->search = dupfind_start(path, show_hidden);
+    state->groups = g_list_store_new(GTK_TYPE_STRING_OBJECT);
+    state->cancellable = g_cancellable_new();
+
+    GtkWidget *box = gtk_box_new(GTK_ORIENTATION_VERTICAL, SPACING);
+    gtk_widget_set_margin_start(box, SPACING);
+    gtk_widget_set_margin_end(box, SPACING);
+    gtk_widget_set_margin_top(box, SPACING);
+    gtk_widget_set_margin_bottom(box, SPACING);
+    gtk_window_set_child(GTK_WINDOW(window), box);
+
+    GtkWidget *status_label = gtk_label_new(NULL);
+    gtk_label_set_xalign(GTK_LABEL(status_label), 0);
+    gtk_label_set_wrap(GTK_LABEL(status_label), TRUE);
+    gtk_box_append(GTK_BOX(box), status_label);
+    state->status_label = GTK_LABEL(status_label);
+
+    // The tree takes the store reference it is given, the state keeps its own
+    GtkTreeListModel *tree = gtk_tree_list_model_new(g_object_ref(G_LIST_MODEL(state->groups)), FALSE, FALSE,
+                                                     create_duplicate_children_model, NULL, NULL);
+    state->selection = gtk_single_selection_new(G_LIST_MODEL(tree));
+    gtk_single_selection_set_autoselect(state->selection, FALSE);
+
+    GtkListItemFactory *factory = gtk_signal_list_item_factory_new();
+    g_signal_connect(factory, "setup", G_CALLBACK(setup_duplicate_row), NULL);
+    g_signal_connect(factory, "bind", G_CALLBACK(bind_duplicate_row), NULL);
+    GtkWidget *list = gtk_list_view_new(GTK_SELECTION_MODEL(state->selection), factory);
+
+    GtkWidget *scroll = gtk_scrolled_window_new();
+    gtk_scrolled_window_set_child(GTK_SCROLLED_WINDOW(scroll), list);
+    gtk_widget_set_vexpand(scroll, TRUE);
+    gtk_box_append(GTK_BOX(box), scroll);
+
+    GtkWidget *buttons = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, SPACING);
+    gtk_widget_set_halign(buttons, GTK_ALIGN_END);
+    gtk_box_append(GTK_BOX(box), buttons);
+
+    state->hardlink_button = gtk_button_new_with_label("Replace with Hard Links");
+    gtk_widget_set_tooltip_text(state->hardlink_button, "The copies become the same file as the one kept");
+    gtk_widget_set_sensitive(state->hardlink_button, FALSE);
+    g_signal_connect(state->hardlink_button, "clicked", G_CALLBACK(on_hardlink_duplicates_clicked), state);
+    gtk_box_append(GTK_BOX(buttons), state->hardlink_button);
+
+    state->reflink_button = gtk_button_new_with_label("Replace with Reflinks");
+    gtk_widget_set_tooltip_text(state->reflink_button, "The copies share the blocks of the one kept until they are changed");
+    gtk_widget_set_sensitive(state->reflink_button, FALSE);
+    g_signal_connect(state->reflink_button, "clicked", G_CALLBACK(on_reflink_duplicates_clicked), state);
+    gtk_box_append(GTK_BOX(buttons), state->reflink_button);
+
+    if (refresh_duplicates_window(state)) {
+        state->timeout_id = g_timeout_add(DUPLICATES_REFRESH_MS, refresh_duplicates_window, state);
+    }
+    g_signal_connect(window, "destroy", G_CALLBACK(on_duplicates_window_destroy), state);
+    return GTK_WINDOW(window);
+}
@@ -1,6 +1,17 @@
 #ifndef UI_BUILDER_H
 #define UI_BUILDER_H
 #define SPACING 7
+#define PROPERTIES_UPDATE_INTERVAL_MS 100 // How often a properties window refreshes a running size calculation
+#define STALL_OVERLAY_REFRESH_MS 250 // How often the stall overlay redraws while it is shown
+#define MEMORY_WINDOW_REFRESH_MS 1000 // How often the memory window rebuilds its report while it is shown
+#define TREEMAP_REFRESH_MS 250 // How often a disk usage window redraws while sizes are being computed
+#define DUPLICATES_REFRESH_MS 250 // How often a duplicates window shows the progress of its search
+#define TREEMAP_LABEL_MIN_WIDTH 40 // Narrower rectangles of the disk usage window are drawn without their name
+#define LIST_ICON_SIZE 16 // Icons of the list view
+#define LIST_SIZE_WIDTH 90 // Fixed widths of the list view columns, the name column takes the rest
+#define LIST_DATE_WIDTH 140
+#define LIST_TYPE_WIDTH 80
+#define LIST_PERMISSIONS_WIDTH 100
 
 #include <gtk/gtk.h>
 #include "main.h"
@@ -10,6 +21,8 @@
  */
 typedef struct {
     GtkWidget* toolbar;
+    GtkWidget* back_button;
+    GtkWidget* forward_button;
     GtkWidget* up_button;
     GtkWidget* directory_entry;
     GtkWidget* search_entry;
@@ -54,16 +67,73 @@ void setup_file_item(GtkListItemFactory *factory, GtkListItem *list_item);
  */
 void bind_file_item(GtkListItemFactory *factory, GtkListItem *list_item);
 
+/**
+ * Releases what bind_file_item() attached to a grid item, before it is rebound or destroyed
+ *
+ * @param factory The GtkListItemFactory of the grid
+ * @param list_item The GtkListItem being unbound
+ */
+void unbind_file_item(GtkListItemFactory *factory, GtkListItem *list_item);
+
+/**
+ * Creates the detailed list view: name, size, modification time, type and permissions columns
+ * Cells are only filled from the metadata cached in the listing, nothing is read
+ * from disk while binding, so scrolling stays smooth at any number of rows.
+ * Cells of entries whose metadata is still being fetched are filled by
+ * refresh_file_column_view(). The name, size, date and type headers can be
+ * clicked, get_column_view_sort() tells which one is sorted by.
+ * The model may also be a GtkTreeListModel of FmGroup (see fmgroup.h), the group
+ * rows then show their label and number of entries with an expander.
+ *
+ * @param model Selection over the model of FmEntry or of tree rows, ownership is taken
+ * @return The view
+ */
+GtkColumnView* create_file_column_view(GtkSelectionModel *model);
+
+/**
+ * Fills the cells of a list view that were waiting for metadata
+ * Cheap enough to call on every stat batch report, only bound cells are visited
+ * @param view The list view
+ */
+void refresh_file_column_view(GtkColumnView *view);
+
+/**
+ * Gets the column header a list view is sorted by
+ * @param view The list view
+ * @param ascending Filled with the direction
+ * @return The sort key of the column (see fm_sort_parse()), NULL if none
+ */
+const char* get_column_view_sort(GtkColumnView *view, gboolean *ascending);
+
+/**
+ * Shows a sort in the column headers of a list view, emits the changed signal of its sorter
+ * @param view The list view
+ * @param sort_key Sort key of the column, NULL or a key without column to clear the indicators
+ * @param ascending The direction
+ */
+void set_column_view_sort(GtkColumnView *view, const char *sort_key, gboolean ascending);
+
 /**
  * Creates the widget structure for the side panel
  * @return GtkWidget* containing the side panel
  */
 left_box_t create_left_box();
 
+/**
+ * Sets up a sidebar row: an expander holding the directory name
+ *
+ * @param factory The GtkListItemFactory to set up
+ * @param list_item The GtkListItem to set up
+ */
+void setup_dir_item(GtkListItemFactory *factory, GtkListItem *list_item);
 
-// Logic for the collapsable directory structures
-static GtkWidget* create_directory_row(GFile *file);
-static void on_directory_row_clicked(GtkGestureClick *gesture, int n_press, double x, double y, gpointer user_data);
+/**
+ * Binds a GtkTreeListRow of the sidebar tree to a row set up by setup_dir_item()
+ *
+ * @param factory The GtkListItemFactory
+ * @param list_item The GtkListItem to bind
+ */
+void bind_dir_item(GtkListItemFactory *factory, GtkListItem *list_item);
 
 void set_context(TabContext* ctx);
 
@@ -82,4 +152,44 @@ dialog_t create_dialog(const char* title, const char* message);
 
 GtkWindow* create_properties_window(const char* file_path);
 
+/**
+ * Creates the stall overlay: a graph of the last frame times and the longest
+ * main loop stalls with the section they are attributed to (see stallmon.h)
+ * It refreshes itself while it is mapped
+ * @return The overlay widget, hidden
+ */
+GtkWidget* create_stall_overlay(void);
+
+/**
+ * Builds a text report, free with g_free()
+ */
+typedef char* (*report_func)(void);
+
+/**
+ * Creates the memory window showing the report of memstats.h
+ * It rebuilds the report while it is mapped
+ * @param parent Window it belongs to
+ * @param report Builds the report
+ * @return The window, not shown yet
+ */
+GtkWindow* create_memory_window(GtkWindow *parent, report_func report);
+
+/**
+ * Creates a disk usage window showing a directory as a treemap (see treemap.h)
+ * A click on a folder shows that folder, a secondary click or the up button its parent
+ * @param path The directory to show
+ * @param show_hidden Whether entries starting with a dot are counted at the top level
+ * @return The window, not shown yet
+ */
+GtkWindow* create_treemap_window(const char *path, gboolean show_hidden);
+
+/**
+ * Creates a window searching a directory for duplicate files (see dupfind.h)
+ * The groups found can be replaced with hard links or reflinks to the selected file
+ * @param path The directory to search
+ * @param show_hidden Whether entries starting with a dot are searched
+ * @return The window, not shown yet
+ */
+GtkWindow* create_duplicates_window(const char *path, gboolean show_hidden);
+
 #endif //UI_BUILDER_H
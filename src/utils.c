@@ -6,328 +6,90 @@
 #include <gtk/gtk.h>
 #include <sys/stat.h>
 #include "main.h"
-
-// Operation history
-GArray *operation_history = NULL;
-// Forward history (for redoing undone operations)
-GArray *forward_history = NULL;
-const int MAX_HISTORY_SIZE = 50; // Maximum number of operations to store in history
+#include "fm_entry.h"
+#include "listcache.h"
 
 /**
  * Gets files from a directory
  * @param directory Path to the directory
  * @param file_count Pointer to store the number of files found
- * @return GListStore of GFile objects representing the files/directories
+ * @param show_hidden_files Whether to include files starting with a dot
+ * @return Store of FmEntry items (must be freed by the caller) with its listing as "listing" data,
+ *         NULL if the directory could not be read
  */
 GListStore* get_files_in_directory(const char* directory, size_t* file_count, gboolean show_hidden_files) {
-    DIR* dir;
-    struct dirent* entry;
-    size_t count = 0;
-
-    GListStore* files = g_list_store_new(G_TYPE_FILE);
+    GError *error = NULL;
 
-    // Open directory
-    if ((dir = opendir(directory)) == NULL) {
-        perror("Failed to open directory");
-        g_object_unref(files);  // Clean up if we can't open the directory
+    // Reuse the listing of another tab or an earlier visit when the directory did not change
+    dir_listing_t *listing = listcache_get(directory, show_hidden_files, &error);
+    if (!listing) {
+        g_warning("Failed to open directory: %s", error->message);
+        g_error_free(error);
         return NULL;
     }
 
-    // Loop over all of the files/directories in the directory
-    while ((entry = readdir(dir)) != NULL) {
-
-        //Skip "." and ".." directories (idk what those are)
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
-            continue;
-        }
-
-        // Skip hidden files if flag is off
-        if (!show_hidden_files && entry->d_name[0] == '.') {
-            continue;
-        }
-
-        // Get full path of the file/directory
-        char path[1024];
-        if (directory[strlen(directory) - 1] == '/') {
-            // Directory already ends with slash
-            snprintf(path, sizeof(path), "%s%s", directory, entry->d_name);
-        } else {
-            // Need to add a slash
-            snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name);
-        }
-
-        // Create a GFile for this path
-        GFile* file = g_file_new_for_path(path);
-        if (file) {
-            // Append it to our list store
-            g_list_store_append(files, file);
-            g_object_unref(file);  // The list store now owns a reference
-            count++;
-        }
-    }
-
-    closedir(dir);
-    *file_count = count;
-
-    // // If directory empty
-    // if (count == 0) {
-    //     g_object_unref(files);
-    //     return NULL;
-    // }
+    // Entries only point into the listing, GFiles are created when needed
+    GListStore* files = g_list_store_new(FM_TYPE_ENTRY);
+    fm_entry_append_listing(files, listing);
+    *file_count = dir_listing_get_count(listing);
 
+    // Kept for empty directories too, a snapshot of the view is validated against it
+    g_object_set_data_full(G_OBJECT(files), "listing", listing, (GDestroyNotify)dir_listing_unref);
     return files;
 }
 
 /**
- * Initialize the operation history system
- * Should be called once at program start
+ * Gets the entry shown at a position of a file view model
+ * @param model Model of FmEntry, or of GtkTreeListRow in the grouped view
+ * @param position Position in the model
+ * @return The entry (must be unreferenced by the caller), NULL for group rows
  */
-void init_operation_history(void) {
-    if (!operation_history) {
-        operation_history = g_array_new(FALSE, FALSE, sizeof(operation_t));
+FmEntry* get_model_entry(GListModel* model, guint position) {
+    gpointer item = g_list_model_get_item(model, position);
+    if (GTK_IS_TREE_LIST_ROW(item)) {
+        gpointer row_item = gtk_tree_list_row_get_item(item);
+        g_object_unref(item);
+        item = row_item;
     }
-    if (!forward_history) {
-        forward_history = g_array_new(FALSE, FALSE, sizeof(operation_t));
-    }
-}
 
-/**
- * Clean up operation history system resources
- * Should be called before program exit
- */
-void cleanup_operation_history(void) {
-    if (operation_history) {
-        // Free any operation data
-        for (guint i = 0; i < operation_history->len; i++) {
-            operation_t *op = &g_array_index(operation_history, operation_t, i);
-            if (op->data) {
-                g_free(op->data);
-            }
-        }
-        g_array_free(operation_history, TRUE);
-        operation_history = NULL;
-    }
-
-    if (forward_history) {
-        // Free any operation data
-        for (guint i = 0; i < forward_history->len; i++) {
-            operation_t *op = &g_array_index(forward_history, operation_t, i);
-            if (op->data) {
-                g_free(op->data);
-            }
-        }
-        g_array_free(forward_history, TRUE);
-        forward_history = NULL;
+    if (item && !FM_IS_ENTRY(item)) {
+        g_clear_object(&item);
     }
+    return item;
 }
 
 /**
- * Adds an operation to the operation history
- * @param operation The operation to add
+ * Gets the entry bound to an item of a file view
+ * @param list_item The item
+ * @return The entry (owned by the model), NULL for group rows and unbound items
  */
-void add_operation_to_history(operation_t operation) {
-    if (!operation_history) {
-        // Ensure operation history is initialized
-        init_operation_history();
+FmEntry* get_list_item_entry(GtkListItem* list_item) {
+    gpointer item = gtk_list_item_get_item(list_item);
+    if (!GTK_IS_TREE_LIST_ROW(item)) {
+        return FM_IS_ENTRY(item) ? item : NULL;
     }
 
-    // Add operation to history array
-    g_array_append_val(operation_history, operation);
-
-    // If we've exceeded the max size, remove the oldest item
-    if (operation_history->len > MAX_HISTORY_SIZE) {
-        // For the deleted operation, free any data if needed
-        operation_t *oldest = &g_array_index(operation_history, operation_t, 0);
-        if (oldest->data) {
-            g_free(oldest->data);
-        }
-
-        g_array_remove_index(operation_history, 0);
+    // The group store keeps the entry alive while the row shows it
+    gpointer row_item = gtk_tree_list_row_get_item(item);
+    FmEntry *entry = FM_IS_ENTRY(row_item) ? row_item : NULL;
+    if (row_item) {
+        g_object_unref(row_item);
     }
+    return entry;
 }
 
 /**
- * Deletes a file at the given path and adds the operation to history
- * @param path Full path to the file to delete
- * @return TRUE if successful, FALSE otherwise
- */
-gboolean delete_file(const char* path) {
-    if (!path || strlen(path) == 0) {
-        g_warning("Invalid path provided for deletion");
-        return FALSE;
-    }
-
-    // Create a GFile for the path
-    GFile *file = g_file_new_for_path(path);
-    GError *error = NULL;
-
-    // Check if the file exists
-    if (!g_file_query_exists(file, NULL)) {
-        g_warning("File does not exist: %s", path);
-        g_object_unref(file);
-        return FALSE;
-    }
-
-    // Make a copy of path for history data as the original path might be freed after deletion
-    char *path_copy = g_strdup(path);
-
-    // Attempt to delete the file
-    gboolean success = g_file_trash(file, NULL, &error);
-    if (!success) {
-        g_warning("Failed to delete file: %s, error: %s", path, error ? error->message : "Unknown error");
-        g_free(path_copy);
-        if (error) g_error_free(error);
-        g_object_unref(file);
-        return FALSE;
-    }
-
-    // Free the GFile
-    g_object_unref(file);
-
-    // Create and add operation to history
-    operation_t op = {
-        .type = OPERATION_TYPE_DELETE,
-        .data = path_copy  // Store the path for possible undo functionality
-    };
-    add_operation_to_history(op);
-
-    return TRUE;
-}
-
-/**
- * Structure to hold both source and destination paths for move operations
- * This is stored in the operation history for possible undo functionality
- */
-typedef struct {
-    char *source_path;
-    char *dest_path;
-} move_paths_t;
-
-/**
- * Moves or renames a file from source path to destination path
- * If both paths are in the same directory, it acts as rename
- * If paths are in different directories, it moves the file
- *
- * @param source_path Full path to the source file
- * @param dest_path Full path to the destination (new name or location)
- * @return TRUE if successful, FALSE otherwise
- */
-gboolean move_file(const char* source_path, const char* dest_path) {
-    if (!source_path || !dest_path || strlen(source_path) == 0 || strlen(dest_path) == 0) {
-        g_warning("Invalid path provided for move operation");
-        return FALSE;
-    }
-
-    // Create GFiles for source and destination
-    GFile *source_file = g_file_new_for_path(source_path);
-    GFile *dest_file = g_file_new_for_path(dest_path);
-    GError *error = NULL;
-
-    // Check if source file exists
-    if (!g_file_query_exists(source_file, NULL)) {
-        g_warning("Source file does not exist: %s", source_path);
-        g_object_unref(source_file);
-        g_object_unref(dest_file);
-        return FALSE;
-    }
-
-    // Make copies of paths for history data
-    move_paths_t *paths = g_malloc(sizeof(move_paths_t));
-    paths->source_path = g_strdup(source_path);
-    paths->dest_path = g_strdup(dest_path);
-
-    // Perform the move operation
-    // G_FILE_COPY_OVERWRITE flag will overwrite destination if it exists
-    // G_FILE_COPY_ALL_METADATA ensures all metadata is preserved
-    gboolean success = g_file_move(
-        source_file,
-        dest_file,
-        G_FILE_COPY_OVERWRITE | G_FILE_COPY_ALL_METADATA,
-        NULL, // Cancellable
-        NULL, // Progress callback
-        NULL, // Progress callback data
-        &error
-    );
-
-    if (!success) {
-        g_warning("Failed to move/rename file from %s to %s, error: %s",
-                  source_path, dest_path, error ? error->message : "Unknown error");
-        g_free(paths->source_path);
-        g_free(paths->dest_path);
-        g_free(paths);
-        if (error) g_error_free(error);
-        g_object_unref(source_file);
-        g_object_unref(dest_file);
-        return FALSE;
-    }
-
-    // Free GFiles
-    g_object_unref(source_file);
-    g_object_unref(dest_file);
-
-    // Create and add operation to history
-    operation_t op = {
-        .type = OPERATION_TYPE_MOVE,
-        .data = paths  // Store both paths for possible undo functionality
-    };
-    add_operation_to_history(op);
-
-    return TRUE;
-}
-
-/**
- * Undoes a move operation by moving the file back to its original location
- * @param operation The operation to undo (must be OPERATION_TYPE_MOVE)
- * @return TRUE if successful, FALSE otherwise
- */
-gboolean undo_move_file(operation_t operation) {
-    // Verify this is a move operation
-    if (operation.type != OPERATION_TYPE_MOVE) {
-        g_warning("Cannot undo non-move operation with undo_move_file");
-        return FALSE;
-    }
-
-    // Check if data is valid
-    if (!operation.data) {
-        g_warning("Invalid operation data for move undo");
-        return FALSE;
-    }
-
-    // Extract the paths from operation data
-    move_paths_t *paths = (move_paths_t *)operation.data;
-
-    // For undo, we simply swap the source and destination
-    // The original destination is now the source
-    // The original source is now the destination
-    gboolean success = move_file(paths->dest_path, paths->source_path);
-
-    if (!success) {
-        g_warning("Failed to undo move operation from %s to %s",
-                  paths->dest_path, paths->source_path);
-    }
-
-    return success;
-}
-
-/**
- * Gets an array of currently selected items from a GtkGridView
- * @param view The GtkGridView to get selection from
+ * Gets an array of currently selected items of a file view
+ * @param selection_model The GtkMultiSelection of the grid or list view
  * @param count Pointer to store the number of selected items
  * @return Array of GFile objects (must be freed by the caller along with each GFile)
  */
-GFile** get_selection(GtkGridView* view, size_t* count) {
-    g_return_val_if_fail(view != NULL && count != NULL, NULL);
+GFile** get_selection(GtkSelectionModel* selection_model, size_t* count) {
+    g_return_val_if_fail(selection_model != NULL && count != NULL, NULL);
 
     // Initialize count to 0 in case of early return
     *count = 0;
 
-    // Get the selection model
-    GtkSelectionModel *selection_model = gtk_grid_view_get_model(view);
-    if (!selection_model) {
-        g_warning("Failed to get selection model from GtkGridView");
-        return NULL;
-    }
-
     // Get the bitset of selected items
     GtkBitset *selection = gtk_selection_model_get_selection(selection_model);
     if (!selection) {
@@ -335,7 +97,7 @@ GFile** get_selection(GtkGridView* view, size_t* count) {
         return NULL;
     }
 
-    // Get the list model containing the actual items
+    // Get the list model containing the actual items, group rows of the grouped view are skipped
     GListModel *files = G_LIST_MODEL(gtk_multi_selection_get_model(GTK_MULTI_SELECTION(selection_model)));
     if (!files) {
         g_warning("Failed to get list store from selection model");
@@ -365,10 +127,11 @@ GFile** get_selection(GtkGridView* view, size_t* count) {
 
     if (gtk_bitset_iter_init_first(&iter, selection, &pos)) {
         do {
-            // Get item at this position and add to our array
-            GFile *file = g_list_model_get_item(files, pos);
-            if (file) {
-                selected_files[index++] = file;
+            // Get item at this position and add its file to our array
+            FmEntry *entry = get_model_entry(files, pos);
+            if (entry) {
+                selected_files[index++] = g_object_ref(fm_entry_get_file(entry));
+                g_object_unref(entry);
             }
         } while (gtk_bitset_iter_next(&iter, &pos));
     }
@@ -378,6 +141,10 @@ GFile** get_selection(GtkGridView* view, size_t* count) {
 
     // Clean up
     gtk_bitset_unref(selection);
+    if (index == 0) {
+        g_free(selected_files);
+        return NULL;
+    }
 
     return selected_files;
 }
@@ -466,286 +233,6 @@ char** split_basenames(const char* joined_string, const char* separator, size_t*
     return parts;
 }
 
-/**
- * Undoes a delete operation by restoring the file from trash
- * @param operation The operation to undo (must be OPERATION_TYPE_DELETE)
- * @return TRUE if successful, FALSE otherwise
- */
-gboolean undo_delete_file(operation_t operation) {
-    if (operation.type != OPERATION_TYPE_DELETE) {
-        g_warning("Attempted to undo non-delete operation");
-        return FALSE;
-    }
-
-    // The operation data contains the original path of the deleted file
-    const char *orig_path = (const char *)operation.data;
-    if (!orig_path) {
-        g_warning("Invalid operation data for undo delete");
-        return FALSE;
-    }
-
-    // Get the trash directory
-    g_autoptr(GFile) trash_dir = g_file_new_for_uri("trash:///");
-
-    // Enumerate files in the trash to find our file
-    g_autoptr(GFileEnumerator) enumerator =
-        g_file_enumerate_children(trash_dir,
-                                 G_FILE_ATTRIBUTE_STANDARD_NAME "," G_FILE_ATTRIBUTE_TRASH_ORIG_PATH,
-                                 G_FILE_QUERY_INFO_NONE,
-                                 NULL, NULL);
-
-    if (!enumerator) {
-        g_warning("Could not access trash directory");
-        return FALSE;
-    }
-
-    // Find the file in trash that matches our original path
-    g_autoptr(GFile) trashed_file = NULL;
-    GFileInfo* info;
-
-    while ((info = g_file_enumerator_next_file(enumerator, NULL, NULL)) != NULL) {
-        g_autofree char *trash_orig_path =
-            g_file_info_get_attribute_as_string(info, G_FILE_ATTRIBUTE_TRASH_ORIG_PATH);
-
-        if (g_strcmp0(trash_orig_path, orig_path) == 0) {
-            // Found our file
-            const char *name = g_file_info_get_name(info);
-            trashed_file = g_file_get_child(trash_dir, name);
-            g_object_unref(info);
-            break;
-        }
-
-        g_object_unref(info);
-    }
-
-    if (!trashed_file) {
-        g_warning("Could not find the deleted file in trash: %s", orig_path);
-        return FALSE;
-    }
-
-    // Create the target file
-    g_autoptr(GFile) target = g_file_new_for_path(orig_path);
-
-    // Move the file from trash back to original location
-    g_autoptr(GError) error = NULL;
-    gboolean success = g_file_move(trashed_file,
-                                  target,
-                                  G_FILE_COPY_NONE,
-                                  NULL, NULL, NULL,
-                                  &error);
-
-    if (!success) {
-        g_warning("Failed to restore file from trash: %s", error ? error->message : "Unknown error");
-        return FALSE;
-    }
-
-    return TRUE;
-}
-
-/**
- * Undoes the given operation by calling the appropriate undo function
- * @param operation The operation to undo
- * @return TRUE if successful, FALSE otherwise
- */
-gboolean undo_operation(operation_t operation) {
-    // Handle operation based on its type
-    switch (operation.type) {
-        case OPERATION_TYPE_MOVE:
-            return undo_move_file(operation);
-
-        case OPERATION_TYPE_DELETE:
-            return undo_delete_file(operation);
-
-        case OPERATION_TYPE_PASTE:
-            return undo_paste_file(operation);
-
-        case OPERATION_TYPE_COPY:
-            g_print("Undo for copy operation is not yet implemented\n");
-            return FALSE;
-
-        case OPERATION_TYPE_CREATE_DIRECTORY:
-            g_print("Undo for create directory operation is not yet implemented\n");
-            return FALSE;
-
-        case OPERATION_TYPE_CREATE_FILE:
-            g_print("Undo for create file operation is not yet implemented\n");
-            return FALSE;
-
-        case OPERATION_TYPE_NONE:
-        default:
-            g_warning("Cannot undo operation of unknown or invalid type: %d", operation.type);
-            return FALSE;
-    }
-}
-
-/**
- * Undoes the last operation in the history and stores it in forward history for possible redo
- * @return TRUE if successful, FALSE if no operations to undo
- */
-gboolean undo_last_operation(void) {
-    // Check if there are any operations to undo
-    if (!operation_history || operation_history->len == 0) {
-        g_print("No operations to undo\n");
-        return FALSE;
-    }
-
-    // Get the last operation from the history
-    operation_t *last_op = &g_array_index(operation_history, operation_t, operation_history->len - 1);
-
-    // Make a copy of the operation for forward history
-    operation_t forward_op;
-    forward_op.type = last_op->type;
-
-    // Deep copy of operation data based on type
-    switch (last_op->type) {
-        case OPERATION_TYPE_DELETE:
-            // For delete operations, data is a string (path)
-            forward_op.data = g_strdup((char *)last_op->data);
-            break;
-
-        case OPERATION_TYPE_MOVE:
-            // For move operations, data is a move_paths_t struct
-            {
-                move_paths_t *orig_paths = (move_paths_t *)last_op->data;
-                move_paths_t *new_paths = g_malloc(sizeof(move_paths_t));
-                new_paths->source_path = g_strdup(orig_paths->source_path);
-                new_paths->dest_path = g_strdup(orig_paths->dest_path);
-                forward_op.data = new_paths;
-            }
-            break;
-
-        case OPERATION_TYPE_COPY:
-        case OPERATION_TYPE_PASTE:
-        case OPERATION_TYPE_CREATE_DIRECTORY:
-        case OPERATION_TYPE_CREATE_FILE:
-        case OPERATION_TYPE_NONE:
-            // For other operations, just copy the pointer (or NULL)
-            forward_op.data = last_op->data;
-            break;
-    }
-
-    // Try to undo the operation
-    gboolean success = undo_operation(*last_op);
-
-    if (success) {
-        // Add the operation to forward history for possible redo
-        if (!forward_history) {
-            forward_history = g_array_new(FALSE, FALSE, sizeof(operation_t));
-        }
-        g_array_append_val(forward_history, forward_op);
-
-        // Remove the operation from the history
-        // Note: we don't free data because we moved it to forward_op
-        g_array_remove_index(operation_history, operation_history->len - 1);
-
-    } else {
-        // Free the copied data if undo failed
-        if (forward_op.data) {
-            switch (forward_op.type) {
-                case OPERATION_TYPE_DELETE:
-                    g_free(forward_op.data);
-                    break;
-
-                case OPERATION_TYPE_MOVE:
-                    {
-                        move_paths_t *paths = (move_paths_t *)forward_op.data;
-                        g_free(paths->source_path);
-                        g_free(paths->dest_path);
-                        g_free(paths);
-                    }
-                    break;
-
-                default:
-                    break;
-            }
-        }
-
-        g_print("Failed to undo operation\n");
-    }
-
-    return success;
-}
-
-/**
- * Redoes the last undone operation by applying it again
- * @return TRUE if successful, FALSE if no operations to redo
- */
-gboolean redo_last_undo(void) {
-    // Check if there are any operations to redo
-    if (!forward_history || forward_history->len == 0) {
-        g_print("No operations to redo\n");
-        return FALSE;
-    }
-
-    // Get the last operation from the forward history
-    operation_t *fwd_op = &g_array_index(forward_history, operation_t, forward_history->len - 1);
-
-    // Create a new operation for the history
-    operation_t history_op;
-    history_op.type = fwd_op->type;
-
-    // Deep copy of operation data based on type
-    switch (fwd_op->type) {
-        case OPERATION_TYPE_DELETE: {
-            // For redo of delete, we need to delete the file again
-            const char *path = (const char *)fwd_op->data;
-            gboolean success = delete_file(path);
-
-            if (!success) {
-                g_warning("Failed to redo delete operation for file: %s", path);
-                return FALSE;
-            }
-
-            // delete_file already adds this to the history, so return immediately
-            // Also remove the forward operation
-            g_array_remove_index(forward_history, forward_history->len - 1);
-            g_print("Delete operation redone successfully\n");
-            return TRUE;
-        }
-
-        case OPERATION_TYPE_MOVE: {
-            // For redo of move, we need to move the file again
-            move_paths_t *paths = (move_paths_t *)fwd_op->data;
-
-            // Move the file (original source to dest)
-            gboolean success = move_file(paths->source_path, paths->dest_path);
-
-            if (!success) {
-                g_warning("Failed to redo move operation from %s to %s",
-                          paths->source_path, paths->dest_path);
-                return FALSE;
-            }
-
-            // move_file already adds this to the history, so return immediately
-            // Also remove the forward operation
-            g_array_remove_index(forward_history, forward_history->len - 1);
-            g_print("Move operation redone successfully\n");
-            return TRUE;
-        }
-
-        case OPERATION_TYPE_COPY:
-            g_print("Redo for copy operation is not yet implemented\n");
-            return FALSE;
-
-        case OPERATION_TYPE_PASTE:
-            g_print("Redo for paste operation is not yet implemented\n");
-            return FALSE;
-
-        case OPERATION_TYPE_CREATE_DIRECTORY:
-            g_print("Redo for create directory operation is not yet implemented\n");
-            return FALSE;
-
-        case OPERATION_TYPE_CREATE_FILE:
-            g_print("Redo for create file operation is not yet implemented\n");
-            return FALSE;
-
-        case OPERATION_TYPE_NONE:
-        default:
-            g_warning("Cannot redo operation of unknown or invalid type: %d", fwd_op->type);
-            return FALSE;
-    }
-}
-
 /**
  * Gets the directory path component of a file path
  * @param file_path Full path to a file
@@ -905,76 +392,7 @@ static void on_paste_text_uris_received(GObject *source, GAsyncResult *res, gpoi
         return;
     }
 
-    // Count successful copy operations for reporting
-    int copied_count = 0;
-    GError *copy_error = NULL;
-
-    // Process each URI
-    for (char **uri_ptr = uris; *uri_ptr != NULL && **uri_ptr != '\0'; uri_ptr++) {
-        // Create a GFile from the URI
-        GFile *src_file = g_file_new_for_uri(*uri_ptr);
-        if (src_file) {
-            // Get the source file information
-            char *src_path = g_file_get_path(src_file);
-            if (src_path) {
-                char *basename = g_file_get_basename(src_file);
-                if (basename) {
-                    // Create destination file path by combining target directory and basename
-                    char *dest_path = g_build_filename(dir, basename, NULL);
-                    if (dest_path) {
-                        // Create destination GFile
-                        GFile *dest_file = g_file_new_for_path(dest_path);
-                        if (dest_file) {
-                            // Check if the destination file already exists
-                            gboolean dest_exists = g_file_query_exists(dest_file, NULL);
-
-                            // Perform the copy operation with appropriate flags
-                            gboolean success = g_file_copy(
-                                src_file,
-                                dest_file,
-                                G_FILE_COPY_ALL_METADATA | (dest_exists ? G_FILE_COPY_OVERWRITE : 0),
-                                NULL,  // Cancellable
-                                NULL,  // Progress callback
-                                NULL,  // Progress callback data
-                                &copy_error
-                            );
-
-                            if (success) {
-                                copied_count++;
-
-                                // Create and add a paste operation to history for possible undo
-                                move_paths_t *paste_data = g_malloc(sizeof(move_paths_t));
-                                paste_data->source_path = g_strdup(src_path);
-                                paste_data->dest_path = g_strdup(dest_path);
-
-                                operation_t op = {
-                                    .type = OPERATION_TYPE_PASTE,
-                                    .data = paste_data
-                                };
-
-                                add_operation_to_history(op);
-                            } else {
-                                g_warning("Failed to copy file %s to %s: %s",
-                                         src_path, dest_path,
-                                         copy_error ? copy_error->message : "Unknown error");
-
-                                if (copy_error) {
-                                    g_error_free(copy_error);
-                                    copy_error = NULL;
-                                }
-                            }
-
-                            g_object_unref(dest_file);
-                        }
-                        g_free(dest_path);
-                    }
-                    g_free(basename);
-                }
-                g_free(src_path);
-            }
-            g_object_unref(src_file);
-        }
-    }
+    paste_uris(uris, dir);
     reload_current_directory();
 
     // Clean up
@@ -992,55 +410,3 @@ void paste_files_from_clipboard(GtkWidget *widget, gpointer user_data) {
         gdk_clipboard_read_text_async(clipboard, NULL, on_paste_text_uris_received, user_data);
     }
 }
-
-/**
- * Undoes a paste operation by deleting the pasted file
- * @param operation The paste operation to undo (must be OPERATION_TYPE_PASTE)
- * @return TRUE if successful, FALSE otherwise
- */
-gboolean undo_paste_file(operation_t operation) {
-    if (operation.type != OPERATION_TYPE_PASTE) {
-        g_warning("Attempted to undo a non-paste operation with undo_paste_file");
-        return FALSE;
-    }
-
-    move_paths_t *paths = (move_paths_t *)operation.data;
-    if (!paths || !paths->dest_path) {
-        g_warning("Invalid paste operation data");
-        return FALSE;
-    }
-
-    g_print("Undoing paste operation: Deleting %s\n", paths->dest_path);
-
-    // Create a GFile for the destination path
-    GFile *dest_file = g_file_new_for_path(paths->dest_path);
-    if (!dest_file) {
-        g_warning("Failed to create GFile for %s", paths->dest_path);
-        return FALSE;
-    }
-
-    // Check if the file exists
-    if (!g_file_query_exists(dest_file, NULL)) {
-        g_warning("File %s does not exist", paths->dest_path);
-        g_object_unref(dest_file);
-        return FALSE;
-    }
-
-    // Delete the file
-    GError *error = NULL;
-    gboolean success = g_file_delete(dest_file, NULL, &error);
-
-    if (!success) {
-        g_warning("Failed to delete file %s: %s", paths->dest_path, error ? error->message : "Unknown error");
-        if (error) {
-            g_error_free(error);
-        }
-        g_object_unref(dest_file);
-        return FALSE;
-    }
-
-    g_object_unref(dest_file);
-    g_print("Successfully undid paste operation by deleting %s\n", paths->dest_path);
-
-    return TRUE;
-}